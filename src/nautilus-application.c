@@ -45,6 +45,7 @@
 #include "nautilus-date-utilities.h"
 #include "nautilus-dbus-launcher.h"
 #include "nautilus-dbus-manager.h"
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-private.h"
 #include "nautilus-file.h"
 #include "nautilus-file-operations.h"
@@ -54,6 +55,7 @@
 #include "nautilus-global-preferences.h"
 #include "nautilus-icon-info.h"
 #include "nautilus-module.h"
+#include "nautilus-name-index.h"
 #include "nautilus-portal.h"
 #include "nautilus-preferences-dialog.h"
 #include "nautilus-previewer.h"
@@ -88,6 +90,8 @@ typedef struct
 
     NautilusTagManager *tag_manager;
 
+    NautilusNameIndex *name_index;
+
     NautilusDBusLauncher *dbus_launcher;
 } NautilusApplicationPrivate;
 
@@ -567,6 +571,8 @@ nautilus_application_finalize (GObject *object)
 
     g_clear_object (&priv->tag_manager);
 
+    g_clear_object (&priv->name_index);
+
     g_clear_object (&priv->dbus_launcher);
 
     nautilus_trash_monitor_clear ();
@@ -999,6 +1005,7 @@ nautilus_application_init (NautilusApplication *self)
 
     priv->undo_manager = nautilus_file_undo_manager_new ();
     priv->tag_manager = nautilus_tag_manager_new ();
+    priv->name_index = nautilus_name_index_new ();
 
     priv->dbus_launcher = nautilus_dbus_launcher_new ();
 
@@ -1073,6 +1080,7 @@ on_application_shutdown (GApplication *application,
     g_list_free (notification_ids);
 
     nautilus_icon_info_clear_caches ();
+    nautilus_deep_count_cache_flush ();
 }
 
 static void
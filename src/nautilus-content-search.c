@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <config.h>
+#include "nautilus-content-search.h"
+
+#include <string.h>
+
+/* How much of a file is read at a time. */
+#define CHUNK_SIZE (64 * 1024)
+/* Larger files are more likely logs or dumps than documents. */
+#define MAX_FILE_SIZE (64 * 1024 * 1024)
+#define MAX_TEXT_LENGTH 256
+/* Bytes of context shown on each side of a match in snippets. */
+#define SNIPPET_CONTEXT 40
+
+/* A plain loop, which compilers turn into vector instructions. */
+static void
+lower_ascii (const char *source,
+             char       *destination,
+             gsize       length)
+{
+    for (gsize i = 0; i < length; i++)
+    {
+        char c = source[i];
+
+        destination[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+}
+
+static const char *
+find_text (const char *haystack,
+           gsize       length,
+           const char *text,
+           gsize       text_length)
+{
+    const char *end = haystack + length;
+    const char *p = haystack;
+
+    while (p + text_length <= end)
+    {
+        /* memchr() is vectorized by the C library, so jump to the next
+         * occurrence of the first byte instead of comparing at every
+         * position.
+         */
+        p = memchr (p, text[0], end - p - text_length + 1);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+
+        if (memcmp (p + 1, text + 1, text_length - 1) == 0)
+        {
+            return p;
+        }
+
+        p++;
+    }
+
+    return NULL;
+}
+
+static void
+append_escaped (GString    *snippet,
+                const char *text,
+                gsize       length)
+{
+    g_autofree char *valid = g_utf8_make_valid (text, length);
+    g_autofree char *escaped = NULL;
+
+    g_strdelimit (valid, "\t\r\n", ' ');
+    escaped = g_markup_escape_text (valid, -1);
+    g_string_append (snippet, escaped);
+}
+
+/* Returns the match with some context from its line, in the markup that
+ * nautilus_search_hit_set_fts_snippet() expects.
+ */
+static char *
+build_snippet (const char *buffer,
+               gsize       length,
+               gsize       match_start,
+               gsize       match_length)
+{
+    gsize match_end = match_start + match_length;
+    gsize start = match_start > SNIPPET_CONTEXT ? match_start - SNIPPET_CONTEXT : 0;
+    gsize end = MIN (length, match_end + SNIPPET_CONTEXT);
+    const char *newline;
+    GString *snippet;
+
+    for (gsize i = match_start; i > start; i--)
+    {
+        if (buffer[i - 1] == '\n')
+        {
+            start = i;
+            break;
+        }
+    }
+
+    newline = memchr (buffer + match_end, '\n', end - match_end);
+    if (newline != NULL)
+    {
+        end = newline - buffer;
+    }
+
+    /* Don't cut characters in half. */
+    while (start < match_start && (buffer[start] & 0xC0) == 0x80)
+    {
+        start++;
+    }
+    while (end > match_end && end < length && (buffer[end] & 0xC0) == 0x80)
+    {
+        end--;
+    }
+
+    snippet = g_string_new (start > 0 && buffer[start - 1] != '\n' ? "…" : "");
+    append_escaped (snippet, buffer + start, match_start - start);
+    g_string_append (snippet, "<b>");
+    append_escaped (snippet, buffer + match_start, match_length);
+    g_string_append (snippet, "</b>");
+    append_escaped (snippet, buffer + match_end, end - match_end);
+    if (end < length && buffer[end] != '\n')
+    {
+        g_string_append (snippet, "…");
+    }
+
+    return g_string_free_and_steal (snippet);
+}
+
+/* @lowered is scratch space of @length bytes. */
+static char *
+search_buffer (const char *buffer,
+               char       *lowered,
+               gsize       length,
+               const char *text,
+               gsize       text_length,
+               guint      *n_matches)
+{
+    const char *lowered_end = lowered + length;
+    const char *match;
+    guint count = 0;
+
+    lower_ascii (buffer, lowered, length);
+
+    match = find_text (lowered, length, text, text_length);
+    if (match == NULL)
+    {
+        return NULL;
+    }
+
+    /* Only the matches in the same buffer are counted, so that finding the
+     * first match is enough to stop reading.
+     */
+    for (const char *p = match; p != NULL;
+         p = find_text (p + text_length, lowered_end - (p + text_length), text, text_length))
+    {
+        count++;
+    }
+
+    if (n_matches != NULL)
+    {
+        *n_matches = count;
+    }
+
+    return build_snippet (buffer, length, match - lowered, text_length);
+}
+
+/**
+ * nautilus_content_search_prepare_text:
+ * @text: the text of a query
+ *
+ * Returns: (transfer full) (nullable): the text to pass to the search
+ *     functions, or %NULL if @text can't be searched for
+ */
+char *
+nautilus_content_search_prepare_text (const char *text)
+{
+    g_autofree char *stripped = g_strstrip (g_strdup (text));
+
+    if (*stripped == '\0' || strlen (stripped) > MAX_TEXT_LENGTH)
+    {
+        return NULL;
+    }
+
+    return g_ascii_strdown (stripped, -1);
+}
+
+/**
+ * nautilus_content_search_can_search:
+ * @info: a #GFileInfo with %NAUTILUS_CONTENT_SEARCH_ATTRIBUTES
+ *
+ * Returns: whether the file is text, judging from its name, and worth
+ *     reading
+ */
+gboolean
+nautilus_content_search_can_search (GFileInfo *info)
+{
+    const char *content_type;
+    goffset size;
+
+    if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
+    {
+        return FALSE;
+    }
+
+    size = g_file_info_get_size (info);
+    if (size == 0 || size > MAX_FILE_SIZE)
+    {
+        return FALSE;
+    }
+
+    content_type = g_file_info_get_attribute_string (info,
+                                                     G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+
+    return content_type != NULL && g_content_type_is_a (content_type, "text/plain");
+}
+
+/**
+ * nautilus_content_search_file:
+ * @file: the file to read
+ * @text: text from nautilus_content_search_prepare_text()
+ * @cancellable: (nullable): a #GCancellable
+ * @n_matches: (out) (optional): how many times @text was found
+ *
+ * Reads @file until finding @text. Files that turn out to be binary are
+ * given up on.
+ *
+ * Returns: (transfer full) (nullable): a snippet of the text around the
+ *     first match, or %NULL if there's none
+ */
+char *
+nautilus_content_search_file (GFile        *file,
+                              const char   *text,
+                              GCancellable *cancellable,
+                              guint        *n_matches)
+{
+    g_autoptr (GFileInputStream) stream = NULL;
+    g_autofree char *buffer = NULL;
+    g_autofree char *lowered = NULL;
+    gsize text_length = strlen (text);
+    gsize overlap;
+    gsize kept = 0;
+
+    g_return_val_if_fail (text_length > 0 && text_length <= MAX_TEXT_LENGTH, NULL);
+
+    stream = g_file_read (file, cancellable, NULL);
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    /* Matches may span two reads, and snippets show some text before. */
+    overlap = text_length - 1 + SNIPPET_CONTEXT;
+    buffer = g_malloc (overlap + CHUNK_SIZE);
+    lowered = g_malloc (overlap + CHUNK_SIZE);
+
+    while (TRUE)
+    {
+        gsize n_read;
+        gsize length;
+        char *snippet;
+
+        if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buffer + kept, CHUNK_SIZE,
+                                      &n_read, cancellable, NULL) ||
+            n_read == 0)
+        {
+            return NULL;
+        }
+
+        /* Text files have no null bytes. */
+        if (memchr (buffer + kept, '\0', n_read) != NULL)
+        {
+            return NULL;
+        }
+
+        length = kept + n_read;
+        snippet = search_buffer (buffer, lowered, length, text, text_length, n_matches);
+        if (snippet != NULL || n_read < CHUNK_SIZE)
+        {
+            return snippet;
+        }
+
+        kept = MIN (length, overlap);
+        memmove (buffer, buffer + length - kept, kept);
+    }
+}
+
+/**
+ * nautilus_content_search_buffer:
+ * @buffer: text to search in
+ * @length: the length of @buffer
+ * @text: text from nautilus_content_search_prepare_text()
+ * @n_matches: (out) (optional): how many times @text was found
+ *
+ * Like nautilus_content_search_file(), for text already in memory.
+ *
+ * Returns: (transfer full) (nullable): a snippet of the text around the
+ *     first match, or %NULL if there's none
+ */
+char *
+nautilus_content_search_buffer (const char *buffer,
+                                gsize       length,
+                                const char *text,
+                                guint      *n_matches)
+{
+    g_autofree char *lowered = NULL;
+    gsize text_length = strlen (text);
+
+    g_return_val_if_fail (text_length > 0, NULL);
+
+    lowered = g_malloc (length);
+
+    return search_buffer (buffer, lowered, length, text, text_length, n_matches);
+}
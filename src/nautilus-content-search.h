@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* Full-text search of files on disk, for when there's no indexer to ask.
+ * Files are read as a stream through a bounded buffer, so that large files
+ * don't use more memory than small ones, and reading stops at the first
+ * buffer with a match.
+ *
+ * Matching ignores case for ASCII letters only.
+ */
+
+/* Attributes needed by nautilus_content_search_can_search(). */
+#define NAUTILUS_CONTENT_SEARCH_ATTRIBUTES \
+        G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+        G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+        G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE
+
+char     *nautilus_content_search_prepare_text (const char   *text);
+
+gboolean  nautilus_content_search_can_search   (GFileInfo    *info);
+
+char     *nautilus_content_search_file         (GFile        *file,
+                                                const char   *text,
+                                                GCancellable *cancellable,
+                                                guint        *n_matches);
+char     *nautilus_content_search_buffer       (const char   *buffer,
+                                                gsize         length,
+                                                const char   *text,
+                                                guint        *n_matches);
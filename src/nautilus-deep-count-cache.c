@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "nautilus-deep-count-cache"
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* On-disk layout, in host byte order:
+ *
+ *   magic (4 bytes), version (u32), entry count (u32), then per entry:
+ *   path (string), mtime (u64), ctime (u64), inode (u64), directory count
+ *   (u32), file count (u32), size (u64), subdirectory count (u32) and the
+ *   subdirectory names (strings).
+ *
+ * Strings are stored as a u32 length followed by the bytes, without NUL.
+ */
+#define CACHE_MAGIC "NDCC"
+#define CACHE_VERSION 3
+
+/* Don't let the cache grow without bounds; new directories simply aren't
+ * remembered once it is full, while existing entries still get updated.
+ */
+#define CACHE_MAX_ENTRIES 500000
+
+#define SAVE_TIMEOUT_SECONDS 5
+
+/* Reference counted, so that saving can work on a snapshot. */
+typedef struct
+{
+    char *path;
+    guint64 mtime;
+    guint64 ctime;
+    guint64 inode;
+    guint directory_count;
+    guint file_count;
+    goffset size;
+    GStrv subdirectories;
+} CacheEntry;
+
+typedef struct
+{
+    const guint8 *data;
+    gsize length;
+    gsize offset;
+} CacheReader;
+
+/* Saving happens on a thread of its own. */
+static GMutex cache_mutex;
+/* Path to CacheEntry, keyed by the entry's own path. */
+static GHashTable *cache_entries = NULL;
+
+/* Only used on the main thread. */
+static guint save_timeout_id = 0;
+static GThread *save_thread = NULL;
+/* Cleared by the save thread when it is done. */
+static gint save_in_progress = FALSE;
+
+static void
+cache_entry_clear (CacheEntry *entry)
+{
+    g_free (entry->path);
+    g_strfreev (entry->subdirectories);
+}
+
+static void
+cache_entry_unref (CacheEntry *entry)
+{
+    g_atomic_rc_box_release_full (entry, (GDestroyNotify) cache_entry_clear);
+}
+
+static gboolean
+is_persistent (void)
+{
+    /* Tests must neither pick up nor leave behind state in the user's cache. */
+    return g_strcmp0 (g_getenv ("RUNNING_TESTS"), "TRUE") != 0;
+}
+
+static char *
+get_cache_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "deep-counts", NULL);
+}
+
+static gboolean
+read_bytes (CacheReader *reader,
+            gpointer     dest,
+            gsize        size)
+{
+    if (reader->length - reader->offset < size)
+    {
+        return FALSE;
+    }
+
+    memcpy (dest, reader->data + reader->offset, size);
+    reader->offset += size;
+
+    return TRUE;
+}
+
+static gboolean
+read_uint32 (CacheReader *reader,
+             guint32     *value)
+{
+    return read_bytes (reader, value, sizeof (guint32));
+}
+
+static gboolean
+read_uint64 (CacheReader *reader,
+             guint64     *value)
+{
+    return read_bytes (reader, value, sizeof (guint64));
+}
+
+static char *
+read_string (CacheReader *reader)
+{
+    guint32 length;
+    char *str;
+
+    if (!read_uint32 (reader, &length) ||
+        reader->length - reader->offset < length)
+    {
+        return NULL;
+    }
+
+    str = g_strndup ((const char *) reader->data + reader->offset, length);
+    reader->offset += length;
+
+    return str;
+}
+
+static gboolean
+read_entry (CacheReader  *reader,
+            CacheEntry  **entry_out)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GStrvBuilder) builder = NULL;
+    CacheEntry *entry;
+    guint32 directory_count;
+    guint32 file_count;
+    guint32 n_subdirectories;
+    guint64 mtime;
+    guint64 ctime;
+    guint64 inode;
+    guint64 size;
+
+    path = read_string (reader);
+    if (path == NULL ||
+        !read_uint64 (reader, &mtime) ||
+        !read_uint64 (reader, &ctime) ||
+        !read_uint64 (reader, &inode) ||
+        !read_uint32 (reader, &directory_count) ||
+        !read_uint32 (reader, &file_count) ||
+        !read_uint64 (reader, &size) ||
+        !read_uint32 (reader, &n_subdirectories))
+    {
+        return FALSE;
+    }
+
+    builder = g_strv_builder_new ();
+    for (guint32 i = 0; i < n_subdirectories; i++)
+    {
+        char *name = read_string (reader);
+
+        if (name == NULL)
+        {
+            return FALSE;
+        }
+        g_strv_builder_take (builder, name);
+    }
+
+    entry = g_atomic_rc_box_new0 (CacheEntry);
+    entry->path = g_steal_pointer (&path);
+    entry->mtime = mtime;
+    entry->ctime = ctime;
+    entry->inode = inode;
+    entry->directory_count = directory_count;
+    entry->file_count = file_count;
+    entry->size = size;
+    entry->subdirectories = g_strv_builder_end (builder);
+
+    *entry_out = entry;
+
+    return TRUE;
+}
+
+static void
+load_cache (void)
+{
+    g_autofree char *filename = NULL;
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    g_autoptr (GError) error = NULL;
+    CacheReader reader = { 0 };
+    char magic[4];
+    guint32 version;
+    guint32 n_entries;
+
+    filename = get_cache_filename ();
+    mapped_file = g_mapped_file_new (filename, FALSE, &error);
+    if (mapped_file == NULL)
+    {
+        if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+            g_debug ("Couldn't load the deep count cache: %s", error->message);
+        }
+        return;
+    }
+
+    reader.data = (const guint8 *) g_mapped_file_get_contents (mapped_file);
+    reader.length = g_mapped_file_get_length (mapped_file);
+
+    if (!read_bytes (&reader, magic, sizeof (magic)) ||
+        memcmp (magic, CACHE_MAGIC, sizeof (magic)) != 0 ||
+        !read_uint32 (&reader, &version) ||
+        version != CACHE_VERSION ||
+        !read_uint32 (&reader, &n_entries))
+    {
+        g_debug ("Ignoring incompatible deep count cache %s", filename);
+        return;
+    }
+
+    for (guint32 i = 0; i < n_entries && i < CACHE_MAX_ENTRIES; i++)
+    {
+        CacheEntry *entry;
+
+        if (!read_entry (&reader, &entry))
+        {
+            g_debug ("Deep count cache %s is truncated", filename);
+            break;
+        }
+
+        g_hash_table_replace (cache_entries, entry->path, entry);
+    }
+}
+
+/* Called with the cache locked. */
+static void
+ensure_cache (void)
+{
+    if (cache_entries != NULL)
+    {
+        return;
+    }
+
+    cache_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           NULL,
+                                           (GDestroyNotify) cache_entry_unref);
+
+    if (is_persistent ())
+    {
+        load_cache ();
+    }
+}
+
+static void
+write_uint32 (GByteArray *array,
+              guint32     value)
+{
+    g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+write_uint64 (GByteArray *array,
+              guint64     value)
+{
+    g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+write_string (GByteArray *array,
+              const char *str)
+{
+    gsize length = strlen (str);
+
+    write_uint32 (array, length);
+    g_byte_array_append (array, (const guint8 *) str, length);
+}
+
+static void
+save_cache (void)
+{
+    g_autoptr (GPtrArray) snapshot = NULL;
+    g_autoptr (GByteArray) array = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autofree char *filename = NULL;
+    g_autofree char *dirname = NULL;
+    GHashTableIter iter;
+    gpointer value;
+
+    /* Only the references are taken while locked. */
+    g_mutex_lock (&cache_mutex);
+    snapshot = g_ptr_array_new_full (g_hash_table_size (cache_entries),
+                                     (GDestroyNotify) cache_entry_unref);
+    g_hash_table_iter_init (&iter, cache_entries);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+        g_ptr_array_add (snapshot, g_atomic_rc_box_acquire (value));
+    }
+    g_mutex_unlock (&cache_mutex);
+
+    array = g_byte_array_new ();
+    g_byte_array_append (array, (const guint8 *) CACHE_MAGIC, strlen (CACHE_MAGIC));
+    write_uint32 (array, CACHE_VERSION);
+    write_uint32 (array, snapshot->len);
+
+    for (guint i = 0; i < snapshot->len; i++)
+    {
+        CacheEntry *entry = g_ptr_array_index (snapshot, i);
+        guint n_subdirectories = g_strv_length (entry->subdirectories);
+
+        write_string (array, entry->path);
+        write_uint64 (array, entry->mtime);
+        write_uint64 (array, entry->ctime);
+        write_uint64 (array, entry->inode);
+        write_uint32 (array, entry->directory_count);
+        write_uint32 (array, entry->file_count);
+        write_uint64 (array, entry->size);
+        write_uint32 (array, n_subdirectories);
+        for (guint j = 0; j < n_subdirectories; j++)
+        {
+            write_string (array, entry->subdirectories[j]);
+        }
+    }
+
+    filename = get_cache_filename ();
+    dirname = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dirname, 0700);
+
+    if (!g_file_set_contents (filename, (const char *) array->data, array->len, &error))
+    {
+        g_warning ("Couldn't save the deep count cache to disk: %s", error->message);
+    }
+}
+
+static gpointer
+save_thread_func (gpointer user_data)
+{
+    save_cache ();
+    g_atomic_int_set (&save_in_progress, FALSE);
+
+    return NULL;
+}
+
+static void schedule_save (void);
+
+static gboolean
+save_timeout_cb (gpointer user_data)
+{
+    save_timeout_id = 0;
+
+    /* Changes since the last save started are saved with the next one. */
+    if (g_atomic_int_get (&save_in_progress))
+    {
+        schedule_save ();
+        return G_SOURCE_REMOVE;
+    }
+
+    g_clear_pointer (&save_thread, g_thread_join);
+    g_atomic_int_set (&save_in_progress, TRUE);
+    save_thread = g_thread_new ("deep-count-cache-save", save_thread_func, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_save (void)
+{
+    if (save_timeout_id != 0 || !is_persistent ())
+    {
+        return;
+    }
+
+    save_timeout_id = g_timeout_add_seconds (SAVE_TIMEOUT_SECONDS, save_timeout_cb, NULL);
+}
+
+/**
+ * nautilus_deep_count_cache_lookup:
+ * @path: the local path of a directory
+ * @mtime: the current modification time of @path, in microseconds
+ * @ctime: the current status change time of @path, in microseconds
+ * @inode: the current inode of @path
+ * @directory_count: (out): directories found directly inside @path
+ * @file_count: (out): other files found directly inside @path
+ * @size: (out): total size of the entries directly inside @path
+ * @subdirectories: (out) (transfer full): names of the subdirectories of
+ *     @path that the deep count descended into
+ *
+ * Looks up what was found directly inside @path, without touching the disk
+ * once the cache was loaded.
+ *
+ * Returns: %TRUE if @path has an entry that is still valid for @mtime,
+ *     @ctime and @inode, in which case the out arguments are set.
+ */
+gboolean
+nautilus_deep_count_cache_lookup (const char *path,
+                                  guint64     mtime,
+                                  guint64     ctime,
+                                  guint64     inode,
+                                  guint      *directory_count,
+                                  guint      *file_count,
+                                  goffset    *size,
+                                  GStrv      *subdirectories)
+{
+    CacheEntry *entry;
+    gboolean found;
+
+    g_mutex_lock (&cache_mutex);
+    ensure_cache ();
+    entry = g_hash_table_lookup (cache_entries, path);
+    found = entry != NULL &&
+            entry->mtime == mtime &&
+            entry->ctime == ctime &&
+            entry->inode == inode;
+    if (found)
+    {
+        *directory_count = entry->directory_count;
+        *file_count = entry->file_count;
+        *size = entry->size;
+        *subdirectories = g_strdupv (entry->subdirectories);
+    }
+    g_mutex_unlock (&cache_mutex);
+
+    return found;
+}
+
+/**
+ * nautilus_deep_count_cache_store:
+ * @path: the local path of a directory
+ * @mtime: the modification time of @path when its enumeration started
+ * @ctime: the status change time of @path when its enumeration started
+ * @inode: the inode of @path
+ * @directory_count: directories found directly inside @path
+ * @file_count: other files found directly inside @path
+ * @size: total size of the entries directly inside @path
+ * @subdirectories: (array zero-terminated=1): names of the subdirectories
+ *     of @path that the deep count descended into
+ *
+ * Remembers the result of enumerating @path, replacing any earlier entry.
+ * The cache is written back to disk shortly after, on a thread.
+ */
+void
+nautilus_deep_count_cache_store (const char  *path,
+                                 guint64      mtime,
+                                 guint64      ctime,
+                                 guint64      inode,
+                                 guint        directory_count,
+                                 guint        file_count,
+                                 goffset      size,
+                                 const char **subdirectories)
+{
+    CacheEntry *entry;
+
+    g_mutex_lock (&cache_mutex);
+    ensure_cache ();
+
+    if (g_hash_table_size (cache_entries) >= CACHE_MAX_ENTRIES &&
+        !g_hash_table_contains (cache_entries, path))
+    {
+        g_mutex_unlock (&cache_mutex);
+        return;
+    }
+
+    entry = g_atomic_rc_box_new0 (CacheEntry);
+    entry->path = g_strdup (path);
+    entry->mtime = mtime;
+    entry->ctime = ctime;
+    entry->inode = inode;
+    entry->directory_count = directory_count;
+    entry->file_count = file_count;
+    entry->size = size;
+    entry->subdirectories = (subdirectories != NULL) ?
+                            g_strdupv ((GStrv) subdirectories) :
+                            g_new0 (char *, 1);
+
+    g_hash_table_replace (cache_entries, entry->path, entry);
+    g_mutex_unlock (&cache_mutex);
+
+    schedule_save ();
+}
+
+/**
+ * nautilus_deep_count_cache_flush:
+ *
+ * Writes changes that are waiting to be saved, and waits for saving to be
+ * done. Called on shutdown.
+ */
+void
+nautilus_deep_count_cache_flush (void)
+{
+    g_clear_pointer (&save_thread, g_thread_join);
+
+    if (save_timeout_id != 0)
+    {
+        g_clear_handle_id (&save_timeout_id, g_source_remove);
+        save_cache ();
+    }
+}
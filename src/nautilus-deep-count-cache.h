@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* Persistent cache of what deep counts found directly inside local
+ * directories: the number of directories and files, their total size and
+ * the names of the subdirectories that were descended into. Entries are
+ * keyed by path and are only valid while the directory's modification
+ * time, status change time and inode are unchanged, so a deep count can
+ * sum unchanged directories from memory and only enumerate the ones that
+ * changed.
+ *
+ * Rewriting a file in place doesn't touch its parent directory, so sizes
+ * may lag behind such changes until the directory itself changes.
+ */
+
+gboolean nautilus_deep_count_cache_lookup (const char  *path,
+                                           guint64      mtime,
+                                           guint64      ctime,
+                                           guint64      inode,
+                                           guint       *directory_count,
+                                           guint       *file_count,
+                                           goffset     *size,
+                                           GStrv       *subdirectories);
+void     nautilus_deep_count_cache_store  (const char  *path,
+                                           guint64      mtime,
+                                           guint64      ctime,
+                                           guint64      inode,
+                                           guint        directory_count,
+                                           guint        file_count,
+                                           goffset      size,
+                                           const char **subdirectories);
+void     nautilus_deep_count_cache_flush  (void);
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "nautilus-delete-engine"
+
+#include <config.h>
+#include "nautilus-delete-engine.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Deleted files are handed back this many at a time. */
+#define BATCH_SIZE 256
+#define MAX_THREADS 8
+
+typedef struct DeleteTask DeleteTask;
+
+/* A directory being deleted. It is opened and removed relative to its
+ * parent, which stays open until then, so that nothing is reached through
+ * a directory that was replaced while deleting.
+ */
+struct DeleteTask
+{
+    NautilusDeleteEngine *engine;
+    DeleteTask *parent;
+    int parent_dfd;
+    char *name;
+    char *path;
+    guint depth;
+    /* Open while its subdirectories are being deleted. */
+    DIR *dir;
+
+    /* Subdirectories still being deleted, plus one while listing. */
+    gint n_pending;
+    /* Whether anything inside couldn't be deleted. */
+    gint failed;
+    /* Why the directory itself couldn't be listed. */
+    GError *error;
+    /* Whether it was removed without being listed. */
+    gboolean removed;
+};
+
+typedef struct
+{
+    GFile *file;
+    GError *error;
+} DeleteEvent;
+
+typedef struct
+{
+    GPtrArray *events;
+    /* Whether the whole tree is done with, which comes last. */
+    gboolean done;
+    gboolean success;
+} DeleteBatch;
+
+struct _NautilusDeleteEngine
+{
+    GThreadPool *pool;
+    GAsyncQueue *batches;
+    /* Of the tree being deleted. */
+    GCancellable *cancellable;
+
+    /* Set while an error is being handled, which may involve asking the
+     * user whether to go on.
+     */
+    gint paused;
+    GMutex pause_mutex;
+    GCond pause_cond;
+};
+
+static void
+delete_event_free (DeleteEvent *event)
+{
+    g_object_unref (event->file);
+    g_clear_error (&event->error);
+    g_free (event);
+}
+
+static void
+delete_batch_free (DeleteBatch *batch)
+{
+    g_ptr_array_unref (batch->events);
+    g_free (batch);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (DeleteBatch, delete_batch_free)
+
+static GPtrArray *
+new_events (void)
+{
+    return g_ptr_array_new_with_free_func ((GDestroyNotify) delete_event_free);
+}
+
+static void
+add_event (GPtrArray  *events,
+           const char *path,
+           GError     *error)
+{
+    DeleteEvent *event = g_new0 (DeleteEvent, 1);
+
+    event->file = g_file_new_for_path (path);
+    event->error = error;
+    g_ptr_array_add (events, event);
+}
+
+static GError *
+error_from_errno (int errsv)
+{
+    return g_error_new_literal (G_IO_ERROR, g_io_error_from_errno (errsv), g_strerror (errsv));
+}
+
+/* Hands the events over to the deleting thread. This must happen before
+ * letting go of a directory, so that everything inside it is reported
+ * before the whole tree is done with.
+ */
+static void
+flush_events (NautilusDeleteEngine  *engine,
+              GPtrArray            **events)
+{
+    DeleteBatch *batch;
+
+    if ((*events)->len == 0)
+    {
+        return;
+    }
+
+    batch = g_new0 (DeleteBatch, 1);
+    batch->events = g_steal_pointer (events);
+    g_async_queue_push (engine->batches, batch);
+
+    *events = new_events ();
+}
+
+static void
+delete_task_free (DeleteTask *task)
+{
+    g_clear_pointer (&task->dir, closedir);
+    g_free (task->name);
+    g_free (task->path);
+    g_clear_error (&task->error);
+    g_free (task);
+}
+
+static DeleteTask *
+delete_task_new (NautilusDeleteEngine *engine,
+                 DeleteTask           *parent,
+                 int                   parent_dfd,
+                 const char           *name,
+                 char                 *path)
+{
+    DeleteTask *task = g_new0 (DeleteTask, 1);
+
+    task->engine = engine;
+    task->parent = parent;
+    task->parent_dfd = parent_dfd;
+    task->name = g_strdup (name);
+    task->path = path;
+    task->depth = (parent != NULL) ? parent->depth + 1 : 0;
+    task->n_pending = 1;
+
+    return task;
+}
+
+static void release_task (DeleteTask  *task,
+                          GPtrArray  **events);
+
+/* Removes a directory once nothing is left inside, and lets go of its
+ * parent.
+ */
+static void
+finish_task (DeleteTask  *task,
+             GPtrArray  **events)
+{
+    NautilusDeleteEngine *engine = task->engine;
+    DeleteTask *parent = task->parent;
+    GError *error = NULL;
+    gboolean failed;
+
+    /* Its subdirectories are all gone. */
+    g_clear_pointer (&task->dir, closedir);
+
+    if (task->error != NULL)
+    {
+        error = g_steal_pointer (&task->error);
+    }
+    else if (g_atomic_int_get (&task->failed))
+    {
+        if (!g_cancellable_set_error_if_cancelled (engine->cancellable, &error))
+        {
+            error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_EMPTY,
+                                 _("Failed to delete all child files"));
+        }
+    }
+    else if (!task->removed && unlinkat (task->parent_dfd, task->name, AT_REMOVEDIR) != 0)
+    {
+        error = error_from_errno (errno);
+    }
+
+    failed = (error != NULL);
+    add_event (*events, task->path, error);
+    flush_events (engine, events);
+
+    if (parent != NULL)
+    {
+        if (failed)
+        {
+            g_atomic_int_set (&parent->failed, TRUE);
+        }
+        delete_task_free (task);
+        release_task (parent, events);
+    }
+    else
+    {
+        DeleteBatch *batch = g_new0 (DeleteBatch, 1);
+
+        batch->events = new_events ();
+        batch->done = TRUE;
+        batch->success = !failed;
+        g_async_queue_push (engine->batches, batch);
+
+        delete_task_free (task);
+    }
+}
+
+static void
+release_task (DeleteTask  *task,
+              GPtrArray  **events)
+{
+    if (g_atomic_int_dec_and_test (&task->n_pending))
+    {
+        finish_task (task, events);
+    }
+}
+
+static gboolean
+is_directory_entry (int            dfd,
+                    struct dirent *entry)
+{
+    struct stat stat_buf;
+
+    if (entry->d_type != DT_UNKNOWN)
+    {
+        return entry->d_type == DT_DIR;
+    }
+
+    return (fstatat (dfd, entry->d_name, &stat_buf, AT_SYMLINK_NOFOLLOW) == 0 &&
+            S_ISDIR (stat_buf.st_mode));
+}
+
+static void
+wait_while_paused (NautilusDeleteEngine *engine)
+{
+    if (!g_atomic_int_get (&engine->paused))
+    {
+        return;
+    }
+
+    g_mutex_lock (&engine->pause_mutex);
+    while (engine->paused)
+    {
+        g_cond_wait (&engine->pause_cond, &engine->pause_mutex);
+    }
+    g_mutex_unlock (&engine->pause_mutex);
+}
+
+static void
+set_paused (NautilusDeleteEngine *engine,
+            gboolean              paused)
+{
+    g_mutex_lock (&engine->pause_mutex);
+    g_atomic_int_set (&engine->paused, paused);
+    if (!paused)
+    {
+        g_cond_broadcast (&engine->pause_cond);
+    }
+    g_mutex_unlock (&engine->pause_mutex);
+}
+
+/* Unlinks the files of a directory and queues its subdirectories. */
+static void
+delete_directory_func (gpointer data,
+                       gpointer user_data)
+{
+    DeleteTask *task = data;
+    NautilusDeleteEngine *engine = user_data;
+    g_autoptr (GPtrArray) events = new_events ();
+    int dfd;
+    int errsv = 0;
+
+    wait_while_paused (engine);
+    if (g_cancellable_is_cancelled (engine->cancellable))
+    {
+        g_atomic_int_set (&task->failed, TRUE);
+        release_task (task, &events);
+        return;
+    }
+
+    dfd = openat (task->parent_dfd, task->name,
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        errsv = errno;
+    }
+    else
+    {
+        task->dir = fdopendir (dfd);
+        if (task->dir == NULL)
+        {
+            errsv = errno;
+            g_close (dfd, NULL);
+        }
+    }
+
+    if (task->dir == NULL)
+    {
+        /* It may still be empty, as it can be removed without being read. */
+        if (unlinkat (task->parent_dfd, task->name, AT_REMOVEDIR) == 0)
+        {
+            task->removed = TRUE;
+        }
+        else
+        {
+            task->error = error_from_errno (errsv);
+        }
+        release_task (task, &events);
+        return;
+    }
+
+    while (TRUE)
+    {
+        struct dirent *entry;
+        g_autofree char *child_path = NULL;
+
+        errno = 0;
+        entry = readdir (task->dir);
+        if (entry == NULL)
+        {
+            if (errno != 0)
+            {
+                task->error = error_from_errno (errno);
+            }
+            break;
+        }
+
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        wait_while_paused (engine);
+        if (g_cancellable_is_cancelled (engine->cancellable))
+        {
+            g_atomic_int_set (&task->failed, TRUE);
+            break;
+        }
+
+        child_path = g_build_filename (task->path, entry->d_name, NULL);
+
+        if (is_directory_entry (dfd, entry))
+        {
+            g_atomic_int_inc (&task->n_pending);
+            g_thread_pool_push (engine->pool,
+                                delete_task_new (engine, task, dfd, entry->d_name,
+                                                 g_steal_pointer (&child_path)),
+                                NULL);
+            continue;
+        }
+
+        if (unlinkat (dfd, entry->d_name, 0) == 0)
+        {
+            add_event (events, child_path, NULL);
+        }
+        else
+        {
+            add_event (events, child_path, error_from_errno (errno));
+            g_atomic_int_set (&task->failed, TRUE);
+        }
+
+        if (events->len >= BATCH_SIZE)
+        {
+            flush_events (engine, &events);
+        }
+    }
+
+    /* Without subdirectories, it isn't needed anymore. */
+    if (g_atomic_int_get (&task->n_pending) == 1)
+    {
+        g_clear_pointer (&task->dir, closedir);
+    }
+
+    flush_events (engine, &events);
+    release_task (task, &events);
+}
+
+/* Deeper directories go first, so that the tree is deleted a branch at a
+ * time rather than queueing every directory level by level.
+ */
+static gint
+compare_tasks (gconstpointer a,
+               gconstpointer b,
+               gpointer      user_data)
+{
+    const DeleteTask *task_a = a;
+    const DeleteTask *task_b = b;
+
+    return (task_a->depth < task_b->depth) - (task_a->depth > task_b->depth);
+}
+
+NautilusDeleteEngine *
+nautilus_delete_engine_new (void)
+{
+    NautilusDeleteEngine *self = g_new0 (NautilusDeleteEngine, 1);
+
+    self->pool = g_thread_pool_new (delete_directory_func, self,
+                                    CLAMP (g_get_num_processors (), 2, MAX_THREADS),
+                                    FALSE, NULL);
+    g_thread_pool_set_sort_function (self->pool, compare_tasks, NULL);
+    self->batches = g_async_queue_new_full ((GDestroyNotify) delete_batch_free);
+    g_mutex_init (&self->pause_mutex);
+    g_cond_init (&self->pause_cond);
+
+    return self;
+}
+
+void
+nautilus_delete_engine_free (NautilusDeleteEngine *self)
+{
+    g_thread_pool_free (self->pool, TRUE, TRUE);
+    g_async_queue_unref (self->batches);
+    g_mutex_clear (&self->pause_mutex);
+    g_cond_clear (&self->pause_cond);
+    g_free (self);
+}
+
+/**
+ * nautilus_delete_engine_delete:
+ * @self: a #NautilusDeleteEngine
+ * @file: a local file or directory to delete with its contents
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (nullable): called for each file deleted, or that couldn't be
+ * @user_data: data for @callback
+ *
+ * Deletes @file and everything inside it, without following symbolic links.
+ * The callback is called in the calling thread, in batches as the threads
+ * make progress. As with a recursive g_file_delete(), directories are
+ * reported after their contents, and fail with %G_IO_ERROR_NOT_EMPTY if
+ * anything inside them couldn't be deleted. The threads wait while the
+ * callback handles an error, so that cancelling from it stops them.
+ *
+ * Returns: whether @file was deleted
+ */
+gboolean
+nautilus_delete_engine_delete (NautilusDeleteEngine         *self,
+                               GFile                        *file,
+                               GCancellable                 *cancellable,
+                               NautilusDeleteEngineCallback  callback,
+                               gpointer                      user_data)
+{
+    g_autofree char *path = g_file_get_path (file);
+    g_autofree char *parent_path = NULL;
+    g_autofree char *name = NULL;
+    g_autoptr (GError) error = NULL;
+    g_autofd int parent_dfd = -1;
+    struct stat stat_buf;
+    gboolean success = FALSE;
+
+    g_return_val_if_fail (path != NULL, FALSE);
+
+    parent_path = g_path_get_dirname (path);
+    name = g_path_get_basename (path);
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+    {
+        /* Reported below. */
+    }
+    else if ((parent_dfd = g_open (parent_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0)) < 0 ||
+             fstatat (parent_dfd, name, &stat_buf, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        error = error_from_errno (errno);
+    }
+    else if (!S_ISDIR (stat_buf.st_mode))
+    {
+        if (unlinkat (parent_dfd, name, 0) != 0)
+        {
+            error = error_from_errno (errno);
+        }
+    }
+    else
+    {
+        self->cancellable = cancellable;
+        g_thread_pool_push (self->pool,
+                            delete_task_new (self, NULL, parent_dfd, name, g_strdup (path)),
+                            NULL);
+
+        while (TRUE)
+        {
+            g_autoptr (DeleteBatch) batch = g_async_queue_pop (self->batches);
+
+            for (guint i = 0; callback != NULL && i < batch->events->len; i++)
+            {
+                DeleteEvent *event = g_ptr_array_index (batch->events, i);
+
+                if (event->error != NULL)
+                {
+                    set_paused (self, TRUE);
+                }
+                callback (event->file, event->error, user_data);
+                if (event->error != NULL)
+                {
+                    set_paused (self, FALSE);
+                }
+            }
+
+            if (batch->done)
+            {
+                success = batch->success;
+                break;
+            }
+        }
+        self->cancellable = NULL;
+
+        g_debug ("Deleted %s %s", path, success ? "completely" : "partially");
+
+        return success;
+    }
+
+    success = (error == NULL);
+    if (callback != NULL)
+    {
+        callback (file, error, user_data);
+    }
+
+    return success;
+}
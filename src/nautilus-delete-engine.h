@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* Deletes local trees on several threads, a directory per thread at a time.
+ * Files and directories are opened and removed relative to their open
+ * parent directory, and directories are removed once their contents are
+ * gone, without first trying to remove them and failing because they
+ * aren't empty.
+ */
+typedef struct _NautilusDeleteEngine NautilusDeleteEngine;
+
+/* Called for each file deleted, with @error set if it couldn't be. */
+typedef void (*NautilusDeleteEngineCallback) (GFile    *file,
+                                              GError   *error,
+                                              gpointer  user_data);
+
+NautilusDeleteEngine *nautilus_delete_engine_new    (void);
+void                  nautilus_delete_engine_free   (NautilusDeleteEngine          *self);
+
+gboolean              nautilus_delete_engine_delete (NautilusDeleteEngine          *self,
+                                                     GFile                         *file,
+                                                     GCancellable                  *cancellable,
+                                                     NautilusDeleteEngineCallback   callback,
+                                                     gpointer                       user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusDeleteEngine, nautilus_delete_engine_free)
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
 #include "nautilus-enums.h"
@@ -31,6 +32,7 @@
 #include "nautilus-global-preferences.h"
 #include "nautilus-hash-queue.h"
 #include "nautilus-metadata.h"
+#include "nautilus-mount-table.h"
 #include "nautilus-signaller.h"
 
 /* turn this on to check if async. job calls are balanced */
@@ -40,8 +42,36 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
-/* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+/* Loading a directory starts with batches of DIRECTORY_LOAD_ITEMS_PER_CALLBACK
+ * entries and grows them up to this size, as long as the enumerator returns
+ * a batch within DIRECTORY_LOAD_BATCH_BUDGET_USEC.
+ */
+#define DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK 4096
+#define DIRECTORY_LOAD_BATCH_BUDGET_USEC 50000
+
+/* Default main loop time that adding loaded files to a directory may take
+ * per idle. The clock is checked every DEQUEUE_PENDING_CHECK_INTERVAL files.
+ */
+#define DEQUEUE_PENDING_BUDGET_USEC 4000
+#define DEQUEUE_PENDING_CHECK_INTERVAL 16
+
+static gint64 dequeue_pending_budget = DEQUEUE_PENDING_BUDGET_USEC;
+
+/* Keep async. jobs down to these numbers for all directories sharing a
+ * backend: the local disk, a given FUSE mount or a given remote host.
+ */
+#define MAX_ASYNC_JOBS_LOCAL 10
+#define MAX_ASYNC_JOBS_FUSE 4
+#define MAX_ASYNC_JOBS_REMOTE 4
+
+/* Number of directories a single deep count enumerates concurrently. */
+#define DEEP_COUNT_MAX_WORKERS 4
+
+/* How many files from the head of the high and low priority queues are
+ * considered at once, so that files behind one waiting for a busy pipeline
+ * can still use the other pipelines.
+ */
+#define QUEUE_LOOKAHEAD 32
 
 struct ThumbnailState
 {
@@ -71,12 +101,16 @@ struct DirectoryLoadState
     GFileEnumerator *enumerator;
     NautilusFile *load_directory_file;
     int load_file_count;
+    guint batch_size;
+    gint64 batch_requested;
+    gboolean prepare_in_thread;
 };
 
 struct GetInfoState
 {
     NautilusDirectory *directory;
     GCancellable *cancellable;
+    NautilusFile *file;
 };
 
 struct NewFilesState
@@ -99,13 +133,43 @@ struct DeepCountState
 {
     NautilusDirectory *directory;
     GCancellable *cancellable;
-    GFileEnumerator *enumerator;
-    GFile *deep_count_location;
     GList *deep_count_subdirectories;
-    GArray *seen_deep_count_inodes;
+    GHashTable *seen_deep_count_inodes;
     char *fs_id;
+    guint n_workers;
 };
 
+/* Enumerates one directory of a deep count. Counts are collected per worker
+ * and merged into the counted file after every batch, all on the main loop.
+ * For local directories, the totals of the directory's own entries are also
+ * kept so they can be stored in the deep count cache.
+ */
+typedef struct
+{
+    DeepCountState *state;
+    GFileEnumerator *enumerator;
+    GFile *location;
+    guint directory_count;
+    guint file_count;
+    guint unreadable_count;
+    goffset size;
+
+    gboolean cacheable;
+    guint64 mtime;
+    guint64 ctime;
+    guint64 inode;
+    guint own_directory_count;
+    guint own_file_count;
+    goffset own_size;
+    GPtrArray *subdirectory_names;
+} DeepCountWorker;
+
+typedef struct
+{
+    guint64 device;
+    guint64 inode;
+} DeepCountInode;
+
 
 
 typedef struct
@@ -144,16 +208,51 @@ typedef struct
 typedef gboolean (*RequestCheck) (Request);
 typedef gboolean (*FileCheck) (NautilusFile *);
 
-/* Current number of async. jobs. */
-static int async_job_count;
-static GHashTable *waiting_directories;
+typedef enum
+{
+    ASYNC_JOB_PRIORITY_VISIBLE, /* Directories shown in a view. */
+    ASYNC_JOB_PRIORITY_DEFAULT,
+    ASYNC_JOB_PRIORITY_LAST
+} AsyncJobPriority;
+
+/* Job slots shared by all directories on one backend, so that a slow
+ * backend can't hold the slots needed by another one. Directories that
+ * can't get a slot wait in FIFO order, visible ones first.
+ */
+struct AsyncJobBackend
+{
+    char *key;
+    guint max_jobs;
+    guint n_jobs;
+    GQueue waiting[ASYNC_JOB_PRIORITY_LAST];
+
+    /* Statistics. */
+    guint max_queue_depth;
+    guint64 n_waits;
+    gint64 total_wait_usec;
+};
+
+/* Backend key to AsyncJobBackend. */
+static GHashTable *async_job_backends;
+
+/* Number of files per directory that may have each kind of attribute
+ * fetched at the same time. Kinds that aren't listed are fetched for one
+ * file at a time.
+ */
+static guint pipeline_widths[REQUEST_TYPE_LAST] =
+{
+    [REQUEST_FILE_INFO] = 4,
+    [REQUEST_DIRECTORY_COUNT] = 4,
+    [REQUEST_FILESYSTEM_INFO] = 4,
+    [REQUEST_MOUNT] = 2,
+    [REQUEST_THUMBNAIL] = 2,
+};
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
 
 /* Forward declarations for functions that need them. */
-static void     deep_count_load (DeepCountState *state,
-                                 GFile          *location);
+static void     deep_count_schedule (DeepCountState *state);
 static gboolean request_is_satisfied (NautilusDirectory *directory,
                                       NautilusFile      *file,
                                       Request            request);
@@ -253,6 +352,175 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+static char *
+async_job_get_backend_key (GFile *location,
+                           guint *max_jobs)
+{
+    g_autofree char *uri = NULL;
+    g_autofree char *scheme = NULL;
+    g_autofree char *host = NULL;
+
+    if (g_file_is_native (location))
+    {
+        g_autofree char *path = g_file_get_path (location);
+        g_autofree char *fuse_mount_path = NULL;
+
+        fuse_mount_path = (path != NULL) ? nautilus_mount_table_get_fuse_mount_path (path) : NULL;
+        if (fuse_mount_path != NULL)
+        {
+            *max_jobs = MAX_ASYNC_JOBS_FUSE;
+            return g_strconcat ("fuse:", fuse_mount_path, NULL);
+        }
+
+        *max_jobs = MAX_ASYNC_JOBS_LOCAL;
+        return g_strdup ("local");
+    }
+
+    /* Everything served from the same host goes through the same mount. */
+    uri = g_file_get_uri (location);
+    if (!g_uri_split (uri, G_URI_FLAGS_NONE,
+                      &scheme, NULL, &host, NULL, NULL, NULL, NULL, NULL))
+    {
+        scheme = g_file_get_uri_scheme (location);
+    }
+
+    *max_jobs = MAX_ASYNC_JOBS_REMOTE;
+    return g_strdup_printf ("%s://%s", scheme, host != NULL ? host : "");
+}
+
+static AsyncJobBackend *
+async_job_get_backend (NautilusDirectory *directory)
+{
+    AsyncJobBackend *backend;
+    g_autofree char *key = NULL;
+    guint max_jobs;
+
+    /* Jobs must end on the backend they started on, even if the directory
+     * is moved in between, so this is only looked up once.
+     */
+    if (directory->details->async_job_backend != NULL)
+    {
+        return directory->details->async_job_backend;
+    }
+
+    if (async_job_backends == NULL)
+    {
+        async_job_backends = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    key = async_job_get_backend_key (directory->details->location, &max_jobs);
+    backend = g_hash_table_lookup (async_job_backends, key);
+    if (backend == NULL)
+    {
+        backend = g_new0 (AsyncJobBackend, 1);
+        backend->key = g_steal_pointer (&key);
+        backend->max_jobs = max_jobs;
+        for (guint i = 0; i < ASYNC_JOB_PRIORITY_LAST; i++)
+        {
+            g_queue_init (&backend->waiting[i]);
+        }
+        g_hash_table_insert (async_job_backends, backend->key, backend);
+    }
+
+    directory->details->async_job_backend = backend;
+
+    return backend;
+}
+
+static AsyncJobPriority
+async_job_get_priority (NautilusDirectory *directory)
+{
+    if (directory->details->monitor_counters[REQUEST_FILE_LIST] > 0)
+    {
+        return ASYNC_JOB_PRIORITY_VISIBLE;
+    }
+
+    return ASYNC_JOB_PRIORITY_DEFAULT;
+}
+
+static guint
+async_job_get_queue_depth (AsyncJobBackend *backend)
+{
+    guint depth = 0;
+
+    for (guint i = 0; i < ASYNC_JOB_PRIORITY_LAST; i++)
+    {
+        depth += g_queue_get_length (&backend->waiting[i]);
+    }
+
+    return depth;
+}
+
+static void
+async_job_wait (NautilusDirectory *directory,
+                AsyncJobBackend   *backend)
+{
+    if (directory->details->async_job_wait_start != 0)
+    {
+        /* Already waiting, keep its place in the queue. */
+        return;
+    }
+
+    g_queue_push_tail (&backend->waiting[async_job_get_priority (directory)], directory);
+    directory->details->async_job_wait_start = g_get_monotonic_time ();
+
+    backend->max_queue_depth = MAX (backend->max_queue_depth,
+                                    async_job_get_queue_depth (backend));
+}
+
+static void
+async_job_stop_waiting (NautilusDirectory *directory)
+{
+    AsyncJobBackend *backend;
+
+    backend = directory->details->async_job_backend;
+    if (backend == NULL || directory->details->async_job_wait_start == 0)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < ASYNC_JOB_PRIORITY_LAST; i++)
+    {
+        g_queue_remove (&backend->waiting[i], directory);
+    }
+
+    backend->n_waits += 1;
+    backend->total_wait_usec += g_get_monotonic_time () - directory->details->async_job_wait_start;
+    directory->details->async_job_wait_start = 0;
+}
+
+static gboolean
+async_job_can_start (NautilusDirectory *directory,
+                     AsyncJobBackend   *backend)
+{
+    AsyncJobPriority priority;
+
+    if (backend->n_jobs >= backend->max_jobs)
+    {
+        return FALSE;
+    }
+
+    /* A directory just woken up from the queue gets the slot it waited for. */
+    if (directory->details->async_job_woken)
+    {
+        return TRUE;
+    }
+
+    /* Otherwise, don't jump ahead of directories that are already waiting
+     * with the same or a higher priority.
+     */
+    priority = async_job_get_priority (directory);
+    for (guint i = 0; i <= priority; i++)
+    {
+        if (!g_queue_is_empty (&backend->waiting[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
@@ -261,25 +529,20 @@ static gboolean
 async_job_start (NautilusDirectory *directory,
                  const char        *job)
 {
+    AsyncJobBackend *backend;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
 #endif
 
     g_debug ("starting %s in %p", job, directory->details->location);
 
-    g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
+    backend = async_job_get_backend (directory);
 
-    if (async_job_count >= MAX_ASYNC_JOBS)
-    {
-        if (waiting_directories == NULL)
-        {
-            waiting_directories = g_hash_table_new (NULL, NULL);
-        }
+    g_assert (backend->n_jobs <= backend->max_jobs);
 
-        g_hash_table_insert (waiting_directories,
-                             directory,
-                             directory);
+    if (!async_job_can_start (directory, backend))
+    {
+        async_job_wait (directory, backend);
 
         return FALSE;
     }
@@ -303,7 +566,8 @@ async_job_start (NautilusDirectory *directory,
     }
 #endif
 
-    async_job_count += 1;
+    directory->details->async_job_woken = FALSE;
+    backend->n_jobs += 1;
     return TRUE;
 }
 
@@ -312,6 +576,7 @@ static void
 async_job_end (NautilusDirectory *directory,
                const char        *job)
 {
+    AsyncJobBackend *backend;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
     gpointer table_key, value;
@@ -319,7 +584,10 @@ async_job_end (NautilusDirectory *directory,
 
     g_debug ("stopping %s in %p", job, directory->details->location);
 
-    g_assert (async_job_count > 0);
+    backend = directory->details->async_job_backend;
+
+    g_assert (backend != NULL);
+    g_assert (backend->n_jobs > 0);
 
 #ifdef DEBUG_ASYNC_JOBS
     {
@@ -342,74 +610,179 @@ async_job_end (NautilusDirectory *directory,
     }
 #endif
 
-    async_job_count -= 1;
+    backend->n_jobs -= 1;
 }
 
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key,
-                        gpointer value,
-                        gpointer callback_data)
+static NautilusDirectory *
+async_job_pop_waiting (AsyncJobBackend *backend)
 {
-    gpointer *returned_value;
-
-    returned_value = callback_data;
-    *returned_value = value;
-}
-
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
-{
-    gpointer value;
+    NautilusDirectory *directory;
 
-    value = NULL;
-    if (table != NULL)
+    for (guint i = 0; i < ASYNC_JOB_PRIORITY_LAST; i++)
     {
-        g_hash_table_foreach (table, get_one_value_callback, &value);
+        directory = g_queue_peek_head (&backend->waiting[i]);
+        if (directory != NULL)
+        {
+            async_job_stop_waiting (directory);
+            return directory;
+        }
     }
-    return value;
+
+    return NULL;
 }
 
 /* Wake up directories that are "blocked" as long as there are job
- * slots available.
+ * slots available on their backend.
  */
 static void
 async_job_wake_up (void)
 {
     static gboolean already_waking_up = FALSE;
-    gpointer value;
-
-    g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
+    g_autoptr (GList) backends = NULL;
+    AsyncJobBackend *backend;
+    NautilusDirectory *directory;
 
-    if (already_waking_up)
+    if (already_waking_up || async_job_backends == NULL)
     {
         return;
     }
 
     already_waking_up = TRUE;
-    while (async_job_count < MAX_ASYNC_JOBS)
+
+    /* Waking directories up may add backends, so don't iterate the table
+     * itself. Backends are never freed.
+     */
+    backends = g_hash_table_get_values (async_job_backends);
+    for (GList *l = backends; l != NULL; l = l->next)
     {
-        value = get_one_value (waiting_directories);
-        if (value == NULL)
+        backend = l->data;
+
+        g_assert (backend->n_jobs <= backend->max_jobs);
+
+        /* Each woken directory either takes a slot or doesn't need one any
+         * more, so this terminates. If it wants more than one slot, it
+         * queues up again behind the others.
+         */
+        while (backend->n_jobs < backend->max_jobs)
         {
-            break;
+            directory = async_job_pop_waiting (backend);
+            if (directory == NULL)
+            {
+                break;
+            }
+
+            nautilus_directory_ref (directory);
+            directory->details->async_job_woken = TRUE;
+            nautilus_directory_async_state_changed (directory);
+            directory->details->async_job_woken = FALSE;
+            nautilus_directory_unref (directory);
         }
-        g_hash_table_remove (waiting_directories, value);
-        nautilus_directory_async_state_changed
-            (NAUTILUS_DIRECTORY (value));
     }
     already_waking_up = FALSE;
 }
 
+/**
+ * nautilus_directory_get_io_stats:
+ * @directory: a #NautilusDirectory
+ * @stats: (out caller-allocates): statistics of the async. job slots
+ *     shared with other directories on the same backend
+ */
+void
+nautilus_directory_get_io_stats (NautilusDirectory        *directory,
+                                 NautilusDirectoryIOStats *stats)
+{
+    AsyncJobBackend *backend;
+
+    g_return_if_fail (NAUTILUS_IS_DIRECTORY (directory));
+
+    backend = async_job_get_backend (directory);
+
+    stats->running_jobs = backend->n_jobs;
+    stats->max_jobs = backend->max_jobs;
+    stats->queue_depth = async_job_get_queue_depth (backend);
+    stats->max_queue_depth = backend->max_queue_depth;
+    stats->n_waits = backend->n_waits;
+    stats->total_wait_usec = backend->total_wait_usec;
+}
+
+/**
+ * nautilus_directory_set_pipeline_width:
+ * @request_type: a kind of attribute that is fetched in a pipeline
+ * @width: how many files per directory may have it fetched at once
+ *
+ * Only file info, directory counts, filesystem info, mounts and thumbnails
+ * are fetched in pipelines. Jobs already in flight are not affected.
+ */
+void
+nautilus_directory_set_pipeline_width (RequestType request_type,
+                                       guint       width)
+{
+    g_return_if_fail (request_type == REQUEST_FILE_INFO ||
+                      request_type == REQUEST_DIRECTORY_COUNT ||
+                      request_type == REQUEST_FILESYSTEM_INFO ||
+                      request_type == REQUEST_MOUNT ||
+                      request_type == REQUEST_THUMBNAIL);
+    g_return_if_fail (width > 0);
+
+    pipeline_widths[request_type] = width;
+}
+
+/**
+ * nautilus_directory_set_dequeue_budget:
+ * @usec: main loop time, in microseconds
+ *
+ * Sets how long adding loaded files to a directory may keep the main loop
+ * busy before yielding to other sources. The files that don't fit are
+ * added in later idles, and done-loading is emitted after the last of them.
+ */
+void
+nautilus_directory_set_dequeue_budget (gint64 usec)
+{
+    g_return_if_fail (usec > 0);
+
+    dequeue_pending_budget = usec;
+}
+
+static gboolean
+pipeline_is_full (GList       *states,
+                  RequestType  request_type)
+{
+    return g_list_length (states) >= pipeline_widths[request_type];
+}
+
+static DirectoryCountState *
+find_directory_count_state (NautilusDirectory *directory,
+                            NautilusFile      *file)
+{
+    for (GList *l = directory->details->count_in_progress; l != NULL; l = l->next)
+    {
+        DirectoryCountState *state = l->data;
+
+        if (state->count_file == file)
+        {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+directory_count_cancel_one (NautilusDirectory   *directory,
+                            DirectoryCountState *state)
+{
+    /* The job ends when the cancelled callback runs. */
+    g_cancellable_cancel (state->cancellable);
+    directory->details->count_in_progress = g_list_remove (directory->details->count_in_progress,
+                                                           state);
+}
+
 static void
 directory_count_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->count_in_progress != NULL)
+    while (directory->details->count_in_progress != NULL)
     {
-        g_cancellable_cancel (directory->details->count_in_progress->cancellable);
-        directory->details->count_in_progress = NULL;
+        directory_count_cancel_one (directory, directory->details->count_in_progress->data);
     }
 }
 
@@ -432,41 +805,131 @@ deep_count_cancel (NautilusDirectory *directory)
     }
 }
 
+static ThumbnailState *
+find_thumbnail_state (NautilusDirectory *directory,
+                      NautilusFile      *file)
+{
+    for (GList *l = directory->details->thumbnail_states; l != NULL; l = l->next)
+    {
+        ThumbnailState *state = l->data;
+
+        if (state->file == file)
+        {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+thumbnail_cancel_one (NautilusDirectory *directory,
+                      ThumbnailState    *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    directory->details->thumbnail_states = g_list_remove (directory->details->thumbnail_states,
+                                                          state);
+    async_job_end (directory, "thumbnail");
+}
+
 static void
 thumbnail_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->thumbnail_state != NULL)
+    while (directory->details->thumbnail_states != NULL)
+    {
+        thumbnail_cancel_one (directory, directory->details->thumbnail_states->data);
+    }
+}
+
+static MountState *
+find_mount_state (NautilusDirectory *directory,
+                  NautilusFile      *file)
+{
+    for (GList *l = directory->details->mount_states; l != NULL; l = l->next)
     {
-        g_cancellable_cancel (directory->details->thumbnail_state->cancellable);
-        directory->details->thumbnail_state->directory = NULL;
-        directory->details->thumbnail_state = NULL;
-        async_job_end (directory, "thumbnail");
+        MountState *state = l->data;
+
+        if (state->file == file)
+        {
+            return state;
+        }
     }
+
+    return NULL;
+}
+
+static void
+mount_cancel_one (NautilusDirectory *directory,
+                  MountState        *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    directory->details->mount_states = g_list_remove (directory->details->mount_states,
+                                                      state);
+    async_job_end (directory, "mount");
 }
 
 static void
 mount_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->mount_state != NULL)
+    while (directory->details->mount_states != NULL)
+    {
+        mount_cancel_one (directory, directory->details->mount_states->data);
+    }
+}
+
+static FilesystemInfoState *
+find_filesystem_info_state (NautilusDirectory *directory,
+                            NautilusFile      *file)
+{
+    for (GList *l = directory->details->filesystem_info_states; l != NULL; l = l->next)
+    {
+        FilesystemInfoState *state = l->data;
+
+        if (state->file == file)
+        {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static GetInfoState *
+find_get_info_state (NautilusDirectory *directory,
+                     NautilusFile      *file)
+{
+    for (GList *l = directory->details->get_info_states; l != NULL; l = l->next)
     {
-        g_cancellable_cancel (directory->details->mount_state->cancellable);
-        directory->details->mount_state->directory = NULL;
-        directory->details->mount_state = NULL;
-        async_job_end (directory, "mount");
+        GetInfoState *state = l->data;
+
+        if (state->file == file)
+        {
+            return state;
+        }
     }
+
+    return NULL;
+}
+
+static void
+file_info_cancel_one (NautilusDirectory *directory,
+                      GetInfoState      *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    directory->details->get_info_states = g_list_remove (directory->details->get_info_states,
+                                                         state);
+    async_job_end (directory, "file info");
 }
 
 static void
 file_info_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->get_info_in_progress != NULL)
+    while (directory->details->get_info_states != NULL)
     {
-        g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-        directory->details->get_info_in_progress->directory = NULL;
-        directory->details->get_info_in_progress = NULL;
-        directory->details->get_info_file = NULL;
-
-        async_job_end (directory, "file info");
+        file_info_cancel_one (directory, directory->details->get_info_states->data);
     }
 }
 
@@ -838,13 +1301,14 @@ static gboolean
 dequeue_pending_idle_callback (gpointer callback_data)
 {
     NautilusDirectory *directory;
-    GList *pending_file_info;
-    GList *node, *next;
+    GQueue *pending_file_records;
+    NautilusFileRecord *record;
     NautilusFile *file;
     GList *changed_files, *added_files;
-    GFileInfo *file_info;
     const char *name;
-    DirectoryLoadState *dir_load_state;
+    gboolean done_adding;
+    gint64 deadline;
+    guint n_records;
 
     directory = NAUTILUS_DIRECTORY (callback_data);
 
@@ -852,40 +1316,27 @@ dequeue_pending_idle_callback (gpointer callback_data)
 
     directory->details->dequeue_pending_idle_id = 0;
 
-    /* Handle the files in the order we saw them. */
-    pending_file_info = g_list_reverse (directory->details->pending_file_info);
-    directory->details->pending_file_info = NULL;
+    pending_file_records = &directory->details->pending_file_records;
 
     /* If we are no longer monitoring, then throw away these. */
     if (!nautilus_directory_is_file_list_monitored (directory))
     {
+        g_queue_clear_full (pending_file_records, (GDestroyNotify) nautilus_file_record_free);
         nautilus_directory_async_state_changed (directory);
-        goto drain;
+        goto out;
     }
 
     added_files = NULL;
     changed_files = NULL;
 
-    dir_load_state = directory->details->directory_load_in_progress;
-
-    /* Build a list of NautilusFile objects. */
-    for (node = pending_file_info; node != NULL; node = node->next)
+    /* Handle the files in the order we saw them, as many as fit in this
+     * idle. The rest is left for the next one.
+     */
+    deadline = g_get_monotonic_time () + dequeue_pending_budget;
+    n_records = 0;
+    while ((record = g_queue_pop_head (pending_file_records)) != NULL)
     {
-        file_info = node->data;
-
-        name = g_file_info_get_name (file_info);
-
-        /* Update the file count. */
-        /* FIXME bugzilla.gnome.org 45063: This could count a
-         * file twice if we get it from both load_directory
-         * and from new_files_callback. Not too hard to fix by
-         * moving this into the actual callback instead of
-         * waiting for the idle function.
-         */
-        if (dir_load_state && !should_skip_file (file_info))
-        {
-            dir_load_state->load_file_count += 1;
-        }
+        name = g_file_info_get_name (record->info);
 
         /* check if the file already exists */
         file = nautilus_directory_find_file_by_name (directory, name);
@@ -904,7 +1355,7 @@ dequeue_pending_idle_callback (gpointer callback_data)
                 file->details->is_added = TRUE;
                 added_files = g_list_prepend (added_files, file);
             }
-            else if (nautilus_file_update_info (file, file_info))
+            else if (nautilus_file_update_info (file, record->info))
             {
                 /* File changed, notify about the change. */
                 nautilus_file_ref (file);
@@ -914,23 +1365,36 @@ dequeue_pending_idle_callback (gpointer callback_data)
         else
         {
             /* new file, create a nautilus file object and add it to the list */
-            file = nautilus_file_new_from_info (directory, file_info);
+            file = nautilus_file_new_from_record (directory, record);
             nautilus_directory_add_file (directory, file);
             file->details->is_added = TRUE;
             added_files = g_list_prepend (added_files, file);
         }
+
+        nautilus_file_record_free (record);
+
+        if (++n_records % DEQUEUE_PENDING_CHECK_INTERVAL == 0 &&
+            g_get_monotonic_time () >= deadline)
+        {
+            break;
+        }
     }
+    done_adding = g_queue_is_empty (pending_file_records);
 
     /* If we are done loading, then we assume that any unconfirmed
-     * files are gone.
+     * files are gone. Loads mark files unconfirmed when they start, so
+     * one pass when the load is over is enough.
      */
-    if (directory->details->directory_loaded)
+    if (done_adding &&
+        directory->details->directory_loaded &&
+        !directory->details->directory_loaded_sent_notification)
     {
-        for (node = directory->details->file_list;
-             node != NULL; node = next)
+        /* Walk backwards, as files that are gone get swapped out of the
+         * array with the last one.
+         */
+        for (guint i = directory->details->files->len; i-- > 0;)
         {
-            file = NAUTILUS_FILE (node->data);
-            next = node->next;
+            file = g_ptr_array_index (directory->details->files, i);
 
             if (file->details->unconfirmed)
             {
@@ -948,23 +1412,13 @@ dequeue_pending_idle_callback (gpointer callback_data)
     nautilus_directory_emit_files_added (directory, added_files);
     nautilus_file_list_free (added_files);
 
-    if (directory->details->directory_loaded &&
+    if (done_adding &&
+        directory->details->directory_loaded &&
         !directory->details->directory_loaded_sent_notification)
     {
         /* Send the done_loading signal. */
         nautilus_directory_emit_done_loading (directory);
 
-        if (dir_load_state)
-        {
-            file = dir_load_state->load_directory_file;
-
-            file->details->directory_count = dir_load_state->load_file_count;
-            file->details->directory_count_is_up_to_date = TRUE;
-            file->details->got_directory_count = TRUE;
-
-            nautilus_file_changed (file);
-        }
-
         nautilus_directory_async_state_changed (directory);
 
         directory->details->directory_loaded_sent_notification = TRUE;
@@ -974,9 +1428,12 @@ dequeue_pending_idle_callback (gpointer callback_data)
      * See Bug 703179 and issue #1576 for a situation this happens. */
     notify_files_changed_while_being_added (directory);
 
-drain:
-    g_list_free_full (pending_file_info, g_object_unref);
+    if (!done_adding)
+    {
+        nautilus_directory_schedule_dequeue_pending (directory);
+    }
 
+out:
     /* Get the state machine running again. */
     nautilus_directory_async_state_changed (directory);
 
@@ -995,15 +1452,12 @@ nautilus_directory_schedule_dequeue_pending (NautilusDirectory *directory)
 }
 
 static void
-directory_load_one (NautilusDirectory *directory,
-                    GFileInfo         *info)
+directory_load_one (NautilusDirectory  *directory,
+                    NautilusFileRecord *record)
 {
-    if (info == NULL)
-    {
-        return;
-    }
+    DirectoryLoadState *state;
 
-    if (g_file_info_get_name (info) == NULL)
+    if (g_file_info_get_name (record->info) == NULL)
     {
         char *uri;
 
@@ -1011,13 +1465,19 @@ directory_load_one (NautilusDirectory *directory,
         g_warning ("Got GFileInfo with NULL name in %s, ignoring. This shouldn't happen unless the gvfs backend is broken.\n", uri);
         g_free (uri);
 
+        nautilus_file_record_free (record);
         return;
     }
 
+    /* Update the file count. New files can also come after loading. */
+    state = directory->details->directory_load_in_progress;
+    if (state != NULL && !should_skip_file (record->info))
+    {
+        state->load_file_count += 1;
+    }
+
     /* Arrange for the "loading" part of the work. */
-    g_object_ref (info);
-    directory->details->pending_file_info
-        = g_list_prepend (directory->details->pending_file_info, info);
+    g_queue_push_tail (&directory->details->pending_file_records, record);
     nautilus_directory_schedule_dequeue_pending (directory);
 }
 
@@ -1055,24 +1515,30 @@ file_list_cancel (NautilusDirectory *directory)
         directory->details->dequeue_pending_idle_id = 0;
     }
 
-    if (directory->details->pending_file_info != NULL)
-    {
-        g_list_free_full (directory->details->pending_file_info, g_object_unref);
-        directory->details->pending_file_info = NULL;
-    }
+    g_queue_clear_full (&directory->details->pending_file_records,
+                        (GDestroyNotify) nautilus_file_record_free);
 }
 
 static void
 directory_load_done (NautilusDirectory *directory,
                      GError            *error)
 {
-    GList *node;
+    DirectoryLoadState *state;
+    NautilusFile *file;
 
     g_object_ref (directory);
 
     directory->details->directory_loaded = TRUE;
     directory->details->directory_loaded_sent_notification = FALSE;
 
+    /* All entries have been counted, even if not all are added yet. */
+    state = directory->details->directory_load_in_progress;
+    file = state->load_directory_file;
+    file->details->directory_count = state->load_file_count;
+    file->details->directory_count_is_up_to_date = TRUE;
+    file->details->got_directory_count = TRUE;
+    nautilus_file_changed (file);
+
     if (error != NULL)
     {
         /* The load did not complete successfully. This means
@@ -1081,10 +1547,9 @@ directory_load_done (NautilusDirectory *directory,
          * they won't be marked "gone" later -- we don't know enough
          * about them to know whether they are really gone.
          */
-        for (node = directory->details->file_list;
-             node != NULL; node = node->next)
+        for (guint i = 0; i < directory->details->files->len; i++)
         {
-            set_file_unconfirmed (NAUTILUS_FILE (node->data), FALSE);
+            set_file_unconfirmed (g_ptr_array_index (directory->details->files, i), FALSE);
         }
 
         nautilus_directory_emit_load_error (directory, error);
@@ -1475,7 +1940,7 @@ new_files_callback (GObject      *source_object,
     info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
     if (info != NULL)
     {
-        directory_load_one (directory, info);
+        directory_load_one (directory, nautilus_file_record_new (info));
         g_object_unref (info);
     }
 
@@ -1570,21 +2035,29 @@ nautilus_async_destroying_file (NautilusFile *file)
     /* Check if it's a file that's currently being worked on.
      * If so, make that NULL so it gets canceled right away.
      */
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
     {
-        directory->details->count_in_progress->count_file = NULL;
-        changed = TRUE;
+        DirectoryCountState *count_state = find_directory_count_state (directory, file);
+
+        if (count_state != NULL)
+        {
+            count_state->count_file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->deep_count_file == file)
     {
         directory->details->deep_count_file = NULL;
         changed = TRUE;
     }
-    if (directory->details->get_info_file == file)
+
     {
-        directory->details->get_info_file = NULL;
-        changed = TRUE;
+        GetInfoState *get_info_state = find_get_info_state (directory, file);
+
+        if (get_info_state != NULL)
+        {
+            get_info_state->file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->extension_info_file == file)
     {
@@ -1592,25 +2065,34 @@ nautilus_async_destroying_file (NautilusFile *file)
         changed = TRUE;
     }
 
-    if (directory->details->thumbnail_state != NULL &&
-        directory->details->thumbnail_state->file == file)
     {
-        directory->details->thumbnail_state->file = NULL;
-        changed = TRUE;
+        ThumbnailState *thumbnail_state = find_thumbnail_state (directory, file);
+
+        if (thumbnail_state != NULL)
+        {
+            thumbnail_state->file = NULL;
+            changed = TRUE;
+        }
     }
 
-    if (directory->details->mount_state != NULL &&
-        directory->details->mount_state->file == file)
     {
-        directory->details->mount_state->file = NULL;
-        changed = TRUE;
+        MountState *mount_state = find_mount_state (directory, file);
+
+        if (mount_state != NULL)
+        {
+            mount_state->file = NULL;
+            changed = TRUE;
+        }
     }
 
-    if (directory->details->filesystem_info_state != NULL &&
-        directory->details->filesystem_info_state->file == file)
     {
-        directory->details->filesystem_info_state->file = NULL;
-        changed = TRUE;
+        FilesystemInfoState *filesystem_info_state = find_filesystem_info_state (directory, file);
+
+        if (filesystem_info_state != NULL)
+        {
+            filesystem_info_state->file = NULL;
+            changed = TRUE;
+        }
     }
 
     /* Let the directory take care of the rest. */
@@ -1691,16 +2173,14 @@ has_problem (NautilusDirectory *directory,
              NautilusFile      *file,
              FileCheck          problem)
 {
-    GList *node;
-
     if (file != NULL)
     {
         return (*problem)(file);
     }
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (guint i = 0; i < directory->details->files->len; i++)
     {
-        if ((*problem)(node->data))
+        if ((*problem)(g_ptr_array_index (directory->details->files, i)))
         {
             return TRUE;
         }
@@ -1938,13 +2418,9 @@ nautilus_directory_is_file_list_monitored (NautilusDirectory *directory)
 static void
 mark_all_files_unconfirmed (NautilusDirectory *directory)
 {
-    GList *node;
-    NautilusFile *file;
-
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (guint i = 0; i < directory->details->files->len; i++)
     {
-        file = node->data;
-        set_file_unconfirmed (file, TRUE);
+        set_file_unconfirmed (g_ptr_array_index (directory->details->files, i), TRUE);
     }
 }
 
@@ -1966,6 +2442,141 @@ directory_load_state_free (DirectoryLoadState *state)
     g_free (state);
 }
 
+static void more_files_callback (GObject      *source_object,
+                                 GAsyncResult *res,
+                                 gpointer      user_data);
+
+static void
+file_record_list_free (GList *records)
+{
+    g_list_free_full (records, (GDestroyNotify) nautilus_file_record_free);
+}
+
+static GList *
+file_records_from_infos (GList *infos)
+{
+    GList *records = NULL;
+
+    for (GList *l = infos; l != NULL; l = l->next)
+    {
+        records = g_list_prepend (records, nautilus_file_record_new (l->data));
+    }
+
+    return g_list_reverse (records);
+}
+
+static void
+prepare_files_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+    GFileEnumerator *enumerator = source_object;
+    GError *error = NULL;
+    GList *infos;
+
+    infos = g_file_enumerator_next_files (enumerator,
+                                          GPOINTER_TO_UINT (task_data),
+                                          cancellable, &error);
+    if (error != NULL)
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    g_task_return_pointer (task, file_records_from_infos (infos),
+                           (GDestroyNotify) file_record_list_free);
+    g_list_free_full (infos, g_object_unref);
+}
+
+static void
+directory_load_next_files (DirectoryLoadState *state)
+{
+    state->batch_requested = g_get_monotonic_time ();
+
+    if (state->prepare_in_thread)
+    {
+        g_autoptr (GTask) task = NULL;
+
+        task = g_task_new (state->enumerator, state->cancellable,
+                           more_files_callback, state);
+        g_task_set_source_tag (task, directory_load_next_files);
+        g_task_set_task_data (task, GUINT_TO_POINTER (state->batch_size), NULL);
+        g_task_run_in_thread (task, prepare_files_thread);
+        return;
+    }
+
+    g_file_enumerator_next_files_async (state->enumerator,
+                                        state->batch_size,
+                                        G_PRIORITY_DEFAULT,
+                                        state->cancellable,
+                                        more_files_callback,
+                                        state);
+}
+
+/* Returns the records for the next batch of entries, or %NULL at the end
+ * or on error.
+ */
+static GList *
+directory_load_next_files_finish (DirectoryLoadState  *state,
+                                  GAsyncResult        *res,
+                                  GError             **error)
+{
+    GList *infos;
+    GList *records;
+
+    if (state->prepare_in_thread)
+    {
+        return g_task_propagate_pointer (G_TASK (res), error);
+    }
+
+    infos = g_file_enumerator_next_files_finish (state->enumerator, res, error);
+    records = file_records_from_infos (infos);
+    g_list_free_full (infos, g_object_unref);
+
+    return records;
+}
+
+/**
+ * nautilus_directory_next_load_batch_size:
+ * @batch_size: how many entries the last batch asked for
+ * @n_files: how many entries the last batch got
+ * @round_trip_usec: how long the enumerator took to return them
+ *
+ * Picks the size of the next batch from how the last one went. Fewer,
+ * larger batches save main loop round trips on fast local disks and
+ * requests on remote backends, but files only show up once their whole
+ * batch is in, so slow enumerators get smaller batches. Adding the files
+ * to the directory is time sliced on its own.
+ *
+ * Returns: how many entries to ask for next
+ */
+guint
+nautilus_directory_next_load_batch_size (guint  batch_size,
+                                         guint  n_files,
+                                         gint64 round_trip_usec)
+{
+    guint affordable;
+
+    /* The number of entries that can be fetched within the budget. */
+    affordable = MIN ((gint64) n_files * DIRECTORY_LOAD_BATCH_BUDGET_USEC / MAX (round_trip_usec, 1),
+                      DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+
+    if (affordable < batch_size)
+    {
+        return MAX (affordable, DIRECTORY_LOAD_ITEMS_PER_CALLBACK);
+    }
+    else if (n_files == batch_size)
+    {
+        /* Only a full batch says there is more to come; grow gradually, as
+         * a single batch is a noisy measurement.
+         */
+        return MIN (affordable, batch_size * 2);
+    }
+
+    return batch_size;
+}
+
 static void
 more_files_callback (GObject      *source_object,
                      GAsyncResult *res,
@@ -1974,8 +2585,9 @@ more_files_callback (GObject      *source_object,
     DirectoryLoadState *state;
     NautilusDirectory *directory;
     GError *error;
-    GList *files, *l;
-    GFileInfo *info;
+    GList *records, *l;
+    guint n_files = 0;
+    gint64 round_trip_usec;
 
     state = user_data;
 
@@ -1992,29 +2604,28 @@ more_files_callback (GObject      *source_object,
     g_assert (directory->details->directory_load_in_progress == state);
 
     error = NULL;
-    files = g_file_enumerator_next_files_finish (state->enumerator,
-                                                 res, &error);
+    records = directory_load_next_files_finish (state, res, &error);
+    round_trip_usec = g_get_monotonic_time () - state->batch_requested;
 
-    for (l = files; l != NULL; l = l->next)
+    for (l = records; l != NULL; l = l->next)
     {
-        info = l->data;
-        directory_load_one (directory, info);
-        g_object_unref (info);
+        directory_load_one (directory, l->data);
+        n_files++;
     }
 
-    if (files == NULL)
+    if (records == NULL)
     {
         directory_load_done (directory, error);
         directory_load_state_free (state);
     }
     else
     {
-        g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-                                            G_PRIORITY_DEFAULT,
-                                            state->cancellable,
-                                            more_files_callback,
-                                            state);
+        g_debug ("Loaded %u entries in %" G_GINT64_FORMAT " us", n_files, round_trip_usec);
+
+        state->batch_size = nautilus_directory_next_load_batch_size (state->batch_size,
+                                                                     n_files,
+                                                                     round_trip_usec);
+        directory_load_next_files (state);
     }
 
     nautilus_directory_unref (directory);
@@ -2024,7 +2635,7 @@ more_files_callback (GObject      *source_object,
         g_error_free (error);
     }
 
-    g_list_free (files);
+    g_list_free (records);
 }
 
 static void
@@ -2059,12 +2670,7 @@ enumerate_children_callback (GObject      *source_object,
     else
     {
         state->enumerator = enumerator;
-        g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-                                            G_PRIORITY_DEFAULT,
-                                            state->cancellable,
-                                            more_files_callback,
-                                            state);
+        directory_load_next_files (state);
     }
 }
 
@@ -2079,7 +2685,7 @@ start_monitoring_file_list (NautilusDirectory *directory)
     {
         g_assert (!directory->details->directory_load_in_progress);
         directory->details->file_list_monitored = TRUE;
-        g_list_foreach (directory->details->file_list, (GFunc) nautilus_file_ref, NULL);
+        g_ptr_array_foreach (directory->details->files, (GFunc) nautilus_file_ref, NULL);
     }
 
     if (directory->details->directory_loaded ||
@@ -2099,6 +2705,11 @@ start_monitoring_file_list (NautilusDirectory *directory)
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
     state->load_file_count = 0;
+    state->batch_size = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
+    /* Local entries come in quickly enough that turning them into records
+     * would keep the main loop busy, so do that next to the enumeration.
+     */
+    state->prepare_in_thread = g_file_is_native (directory->details->location);
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2131,7 +2742,13 @@ nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 
     directory->details->file_list_monitored = FALSE;
     file_list_cancel (directory);
-    g_list_foreach (directory->details->file_list, (GFunc) nautilus_file_unref, NULL);
+    /* Dropping the last reference removes a file from the array, swapping
+     * the last file into its place, so go backwards.
+     */
+    for (guint i = directory->details->files->len; i-- > 0;)
+    {
+        nautilus_file_unref (g_ptr_array_index (directory->details->files, i));
+    }
     directory->details->directory_loaded = FALSE;
 }
 
@@ -2179,13 +2796,11 @@ static void
 nautilus_directory_invalidate_file_attributes (NautilusDirectory      *directory,
                                                NautilusFileAttributes  file_attributes)
 {
-    GList *node;
-
     cancel_loading_attributes (directory, file_attributes);
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (guint i = 0; i < directory->details->files->len; i++)
     {
-        nautilus_file_invalidate_attributes_internal (NAUTILUS_FILE (node->data),
+        nautilus_file_invalidate_attributes_internal (g_ptr_array_index (directory->details->files, i),
                                                       file_attributes);
     }
 
@@ -2318,10 +2933,15 @@ static void
 directory_count_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    GList *node, *next;
+    DirectoryCountState *state;
 
-    if (directory->details->count_in_progress != NULL)
+    for (node = directory->details->count_in_progress; node != NULL; node = next)
     {
-        file = directory->details->count_in_progress->count_file;
+        next = node->next;
+        state = node->data;
+
+        file = state->count_file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
@@ -2330,12 +2950,12 @@ directory_count_stop (NautilusDirectory *directory)
                           should_get_directory_count_now,
                           REQUEST_DIRECTORY_COUNT))
             {
-                return;
+                continue;
             }
         }
 
         /* The count is not wanted, so stop it. */
-        directory_count_cancel (directory);
+        directory_count_cancel_one (directory, state);
     }
 }
 
@@ -2359,11 +2979,13 @@ count_non_skipped_files (GList *list)
 }
 
 static void
-count_children_done (NautilusDirectory *directory,
-                     NautilusFile      *count_file,
-                     gboolean           succeeded,
-                     int                count)
+count_children_done (NautilusDirectory   *directory,
+                     DirectoryCountState *state,
+                     gboolean             succeeded,
+                     int                  count)
 {
+    NautilusFile *count_file = state->count_file;
+
     g_assert (NAUTILUS_IS_FILE (count_file));
 
     count_file->details->directory_count_is_up_to_date = TRUE;
@@ -2381,7 +3003,8 @@ count_children_done (NautilusDirectory *directory,
         count_file->details->got_directory_count = TRUE;
         count_file->details->directory_count = count;
     }
-    directory->details->count_in_progress = NULL;
+    directory->details->count_in_progress = g_list_remove (directory->details->count_in_progress,
+                                                           state);
 
     /* Send file-changed even if count failed, so interested parties can
      * distinguish between unknowable and not-yet-known cases.
@@ -2435,8 +3058,7 @@ count_more_files_callback (GObject      *source_object,
         return;
     }
 
-    g_assert (directory->details->count_in_progress != NULL);
-    g_assert (directory->details->count_in_progress == state);
+    g_assert (g_list_find (directory->details->count_in_progress, state) != NULL);
 
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
@@ -2446,7 +3068,7 @@ count_more_files_callback (GObject      *source_object,
 
     if (files == NULL)
     {
-        count_children_done (directory, state->count_file,
+        count_children_done (directory, state,
                              TRUE, state->file_count);
         directory_count_state_free (state);
     }
@@ -2500,7 +3122,7 @@ count_children_callback (GObject      *source_object,
     if (enumerator == NULL)
     {
         count_children_done (state->directory,
-                             state->count_file,
+                             state,
                              FALSE, 0);
         g_error_free (error);
         directory_count_state_free (state);
@@ -2526,7 +3148,7 @@ directory_count_start (NautilusDirectory *directory,
     DirectoryCountState *state;
     GFile *location;
 
-    if (directory->details->count_in_progress != NULL)
+    if (find_directory_count_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -2550,7 +3172,8 @@ directory_count_start (NautilusDirectory *directory,
         return;
     }
 
-    if (!async_job_start (directory, "directory count"))
+    if (pipeline_is_full (directory->details->count_in_progress, REQUEST_DIRECTORY_COUNT) ||
+        !async_job_start (directory, "directory count"))
     {
         return;
     }
@@ -2561,7 +3184,8 @@ directory_count_start (NautilusDirectory *directory,
     state->directory = nautilus_directory_ref (directory);
     state->cancellable = g_cancellable_new ();
 
-    directory->details->count_in_progress = state;
+    directory->details->count_in_progress = g_list_prepend (directory->details->count_in_progress,
+                                                            state);
 
     location = nautilus_file_get_location (file);
 
@@ -2583,153 +3207,209 @@ directory_count_start (NautilusDirectory *directory,
     g_object_unref (location);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-            GFileInfo      *info)
+static guint
+deep_count_inode_hash (gconstpointer key)
 {
-    guint64 inode, inode2;
-    guint i;
+    const DeepCountInode *id = key;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    return (guint) (id->inode ^ (id->inode >> 32) ^ (id->device * 31));
+}
 
-    if (inode != 0)
-    {
-        for (i = 0; i < state->seen_deep_count_inodes->len; i++)
-        {
-            inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-            if (inode == inode2)
-            {
-                return TRUE;
-            }
-        }
-    }
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+                        gconstpointer b)
+{
+    const DeepCountInode *id_a = a;
+    const DeepCountInode *id_b = b;
 
-    return FALSE;
+    return id_a->inode == id_b->inode && id_a->device == id_b->device;
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-                    GFileInfo      *info)
+/* Returns TRUE if the size of this entry was already accounted for via
+ * another hard link. Only entries that can actually be hard links (i.e.
+ * non-directories with more than one link) are tracked, so the set stays
+ * small for ordinary trees and each lookup is O(1).
+ */
+static gboolean
+check_and_mark_inode_as_seen (DeepCountState *state,
+                              GFileInfo      *info)
 {
-    guint64 inode;
+    DeepCountInode *id;
+
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY ||
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) <= 1)
+    {
+        return FALSE;
+    }
+
+    id = g_new (DeepCountInode, 1);
+    id->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    id->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-    if (inode != 0)
+    if (id->inode == 0)
     {
-        g_array_append_val (state->seen_deep_count_inodes, inode);
+        g_free (id);
+        return FALSE;
     }
+
+    /* If an equal key is present, g_hash_table_add() swaps in the new one
+     * and frees the old one, so nothing leaks either way. */
+    return !g_hash_table_add (state->seen_deep_count_inodes, id);
 }
 
 static void
-deep_count_one (DeepCountState *state,
-                GFileInfo      *info)
+deep_count_one (DeepCountWorker *worker,
+                GFileInfo       *info)
 {
-    NautilusFile *file;
+    DeepCountState *state;
     GFile *subdir;
     gboolean is_seen_inode;
     const char *fs_id;
 
-    is_seen_inode = seen_inode (state, info);
-    if (!is_seen_inode)
-    {
-        mark_inode_as_seen (state, info);
-    }
-
-    file = state->directory->details->deep_count_file;
+    state = worker->state;
+    is_seen_inode = check_and_mark_inode_as_seen (state, info);
 
     if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
     {
         /* Count the directory. */
-        file->details->deep_directory_count += 1;
+        worker->directory_count += 1;
+        worker->own_directory_count += 1;
 
         /* Record the fact that we have to descend into this directory. */
         fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
         if (g_strcmp0 (fs_id, state->fs_id) == 0)
         {
             /* only if it is on the same filesystem */
-            subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
+            subdir = g_file_get_child (worker->location, g_file_info_get_name (info));
             state->deep_count_subdirectories = g_list_prepend
                                                    (state->deep_count_subdirectories, subdir);
+            if (worker->subdirectory_names != NULL)
+            {
+                g_ptr_array_add (worker->subdirectory_names,
+                                 g_strdup (g_file_info_get_name (info)));
+            }
         }
     }
     else
     {
         /* Even non-regular files count as files. */
-        file->details->deep_file_count += 1;
+        worker->file_count += 1;
+        worker->own_file_count += 1;
+
+        /* Hard link dedup spans directories, so a cached total for this
+         * directory could count sizes that the rest of the tree also counts.
+         */
+        if (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) > 1)
+        {
+            worker->cacheable = FALSE;
+        }
     }
 
     /* Count the size. */
     if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
     {
-        file->details->deep_size += g_file_info_get_size (info);
+        worker->size += g_file_info_get_size (info);
+        worker->own_size += g_file_info_get_size (info);
     }
 }
 
 static void
 deep_count_state_free (DeepCountState *state)
 {
-    if (state->enumerator)
+    g_assert (state->n_workers == 0);
+
+    g_object_unref (state->cancellable);
+    g_list_free_full (state->deep_count_subdirectories, g_object_unref);
+    g_hash_table_destroy (state->seen_deep_count_inodes);
+    g_free (state->fs_id);
+    g_free (state);
+}
+
+static void
+deep_count_worker_free (DeepCountWorker *worker)
+{
+    if (worker->enumerator)
     {
-        if (!g_file_enumerator_is_closed (state->enumerator))
+        if (!g_file_enumerator_is_closed (worker->enumerator))
         {
-            g_file_enumerator_close_async (state->enumerator,
+            g_file_enumerator_close_async (worker->enumerator,
                                            0, NULL, NULL, NULL);
         }
-        g_object_unref (state->enumerator);
+        g_object_unref (worker->enumerator);
     }
-    g_object_unref (state->cancellable);
-    if (state->deep_count_location)
+    g_object_unref (worker->location);
+    g_clear_pointer (&worker->subdirectory_names, g_ptr_array_unref);
+
+    worker->state->n_workers -= 1;
+    g_free (worker);
+}
+
+static void
+deep_count_worker_cancelled (DeepCountWorker *worker)
+{
+    DeepCountState *state;
+
+    state = worker->state;
+    deep_count_worker_free (worker);
+
+    /* The last worker to notice the cancellation frees the shared state. */
+    if (state->n_workers == 0)
     {
-        g_object_unref (state->deep_count_location);
+        deep_count_state_free (state);
     }
-    g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-    g_array_free (state->seen_deep_count_inodes, TRUE);
-    g_free (state->fs_id);
-    g_free (state);
 }
 
 static void
-deep_count_next_dir (DeepCountState *state)
+deep_count_worker_merge (DeepCountWorker *worker)
 {
-    GFile *location;
     NautilusFile *file;
-    NautilusDirectory *directory;
-    gboolean done;
 
-    directory = state->directory;
+    file = worker->state->directory->details->deep_count_file;
 
-    g_object_unref (state->deep_count_location);
-    state->deep_count_location = NULL;
+    file->details->deep_directory_count += worker->directory_count;
+    file->details->deep_file_count += worker->file_count;
+    file->details->deep_unreadable_count += worker->unreadable_count;
+    file->details->deep_size += worker->size;
 
-    done = FALSE;
-    file = directory->details->deep_count_file;
+    worker->directory_count = 0;
+    worker->file_count = 0;
+    worker->unreadable_count = 0;
+    worker->size = 0;
+}
 
-    if (state->deep_count_subdirectories != NULL)
-    {
-        /* Work on a new directory. */
-        location = state->deep_count_subdirectories->data;
-        state->deep_count_subdirectories = g_list_remove
-                                               (state->deep_count_subdirectories, location);
-        deep_count_load (state, location);
-        g_object_unref (location);
-    }
-    else
+static void
+deep_count_worker_store_in_cache (DeepCountWorker *worker)
+{
+    g_autofree char *path = NULL;
+
+    if (!worker->cacheable)
     {
-        file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
-        directory->details->deep_count_file = NULL;
-        directory->details->deep_count_in_progress = NULL;
-        deep_count_state_free (state);
-        done = TRUE;
+        return;
     }
 
-    nautilus_file_updated_deep_count_in_progress (file);
+    path = g_file_get_path (worker->location);
+    g_ptr_array_add (worker->subdirectory_names, NULL);
+    nautilus_deep_count_cache_store (path,
+                                     worker->mtime,
+                                     worker->ctime,
+                                     worker->inode,
+                                     worker->own_directory_count,
+                                     worker->own_file_count,
+                                     worker->own_size,
+                                     (const char **) worker->subdirectory_names->pdata);
+}
 
-    if (done)
-    {
-        nautilus_file_changed (file);
-        async_job_end (directory, "deep count");
-        nautilus_directory_async_state_changed (directory);
-    }
+static void
+deep_count_worker_done (DeepCountWorker *worker)
+{
+    DeepCountState *state;
+
+    state = worker->state;
+
+    deep_count_worker_merge (worker);
+    deep_count_worker_free (worker);
+
+    deep_count_schedule (state);
 }
 
 static void
@@ -2737,17 +3417,20 @@ deep_count_more_files_callback (GObject      *source_object,
                                 GAsyncResult *res,
                                 gpointer      user_data)
 {
+    DeepCountWorker *worker;
     DeepCountState *state;
     NautilusDirectory *directory;
     GList *files, *l;
     GFileInfo *info;
+    g_autoptr (GError) error = NULL;
 
-    state = user_data;
+    worker = user_data;
+    state = worker->state;
 
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
-        deep_count_state_free (state);
+        deep_count_worker_cancelled (worker);
         return;
     }
 
@@ -2756,32 +3439,37 @@ deep_count_more_files_callback (GObject      *source_object,
     g_assert (directory->details->deep_count_in_progress != NULL);
     g_assert (directory->details->deep_count_in_progress == state);
 
-    files = g_file_enumerator_next_files_finish (state->enumerator,
-                                                 res, NULL);
+    files = g_file_enumerator_next_files_finish (worker->enumerator,
+                                                 res, &error);
 
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
-        deep_count_one (state, info);
+        deep_count_one (worker, info);
         g_object_unref (info);
     }
 
     if (files == NULL)
     {
-        g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-        g_object_unref (state->enumerator);
-        state->enumerator = NULL;
+        g_file_enumerator_close_async (worker->enumerator, 0, NULL, NULL, NULL);
+        g_object_unref (worker->enumerator);
+        worker->enumerator = NULL;
 
-        deep_count_next_dir (state);
+        if (error == NULL)
+        {
+            deep_count_worker_store_in_cache (worker);
+        }
+        deep_count_worker_done (worker);
     }
     else
     {
-        g_file_enumerator_next_files_async (state->enumerator,
+        deep_count_worker_merge (worker);
+        g_file_enumerator_next_files_async (worker->enumerator,
                                             DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
-                                            state);
+                                            worker);
     }
 
     g_list_free (files);
@@ -2794,62 +3482,232 @@ deep_count_callback (GObject      *source_object,
                      GAsyncResult *res,
                      gpointer      user_data)
 {
+    DeepCountWorker *worker;
     DeepCountState *state;
     GFileEnumerator *enumerator;
-    NautilusFile *file;
 
-    state = user_data;
+    worker = user_data;
+    state = worker->state;
 
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
-        deep_count_state_free (state);
+        deep_count_worker_cancelled (worker);
         return;
     }
 
-    file = state->directory->details->deep_count_file;
-
     enumerator = g_file_enumerate_children_finish (G_FILE (source_object), res, NULL);
 
     if (enumerator == NULL)
     {
-        file->details->deep_unreadable_count += 1;
+        worker->unreadable_count += 1;
 
-        deep_count_next_dir (state);
+        deep_count_worker_done (worker);
     }
     else
     {
-        state->enumerator = enumerator;
-        g_file_enumerator_next_files_async (state->enumerator,
+        worker->enumerator = enumerator;
+        g_file_enumerator_next_files_async (worker->enumerator,
                                             DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
-                                            state);
+                                            worker);
     }
 }
 
 
 static void
-deep_count_load (DeepCountState *state,
-                 GFile          *location)
+deep_count_enumerate (DeepCountWorker *worker)
 {
-    state->deep_count_location = g_object_ref (location);
-
-    g_debug ("load_directory called to get deep file count for %p", location);
-    g_file_enumerate_children_async (state->deep_count_location,
+    g_debug ("load_directory called to get deep file count for %p", worker->location);
+    g_file_enumerate_children_async (worker->location,
                                      G_FILE_ATTRIBUTE_STANDARD_NAME ","
                                      G_FILE_ATTRIBUTE_STANDARD_TYPE ","
                                      G_FILE_ATTRIBUTE_STANDARD_SIZE ","
                                      G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
                                      G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
                                      G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-                                     G_FILE_ATTRIBUTE_UNIX_INODE,
+                                     G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+                                     G_FILE_ATTRIBUTE_UNIX_INODE ","
+                                     G_FILE_ATTRIBUTE_UNIX_NLINK,
                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
                                      G_PRIORITY_LOW,     /* prio */
-                                     state->cancellable,
+                                     worker->state->cancellable,
                                      deep_count_callback,
-                                     state);
+                                     worker);
+}
+
+static gboolean
+deep_count_use_cache (DeepCountWorker *worker)
+{
+    DeepCountState *state;
+    g_autofree char *path = NULL;
+    g_auto (GStrv) subdirectories = NULL;
+    guint directory_count;
+    guint file_count;
+    goffset size;
+
+    state = worker->state;
+    path = g_file_get_path (worker->location);
+
+    if (!nautilus_deep_count_cache_lookup (path, worker->mtime, worker->ctime, worker->inode,
+                                           &directory_count, &file_count, &size,
+                                           &subdirectories))
+    {
+        return FALSE;
+    }
+
+    worker->directory_count += directory_count;
+    worker->file_count += file_count;
+    worker->size += size;
+
+    /* The subdirectories may have changed even though this one didn't. */
+    for (guint i = 0; subdirectories[i] != NULL; i++)
+    {
+        state->deep_count_subdirectories = g_list_prepend
+                                               (state->deep_count_subdirectories,
+                                               g_file_get_child (worker->location,
+                                                                 subdirectories[i]));
+    }
+
+    return TRUE;
+}
+
+static void
+deep_count_got_directory_info (GObject      *source_object,
+                               GAsyncResult *res,
+                               gpointer      user_data)
+{
+    DeepCountWorker *worker;
+    DeepCountState *state;
+    g_autoptr (GFileInfo) info = NULL;
+    const char *fs_id;
+
+    worker = user_data;
+    state = worker->state;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        deep_count_worker_cancelled (worker);
+        return;
+    }
+
+    info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+    if (info != NULL)
+    {
+        /* Something may have been mounted here since the cache was written. */
+        fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+        if (state->fs_id != NULL && g_strcmp0 (fs_id, state->fs_id) != 0)
+        {
+            deep_count_worker_done (worker);
+            return;
+        }
+
+        if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_INODE) &&
+            g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) &&
+            g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_CHANGED))
+        {
+            worker->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+                            g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+            worker->ctime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_CHANGED) * G_USEC_PER_SEC +
+                            g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_CHANGED_USEC);
+            worker->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+
+            if (deep_count_use_cache (worker))
+            {
+                deep_count_worker_done (worker);
+                return;
+            }
+
+            worker->cacheable = TRUE;
+            worker->subdirectory_names = g_ptr_array_new_with_free_func (g_free);
+        }
+    }
+
+    deep_count_enumerate (worker);
+}
+
+static void
+deep_count_load (DeepCountState *state,
+                 GFile          *location)
+{
+    DeepCountWorker *worker;
+
+    worker = g_new0 (DeepCountWorker, 1);
+    worker->state = state;
+    worker->location = g_object_ref (location);
+    state->n_workers += 1;
+
+    if (!g_file_is_native (location))
+    {
+        deep_count_enumerate (worker);
+        return;
+    }
+
+    /* Local directories that haven't changed since they were last counted
+     * are summed from the cache instead of being enumerated. Their
+     * modification and change times are read before enumerating, so changes
+     * made during the enumeration invalidate the stored entry.
+     */
+    g_file_query_info_async (worker->location,
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                             G_FILE_ATTRIBUTE_TIME_CHANGED ","
+                             G_FILE_ATTRIBUTE_TIME_CHANGED_USEC ","
+                             G_FILE_ATTRIBUTE_UNIX_INODE ","
+                             G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                             G_PRIORITY_LOW,
+                             state->cancellable,
+                             deep_count_got_directory_info,
+                             worker);
+}
+
+/* Keeps up to DEEP_COUNT_MAX_WORKERS directories being enumerated at once,
+ * and finishes the count once there is nothing left to enumerate.
+ */
+static void
+deep_count_schedule (DeepCountState *state)
+{
+    GFile *location;
+    NautilusFile *file;
+    NautilusDirectory *directory;
+    gboolean done;
+
+    directory = state->directory;
+    file = directory->details->deep_count_file;
+
+    while (state->n_workers < DEEP_COUNT_MAX_WORKERS &&
+           state->deep_count_subdirectories != NULL)
+    {
+        /* Work on a new directory. */
+        location = state->deep_count_subdirectories->data;
+        state->deep_count_subdirectories = g_list_delete_link
+                                               (state->deep_count_subdirectories,
+                                               state->deep_count_subdirectories);
+        deep_count_load (state, location);
+        g_object_unref (location);
+    }
+
+    done = (state->n_workers == 0);
+    if (done)
+    {
+        file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
+        directory->details->deep_count_file = NULL;
+        directory->details->deep_count_in_progress = NULL;
+        deep_count_state_free (state);
+    }
+
+    nautilus_file_updated_deep_count_in_progress (file);
+
+    if (done)
+    {
+        nautilus_file_changed (file);
+        async_job_end (directory, "deep count");
+        nautilus_directory_async_state_changed (directory);
+    }
 }
 
 static void
@@ -2887,6 +3745,19 @@ deep_count_got_info (GObject      *source_object,
     GFile *file = (GFile *) source_object;
     DeepCountState *state = (DeepCountState *) user_data;
 
+    /* The filesystem query holds a worker slot until it returns. */
+    state->n_workers -= 1;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        if (state->n_workers == 0)
+        {
+            deep_count_state_free (state);
+        }
+        return;
+    }
+
     info = g_file_query_info_finish (file, res, NULL);
     if (info != NULL)
     {
@@ -2907,7 +3778,11 @@ deep_count_start (NautilusDirectory *directory,
 
     if (directory->details->deep_count_in_progress != NULL)
     {
-        *doing_io = TRUE;
+        if (directory->details->deep_count_file == file ||
+            is_needy (file, lacks_deep_count, REQUEST_DEEP_COUNT))
+        {
+            *doing_io = TRUE;
+        }
         return;
     }
 
@@ -2943,8 +3818,11 @@ deep_count_start (NautilusDirectory *directory,
     state = g_new0 (DeepCountState, 1);
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
-    state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+    state->seen_deep_count_inodes = g_hash_table_new_full (deep_count_inode_hash,
+                                                           deep_count_inode_equal,
+                                                           g_free, NULL);
     state->fs_id = NULL;
+    state->n_workers = 1;
 
     directory->details->deep_count_in_progress = state;
 
@@ -2988,11 +3866,11 @@ query_info_callback (GObject      *source_object,
 
     directory = nautilus_directory_ref (state->directory);
 
-    get_info_file = directory->details->get_info_file;
+    get_info_file = state->file;
     g_assert (NAUTILUS_IS_FILE (get_info_file));
 
-    directory->details->get_info_file = NULL;
-    directory->details->get_info_in_progress = NULL;
+    directory->details->get_info_states = g_list_remove (directory->details->get_info_states,
+                                                         state);
 
     /* ref here because we might be removing the last ref when we
      * mark the file gone below, but we need to keep a ref at
@@ -3036,22 +3914,27 @@ static void
 file_info_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    GList *node, *next;
+    GetInfoState *state;
 
-    if (directory->details->get_info_in_progress != NULL)
+    for (node = directory->details->get_info_states; node != NULL; node = next)
     {
-        file = directory->details->get_info_file;
+        next = node->next;
+        state = node->data;
+
+        file = state->file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
             g_assert (file->details->directory == directory);
             if (is_needy (file, lacks_info, REQUEST_FILE_INFO))
             {
-                return;
+                continue;
             }
         }
 
         /* The info is not wanted, so stop it. */
-        file_info_cancel (directory);
+        file_info_cancel_one (directory, state);
     }
 }
 
@@ -3063,9 +3946,7 @@ file_info_start (NautilusDirectory *directory,
     GFile *location;
     GetInfoState *state;
 
-    file_info_stop (directory);
-
-    if (directory->details->get_info_in_progress != NULL)
+    if (find_get_info_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3077,12 +3958,12 @@ file_info_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "file info"))
+    if (pipeline_is_full (directory->details->get_info_states, REQUEST_FILE_INFO) ||
+        !async_job_start (directory, "file info"))
     {
         return;
     }
 
-    directory->details->get_info_file = file;
     file->details->get_info_failed = FALSE;
     if (file->details->get_info_error)
     {
@@ -3090,11 +3971,13 @@ file_info_start (NautilusDirectory *directory,
         file->details->get_info_error = NULL;
     }
 
-    state = g_new (GetInfoState, 1);
+    state = g_new0 (GetInfoState, 1);
     state->directory = directory;
+    state->file = file;
     state->cancellable = g_cancellable_new ();
 
-    directory->details->get_info_in_progress = state;
+    directory->details->get_info_states = g_list_prepend (directory->details->get_info_states,
+                                                          state);
 
     location = nautilus_file_get_location (file);
     g_file_query_info_async (location,
@@ -3122,11 +4005,15 @@ static void
 thumbnail_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    GList *node, *next;
+    ThumbnailState *state;
 
-    if (directory->details->thumbnail_state != NULL)
+    for (node = directory->details->thumbnail_states; node != NULL; node = next)
     {
-        file = directory->details->thumbnail_state->file;
+        next = node->next;
+        state = node->data;
 
+        file = state->file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
@@ -3135,12 +4022,12 @@ thumbnail_stop (NautilusDirectory *directory)
                           lacks_thumbnail,
                           REQUEST_THUMBNAIL))
             {
-                return;
+                continue;
             }
         }
 
         /* The link info is not wanted, so stop it. */
-        thumbnail_cancel (directory);
+        thumbnail_cancel_one (directory, state);
     }
 }
 
@@ -3276,7 +4163,8 @@ thumbnail_read_callback (GObject      *source_object,
         g_free (file_contents);
     }
 
-    state->directory->details->thumbnail_state = NULL;
+    state->directory->details->thumbnail_states = g_list_remove (state->directory->details->thumbnail_states,
+                                                                 state);
     async_job_end (state->directory, "thumbnail");
 
     thumbnail_got_pixbuf (state->directory, state->file, pixbuf);
@@ -3294,7 +4182,7 @@ thumbnail_start (NautilusDirectory *directory,
     GFile *location;
     ThumbnailState *state;
 
-    if (directory->details->thumbnail_state != NULL)
+    if (find_thumbnail_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3308,7 +4196,8 @@ thumbnail_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "thumbnail"))
+    if (pipeline_is_full (directory->details->thumbnail_states, REQUEST_THUMBNAIL) ||
+        !async_job_start (directory, "thumbnail"))
     {
         return;
     }
@@ -3320,7 +4209,8 @@ thumbnail_start (NautilusDirectory *directory,
 
     location = g_file_new_for_path (file->details->thumbnail_path);
 
-    directory->details->thumbnail_state = state;
+    directory->details->thumbnail_states = g_list_prepend (directory->details->thumbnail_states,
+                                                           state);
 
     g_file_load_contents_async (location,
                                 state->cancellable,
@@ -3333,11 +4223,15 @@ static void
 mount_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    GList *node, *next;
+    MountState *state;
 
-    if (directory->details->mount_state != NULL)
+    for (node = directory->details->mount_states; node != NULL; node = next)
     {
-        file = directory->details->mount_state->file;
+        next = node->next;
+        state = node->data;
 
+        file = state->file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
@@ -3346,12 +4240,12 @@ mount_stop (NautilusDirectory *directory)
                           lacks_mount,
                           REQUEST_MOUNT))
             {
-                return;
+                continue;
             }
         }
 
         /* The link info is not wanted, so stop it. */
-        mount_cancel (directory);
+        mount_cancel_one (directory, state);
     }
 }
 
@@ -3371,7 +4265,8 @@ got_mount (MountState *state,
 
     directory = nautilus_directory_ref (state->directory);
 
-    state->directory->details->mount_state = NULL;
+    state->directory->details->mount_states = g_list_remove (state->directory->details->mount_states,
+                                                             state);
     async_job_end (state->directory, "mount");
 
     file = nautilus_file_ref (state->file);
@@ -3438,7 +4333,7 @@ mount_start (NautilusDirectory *directory,
     GFile *location;
     MountState *state;
 
-    if (directory->details->mount_state != NULL)
+    if (find_mount_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3452,7 +4347,8 @@ mount_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "mount"))
+    if (pipeline_is_full (directory->details->mount_states, REQUEST_MOUNT) ||
+        !async_job_start (directory, "mount"))
     {
         return;
     }
@@ -3464,7 +4360,8 @@ mount_start (NautilusDirectory *directory,
 
     location = nautilus_file_get_location (file);
 
-    directory->details->mount_state = state;
+    directory->details->mount_states = g_list_prepend (directory->details->mount_states,
+                                                       state);
 
     if (file->details->type == G_FILE_TYPE_MOUNTABLE)
     {
@@ -3497,15 +4394,23 @@ mount_start (NautilusDirectory *directory,
     g_object_unref (location);
 }
 
+static void
+filesystem_info_cancel_one (NautilusDirectory   *directory,
+                            FilesystemInfoState *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    directory->details->filesystem_info_states = g_list_remove (directory->details->filesystem_info_states,
+                                                                state);
+    async_job_end (directory, "filesystem info");
+}
+
 static void
 filesystem_info_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->filesystem_info_state != NULL)
+    while (directory->details->filesystem_info_states != NULL)
     {
-        g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
-        directory->details->filesystem_info_state->directory = NULL;
-        directory->details->filesystem_info_state = NULL;
-        async_job_end (directory, "filesystem info");
+        filesystem_info_cancel_one (directory, directory->details->filesystem_info_states->data);
     }
 }
 
@@ -3513,11 +4418,15 @@ static void
 filesystem_info_stop (NautilusDirectory *directory)
 {
     NautilusFile *file;
+    GList *node, *next;
+    FilesystemInfoState *state;
 
-    if (directory->details->filesystem_info_state != NULL)
+    for (node = directory->details->filesystem_info_states; node != NULL; node = next)
     {
-        file = directory->details->filesystem_info_state->file;
+        next = node->next;
+        state = node->data;
 
+        file = state->file;
         if (file != NULL)
         {
             g_assert (NAUTILUS_IS_FILE (file));
@@ -3526,12 +4435,12 @@ filesystem_info_stop (NautilusDirectory *directory)
                           lacks_filesystem_info,
                           REQUEST_FILESYSTEM_INFO))
             {
-                return;
+                continue;
             }
         }
 
         /* The filesystem info is not wanted, so stop it. */
-        filesystem_info_cancel (directory);
+        filesystem_info_cancel_one (directory, state);
     }
 }
 
@@ -3553,7 +4462,8 @@ got_filesystem_info (FilesystemInfoState *state,
 
     directory = nautilus_directory_ref (state->directory);
 
-    state->directory->details->filesystem_info_state = NULL;
+    state->directory->details->filesystem_info_states = g_list_remove (state->directory->details->filesystem_info_states,
+                                                                       state);
     async_job_end (state->directory, "filesystem info");
 
     file = nautilus_file_ref (state->file);
@@ -3612,7 +4522,7 @@ filesystem_info_start (NautilusDirectory *directory,
     GFile *location;
     FilesystemInfoState *state;
 
-    if (directory->details->filesystem_info_state != NULL)
+    if (find_filesystem_info_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3626,7 +4536,8 @@ filesystem_info_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "filesystem info"))
+    if (pipeline_is_full (directory->details->filesystem_info_states, REQUEST_FILESYSTEM_INFO) ||
+        !async_job_start (directory, "filesystem info"))
     {
         return;
     }
@@ -3638,7 +4549,8 @@ filesystem_info_start (NautilusDirectory *directory,
 
     location = nautilus_file_get_location (file);
 
-    directory->details->filesystem_info_state = state;
+    directory->details->filesystem_info_states = g_list_prepend (directory->details->filesystem_info_states,
+                                                                 state);
 
     g_file_query_filesystem_info_async (location,
                                         G_FILE_ATTRIBUTE_FILESYSTEM_READONLY ","
@@ -3846,40 +4758,94 @@ start_or_stop_io (NautilusDirectory *directory)
     filesystem_info_stop (directory);
 
     doing_io = FALSE;
-    /* Take files that are all done off the queue. */
+    /* Take files that are all done off the queue. Several files from the
+     * head are worked on at once, so that file info can be fetched for as
+     * many files as its pipeline allows.
+     */
     while (!nautilus_hash_queue_is_empty (directory->details->high_priority_queue))
     {
-        file = nautilus_hash_queue_peek_head (directory->details->high_priority_queue);
+        g_autolist (NautilusFile) files = NULL;
+        gboolean any_doing_io = FALSE;
 
-        /* Start getting attributes if possible */
-        file_info_start (directory, file, &doing_io);
+        files = nautilus_hash_queue_peek_head_n (directory->details->high_priority_queue,
+                                                 QUEUE_LOOKAHEAD);
+        g_list_foreach (files, (GFunc) nautilus_file_ref, NULL);
 
-        if (doing_io)
+        for (GList *l = files; l != NULL; l = l->next)
         {
-            return;
+            file = l->data;
+
+            /* Starting one file may have finished or dropped another. */
+            if (nautilus_hash_queue_find_item (directory->details->high_priority_queue,
+                                               file) == NULL)
+            {
+                continue;
+            }
+
+            /* Start getting attributes if possible */
+            doing_io = FALSE;
+            file_info_start (directory, file, &doing_io);
+
+            if (doing_io)
+            {
+                any_doing_io = TRUE;
+                continue;
+            }
+
+            move_file_to_low_priority_queue (directory, file);
         }
 
-        move_file_to_low_priority_queue (directory, file);
+        if (any_doing_io)
+        {
+            return;
+        }
     }
 
-    /* High priority queue must be empty */
+    /* High priority queue must be empty. Several files from the head of
+     * the low priority queue are worked on at once, so that each kind of
+     * attribute can be fetched for as many files as its pipeline allows.
+     */
     while (!nautilus_hash_queue_is_empty (directory->details->low_priority_queue))
     {
-        file = nautilus_hash_queue_peek_head (directory->details->low_priority_queue);
+        g_autolist (NautilusFile) files = NULL;
+        gboolean any_doing_io = FALSE;
 
-        /* Start getting attributes if possible */
-        mount_start (directory, file, &doing_io);
-        directory_count_start (directory, file, &doing_io);
-        deep_count_start (directory, file, &doing_io);
-        thumbnail_start (directory, file, &doing_io);
-        filesystem_info_start (directory, file, &doing_io);
+        files = nautilus_hash_queue_peek_head_n (directory->details->low_priority_queue,
+                                                 QUEUE_LOOKAHEAD);
+        g_list_foreach (files, (GFunc) nautilus_file_ref, NULL);
 
-        if (doing_io)
+        for (GList *l = files; l != NULL; l = l->next)
         {
-            return;
+            file = l->data;
+
+            /* Starting one file may have finished or dropped another. */
+            if (nautilus_hash_queue_find_item (directory->details->low_priority_queue,
+                                               file) == NULL)
+            {
+                continue;
+            }
+
+            /* Start getting attributes if possible */
+            doing_io = FALSE;
+            mount_start (directory, file, &doing_io);
+            directory_count_start (directory, file, &doing_io);
+            deep_count_start (directory, file, &doing_io);
+            thumbnail_start (directory, file, &doing_io);
+            filesystem_info_start (directory, file, &doing_io);
+
+            if (doing_io)
+            {
+                any_doing_io = TRUE;
+                continue;
+            }
+
+            move_file_to_extension_queue (directory, file);
         }
 
-        move_file_to_extension_queue (directory, file);
+        if (any_doing_io)
+        {
+            return;
+        }
     }
 
     /* Low priority queue must be empty */
@@ -3951,10 +4917,7 @@ nautilus_directory_cancel (NautilusDirectory *directory)
     filesystem_info_cancel (directory);
 
     /* We aren't waiting for anything any more. */
-    if (waiting_directories != NULL)
-    {
-        g_hash_table_remove (waiting_directories, directory);
-    }
+    async_job_stop_waiting (directory);
 
     /* Check if any directories should wake up. */
     async_job_wake_up ();
@@ -3964,10 +4927,11 @@ static void
 cancel_directory_count_for_file (NautilusDirectory *directory,
                                  NautilusFile      *file)
 {
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
+    DirectoryCountState *state = find_directory_count_state (directory, file);
+
+    if (state != NULL)
     {
-        directory_count_cancel (directory);
+        directory_count_cancel_one (directory, state);
     }
 }
 
@@ -3985,9 +4949,11 @@ static void
 cancel_file_info_for_file (NautilusDirectory *directory,
                            NautilusFile      *file)
 {
-    if (directory->details->get_info_file == file)
+    GetInfoState *state = find_get_info_state (directory, file);
+
+    if (state != NULL)
     {
-        file_info_cancel (directory);
+        file_info_cancel_one (directory, state);
     }
 }
 
@@ -3995,10 +4961,11 @@ static void
 cancel_thumbnail_for_file (NautilusDirectory *directory,
                            NautilusFile      *file)
 {
-    if (directory->details->thumbnail_state != NULL &&
-        directory->details->thumbnail_state->file == file)
+    ThumbnailState *state = find_thumbnail_state (directory, file);
+
+    if (state != NULL)
     {
-        thumbnail_cancel (directory);
+        thumbnail_cancel_one (directory, state);
     }
 }
 
@@ -4006,10 +4973,11 @@ static void
 cancel_mount_for_file (NautilusDirectory *directory,
                        NautilusFile      *file)
 {
-    if (directory->details->mount_state != NULL &&
-        directory->details->mount_state->file == file)
+    MountState *state = find_mount_state (directory, file);
+
+    if (state != NULL)
     {
-        mount_cancel (directory);
+        mount_cancel_one (directory, state);
     }
 }
 
@@ -4017,10 +4985,11 @@ static void
 cancel_filesystem_info_for_file (NautilusDirectory *directory,
                                  NautilusFile      *file)
 {
-    if (directory->details->filesystem_info_state != NULL &&
-        directory->details->filesystem_info_state->file == file)
+    FilesystemInfoState *state = find_filesystem_info_state (directory, file);
+
+    if (state != NULL)
     {
-        filesystem_info_cancel (directory);
+        filesystem_info_cancel_one (directory, state);
     }
 }
 
@@ -4119,14 +5088,10 @@ nautilus_directory_add_file_to_work_queue (NautilusDirectory *directory,
 static void
 add_all_files_to_work_queue (NautilusDirectory *directory)
 {
-    GList *node;
-    NautilusFile *file;
-
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (guint i = 0; i < directory->details->files->len; i++)
     {
-        file = NAUTILUS_FILE (node->data);
-
-        nautilus_directory_add_file_to_work_queue (directory, file);
+        nautilus_directory_add_file_to_work_queue (directory,
+                                                   g_ptr_array_index (directory->details->files, i));
     }
 }
 
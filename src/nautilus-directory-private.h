@@ -36,6 +36,7 @@ typedef struct NewFilesState NewFilesState;
 typedef struct ThumbnailState ThumbnailState;
 typedef struct MountState MountState;
 typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct AsyncJobBackend AsyncJobBackend;
 
 typedef enum {
 	REQUEST_DEEP_COUNT,
@@ -63,8 +64,8 @@ struct NautilusDirectoryPrivate
 
 	/* The file objects. */
 	NautilusFile *as_file;
-	GList *file_list;
-	GHashTable *file_hash;
+	GPtrArray *files; /* unordered, see NautilusFilePrivate.directory_index */
+	GHashTable *file_hash; /* name to NautilusFile */
 
 	/* Queues of files needing some I/O done. */
 	NautilusHashQueue *high_priority_queue;
@@ -91,7 +92,7 @@ struct NautilusDirectoryPrivate
 	gboolean directory_loaded_sent_notification;
 	DirectoryLoadState *directory_load_in_progress;
 
-	GList *pending_file_info; /* list of GnomeVFSFileInfo's that are pending */
+	GQueue pending_file_records; /* NautilusFileRecord's waiting to be added */
 	int confirmed_file_count;
         guint dequeue_pending_idle_id;
 
@@ -103,28 +104,42 @@ struct NautilusDirectoryPrivate
 	 */
 	GList *files_changed_while_adding;
 
-	DirectoryCountState *count_in_progress;
+	GList *count_in_progress; /* list of DirectoryCountState * */
 
 	NautilusFile *deep_count_file;
 	DeepCountState *deep_count_in_progress;
 
-	NautilusFile *get_info_file;
-	GetInfoState *get_info_in_progress;
+	GList *get_info_states; /* list of GetInfoState * */
 
 	NautilusFile *extension_info_file;
 	NautilusInfoProvider *extension_info_provider;
 	NautilusOperationHandle *extension_info_in_progress;
 	guint extension_info_idle;
 
-	ThumbnailState *thumbnail_state;
+	GList *thumbnail_states; /* list of ThumbnailState * */
 
-	MountState *mount_state;
+	GList *mount_states; /* list of MountState * */
 
-	FilesystemInfoState *filesystem_info_state;
+	GList *filesystem_info_states; /* list of FilesystemInfoState * */
 
 	GList *file_operations_in_progress; /* list of FileOperation * */
+
+	AsyncJobBackend *async_job_backend;
+	gint64 async_job_wait_start; /* 0 unless waiting for a job slot */
+	gboolean async_job_woken;
 };
 
+/* Statistics of the async. job slots of one backend. */
+typedef struct
+{
+	guint running_jobs;
+	guint max_jobs;
+	guint queue_depth;
+	guint max_queue_depth;
+	guint64 n_waits;
+	gint64 total_wait_usec;
+} NautilusDirectoryIOStats;
+
 NautilusDirectory *nautilus_directory_get_existing                    (GFile                     *location);
 
 /* async. interface */
@@ -165,6 +180,15 @@ gboolean           nautilus_directory_has_request_for_file            (NautilusD
 void               nautilus_directory_schedule_dequeue_pending        (NautilusDirectory         *directory);
 void               nautilus_directory_stop_monitoring_file_list       (NautilusDirectory         *directory);
 void               nautilus_directory_cancel                          (NautilusDirectory         *directory);
+void               nautilus_directory_get_io_stats                    (NautilusDirectory         *directory,
+								       NautilusDirectoryIOStats  *stats);
+void               nautilus_directory_set_dequeue_budget              (gint64                     usec);
+void               nautilus_directory_set_pipeline_width              (RequestType                request_type,
+								       guint                      width);
+guint              nautilus_directory_next_load_batch_size            (guint                      batch_size,
+								       guint                      n_files,
+								       gint64                     round_trip_usec);
+GList *           nautilus_directory_get_all_files                   (NautilusDirectory         *directory);
 void               nautilus_async_destroying_file                     (NautilusFile              *file);
 void               nautilus_directory_force_reload_internal           (NautilusDirectory         *directory,
 								       NautilusFileAttributes     file_attributes);
@@ -204,11 +228,11 @@ void               nautilus_directory_add_file_monitors               (NautilusD
 								       FileMonitors              *monitors);
 void               nautilus_directory_add_file                        (NautilusDirectory         *directory,
 								       NautilusFile              *file);
-GList *            nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
+gboolean           nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
 								       NautilusFile              *file);
 void               nautilus_directory_end_file_name_change            (NautilusDirectory         *directory,
 								       NautilusFile              *file,
-								       GList                     *node);
+								       gboolean                   in_hash_table);
 void               nautilus_directory_moved                           (const char                *from_uri,
 								       const char                *to_uri);
 /* Interface to the work queue. */
@@ -82,7 +82,7 @@ real_are_all_files_seen (NautilusDirectory *directory)
 static gboolean
 real_is_not_empty (NautilusDirectory *directory)
 {
-    return directory->details->file_list != NULL;
+    return directory->details->files->len > 0;
 }
 
 static gboolean
@@ -101,11 +101,19 @@ is_tentative (NautilusFile *file,
 static GList *
 real_get_file_list (NautilusDirectory *directory)
 {
-    GList *tentative_files, *non_tentative_files;
+    GPtrArray *files = directory->details->files;
+    GList *non_tentative_files = NULL;
 
-    tentative_files = nautilus_file_list_filter (directory->details->file_list,
-                                                 &non_tentative_files, is_tentative, NULL);
-    nautilus_file_list_free (tentative_files);
+    for (guint i = 0; i < files->len; i++)
+    {
+        NautilusFile *file = g_ptr_array_index (files, i);
+
+        if (!is_tentative (file, NULL))
+        {
+            non_tentative_files = g_list_prepend (non_tentative_files,
+                                                  nautilus_file_ref (file));
+        }
+    }
 
     return non_tentative_files;
 }
@@ -182,7 +190,8 @@ nautilus_directory_finalize (GObject *object)
         g_object_unref (directory->details->location);
     }
 
-    g_assert (directory->details->file_list == NULL);
+    g_assert (directory->details->files->len == 0);
+    g_ptr_array_unref (directory->details->files);
     g_hash_table_destroy (directory->details->file_hash);
 
     nautilus_hash_queue_destroy (directory->details->high_priority_queue);
@@ -192,7 +201,8 @@ nautilus_directory_finalize (GObject *object)
     g_assert (directory->details->directory_load_in_progress == NULL);
     g_assert (directory->details->count_in_progress == NULL);
     g_assert (directory->details->dequeue_pending_idle_id == 0);
-    g_list_free_full (directory->details->pending_file_info, g_object_unref);
+    g_queue_clear_full (&directory->details->pending_file_records,
+                        (GDestroyNotify) nautilus_file_record_free);
 
     G_OBJECT_CLASS (nautilus_directory_parent_class)->finalize (object);
 }
@@ -311,6 +321,7 @@ static void
 nautilus_directory_init (NautilusDirectory *directory)
 {
     directory->details = nautilus_directory_get_instance_private (directory);
+    directory->details->files = g_ptr_array_new ();
     directory->details->file_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                            g_free, NULL);
     directory->details->high_priority_queue = nautilus_hash_queue_new (g_direct_hash, g_direct_equal, g_object_ref, g_object_unref);
@@ -388,7 +399,7 @@ emit_change_signals_for_all_files (NautilusDirectory *directory)
 {
     g_autolist (NautilusFile) files = NULL;
 
-    files = nautilus_file_list_copy (directory->details->file_list);
+    files = nautilus_directory_get_all_files (directory);
     if (directory->details->as_file != NULL)
     {
         files = g_list_prepend (files, g_object_ref (directory->details->as_file));
@@ -825,55 +836,72 @@ nautilus_directory_are_all_files_seen (NautilusDirectory *directory)
     return NAUTILUS_DIRECTORY_CLASS (G_OBJECT_GET_CLASS (directory))->are_all_files_seen (directory);
 }
 
+/**
+ * nautilus_directory_get_all_files:
+ * @directory: a #NautilusDirectory
+ *
+ * Unlike nautilus_directory_get_file_list(), this includes files that
+ * haven't been announced with files-added yet.
+ *
+ * Returns: (transfer full): the files in @directory, most recently added
+ *     first
+ */
+GList *
+nautilus_directory_get_all_files (NautilusDirectory *directory)
+{
+    GPtrArray *files = directory->details->files;
+    GList *list = NULL;
+
+    for (guint i = 0; i < files->len; i++)
+    {
+        list = g_list_prepend (list, nautilus_file_ref (g_ptr_array_index (files, i)));
+    }
+
+    return list;
+}
+
 static void
 add_to_hash_table (NautilusDirectory *directory,
-                   NautilusFile      *file,
-                   GList             *node)
+                   NautilusFile      *file)
 {
     const char *name = nautilus_file_get_name (file);
 
     g_assert (name != NULL);
-    g_assert (node != NULL);
     g_assert (g_hash_table_lookup (directory->details->file_hash,
                                    name) == NULL);
-    g_hash_table_insert (directory->details->file_hash, g_strdup (name), node);
+    g_hash_table_insert (directory->details->file_hash, g_strdup (name), file);
 }
 
-static GList *
-extract_from_hash_table (NautilusDirectory *directory,
-                         NautilusFile      *file)
+static gboolean
+remove_from_hash_table (NautilusDirectory *directory,
+                        NautilusFile      *file)
 {
     const char *name = nautilus_file_get_name (file);
-    GList *node;
 
-    if (name == NULL)
+    if (name == NULL ||
+        g_hash_table_lookup (directory->details->file_hash, name) != file)
     {
-        return NULL;
+        return FALSE;
     }
 
-    /* Find the list node in the hash table. */
-    node = g_hash_table_lookup (directory->details->file_hash, name);
-    g_hash_table_remove (directory->details->file_hash, name);
-
-    return node;
+    return g_hash_table_remove (directory->details->file_hash, name);
 }
 
 void
 nautilus_directory_add_file (NautilusDirectory *directory,
                              NautilusFile      *file)
 {
-    GList *node;
     gboolean add_to_work_queue;
 
     g_assert (NAUTILUS_IS_DIRECTORY (directory));
     g_assert (NAUTILUS_IS_FILE (file));
 
-    /* Add to list. */
-    node = g_list_prepend (directory->details->file_list, file);
-    directory->details->file_list = node;
+    /* Add to the array. */
+    file->details->directory_index = directory->details->files->len;
+    g_ptr_array_add (directory->details->files, file);
 
     /* Add to hash table. */
-    add_to_hash_table (directory, file, node);
+    add_to_hash_table (directory, file);
 
     directory->details->confirmed_file_count++;
 
@@ -902,20 +930,27 @@ void
 nautilus_directory_remove_file (NautilusDirectory *directory,
                                 NautilusFile      *file)
 {
-    GList *node;
+    GPtrArray *files;
+    guint index;
+    gboolean was_in_hash_table;
 
     g_assert (NAUTILUS_IS_DIRECTORY (directory));
     g_assert (NAUTILUS_IS_FILE (file));
 
-    /* Find the list node in the hash table. */
-    node = extract_from_hash_table (directory, file);
-    g_assert (node != NULL);
-    g_assert (node->data == file);
+    files = directory->details->files;
+    index = file->details->directory_index;
+    g_assert (index < files->len);
+    g_assert (g_ptr_array_index (files, index) == file);
+
+    was_in_hash_table = remove_from_hash_table (directory, file);
+    g_assert (was_in_hash_table);
 
-    /* Remove the item from the list. */
-    directory->details->file_list = g_list_remove_link
-                                        (directory->details->file_list, node);
-    g_list_free_1 (node);
+    /* Move the last file into the hole. */
+    g_ptr_array_remove_index_fast (files, index);
+    if (index < files->len)
+    {
+        NAUTILUS_FILE (g_ptr_array_index (files, index))->details->directory_index = index;
+    }
 
     nautilus_directory_remove_file_from_work_queue (directory, file);
 
@@ -931,23 +966,23 @@ nautilus_directory_remove_file (NautilusDirectory *directory,
     }
 }
 
-GList *
+gboolean
 nautilus_directory_begin_file_name_change (NautilusDirectory *directory,
                                            NautilusFile      *file)
 {
-    /* Find the list node in the hash table. */
-    return extract_from_hash_table (directory, file);
+    /* Take the old name out of the hash table. */
+    return remove_from_hash_table (directory, file);
 }
 
 void
 nautilus_directory_end_file_name_change (NautilusDirectory *directory,
                                          NautilusFile      *file,
-                                         GList             *node)
+                                         gboolean           in_hash_table)
 {
-    /* Add the list node to the hash table. */
-    if (node != NULL)
+    /* Add the new name to the hash table. */
+    if (in_hash_table)
     {
-        add_to_hash_table (directory, file, node);
+        add_to_hash_table (directory, file);
     }
 }
 
@@ -955,14 +990,10 @@ NautilusFile *
 nautilus_directory_find_file_by_name (NautilusDirectory *directory,
                                       const char        *name)
 {
-    GList *node;
-
     g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
     g_return_val_if_fail (name != NULL, NULL);
 
-    node = g_hash_table_lookup (directory->details->file_hash,
-                                name);
-    return node == NULL ? NULL : NAUTILUS_FILE (node->data);
+    return g_hash_table_lookup (directory->details->file_hash, name);
 }
 
 void
@@ -1497,7 +1528,7 @@ nautilus_directory_moved_internal (GFile *old_location,
             }
             affected_files = g_list_concat
                                  (affected_files,
-                                 nautilus_file_list_copy (directory->details->file_list));
+                                 nautilus_directory_get_all_files (directory));
         }
 
         nautilus_directory_unref (directory);
@@ -21,6 +21,7 @@
 #include "nautilus-file-changes-queue.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-name-index.h"
 #include "nautilus-tag-manager.h"
 
 typedef enum
@@ -159,6 +160,7 @@ nautilus_file_changes_consume_changes (void)
     GList *unmounts = NULL;
     GFilePair *pair;
     GAsyncQueue *queue;
+    NautilusNameIndex *name_index;
     gboolean flush_needed;
 
 
@@ -168,6 +170,7 @@ nautilus_file_changes_consume_changes (void)
     moves = NULL;
 
     queue = nautilus_file_changes_queue_get ();
+    name_index = nautilus_name_index_get ();
 
     /* Consume changes from the queue, stuffing them into one of three lists,
      * keep doing it while the changes are of the same kind, then send them off.
@@ -252,6 +255,39 @@ nautilus_file_changes_consume_changes (void)
             return;
         }
 
+        /* Changes made by Nautilus itself and by others all come through
+         * here, so this keeps the name index up to date.
+         */
+        if (name_index != NULL)
+        {
+            switch (change->kind)
+            {
+                case CHANGE_FILE_ADDED:
+                {
+                    nautilus_name_index_file_added (name_index, change->from);
+                }
+                break;
+
+                case CHANGE_FILE_UNMOUNTED:
+                case CHANGE_FILE_REMOVED:
+                {
+                    nautilus_name_index_file_removed (name_index, change->from);
+                }
+                break;
+
+                case CHANGE_FILE_MOVED:
+                {
+                    nautilus_name_index_file_moved (name_index, change->from, change->to);
+                }
+                break;
+
+                default:
+                {
+                }
+                break;
+            }
+        }
+
         /* add the new change to the list */
         switch (change->kind)
         {
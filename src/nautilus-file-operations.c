@@ -46,6 +46,7 @@
 #include <glib.h>
 
 #include "nautilus-error-reporting.h"
+#include "nautilus-delete-engine.h"
 #include "nautilus-fd-holder.h"
 #include "nautilus-operations-ui-manager.h"
 #include "nautilus-file-changes-queue.h"
@@ -53,6 +54,7 @@
 #include "nautilus-file-private.h"
 #include "nautilus-filename-utilities.h"
 #include "nautilus-tag-manager.h"
+#include "nautilus-trash-batch.h"
 #include "nautilus-trash-monitor.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-undo-operations.h"
@@ -86,6 +88,16 @@ typedef struct
     gboolean delete_all;
 } CommonJob;
 
+/* Copies small files on worker threads, while the job thread goes on
+ * walking the source tree. Only the job thread touches the pipeline.
+ */
+typedef struct
+{
+    GThreadPool *pool;
+    GAsyncQueue *results;
+    guint n_in_flight;
+} CopyPipeline;
+
 typedef struct
 {
     CommonJob common;
@@ -95,6 +107,7 @@ typedef struct
     GFile *fake_display_source;
     GHashTable *debuting_files;
     gchar *target_name;
+    CopyPipeline *pipeline;
     NautilusCopyCallback done_callback;
     gpointer done_callback_data;
 } CopyMoveJob;
@@ -170,6 +183,8 @@ typedef struct
     goffset num_bytes_children;
 } SourceDirInfo;
 
+typedef struct SourceScan SourceScan;
+
 typedef struct
 {
     int num_files;
@@ -178,8 +193,42 @@ typedef struct
     int num_files_since_progress;
     OpKind op;
     GHashTable *scanned_dirs_info;
+    /* Whether this is the count of a SourceScan, done in its thread. */
+    gboolean in_background;
+    /* The count still going on while the job uses these totals, if any. */
+    SourceScan *scan;
+    /* Whether the job started before the count was done. */
+    gboolean started_while_counting;
 } SourceInfo;
 
+/* Counts the sources in a thread, so that the job doesn't have to wait for
+ * the count of large trees. Errors are left for the job to run into.
+ */
+struct SourceScan
+{
+    SourceInfo info;
+    CommonJob *job;
+    GList *files;
+    GThread *thread;
+    /* Atomic. Set when the job doesn't need the count anymore. */
+    gint stop;
+
+    GMutex mutex;
+    GCond cond;
+    /* Guarded by the mutex. The totals counted so far. */
+    int num_files;
+    goffset num_bytes;
+    goffset largest_file_bytes;
+    gboolean done;
+
+    /* Only used by the job thread. The totals already added to the job's,
+     * and the files it skipped, whose contents may not be counted yet.
+     */
+    int merged_num_files;
+    goffset merged_num_bytes;
+    GList *skipped_files;
+};
+
 typedef struct
 {
     int num_files;
@@ -248,9 +297,31 @@ typedef struct
     gpointer done_callback_data;
 } SaveImageJob;
 
+static void
+source_info_clear (SourceInfo *source_info);
+
+static void
+source_scan_free (SourceScan *scan)
+{
+    if (scan->thread != NULL)
+    {
+        g_atomic_int_set (&scan->stop, TRUE);
+        g_thread_join (scan->thread);
+    }
+
+    source_info_clear (&scan->info);
+    g_list_free_full (scan->files, g_object_unref);
+    g_list_free_full (scan->skipped_files, g_object_unref);
+    g_mutex_clear (&scan->mutex);
+    g_cond_clear (&scan->cond);
+    g_free (scan);
+}
+
 static void
 source_info_clear (SourceInfo *source_info)
 {
+    g_clear_pointer (&source_info->scan, source_scan_free);
+
     if (source_info->scanned_dirs_info != NULL)
     {
         g_hash_table_unref (source_info->scanned_dirs_info);
@@ -268,6 +339,24 @@ G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (SourceInfo, source_info_clear)
 #define MAXIMUM_DISPLAYED_FILE_NAME_LENGTH 50
 #define MAXIMUM_FAT_FILE_SIZE G_MAXUINT32
 
+/* Larger files are copied on the job thread, which reports their progress
+ * as they are written.
+ */
+#define COPY_PIPELINE_MAX_FILE_SIZE (1024 * 1024)
+#define COPY_PIPELINE_N_THREADS 8
+#define COPY_PIPELINE_MAX_IN_FLIGHT 64
+
+/* How long jobs wait for their sources to be counted before starting. */
+#define SCAN_SOURCES_TIMEOUT (1 * G_USEC_PER_SEC)
+
+/* Set by tests, see nautilus_file_operations_set_count_hooks(). */
+static NautilusCountSourceFunc count_source_hook;
+static NautilusCountFinishedFunc count_finished_hook;
+static gpointer count_hooks_data;
+
+/* Local files are trashed this many at a time. */
+#define TRASH_BATCH_SIZE 1000
+
 #define IS_IO_ERROR(__error, KIND) (((__error)->domain == G_IO_ERROR && (__error)->code == G_IO_ERROR_ ## KIND))
 
 #define CANCEL _("_Cancel")
@@ -299,6 +388,13 @@ static void scan_sources (GList      *files,
                           SourceInfo *source_info,
                           CommonJob  *job,
                           OpKind      kind);
+static void scan_sources_in_background (GList      *files,
+                                        SourceInfo *source_info,
+                                        CommonJob  *job,
+                                        OpKind      kind);
+static void source_info_refresh (SourceInfo *source_info);
+static void source_info_finish_count (SourceInfo   *source_info,
+                                      TransferInfo *transfer_info);
 
 
 static void empty_trash_thread_func (GTask        *task,
@@ -1212,6 +1308,25 @@ confirm_delete_directly (CommonJob *job,
     return response == 1;
 }
 
+/* While the sources are still being counted, their total is only a lower
+ * bound, and the time left is unknown.
+ */
+static void
+report_counting_progress (CommonJob    *job,
+                          SourceInfo   *source_info,
+                          TransferInfo *transfer_info)
+{
+    /* To translators: %'d is the number of files completed for the operation,
+     * out of the ones found so far. So it will be something like "2 / at least 14". */
+    nautilus_progress_info_take_details (job->progress,
+                                         g_strdup_printf (_("%'d / at least %'d"),
+                                                          transfer_info->num_files,
+                                                          source_info->num_files));
+    nautilus_progress_info_set_elapsed_time (job->progress,
+                                             g_timer_elapsed (job->time, NULL));
+    nautilus_progress_info_pulse_progress (job->progress);
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
 static void
@@ -1230,6 +1345,7 @@ report_delete_progress (CommonJob    *job,
 
     delete_job = (DeleteJob *) job;
     now = g_get_monotonic_time ();
+    source_info_refresh (source_info);
     files_left = source_info->num_files - transfer_info->num_files;
 
     /* Races and whatnot could cause this to be negative... */
@@ -1237,6 +1353,11 @@ report_delete_progress (CommonJob    *job,
     {
         files_left = 0;
     }
+    /* ...and there are more to come while counting. */
+    if (source_info->scan != NULL)
+    {
+        files_left = MAX (files_left, 1);
+    }
 
     /* If the number of files left is 0, we want to update the status without
      * considering this time, since we want to change the status to completed
@@ -1326,6 +1447,12 @@ report_delete_progress (CommonJob    *job,
                                                              source_info->num_files));
     }
 
+    if (source_info->scan != NULL)
+    {
+        report_counting_progress (job, source_info, transfer_info);
+        return;
+    }
+
     elapsed = g_timer_elapsed (job->time, NULL);
     transfer_rate = 0;
     remaining_time = INT_MAX;
@@ -1597,16 +1724,17 @@ delete_files (CommonJob *job,
     g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
     TransferInfo transfer_info;
     DeleteData data;
+    g_autoptr (NautilusDeleteEngine) engine = NULL;
 
     if (job_aborted (job))
     {
         return;
     }
 
-    scan_sources (files,
-                  &source_info,
-                  job,
-                  OP_KIND_DELETE);
+    scan_sources_in_background (files,
+                                &source_info,
+                                job,
+                                OP_KIND_DELETE);
     if (job_aborted (job))
     {
         return;
@@ -1635,15 +1763,35 @@ delete_files (CommonJob *job,
             continue;
         }
 
-        success = delete_file_recursively (file, job->cancellable,
-                                           file_deleted_callback,
-                                           &data);
+        if (g_file_is_native (file))
+        {
+            if (engine == NULL)
+            {
+                engine = nautilus_delete_engine_new ();
+            }
+
+            success = nautilus_delete_engine_delete (engine, file, job->cancellable,
+                                                     file_deleted_callback,
+                                                     &data);
+        }
+        else
+        {
+            success = delete_file_recursively (file, job->cancellable,
+                                               file_deleted_callback,
+                                               &data);
+        }
 
         if (!success)
         {
             (*files_skipped)++;
         }
     }
+
+    if (source_info.started_while_counting && !job_aborted (job))
+    {
+        source_info_finish_count (&source_info, &transfer_info);
+        report_delete_progress (job, &source_info, &transfer_info);
+    }
 }
 
 #pragma GCC diagnostic push
@@ -1964,6 +2112,14 @@ source_info_remove_file_from_count (GFile      *file,
         source_info->num_bytes -= g_file_info_get_size (file_info);
     }
 
+    /* Its contents are only all counted once the count is done. */
+    if (source_info->scan != NULL)
+    {
+        source_info->scan->skipped_files = g_list_prepend (source_info->scan->skipped_files,
+                                                          g_object_ref (file));
+        return;
+    }
+
     dir_info = g_hash_table_lookup (source_info->scanned_dirs_info, file);
 
     if (dir_info != NULL)
@@ -1974,6 +2130,86 @@ source_info_remove_file_from_count (GFile      *file,
     }
 }
 
+static void
+trash_toplevel_file (CommonJob     *job,
+                     GFile         *file,
+                     SourceInfo    *source_info,
+                     TransferInfo  *transfer_info,
+                     GList        **to_delete,
+                     guint         *files_skipped)
+{
+    gboolean skipped_file = FALSE;
+
+    trash_file (job, file,
+                &skipped_file,
+                source_info, transfer_info,
+                TRUE, to_delete);
+    if (skipped_file)
+    {
+        (*files_skipped)++;
+        source_info_remove_file_from_count (file, job, source_info);
+        report_trash_progress (job, source_info, transfer_info);
+    }
+}
+
+/* Trashes a batch of local files together, and then trashes those that
+ * failed one at a time, so that their errors are reported as usual.
+ */
+static void
+trash_file_batch (CommonJob     *job,
+                  GPtrArray     *batch,
+                  SourceInfo    *source_info,
+                  TransferInfo  *transfer_info,
+                  GList        **to_delete,
+                  guint         *files_skipped)
+{
+    g_autoptr (GPtrArray) errors = NULL;
+    g_autofree gint64 *deletion_times = NULL;
+
+    if (batch->len == 0)
+    {
+        return;
+    }
+
+    deletion_times = g_new0 (gint64, batch->len);
+    errors = nautilus_trash_batch_trash_files (NULL, batch, deletion_times, job->cancellable);
+
+    for (guint i = 0; i < batch->len; i++)
+    {
+        GFile *file = g_ptr_array_index (batch, i);
+
+        if (g_ptr_array_index (errors, i) != NULL)
+        {
+            continue;
+        }
+
+        transfer_info->num_files++;
+        nautilus_file_changes_queue_file_removed (file);
+
+        /* Undo finds the files by the deletion date in their info, which
+         * can be a while before the whole batch is trashed.
+         */
+        if (job->undo_info != NULL)
+        {
+            nautilus_file_undo_info_trash_add_file_at (NAUTILUS_FILE_UNDO_INFO_TRASH (job->undo_info),
+                                                       file, deletion_times[i]);
+        }
+    }
+    report_trash_progress (job, source_info, transfer_info);
+
+    for (guint i = 0; i < batch->len && !job_aborted (job); i++)
+    {
+        if (g_ptr_array_index (errors, i) != NULL)
+        {
+            trash_toplevel_file (job, g_ptr_array_index (batch, i),
+                                 source_info, transfer_info,
+                                 to_delete, files_skipped);
+        }
+    }
+
+    g_ptr_array_set_size (batch, 0);
+}
+
 static void
 trash_files (CommonJob *job,
              GList     *files,
@@ -1984,7 +2220,7 @@ trash_files (CommonJob *job,
     GList *to_delete;
     g_auto (SourceInfo) source_info = SOURCE_INFO_INIT;
     TransferInfo transfer_info;
-    gboolean skipped_file;
+    g_autoptr (GPtrArray) batch = NULL;
 
     if (job_aborted (job))
     {
@@ -2006,25 +2242,39 @@ trash_files (CommonJob *job,
     report_trash_progress (job, &source_info, &transfer_info);
 
     to_delete = NULL;
+    batch = g_ptr_array_new ();
     for (l = files;
          l != NULL && !job_aborted (job);
          l = l->next)
     {
         file = l->data;
 
-        skipped_file = FALSE;
-        trash_file (job, file,
-                    &skipped_file,
-                    &source_info, &transfer_info,
-                    TRUE, &to_delete);
-        if (skipped_file)
+        if (g_file_is_native (file) && !should_skip_file (job, file))
         {
-            (*files_skipped)++;
-            source_info_remove_file_from_count (file, job, &source_info);
-            report_trash_progress (job, &source_info, &transfer_info);
+            g_ptr_array_add (batch, file);
+            if (batch->len >= TRASH_BATCH_SIZE)
+            {
+                trash_file_batch (job, batch, &source_info, &transfer_info,
+                                  &to_delete, files_skipped);
+            }
+            continue;
+        }
+
+        trash_file_batch (job, batch, &source_info, &transfer_info,
+                          &to_delete, files_skipped);
+        if (!job_aborted (job))
+        {
+            trash_toplevel_file (job, file, &source_info, &transfer_info,
+                                 &to_delete, files_skipped);
         }
     }
 
+    if (!job_aborted (job))
+    {
+        trash_file_batch (job, batch, &source_info, &transfer_info,
+                          &to_delete, files_skipped);
+    }
+
     if (to_delete)
     {
         to_delete = g_list_reverse (to_delete);
@@ -2812,7 +3062,9 @@ count_file (GFileInfo     *info,
         dir_info->num_bytes_children += num_bytes;
     }
 
-    if (source_info->num_files_since_progress++ > 100)
+    /* Counts in the background are reported by the job. */
+    if (!source_info->in_background &&
+        source_info->num_files_since_progress++ > 100)
     {
         report_preparing_count_progress (job, source_info);
         source_info->num_files_since_progress = 0;
@@ -2852,6 +3104,24 @@ get_scan_primary (OpKind kind)
     }
 }
 
+/* Called from the thread of the scan, to share the totals so far. */
+static void
+source_scan_publish (SourceScan *scan)
+{
+    g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&scan->mutex);
+
+    scan->num_files = scan->info.num_files;
+    scan->num_bytes = scan->info.num_bytes;
+    scan->largest_file_bytes = scan->info.largest_file_bytes;
+}
+
+static gboolean
+is_scan_stopped (SourceInfo *source_info)
+{
+    return (source_info->in_background &&
+            g_atomic_int_get (&((SourceScan *) source_info)->stop));
+}
+
 static void
 scan_dir (GFile      *dir,
           SourceInfo *source_info,
@@ -2925,7 +3195,7 @@ retry:
         g_file_enumerator_close (enumerator, job->cancellable, NULL);
         g_object_unref (enumerator);
 
-        if (error && IS_IO_ERROR (error, CANCELLED))
+        if (error && (IS_IO_ERROR (error, CANCELLED) || source_info->in_background))
         {
             g_error_free (error);
         }
@@ -2981,6 +3251,12 @@ retry:
             }
         }
     }
+    else if (source_info->in_background)
+    {
+        /* The job reports it when it gets there. */
+        g_error_free (error);
+        skip_subdirs = TRUE;
+    }
     else if (job->skip_all_error)
     {
         g_error_free (error);
@@ -3097,6 +3373,11 @@ retry:
         }
         g_object_unref (info);
     }
+    else if (source_info->in_background)
+    {
+        /* The job reports it when it gets there. */
+        g_error_free (error);
+    }
     else if (job->skip_all_error)
     {
         g_error_free (error);
@@ -3160,11 +3441,16 @@ retry:
         }
     }
 
-    while (!job_aborted (job) &&
+    while (!job_aborted (job) && !is_scan_stopped (source_info) &&
            (dir = g_queue_pop_head (dirs)) != NULL)
     {
         scan_dir (dir, source_info, job, dirs);
         g_object_unref (dir);
+
+        if (source_info->in_background)
+        {
+            source_scan_publish ((SourceScan *) source_info);
+        }
     }
 
     /* Free all from queue if we exited early */
@@ -3202,6 +3488,168 @@ scan_sources (GList      *files,
     report_preparing_count_progress (job, source_info);
 }
 
+static gpointer
+source_scan_thread_func (gpointer user_data)
+{
+    SourceScan *scan = user_data;
+
+    for (GList *l = scan->files;
+         l != NULL && !job_aborted (scan->job) && !is_scan_stopped (&scan->info);
+         l = l->next)
+    {
+        if (count_source_hook != NULL)
+        {
+            count_source_hook (l->data, count_hooks_data);
+        }
+
+        scan_file (l->data, &scan->info, scan->job);
+        source_scan_publish (scan);
+    }
+
+    g_mutex_lock (&scan->mutex);
+    scan->done = TRUE;
+    g_cond_signal (&scan->cond);
+    g_mutex_unlock (&scan->mutex);
+
+    return NULL;
+}
+
+/* Adds what was counted since last time to the totals of the job, and takes
+ * over the count once it's done.
+ */
+static void
+source_info_refresh (SourceInfo *source_info)
+{
+    SourceScan *scan = source_info->scan;
+    gboolean done;
+
+    if (scan == NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock (&scan->mutex);
+    source_info->num_files += scan->num_files - scan->merged_num_files;
+    source_info->num_bytes += scan->num_bytes - scan->merged_num_bytes;
+    source_info->largest_file_bytes = MAX (source_info->largest_file_bytes,
+                                           scan->largest_file_bytes);
+    scan->merged_num_files = scan->num_files;
+    scan->merged_num_bytes = scan->num_bytes;
+    done = scan->done;
+    g_mutex_unlock (&scan->mutex);
+
+    if (!done)
+    {
+        return;
+    }
+
+    g_thread_join (g_steal_pointer (&scan->thread));
+
+    g_hash_table_unref (source_info->scanned_dirs_info);
+    source_info->scanned_dirs_info = g_steal_pointer (&scan->info.scanned_dirs_info);
+    source_info->scan = NULL;
+
+    /* The contents of skipped directories can be discounted now. */
+    for (GList *l = scan->skipped_files; l != NULL; l = l->next)
+    {
+        SourceDirInfo *dir_info = g_hash_table_lookup (source_info->scanned_dirs_info, l->data);
+
+        if (dir_info != NULL)
+        {
+            source_info_remove_descendent_files_from_count (l->data, dir_info, source_info);
+        }
+    }
+
+    source_scan_free (scan);
+}
+
+/* Like scan_sources(), but only waits a bit for the count. The job can then
+ * start while the count goes on, with its totals growing as they are
+ * refreshed when reporting progress.
+ */
+static void
+scan_sources_in_background (GList      *files,
+                            SourceInfo *source_info,
+                            CommonJob  *job,
+                            OpKind      kind)
+{
+    SourceScan *scan = g_new0 (SourceScan, 1);
+    gint64 end_time = g_get_monotonic_time () + SCAN_SOURCES_TIMEOUT;
+
+    source_info->op = kind;
+    source_info->scanned_dirs_info = g_hash_table_new_full (g_file_hash,
+                                                            (GEqualFunc) g_file_equal,
+                                                            (GDestroyNotify) g_object_unref,
+                                                            (GDestroyNotify) g_free);
+
+    scan->info.op = kind;
+    scan->info.in_background = TRUE;
+    scan->info.scanned_dirs_info = g_hash_table_new_full (g_file_hash,
+                                                          (GEqualFunc) g_file_equal,
+                                                          (GDestroyNotify) g_object_unref,
+                                                          (GDestroyNotify) g_free);
+    scan->job = job;
+    scan->files = g_list_copy_deep (files, (GCopyFunc) g_object_ref, NULL);
+    g_mutex_init (&scan->mutex);
+    g_cond_init (&scan->cond);
+    scan->thread = g_thread_new ("nautilus-scan-sources", source_scan_thread_func, scan);
+    source_info->scan = scan;
+
+    report_preparing_count_progress (job, source_info);
+
+    /* Small trees are counted before starting, like with scan_sources(). */
+    while (source_info->scan != NULL && g_get_monotonic_time () < end_time)
+    {
+        g_mutex_lock (&scan->mutex);
+        if (!scan->done)
+        {
+            g_cond_wait_until (&scan->cond, &scan->mutex,
+                               MIN (end_time, g_get_monotonic_time () + PROGRESS_NOTIFY_INTERVAL));
+        }
+        g_mutex_unlock (&scan->mutex);
+
+        source_info_refresh (source_info);
+        report_preparing_count_progress (job, source_info);
+    }
+
+    source_info->started_while_counting = source_info->scan != NULL;
+}
+
+/* Called once a job that started before its sources were counted is done.
+ * The count may have missed what was moved or deleted before it got there,
+ * so what was transferred is the total.
+ */
+static void
+source_info_finish_count (SourceInfo   *source_info,
+                          TransferInfo *transfer_info)
+{
+    SourceScan *scan = source_info->scan;
+
+    if (scan != NULL)
+    {
+        g_atomic_int_set (&scan->stop, TRUE);
+
+        g_mutex_lock (&scan->mutex);
+        while (!scan->done)
+        {
+            g_cond_wait (&scan->cond, &scan->mutex);
+        }
+        g_mutex_unlock (&scan->mutex);
+
+        source_info_refresh (source_info);
+    }
+
+    source_info->num_files = transfer_info->num_files;
+    source_info->num_bytes = transfer_info->num_bytes;
+
+    if (count_finished_hook != NULL)
+    {
+        count_finished_hook (source_info->num_files, source_info->num_bytes,
+                             transfer_info->num_files, transfer_info->num_bytes,
+                             count_hooks_data);
+    }
+}
+
 static void
 verify_destination (CommonJob   *job,
                     GFile       *dest,
@@ -3467,6 +3915,7 @@ report_copy_progress (CopyMoveJob  *copy_job,
 
     now = g_get_monotonic_time ();
 
+    source_info_refresh (source_info);
     files_left = source_info->num_files - transfer_info->num_files;
 
     /* Races and whatnot could cause this to be negative... */
@@ -3474,6 +3923,11 @@ report_copy_progress (CopyMoveJob  *copy_job,
     {
         files_left = 0;
     }
+    /* ...and there are more to come while counting. */
+    if (source_info->scan != NULL)
+    {
+        files_left = MAX (files_left, 1);
+    }
 
     /* If the number of files left is 0, we want to update the status without
      * considering this time, since we want to change the status to completed
@@ -3651,6 +4105,12 @@ report_copy_progress (CopyMoveJob  *copy_job,
         }
     }
 
+    if (source_info->scan != NULL)
+    {
+        report_counting_progress (job, source_info, transfer_info);
+        return;
+    }
+
     total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
 
     elapsed = g_timer_elapsed (job->time, NULL);
@@ -4330,6 +4790,203 @@ retry:
     return CREATE_DEST_DIR_SUCCESS;
 }
 
+/* The files of a directory that are in the pipeline. */
+typedef struct
+{
+    guint n_pending;
+    /* Sources that couldn't be copied right away, to copy again on the job
+     * thread, where errors and conflicts can be handled.
+     */
+    GList *failed;
+} CopyBatch;
+
+typedef struct
+{
+    CopyMoveJob *job;
+    CopyBatch *batch;
+    GFile *src;
+    GFile *dest_dir;
+    GFile *dest;
+    char *dest_fs_type;
+    gboolean same_fs;
+    GFileCopyFlags flags;
+    goffset size;
+    gboolean copied;
+} PipelinedCopy;
+
+static void
+pipelined_copy_free (PipelinedCopy *copy)
+{
+    g_object_unref (copy->src);
+    g_object_unref (copy->dest_dir);
+    g_clear_object (&copy->dest);
+    g_free (copy->dest_fs_type);
+    g_free (copy);
+}
+
+static void
+pipelined_copy_func (gpointer data,
+                     gpointer user_data)
+{
+    PipelinedCopy *copy = data;
+    CopyPipeline *pipeline = user_data;
+    CommonJob *job = (CommonJob *) copy->job;
+    g_autoptr (GError) error = NULL;
+    gboolean existed;
+
+    /* Without overwriting, the copy fails if the destination exists, but
+     * errors reading the source may come first. Only what the copy left
+     * where nothing was before is removed, so that merging never loses
+     * files the user had.
+     */
+    copy->dest = get_target_file (copy->src, copy->dest_dir, copy->dest_fs_type, copy->same_fs);
+    existed = g_file_query_exists (copy->dest, NULL);
+    copy->copied = g_file_copy (copy->src, copy->dest, copy->flags, job->cancellable,
+                                NULL, NULL, &error);
+
+    if (!copy->copied && !existed && !IS_IO_ERROR (error, EXISTS))
+    {
+        g_file_delete (copy->dest, NULL, NULL);
+    }
+
+    g_async_queue_push (pipeline->results, copy);
+}
+
+static CopyPipeline *
+copy_pipeline_new (void)
+{
+    CopyPipeline *pipeline = g_new0 (CopyPipeline, 1);
+
+    pipeline->results = g_async_queue_new ();
+    pipeline->pool = g_thread_pool_new (pipelined_copy_func, pipeline,
+                                        COPY_PIPELINE_N_THREADS, FALSE, NULL);
+
+    return pipeline;
+}
+
+/* Every batch must have been waited for. */
+static void
+copy_pipeline_free (CopyPipeline *pipeline)
+{
+    g_assert (pipeline->n_in_flight == 0);
+
+    g_thread_pool_free (pipeline->pool, FALSE, TRUE);
+    g_async_queue_unref (pipeline->results);
+    g_free (pipeline);
+}
+
+/* Waits for one copy to finish, from any batch, and accounts for it. */
+static void
+wait_for_pipelined_copy (CopyMoveJob  *copy_job,
+                         SourceInfo   *source_info,
+                         TransferInfo *transfer_info)
+{
+    CommonJob *job = (CommonJob *) copy_job;
+    PipelinedCopy *copy = g_async_queue_pop (copy_job->pipeline->results);
+
+    copy_job->pipeline->n_in_flight--;
+    copy->batch->n_pending--;
+
+    if (copy->copied)
+    {
+        transfer_info->num_files++;
+        transfer_info->num_bytes += copy->size;
+        report_copy_progress (copy_job, source_info, transfer_info);
+
+        nautilus_file_changes_queue_file_added (copy->dest);
+
+        if (job->undo_info != NULL)
+        {
+            nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+                                                                copy->src, copy->dest);
+        }
+    }
+    else
+    {
+        copy->batch->failed = g_list_prepend (copy->batch->failed, g_object_ref (copy->src));
+    }
+
+    pipelined_copy_free (copy);
+}
+
+static void
+queue_pipelined_copy (CopyMoveJob  *copy_job,
+                      CopyBatch    *batch,
+                      GFile        *src,
+                      GFile        *dest_dir,
+                      const char   *dest_fs_type,
+                      gboolean      same_fs,
+                      goffset       size,
+                      gboolean      reset_perms,
+                      SourceInfo   *source_info,
+                      TransferInfo *transfer_info)
+{
+    PipelinedCopy *copy;
+
+    while (copy_job->pipeline->n_in_flight >= COPY_PIPELINE_MAX_IN_FLIGHT)
+    {
+        wait_for_pipelined_copy (copy_job, source_info, transfer_info);
+    }
+
+    copy = g_new0 (PipelinedCopy, 1);
+    copy->job = copy_job;
+    copy->batch = batch;
+    copy->src = g_object_ref (src);
+    copy->dest_dir = g_object_ref (dest_dir);
+    copy->dest_fs_type = g_strdup (dest_fs_type);
+    copy->same_fs = same_fs;
+    copy->flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+    if (reset_perms)
+    {
+        copy->flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+    }
+    copy->size = size;
+
+    copy_job->pipeline->n_in_flight++;
+    batch->n_pending++;
+    g_thread_pool_push (copy_job->pipeline->pool, copy, NULL);
+}
+
+/* Waits for the files of a directory to be copied, and copies the ones that
+ * failed again the usual way.
+ */
+static void
+finish_copy_batch (CopyMoveJob   *copy_job,
+                   CopyBatch     *batch,
+                   GFile         *dest_dir,
+                   gboolean       same_fs,
+                   char         **dest_fs_type,
+                   SourceInfo    *source_info,
+                   TransferInfo  *transfer_info,
+                   gboolean      *skipped_file,
+                   gboolean       reset_perms)
+{
+    CommonJob *job = (CommonJob *) copy_job;
+
+    while (batch->n_pending > 0)
+    {
+        wait_for_pipelined_copy (copy_job, source_info, transfer_info);
+    }
+
+    batch->failed = g_list_reverse (batch->failed);
+    for (GList *l = batch->failed; l != NULL && !job_aborted (job); l = l->next)
+    {
+        GFile *src_file = l->data;
+
+        copy_move_file (copy_job, src_file, dest_dir, same_fs, FALSE, dest_fs_type,
+                        source_info, transfer_info, NULL, FALSE, skipped_file,
+                        reset_perms);
+
+        if (*skipped_file)
+        {
+            source_info_remove_file_from_count (src_file, job, source_info);
+            report_copy_progress (copy_job, source_info, transfer_info);
+        }
+    }
+
+    g_clear_list (&batch->failed, g_object_unref);
+}
+
 /* a return value of FALSE means retry, i.e.
  * the destination has changed and the source
  * is expected to re-try the preceding
@@ -4361,6 +5018,7 @@ copy_move_directory (CopyMoveJob   *copy_job,
     gboolean local_skipped_file;
     CommonJob *job;
     GFileCopyFlags flags;
+    gboolean use_pipeline;
 
     job = (CommonJob *) copy_job;
     *skipped_file = FALSE;
@@ -4419,16 +5077,29 @@ copy_move_directory (CopyMoveJob   *copy_job,
     local_skipped_file = FALSE;
     dest_fs_type = NULL;
 
+    /* Opening and closing files is what takes time when copying many small
+     * local files, so several are copied at once.
+     */
+    use_pipeline = copy_job->pipeline != NULL && !copy_job->is_move &&
+                   copy_job->target_name == NULL &&
+                   g_file_is_native (src) && g_file_is_native (*dest);
+
     skip_error = should_skip_readdir_error (job, src);
 retry:
     error = NULL;
     enumerator = g_file_enumerate_children (src,
+                                            use_pipeline ?
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                            G_FILE_ATTRIBUTE_STANDARD_SIZE :
                                             G_FILE_ATTRIBUTE_STANDARD_NAME,
                                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                             job->cancellable,
                                             &error);
     if (enumerator)
     {
+        CopyBatch batch = { 0 };
+
         error = NULL;
 
         while (!job_aborted (job) &&
@@ -4436,14 +5107,28 @@ retry:
         {
             src_file = g_file_get_child (src,
                                          g_file_info_get_name (info));
-            copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-                            source_info, transfer_info, NULL, FALSE, &local_skipped_file,
-                            reset_perms);
 
-            if (local_skipped_file)
+            if (use_pipeline &&
+                g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+                g_file_info_get_size (info) <= COPY_PIPELINE_MAX_FILE_SIZE &&
+                !should_skip_file (job, src_file))
+            {
+                queue_pipelined_copy (copy_job, &batch, src_file, *dest,
+                                      dest_fs_type, same_fs,
+                                      g_file_info_get_size (info), reset_perms,
+                                      source_info, transfer_info);
+            }
+            else
             {
-                source_info_remove_file_from_count (src_file, job, source_info);
-                report_copy_progress (copy_job, source_info, transfer_info);
+                copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+                                source_info, transfer_info, NULL, FALSE, &local_skipped_file,
+                                reset_perms);
+
+                if (local_skipped_file)
+                {
+                    source_info_remove_file_from_count (src_file, job, source_info);
+                    report_copy_progress (copy_job, source_info, transfer_info);
+                }
             }
 
             g_object_unref (src_file);
@@ -4452,6 +5137,11 @@ retry:
         g_file_enumerator_close (enumerator, job->cancellable, NULL);
         g_object_unref (enumerator);
 
+        /* The attributes of the directory are set once its files are in. */
+        finish_copy_batch (copy_job, &batch, *dest, same_fs, &dest_fs_type,
+                           source_info, transfer_info, &local_skipped_file,
+                           reset_perms);
+
         if (error && IS_IO_ERROR (error, CANCELLED))
         {
             g_error_free (error);
@@ -5565,10 +6255,10 @@ nautilus_file_operations_copy (GTask        *task,
 
     nautilus_progress_info_start (job->common.progress);
 
-    scan_sources (job->files,
-                  &source_info,
-                  common,
-                  OP_KIND_COPY);
+    scan_sources_in_background (job->files,
+                                &source_info,
+                                common,
+                                OP_KIND_COPY);
     if (job_aborted (common))
     {
         return;
@@ -5599,9 +6289,17 @@ nautilus_file_operations_copy (GTask        *task,
     g_timer_start (job->common.time);
 
     memset (&transfer_info, 0, sizeof (transfer_info));
+    job->pipeline = copy_pipeline_new ();
     copy_files (job,
                 dest_fs_id,
                 &source_info, &transfer_info);
+    g_clear_pointer (&job->pipeline, copy_pipeline_free);
+
+    if (source_info.started_while_counting && !job_aborted (common))
+    {
+        source_info_finish_count (&source_info, &transfer_info);
+        report_copy_progress (job, &source_info, &transfer_info);
+    }
 }
 
 void
@@ -5628,6 +6326,27 @@ nautilus_file_operations_copy_sync (GList *files,
     copy_task_done (NULL, NULL, job);
 }
 
+/**
+ * nautilus_file_operations_set_count_hooks:
+ * @count_source: (nullable): called in the counting thread before each
+ *     source is counted, which it may hold up
+ * @count_finished: (nullable): called once a job is done, with the totals it
+ *     ended with and what it transferred
+ * @user_data: data for the hooks
+ *
+ * Only meant for tests, which can't otherwise tell how the count and the
+ * transfer overlapped.
+ */
+void
+nautilus_file_operations_set_count_hooks (NautilusCountSourceFunc   count_source,
+                                          NautilusCountFinishedFunc count_finished,
+                                          gpointer                  user_data)
+{
+    count_source_hook = count_source;
+    count_finished_hook = count_finished;
+    count_hooks_data = user_data;
+}
+
 void
 nautilus_file_operations_copy_async (GList                          *files,
                                      GFile                          *target_dir,
@@ -6319,10 +7038,10 @@ nautilus_file_operations_move (GTask        *task,
      *  so scan for size */
 
     fallback_files = get_files_from_fallbacks (fallbacks);
-    scan_sources (fallback_files,
-                  &source_info,
-                  common,
-                  OP_KIND_MOVE);
+    scan_sources_in_background (fallback_files,
+                                &source_info,
+                                common,
+                                OP_KIND_MOVE);
 
     g_list_free (fallback_files);
 
@@ -6346,6 +7065,12 @@ nautilus_file_operations_move (GTask        *task,
                 dest_fs_id, &dest_fs_type,
                 &source_info, &transfer_info);
 
+    if (source_info.started_while_counting && !job_aborted (common))
+    {
+        source_info_finish_count (&source_info, &transfer_info);
+        report_copy_progress (job, &source_info, &transfer_info);
+    }
+
 aborted:
     g_list_free_full (fallbacks, g_free);
 }
@@ -48,6 +48,13 @@ typedef void (* NautilusMountCallback)     (GVolume    *volume,
 typedef void (* NautilusUnmountCallback)   (gpointer    callback_data);
 typedef void (* NautilusExtractCallback)   (GList    *outputs,
                                             gpointer  callback_data);
+typedef void (* NautilusCountSourceFunc)   (GFile    *source,
+                                            gpointer  user_data);
+typedef void (* NautilusCountFinishedFunc) (int       total_files,
+                                            goffset   total_bytes,
+                                            int       transferred_files,
+                                            goffset   transferred_bytes,
+                                            gpointer  user_data);
 
 void nautilus_file_operations_copy_move   (const GList                    *item_uris,
                                            const char                     *target_dir_uri,
@@ -127,6 +134,13 @@ void nautilus_file_operations_copy_async (GList                          *files,
 void nautilus_file_operations_copy_sync (GList                *files,
                                          GFile                *target_dir);
 
+/* For tests, to follow the count of the sources of copy, move and delete
+ * jobs, which goes on alongside the transfer once it takes a while.
+ */
+void nautilus_file_operations_set_count_hooks (NautilusCountSourceFunc   count_source,
+                                               NautilusCountFinishedFunc count_finished,
+                                               gpointer                  user_data);
+
 void nautilus_file_operations_move_async (GList                          *files,
                                           GFile                          *target_dir,
                                           GtkWindow                      *parent_window,
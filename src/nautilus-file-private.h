@@ -41,6 +41,7 @@ typedef enum {
 struct NautilusFilePrivate
 {
 	NautilusDirectory *directory;
+	guint directory_index; /* position in the directory's files array */
 	
 	GRefString *name;
 
@@ -52,6 +53,13 @@ struct NautilusFilePrivate
 	char *directory_name_collation_key;
 	GRefString *edit_name;
 
+	/* Sort keys, built by the first sort that needs them and dropped
+	 * whenever what they are built from changes.
+	 */
+	char *type_collation_key;
+	char *mime_type_collation_key;
+	guint starred_generation; /* 0 if is_starred isn't known */
+
 	goffset size; /* -1 is unknown */
 	
 	int sort_order;
@@ -188,6 +196,9 @@ struct NautilusFilePrivate
 	guint filesystem_info_is_up_to_date : 1;
 	guint filesystem_remote             : 1;
 
+	guint got_type_sort_keys            : 1;
+	guint is_starred                    : 1;
+
 	time_t trash_time; /* 0 is unknown */
 	time_t recency; /* 0 is unknown */
 
@@ -198,6 +209,18 @@ struct NautilusFilePrivate
 	time_t free_space_read; /* The time free_space was updated, or 0 for never */
 };
 
+/* What a new NautilusFile works out from its GFileInfo, prepared ahead of
+ * creating the file. Records don't touch any shared state, so they can be
+ * made on a worker thread while the directory is loading.
+ */
+typedef struct {
+	GFileInfo *info;
+	GRefString *display_name;
+	char *display_name_collation_key;
+	GRefString *mime_type;
+	gboolean is_hidden;
+} NautilusFileRecord;
+
 typedef struct {
 	NautilusFile *file;
 	GList *files;
@@ -215,6 +238,10 @@ typedef struct {
 
 NautilusFile *nautilus_file_new_from_info                  (NautilusDirectory      *directory,
 							    GFileInfo              *info);
+NautilusFile *nautilus_file_new_from_record                (NautilusDirectory      *directory,
+							    NautilusFileRecord     *record);
+NautilusFileRecord *nautilus_file_record_new               (GFileInfo              *info);
+void          nautilus_file_record_free                    (NautilusFileRecord     *record);
 NautilusFile *nautilus_file_new_from_filename              (NautilusDirectory *directory,
                                                             const char        *filename,
                                                             gboolean           self_owned);
@@ -1907,9 +1907,21 @@ nautilus_file_undo_info_trash_add_file (NautilusFileUndoInfoTrash *self,
 {
     /* Convert from microseconds to seconds */
     gint64 orig_trash_time = g_get_real_time () / 1000000;
+
+    nautilus_file_undo_info_trash_add_file_at (self, file, orig_trash_time);
+}
+
+/* For files trashed a while before being added, with their deletion date
+ * in seconds since the epoch.
+ */
+void
+nautilus_file_undo_info_trash_add_file_at (NautilusFileUndoInfoTrash *self,
+                                           GFile                     *file,
+                                           gint64                     trash_time)
+{
     g_hash_table_insert (self->trashed,
                          g_object_ref (file),
-                         g_memdup2 (&orig_trash_time, sizeof (orig_trash_time)));
+                         g_memdup2 (&trash_time, sizeof (trash_time)));
 }
 
 GList *
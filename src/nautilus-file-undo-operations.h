@@ -168,6 +168,9 @@ G_DECLARE_FINAL_TYPE (NautilusFileUndoInfoTrash, nautilus_file_undo_info_trash,
 NautilusFileUndoInfo *nautilus_file_undo_info_trash_new (gint item_count);
 void nautilus_file_undo_info_trash_add_file (NautilusFileUndoInfoTrash *self,
                                              GFile                     *file);
+void nautilus_file_undo_info_trash_add_file_at (NautilusFileUndoInfoTrash *self,
+                                                GFile                     *file,
+                                                gint64                     trash_time);
 GList *nautilus_file_undo_info_trash_get_files (NautilusFileUndoInfoTrash *self);
 
 /* recursive permissions */
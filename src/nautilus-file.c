@@ -306,6 +306,15 @@ nautilus_file_set_display_name (NautilusFile *file,
     return changed;
 }
 
+static void
+invalidate_sort_keys (NautilusFile *file)
+{
+    g_clear_pointer (&file->details->type_collation_key, g_free);
+    g_clear_pointer (&file->details->mime_type_collation_key, g_free);
+    file->details->got_type_sort_keys = FALSE;
+    file->details->starred_generation = 0;
+}
+
 static void
 nautilus_file_clear_display_name (NautilusFile *file)
 {
@@ -579,6 +588,7 @@ nautilus_file_clear_info (NautilusFile *file)
     g_clear_pointer (&file->details->filesystem_id, g_ref_string_release);
 
     clear_metadata (file);
+    invalidate_sort_keys (file);
 }
 
 NautilusDirectory *
@@ -602,6 +612,7 @@ nautilus_file_set_directory (NautilusFile      *file,
 
     g_free (file->details->directory_name_collation_key);
     file->details->directory_name_collation_key = g_utf8_collate_key_for_filename (parent_uri, -1);
+    invalidate_sort_keys (file);
 
     g_object_notify_by_pspec (G_OBJECT (file), properties[PROP_DIRECTORY]);
 }
@@ -739,6 +750,104 @@ nautilus_file_new_from_info (NautilusDirectory *directory,
     return file;
 }
 
+/**
+ * nautilus_file_record_new:
+ * @info: the info of a file
+ *
+ * Prepares what nautilus_file_new_from_record() needs from @info. This is
+ * safe to call from any thread.
+ *
+ * Returns: (transfer full): a new #NautilusFileRecord
+ */
+NautilusFileRecord *
+nautilus_file_record_new (GFileInfo *info)
+{
+    NautilusFileRecord *record;
+    const char *display_name;
+    const char *mime_type;
+
+    record = g_new0 (NautilusFileRecord, 1);
+    record->info = g_object_ref (info);
+
+    display_name = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+    if (display_name != NULL && *display_name != '\0')
+    {
+        record->display_name = g_ref_string_new (display_name);
+        record->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+    }
+
+    mime_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+    if (mime_type == NULL)
+    {
+        mime_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
+    if (mime_type != NULL)
+    {
+        record->mime_type = g_ref_string_new_intern (mime_type);
+    }
+
+    record->is_hidden = g_file_info_get_attribute_boolean (info,
+                                                           G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN) ||
+                        g_file_info_get_attribute_boolean (info,
+                                                           G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP);
+
+    return record;
+}
+
+void
+nautilus_file_record_free (NautilusFileRecord *record)
+{
+    g_object_unref (record->info);
+    g_clear_pointer (&record->display_name, g_ref_string_release);
+    g_free (record->display_name_collation_key);
+    g_clear_pointer (&record->mime_type, g_ref_string_release);
+    g_free (record);
+}
+
+/**
+ * nautilus_file_new_from_record:
+ * @directory: the directory of the new file
+ * @record: a record made by nautilus_file_record_new()
+ *
+ * Like nautilus_file_new_from_info(), but takes over what @record already
+ * worked out instead of computing it again.
+ *
+ * Returns: (transfer full): a new #NautilusFile
+ */
+NautilusFile *
+nautilus_file_new_from_record (NautilusDirectory  *directory,
+                               NautilusFileRecord *record)
+{
+    NautilusFile *file;
+
+    g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
+    g_return_val_if_fail (record != NULL, NULL);
+
+    file = NAUTILUS_FILE (g_object_new (NAUTILUS_TYPE_VFS_FILE,
+                                        "directory", directory,
+                                        NULL));
+
+    /* update_info_and_name() finds these up to date and keeps them. */
+    if (record->display_name != NULL)
+    {
+        file->details->display_name = g_ref_string_acquire (record->display_name);
+        file->details->display_name_collation_key = g_steal_pointer (&record->display_name_collation_key);
+    }
+    if (record->mime_type != NULL)
+    {
+        file->details->mime_type = g_ref_string_acquire (record->mime_type);
+    }
+    file->details->is_hidden = record->is_hidden;
+
+    update_info_and_name (file, record->info);
+
+#ifdef NAUTILUS_FILE_DEBUG_REF
+    DEBUG_REF_PRINTF ("%10p ref'd", file);
+#endif
+
+    return file;
+}
+
 static NautilusFileInfo *
 nautilus_file_get_internal (GFile    *location,
                             gboolean  create)
@@ -901,6 +1010,8 @@ finalize (GObject *object)
     g_clear_pointer (&file->details->display_name, g_ref_string_release);
     g_free (file->details->display_name_collation_key);
     g_free (file->details->directory_name_collation_key);
+    g_free (file->details->type_collation_key);
+    g_free (file->details->mime_type_collation_key);
     g_clear_pointer (&file->details->edit_name, g_ref_string_release);
     if (file->details->icon)
     {
@@ -2365,7 +2476,7 @@ update_info_internal (NautilusFile *file,
                       GFileInfo    *info,
                       gboolean      update_name)
 {
-    GList *node;
+    gboolean in_hash_table;
     gboolean changed;
     gboolean is_symlink, is_hidden, is_mountpoint;
     gboolean has_permissions;
@@ -2822,8 +2933,8 @@ update_info_internal (NautilusFile *file,
         {
             changed = TRUE;
 
-            node = nautilus_directory_begin_file_name_change
-                       (file->details->directory, file);
+            in_hash_table = nautilus_directory_begin_file_name_change
+                                (file->details->directory, file);
 
             g_clear_pointer (&file->details->name, g_ref_string_release);
             if (g_strcmp0 (file->details->display_name, name) == 0)
@@ -2846,12 +2957,13 @@ update_info_internal (NautilusFile *file,
             }
 
             nautilus_directory_end_file_name_change
-                (file->details->directory, file, node);
+                (file->details->directory, file, in_hash_table);
         }
     }
 
     if (changed)
     {
+        invalidate_sort_keys (file);
         add_to_link_hash_table (file);
 
         update_links_if_target (file);
@@ -2879,7 +2991,7 @@ update_name_internal (NautilusFile *file,
                       const char   *name,
                       gboolean      in_directory)
 {
-    GList *node;
+    gboolean in_hash_table;
 
     g_assert (name != NULL);
 
@@ -2893,11 +3005,11 @@ update_name_internal (NautilusFile *file,
         return FALSE;
     }
 
-    node = NULL;
+    in_hash_table = FALSE;
     if (in_directory)
     {
-        node = nautilus_directory_begin_file_name_change
-                   (file->details->directory, file);
+        in_hash_table = nautilus_directory_begin_file_name_change
+                            (file->details->directory, file);
     }
 
     g_clear_pointer (&file->details->name, g_ref_string_release);
@@ -2907,11 +3019,12 @@ update_name_internal (NautilusFile *file,
     {
         nautilus_file_clear_display_name (file);
     }
+    invalidate_sort_keys (file);
 
     if (in_directory)
     {
         nautilus_directory_end_file_name_change
-            (file->details->directory, file, node);
+            (file->details->directory, file, in_hash_table);
     }
 
     return TRUE;
@@ -3336,19 +3449,37 @@ prepend_automatic_keywords (NautilusFile *file,
     return names;
 }
 
+static void
+ensure_type_sort_keys (NautilusFile *file)
+{
+    const char *type_string;
+
+    if (file->details->got_type_sort_keys)
+    {
+        return;
+    }
+
+    type_string = nautilus_file_get_type_as_string_no_extra_text (file);
+    file->details->type_collation_key = (type_string != NULL) ?
+                                        g_utf8_collate_key (type_string, -1) : NULL;
+    file->details->mime_type_collation_key = (file->details->mime_type != NULL) ?
+                                             g_utf8_collate_key (file->details->mime_type, -1) : NULL;
+    file->details->got_type_sort_keys = TRUE;
+}
+
 static int
 compare_by_type (NautilusFile *file_1,
                  NautilusFile *file_2)
 {
     gboolean is_directory_1;
     gboolean is_directory_2;
-    const char *type_string_1;
-    const char *type_string_2;
+    const char *type_key_1;
+    const char *type_key_2;
     int result;
 
     /* Directories go first. Then, if mime types are identical,
-     * don't bother getting strings (for speed). This assumes
-     * that the string is dependent entirely on the mime type,
+     * don't bother looking at the type strings (for speed). This
+     * assumes that the string is dependent entirely on the mime type,
      * which is true now but might not be later.
      */
     is_directory_1 = nautilus_file_is_directory (file_1);
@@ -3369,25 +3500,29 @@ compare_by_type (NautilusFile *file_1,
         return +1;
     }
 
+    /* Mime types are interned, so equal ones are the same string. */
     if (file_1->details->mime_type != NULL &&
-        file_2->details->mime_type != NULL &&
-        strcmp (file_1->details->mime_type,
-                file_2->details->mime_type) == 0)
+        file_1->details->mime_type == file_2->details->mime_type)
     {
         return 0;
     }
 
-    type_string_1 = nautilus_file_get_type_as_string_no_extra_text (file_1);
-    type_string_2 = nautilus_file_get_type_as_string_no_extra_text (file_2);
+    /* Collation keys are built once per file rather than collating the
+     * type strings on every comparison.
+     */
+    ensure_type_sort_keys (file_1);
+    ensure_type_sort_keys (file_2);
+    type_key_1 = file_1->details->type_collation_key;
+    type_key_2 = file_2->details->type_collation_key;
 
-    if (type_string_1 == NULL || type_string_2 == NULL)
+    if (type_key_1 == NULL || type_key_2 == NULL)
     {
-        if (type_string_1 != NULL)
+        if (type_key_1 != NULL)
         {
             return -1;
         }
 
-        if (type_string_2 != NULL)
+        if (type_key_2 != NULL)
         {
             return 1;
         }
@@ -3395,38 +3530,51 @@ compare_by_type (NautilusFile *file_1,
         return 0;
     }
 
-    result = g_utf8_collate (type_string_1, type_string_2);
+    result = strcmp (type_key_1, type_key_2);
     if (result == 0)
     {
         /* Among files of the same (generic) type, sort them by mime type. */
-        result = g_utf8_collate (file_1->details->mime_type, file_2->details->mime_type);
+        result = g_strcmp0 (file_1->details->mime_type_collation_key,
+                            file_2->details->mime_type_collation_key);
     }
 
     return result;
 }
 
+static gboolean
+get_is_starred_for_sort (NautilusFile *file)
+{
+    guint generation = nautilus_tag_manager_get_starred_generation ();
+
+    /* Looking the state up needs the URI, so only do it again once the
+     * set of starred files or the file's location has changed.
+     */
+    if (file->details->starred_generation != generation)
+    {
+        g_autofree gchar *uri = nautilus_file_get_uri (file);
+
+        file->details->is_starred = nautilus_tag_manager_file_is_starred (nautilus_tag_manager_get (),
+                                                                          uri);
+        file->details->starred_generation = generation;
+    }
+
+    return file->details->is_starred;
+}
+
 static int
 compare_by_starred (NautilusFile *file_1,
                     NautilusFile *file_2)
 {
-    NautilusTagManager *tag_manager = nautilus_tag_manager_get ();
-    g_autofree gchar *uri_1 = NULL;
-    g_autofree gchar *uri_2 = NULL;
     gboolean file_1_is_starred;
     gboolean file_2_is_starred;
 
-    uri_1 = nautilus_file_get_uri (file_1);
-    uri_2 = nautilus_file_get_uri (file_2);
-
-    file_1_is_starred = nautilus_tag_manager_file_is_starred (tag_manager,
-                                                              uri_1);
-    file_2_is_starred = nautilus_tag_manager_file_is_starred (tag_manager,
-                                                              uri_2);
-    if (!!file_1_is_starred == !!file_2_is_starred)
+    file_1_is_starred = get_is_starred_for_sort (file_1);
+    file_2_is_starred = get_is_starred_for_sort (file_2);
+    if (file_1_is_starred == file_2_is_starred)
     {
         return 0;
     }
-    else if (file_1_is_starred && !file_2_is_starred)
+    else if (file_1_is_starred)
     {
         return -1;
     }
@@ -3468,6 +3616,32 @@ compare_by_search_relevance (NautilusFile *file_1,
     return 0;
 }
 
+static gint64
+get_time_sort_key (NautilusFile     *file,
+                   NautilusDateType  type)
+{
+    time_t time = 0;
+
+    switch (get_time (file, &time, type))
+    {
+        case UNKNOWN:
+        {
+            return G_MININT64;
+        }
+
+        case UNKNOWABLE:
+        {
+            return G_MININT64 + 1;
+        }
+
+        case KNOWN:
+        default:
+        {
+            return time;
+        }
+    }
+}
+
 static int
 compare_by_time (NautilusFile     *file_1,
                  NautilusFile     *file_2,
@@ -3478,39 +3652,18 @@ compare_by_time (NautilusFile     *file_1,
      *   Files with "unknowable" times.
      *   Files with older times.
      *   Files with newer times.
+     *
+     * Known times are never 0, so they can't clash with the two values
+     * below all others that stand for the unknown cases.
      */
+    gint64 key_1 = get_time_sort_key (file_1, type);
+    gint64 key_2 = get_time_sort_key (file_2, type);
 
-    Knowledge time_known_1, time_known_2;
-    time_t time_1, time_2;
-
-    time_1 = 0;
-    time_2 = 0;
-
-    time_known_1 = get_time (file_1, &time_1, type);
-    time_known_2 = get_time (file_2, &time_2, type);
-
-    if (time_known_1 > time_known_2)
-    {
-        return -1;
-    }
-    if (time_known_1 < time_known_2)
-    {
-        return +1;
-    }
-
-    /* Now time_known_1 is equal to time_known_2. Check whether
-     * we failed to get modification times for files
-     */
-    if (time_known_1 == UNKNOWABLE || time_known_1 == UNKNOWN)
-    {
-        return 0;
-    }
-
-    if (time_1 < time_2)
+    if (key_1 < key_2)
     {
         return -1;
     }
-    if (time_1 > time_2)
+    if (key_1 > key_2)
     {
         return +1;
     }
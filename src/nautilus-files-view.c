@@ -84,6 +84,7 @@
 #include "nautilus-ui-utilities.h"
 #include "nautilus-view.h"
 #include "nautilus-view-model.h"
+#include "nautilus-window.h"
 #include "nautilus-tracker-utilities.h"
 
 /* Minimum starting update inverval */
@@ -3944,6 +3945,18 @@ done_loading (NautilusFilesView *view,
         g_clear_pointer (&priv->pending_selection, nautilus_file_list_free);
 
         nautilus_files_view_display_selection_info (view);
+
+        if (nautilus_view_is_searching (NAUTILUS_VIEW (view)) && all_files_seen && priv->active &&
+            nautilus_search_directory_is_truncated (NAUTILUS_SEARCH_DIRECTORY (priv->directory)))
+        {
+            GtkWindow *window = nautilus_files_view_get_containing_window (view);
+
+            if (NAUTILUS_IS_WINDOW (window))
+            {
+                nautilus_window_show_notification (NAUTILUS_WINDOW (window),
+                                                   _("Not all results are shown. Refine the search to find more."));
+            }
+        }
     }
 
     priv->loading = FALSE;
@@ -153,3 +153,26 @@ nautilus_hash_queue_move_existing_to_tail (NautilusHashQueue *queue,
     g_queue_unlink ((GQueue *) queue, link);
     g_queue_push_tail_link ((GQueue *) queue, link);
 }
+
+/**
+ * nautilus_hash_queue_peek_head_n:
+ * @queue: a #NautilusHashQueue
+ * @n: the maximum number of items to return
+ *
+ * Returns: (transfer container): the first @n items of the queue, from the
+ *     head, without removing or referencing them.
+ */
+GList *
+nautilus_hash_queue_peek_head_n (NautilusHashQueue *queue,
+                                 guint              n)
+{
+    GList *items = NULL;
+    guint i = 0;
+
+    for (GList *l = queue->parent.head; l != NULL && i < n; l = l->next, i++)
+    {
+        items = g_list_prepend (items, l->data);
+    }
+
+    return g_list_reverse (items);
+}
@@ -42,6 +42,8 @@ void               nautilus_hash_queue_move_existing_to_head (NautilusHashQueue
                                                               gconstpointer      key);
 void               nautilus_hash_queue_move_existing_to_tail (NautilusHashQueue *queue,
                                                               gconstpointer      key);
+GList             *nautilus_hash_queue_peek_head_n           (NautilusHashQueue *queue,
+                                                              guint              n);
 
 /* Get the file at the head of the queue without removing or unrefing it. */
 #define nautilus_hash_queue_peek_head(queue) (g_queue_peek_head ((GQueue *) (queue)))
@@ -16,6 +16,7 @@
 #include "nautilus-file-operations.h"
 #include "nautilus-metadata.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-search-directory.h"
 #include "nautilus-thumbnails.h"
 
 #ifdef GDK_WINDOWING_X11
@@ -43,6 +44,8 @@ struct _NautilusListBasePrivate
 {
     NautilusViewModel *model;
     NautilusFile *directory_as_file;
+    /* Set when showing search results, which are listed a page at a time. */
+    NautilusSearchDirectory *search_directory;
 
     GtkWidget *overlay;
     GtkWidget *scrolled_window;
@@ -937,6 +940,32 @@ typedef struct
     GQuark attribute_q;
 } NautilusListBaseSortData;
 
+/* Search results are listed a page at a time, the most relevant first,
+ * which only makes sense when they are sorted by relevance.
+ */
+static void
+update_search_paging (NautilusListBase *self)
+{
+    NautilusListBasePrivate *priv = nautilus_list_base_get_instance_private (self);
+    g_autoptr (GVariant) sort_state = NULL;
+    const char *sort_attribute = NULL;
+
+    /* The sort state is only set once there is a model. */
+    if (priv->search_directory == NULL || priv->model == NULL)
+    {
+        return;
+    }
+
+    sort_state = nautilus_list_base_get_sort_state (self);
+    if (sort_state != NULL)
+    {
+        g_variant_get (sort_state, "(&sb)", &sort_attribute, NULL);
+    }
+
+    nautilus_search_directory_set_show_all_files (priv->search_directory,
+                                                  g_strcmp0 (sort_attribute, "search_relevance") != 0);
+}
+
 static void
 base_setup_directory (NautilusListBase  *self,
                       NautilusDirectory *directory)
@@ -946,6 +975,13 @@ base_setup_directory (NautilusListBase  *self,
     g_clear_object (&priv->directory_as_file);
     priv->directory_as_file = nautilus_directory_get_corresponding_file (directory);
 
+    g_clear_object (&priv->search_directory);
+    if (NAUTILUS_IS_SEARCH_DIRECTORY (directory))
+    {
+        priv->search_directory = g_object_ref (NAUTILUS_SEARCH_DIRECTORY (directory));
+        update_search_paging (self);
+    }
+
     /* Temporary workaround */
     rubberband_set_state (self, TRUE);
 
@@ -1074,6 +1110,7 @@ nautilus_list_base_dispose (GObject *object)
     NautilusListBasePrivate *priv = nautilus_list_base_get_instance_private (self);
 
     g_clear_object (&priv->directory_as_file);
+    g_clear_object (&priv->search_directory);
     g_clear_object (&priv->model);
     g_clear_handle_id (&priv->hover_timer_id, g_source_remove);
     g_clear_handle_id (&priv->scroll_timeout_id, g_source_remove);
@@ -1316,6 +1353,30 @@ nautilus_list_base_class_init (NautilusListBaseClass *klass)
                                                           GTK_TYPE_WIDGET);
 }
 
+static void
+on_edge_reached (GtkScrolledWindow *scrolled_window,
+                 GtkPositionType    position,
+                 gpointer           user_data)
+{
+    NautilusListBase *self = NAUTILUS_LIST_BASE (user_data);
+    NautilusListBasePrivate *priv = nautilus_list_base_get_instance_private (self);
+
+    if (position == GTK_POS_BOTTOM &&
+        priv->search_directory != NULL &&
+        nautilus_search_directory_has_more_files (priv->search_directory))
+    {
+        nautilus_search_directory_load_more_files (priv->search_directory);
+    }
+}
+
+static void
+on_sort_state_changed (GObject    *object,
+                       GParamSpec *pspec,
+                       gpointer    user_data)
+{
+    update_search_paging (NAUTILUS_LIST_BASE (object));
+}
+
 static void
 nautilus_list_base_init (NautilusListBase *self)
 {
@@ -1333,6 +1394,11 @@ nautilus_list_base_init (NautilusListBase *self)
     gtk_event_controller_set_propagation_phase (controller, GTK_PHASE_CAPTURE);
     g_signal_connect (controller, "scroll", G_CALLBACK (on_scroll), self);
 
+    g_signal_connect (priv->scrolled_window, "edge-reached",
+                      G_CALLBACK (on_edge_reached), self);
+    g_signal_connect (self, "notify::sort-state",
+                      G_CALLBACK (on_sort_state_changed), NULL);
+
     g_signal_connect_object (nautilus_preferences,
                              "changed::" NAUTILUS_PREFERENCES_CLICK_POLICY,
                              G_CALLBACK (set_click_mode_from_settings), self,
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "nautilus-mount-table"
+
+#include <config.h>
+#include "nautilus-mount-table.h"
+
+#include <gio/gio.h>
+#include <gio/gunixmounts.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+/* Lists the mount points and the devices they are on, with major and minor
+ * numbers, which the generic mount API doesn't give.
+ */
+#define MOUNTINFO_PATH "/proc/self/mountinfo"
+
+typedef struct
+{
+    char *mount_path;
+    char *fs_type;
+    gboolean is_remote;
+} MountEntry;
+
+static GMutex table_mutex;
+/* Guarded by the mutex. The mounts are sorted with the longest mount paths
+ * first, so that the first mount containing a path is the one it's on.
+ */
+static GPtrArray *mounts;
+static GHashTable *mounts_by_device;
+/* Whether mounts changed since the table was read. Atomic. */
+static gint table_stale = TRUE;
+
+/* The file system types that go through the network. FUSE file systems are
+ * listed with their subtype.
+ */
+static const char *remote_fs_types[] =
+{
+    "9p",
+    "afs",
+    "autofs",
+    "ceph",
+    "cifs",
+    "coda",
+    "davfs",
+    "fuse.glusterfs",
+    "fuse.rclone",
+    "fuse.s3fs",
+    "fuse.sshfs",
+    "ncpfs",
+    "nfs",
+    "nfs4",
+    "smb3",
+    "smbfs",
+    "sshfs",
+};
+
+static gboolean
+is_remote_fs_type (const char *fs_type)
+{
+    for (guint i = 0; i < G_N_ELEMENTS (remote_fs_types); i++)
+    {
+        if (g_strcmp0 (fs_type, remote_fs_types[i]) == 0)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+mount_entry_free (MountEntry *entry)
+{
+    g_free (entry->mount_path);
+    g_free (entry->fs_type);
+    g_free (entry);
+}
+
+static MountEntry *
+add_mount (const char *mount_path,
+           const char *fs_type)
+{
+    MountEntry *entry = g_new0 (MountEntry, 1);
+
+    entry->mount_path = g_strdup (mount_path);
+    entry->fs_type = g_strdup (fs_type);
+    entry->is_remote = is_remote_fs_type (fs_type);
+    g_ptr_array_add (mounts, entry);
+
+    return entry;
+}
+
+#ifdef __linux__
+/* Lines look like this, with optional fields before the dash:
+ *
+ *   36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw
+ */
+static gboolean
+read_mountinfo (void)
+{
+    g_autofree char *contents = NULL;
+    g_auto (GStrv) lines = NULL;
+
+    if (!g_file_get_contents (MOUNTINFO_PATH, &contents, NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (guint i = 0; lines[i] != NULL; i++)
+    {
+        g_auto (GStrv) fields = g_strsplit (lines[i], " ", -1);
+        g_autofree char *mount_path = NULL;
+        guint n_fields = g_strv_length (fields);
+        guint separator = 6;
+        guint major;
+        guint minor;
+        MountEntry *entry;
+
+        while (separator < n_fields && strcmp (fields[separator], "-") != 0)
+        {
+            separator++;
+        }
+        if (separator + 1 >= n_fields ||
+            sscanf (fields[2], "%u:%u", &major, &minor) != 2)
+        {
+            continue;
+        }
+
+        /* Spaces and such are escaped in octal. */
+        mount_path = g_strcompress (fields[4]);
+        entry = add_mount (mount_path, fields[separator + 1]);
+
+        /* Bind mounts share the device of what they mount, so the first
+         * entry is as good as any.
+         */
+        if (!g_hash_table_contains (mounts_by_device,
+                                    GUINT_TO_POINTER ((guint32) makedev (major, minor))))
+        {
+            g_hash_table_insert (mounts_by_device,
+                                 GUINT_TO_POINTER ((guint32) makedev (major, minor)),
+                                 entry);
+        }
+    }
+
+    return TRUE;
+}
+#endif
+
+/* Devices are not known this way, so only lookups by path work. */
+static void
+read_unix_mounts (void)
+{
+    GList *unix_mounts = g_unix_mounts_get (NULL);
+
+    for (GList *l = unix_mounts; l != NULL; l = l->next)
+    {
+        add_mount (g_unix_mount_get_mount_path (l->data),
+                   g_unix_mount_get_fs_type (l->data));
+    }
+
+    g_list_free_full (unix_mounts, (GDestroyNotify) g_unix_mount_free);
+}
+
+static gint
+compare_mount_path_length (gconstpointer a,
+                           gconstpointer b)
+{
+    const MountEntry *entry_a = *(const MountEntry **) a;
+    const MountEntry *entry_b = *(const MountEntry **) b;
+
+    return strlen (entry_b->mount_path) - strlen (entry_a->mount_path);
+}
+
+static void
+on_mounts_changed (GUnixMountMonitor *monitor,
+                   gpointer           user_data)
+{
+    g_atomic_int_set (&table_stale, TRUE);
+}
+
+/* Must be called with the mutex held. */
+static void
+ensure_table (void)
+{
+    static gsize monitor_initialized = FALSE;
+
+    if (g_once_init_enter (&monitor_initialized))
+    {
+        /* Kept for the lifetime of the process. The signal is emitted in
+         * the main context, which is fine since it only flags the table.
+         */
+        g_signal_connect (g_unix_mount_monitor_get (), "mounts-changed",
+                          G_CALLBACK (on_mounts_changed), NULL);
+        g_once_init_leave (&monitor_initialized, TRUE);
+    }
+
+    if (!g_atomic_int_compare_and_exchange (&table_stale, TRUE, FALSE))
+    {
+        return;
+    }
+
+    g_clear_pointer (&mounts_by_device, g_hash_table_destroy);
+    g_clear_pointer (&mounts, g_ptr_array_unref);
+    mounts = g_ptr_array_new_with_free_func ((GDestroyNotify) mount_entry_free);
+    mounts_by_device = g_hash_table_new (NULL, NULL);
+
+#ifdef __linux__
+    if (!read_mountinfo ())
+#endif
+    {
+        read_unix_mounts ();
+    }
+
+    /* Later mounts hide earlier ones on the same path, so they must come
+     * first after sorting, which keeps the order of equal elements.
+     */
+    for (guint i = 0; i < mounts->len / 2; i++)
+    {
+        gpointer entry = mounts->pdata[i];
+
+        mounts->pdata[i] = mounts->pdata[mounts->len - 1 - i];
+        mounts->pdata[mounts->len - 1 - i] = entry;
+    }
+    g_ptr_array_sort (mounts, compare_mount_path_length);
+
+    g_debug ("Read %u mounts", mounts->len);
+}
+
+/* Must be called with the mutex held. */
+static MountEntry *
+find_mount_for_path (const char *path)
+{
+    for (guint i = 0; i < mounts->len; i++)
+    {
+        MountEntry *entry = g_ptr_array_index (mounts, i);
+        gsize length = strlen (entry->mount_path);
+
+        if (strncmp (path, entry->mount_path, length) == 0 &&
+            (path[length] == '\0' || path[length] == '/' ||
+             (length > 0 && entry->mount_path[length - 1] == '/')))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static NautilusMountLocality
+get_locality (MountEntry *entry)
+{
+    if (entry == NULL)
+    {
+        return NAUTILUS_MOUNT_LOCALITY_UNKNOWN;
+    }
+
+    return entry->is_remote ? NAUTILUS_MOUNT_LOCALITY_REMOTE : NAUTILUS_MOUNT_LOCALITY_LOCAL;
+}
+
+/**
+ * nautilus_mount_table_get_device_locality:
+ * @device: a device number, as in the unix::device attribute
+ *
+ * Returns: whether the file system on @device is remote, if known
+ */
+NautilusMountLocality
+nautilus_mount_table_get_device_locality (guint32 device)
+{
+    g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&table_mutex);
+
+    ensure_table ();
+
+    return get_locality (g_hash_table_lookup (mounts_by_device, GUINT_TO_POINTER (device)));
+}
+
+/**
+ * nautilus_mount_table_get_path_locality:
+ * @path: an absolute path
+ *
+ * Returns: whether the file system @path is on is remote, if known
+ */
+NautilusMountLocality
+nautilus_mount_table_get_path_locality (const char *path)
+{
+    g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&table_mutex);
+
+    ensure_table ();
+
+    return get_locality (find_mount_for_path (path));
+}
+
+/**
+ * nautilus_mount_table_get_fuse_mount_path:
+ * @path: an absolute path
+ *
+ * Returns: (transfer full) (nullable): the mount point of the FUSE file
+ *     system @path is on, or %NULL if it's not on one
+ */
+char *
+nautilus_mount_table_get_fuse_mount_path (const char *path)
+{
+    g_autoptr (GMutexLocker) locker = g_mutex_locker_new (&table_mutex);
+    MountEntry *entry;
+
+    ensure_table ();
+
+    entry = find_mount_for_path (path);
+    if (entry == NULL || !g_str_has_prefix (entry->fs_type, "fuse"))
+    {
+        return NULL;
+    }
+
+    return g_strdup (entry->mount_path);
+}
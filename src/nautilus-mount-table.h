@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* A cache of the mount table, to tell whether a file is on a remote file
+ * system without asking the file system. The cache is read again after
+ * mounts change. It can be used from any thread.
+ */
+
+typedef enum
+{
+    NAUTILUS_MOUNT_LOCALITY_UNKNOWN,
+    NAUTILUS_MOUNT_LOCALITY_LOCAL,
+    NAUTILUS_MOUNT_LOCALITY_REMOTE,
+} NautilusMountLocality;
+
+NautilusMountLocality nautilus_mount_table_get_device_locality (guint32     device);
+NautilusMountLocality nautilus_mount_table_get_path_locality   (const char *path);
+
+char                 *nautilus_mount_table_get_fuse_mount_path (const char *path);
@@ -0,0 +1,2109 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "nautilus-name-index"
+
+#include <config.h>
+#include "nautilus-name-index.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "nautilus-tracker-utilities.h"
+
+/* On-disk layout, in host byte order:
+ *
+ *   magic (4 bytes), version (u32), entry count (u32), restart count (u32),
+ *   build time (u64), restart offsets (u32 each), then per entry: the length of the prefix it
+ *   shares with the name before (u16), the length of the rest of the name
+ *   (u16), the rest of the name, the parent id (u32) and flags (u8).
+ *
+ * Entries are sorted by name, and their ids are their positions. Every
+ * RESTART_INTERVAL entries the whole name is stored, so that entries can be
+ * found without decoding all the ones before them; the restart offsets
+ * point at those entries, relative to the first one. Roots are stored with
+ * their absolute path as name and without parent.
+ *
+ * The build time is when the crawl the index comes from started, in
+ * microseconds since the epoch. Merging changes keeps it, so that it tells
+ * how long changes may have been missed.
+ */
+#define INDEX_MAGIC "NNIX"
+#define INDEX_VERSION 2
+#define HEADER_SIZE 24
+#define RESTART_INTERVAL 16
+#define ENTRY_HEADER_SIZE 4
+#define ENTRY_TRAILER_SIZE 5
+#define MAX_NAME_LENGTH 4096
+
+#define NO_ENTRY G_MAXUINT32
+
+/* Changes made while Nautilus isn't watching are missed, so start over
+ * once the index is this old. It's only kept up to date while Tracker
+ * can't be searched, which is known some time after starting up.
+ */
+#define MAX_AGE_SECONDS (24 * 60 * 60)
+#define STALE_CHECK_INTERVAL_SECONDS (60 * 60)
+#define FIRST_STALE_CHECK_SECONDS 30
+
+#define SAVE_TIMEOUT_SECONDS 60
+
+#define CANCEL_CHECK_INTERVAL 4096
+
+#define CRAWL_ATTRIBUTES \
+        G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+        G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+        G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+        G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+        G_FILE_ATTRIBUTE_ID_FILESYSTEM
+
+enum
+{
+    FLAG_DIRECTORY = 1 << 0,
+    FLAG_HIDDEN = 1 << 1,
+    /* A directory of another file system, whose files aren't indexed */
+    FLAG_MOUNT_POINT = 1 << 2,
+};
+
+/* Reference counted, so that searches can read it without the lock. */
+typedef struct
+{
+    GMappedFile *mapped_file;
+    const guint8 *data;
+    gsize length;
+    guint32 n_entries;
+    guint32 n_restarts;
+    gint64 build_time;
+    gsize entries_offset;
+} IndexData;
+
+typedef struct
+{
+    const IndexData *index_data;
+    gsize offset;
+    guint32 next_id;
+
+    /* The entry decoded last */
+    guint32 id;
+    char name[MAX_NAME_LENGTH + 1];
+    gsize name_length;
+    guint32 parent;
+    guint8 flags;
+} IndexCursor;
+
+typedef struct
+{
+    guint8 flags;
+    guint64 serial;
+} OverlayEntry;
+
+typedef struct
+{
+    char *name;
+    guint32 parent;
+    guint8 flags;
+} BuilderEntry;
+
+struct _NautilusNameIndex
+{
+    GObject parent_instance;
+
+    char *filename;
+    GStrv roots;
+
+    GRWLock lock;
+    /* The following data can be accessed from different threads and needs
+     * to hold the lock. Changes since the index was written are kept in the
+     * overlay, numbered so that the ones a new index already includes can
+     * be dropped once it replaces the old one.
+     */
+    IndexData *index_data;
+    GHashTable *added;      /* path → OverlayEntry */
+    GHashTable *removed;    /* path → OverlayEntry */
+    guint64 serial;
+
+    GPtrArray *pending_refresh;     /* paths */
+    gboolean refreshing;
+    gboolean writing;
+    guint save_timeout_id;
+    guint stale_check_id;
+};
+
+G_DEFINE_TYPE (NautilusNameIndex, nautilus_name_index, G_TYPE_OBJECT)
+
+static NautilusNameIndex *default_index = NULL;
+
+static void schedule_save (NautilusNameIndex *self);
+
+static guint16
+read_uint16 (const guint8 *data)
+{
+    guint16 value;
+
+    memcpy (&value, data, sizeof (value));
+
+    return value;
+}
+
+static guint32
+read_uint32 (const guint8 *data)
+{
+    guint32 value;
+
+    memcpy (&value, data, sizeof (value));
+
+    return value;
+}
+
+static guint64
+read_uint64 (const guint8 *data)
+{
+    guint64 value;
+
+    memcpy (&value, data, sizeof (value));
+
+    return value;
+}
+
+static void
+write_uint16 (GByteArray *array,
+              guint16     value)
+{
+    g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+write_uint32 (GByteArray *array,
+              guint32     value)
+{
+    g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+write_uint64 (GByteArray *array,
+              guint64     value)
+{
+    g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static IndexData *
+index_data_ref (IndexData *index_data)
+{
+    return g_atomic_rc_box_acquire (index_data);
+}
+
+static void
+index_data_clear (IndexData *index_data)
+{
+    g_mapped_file_unref (index_data->mapped_file);
+}
+
+static void
+index_data_unref (IndexData *index_data)
+{
+    g_atomic_rc_box_release_full (index_data, (GDestroyNotify) index_data_clear);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IndexData, index_data_unref)
+
+static IndexData *
+index_data_load (const char  *filename,
+                 GError     **error)
+{
+    g_autoptr (GMappedFile) mapped_file = NULL;
+    IndexData *index_data;
+    const guint8 *data;
+    gsize length;
+    guint32 n_entries;
+    guint32 n_restarts;
+
+    mapped_file = g_mapped_file_new (filename, FALSE, error);
+    if (mapped_file == NULL)
+    {
+        return NULL;
+    }
+
+    data = (const guint8 *) g_mapped_file_get_contents (mapped_file);
+    length = g_mapped_file_get_length (mapped_file);
+
+    if (length < HEADER_SIZE ||
+        memcmp (data, INDEX_MAGIC, strlen (INDEX_MAGIC)) != 0 ||
+        read_uint32 (data + 4) != INDEX_VERSION)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Incompatible name index %s", filename);
+        return NULL;
+    }
+
+    n_entries = read_uint32 (data + 8);
+    n_restarts = read_uint32 (data + 12);
+    if (n_restarts != (n_entries + RESTART_INTERVAL - 1) / RESTART_INTERVAL ||
+        (length - HEADER_SIZE) / sizeof (guint32) < n_restarts)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Name index %s is truncated", filename);
+        return NULL;
+    }
+
+    index_data = g_atomic_rc_box_new0 (IndexData);
+    index_data->mapped_file = g_steal_pointer (&mapped_file);
+    index_data->data = data;
+    index_data->length = length;
+    index_data->n_entries = n_entries;
+    index_data->n_restarts = n_restarts;
+    index_data->build_time = read_uint64 (data + 16);
+    index_data->entries_offset = HEADER_SIZE + (gsize) n_restarts * sizeof (guint32);
+
+    return index_data;
+}
+
+static void
+cursor_seek (IndexCursor     *cursor,
+             const IndexData *index_data,
+             guint32          restart)
+{
+    cursor->index_data = index_data;
+    cursor->next_id = restart * RESTART_INTERVAL;
+    cursor->offset = index_data->length;
+    cursor->name_length = 0;
+    cursor->name[0] = '\0';
+
+    if (restart < index_data->n_restarts)
+    {
+        const guint8 *restarts = index_data->data + HEADER_SIZE;
+
+        cursor->offset = index_data->entries_offset +
+                         read_uint32 (restarts + restart * sizeof (guint32));
+    }
+}
+
+/* Decodes the next entry. Returns %FALSE at the end, or if the data turns
+ * out to be corrupt.
+ */
+static gboolean
+cursor_next (IndexCursor *cursor)
+{
+    const IndexData *index_data = cursor->index_data;
+    const guint8 *data = index_data->data;
+    guint16 shared;
+    guint16 suffix;
+
+    if (cursor->next_id >= index_data->n_entries ||
+        cursor->offset > index_data->length ||
+        index_data->length - cursor->offset < ENTRY_HEADER_SIZE)
+    {
+        return FALSE;
+    }
+
+    shared = read_uint16 (data + cursor->offset);
+    suffix = read_uint16 (data + cursor->offset + 2);
+    cursor->offset += ENTRY_HEADER_SIZE;
+
+    if (shared > cursor->name_length ||
+        (gsize) shared + suffix > MAX_NAME_LENGTH ||
+        index_data->length - cursor->offset < (gsize) suffix + ENTRY_TRAILER_SIZE)
+    {
+        return FALSE;
+    }
+
+    memcpy (cursor->name + shared, data + cursor->offset, suffix);
+    cursor->name_length = shared + suffix;
+    cursor->name[cursor->name_length] = '\0';
+    cursor->offset += suffix;
+
+    cursor->parent = read_uint32 (data + cursor->offset);
+    cursor->flags = data[cursor->offset + 4];
+    cursor->offset += ENTRY_TRAILER_SIZE;
+
+    cursor->id = cursor->next_id++;
+
+    return TRUE;
+}
+
+static gboolean
+cursor_seek_to_id (IndexCursor     *cursor,
+                   const IndexData *index_data,
+                   guint32          id)
+{
+    if (id >= index_data->n_entries)
+    {
+        return FALSE;
+    }
+
+    cursor_seek (cursor, index_data, id / RESTART_INTERVAL);
+    while (cursor_next (cursor))
+    {
+        if (cursor->id == id)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Returns the id of the entry called @name inside @parent, or NO_ENTRY. */
+static guint32
+index_data_lookup (const IndexData *index_data,
+                   guint32          parent,
+                   const char      *name)
+{
+    IndexCursor cursor;
+    guint32 low = 0;
+    guint32 high = index_data->n_restarts;
+
+    /* Find the first restart that doesn't sort before @name. Entries with
+     * that name may begin in the block before it.
+     */
+    while (low < high)
+    {
+        guint32 middle = low + (high - low) / 2;
+
+        cursor_seek (&cursor, index_data, middle);
+        if (!cursor_next (&cursor))
+        {
+            return NO_ENTRY;
+        }
+
+        if (strcmp (cursor.name, name) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    cursor_seek (&cursor, index_data, (low > 0) ? low - 1 : 0);
+    while (cursor_next (&cursor))
+    {
+        int result = strcmp (cursor.name, name);
+
+        if (result > 0)
+        {
+            break;
+        }
+
+        if (result == 0 && cursor.parent == parent)
+        {
+            return cursor.id;
+        }
+    }
+
+    return NO_ENTRY;
+}
+
+/* Returns the part of @path inside @ancestor, "" if they are the same, or
+ * %NULL if @path isn't inside @ancestor.
+ */
+static const char *
+path_get_relative (const char *path,
+                   const char *ancestor)
+{
+    gsize length = strlen (ancestor);
+
+    if (strncmp (path, ancestor, length) != 0)
+    {
+        return NULL;
+    }
+
+    if (path[length] == '\0')
+    {
+        return path + length;
+    }
+
+    if (length > 0 && ancestor[length - 1] == '/')
+    {
+        return path + length;
+    }
+
+    if (path[length] == '/')
+    {
+        return path + length + 1;
+    }
+
+    return NULL;
+}
+
+static guint32
+index_data_locate (const IndexData    *index_data,
+                   const char * const *roots,
+                   const char         *path)
+{
+    for (guint i = 0; roots[i] != NULL; i++)
+    {
+        const char *relative = path_get_relative (path, roots[i]);
+        g_auto (GStrv) components = NULL;
+        guint32 id;
+
+        if (relative == NULL)
+        {
+            continue;
+        }
+
+        id = index_data_lookup (index_data, NO_ENTRY, roots[i]);
+        components = g_strsplit (relative, "/", -1);
+        for (guint j = 0; id != NO_ENTRY && components[j] != NULL; j++)
+        {
+            if (components[j][0] != '\0')
+            {
+                id = index_data_lookup (index_data, id, components[j]);
+            }
+        }
+
+        return id;
+    }
+
+    return NO_ENTRY;
+}
+
+static gboolean
+is_inside_roots (NautilusNameIndex *self,
+                 const char        *path)
+{
+    for (guint i = 0; self->roots[i] != NULL; i++)
+    {
+        if (path_get_relative (path, self->roots[i]) != NULL)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+name_is_hidden (const char *name)
+{
+    gsize length = strlen (name);
+
+    return length > 0 && (name[0] == '.' || name[length - 1] == '~');
+}
+
+/* Files added since the index was written weren't looked at as a whole, so
+ * whether their directories are hidden is only known from their names.
+ */
+static gboolean
+relative_path_is_hidden (const char *relative)
+{
+    g_auto (GStrv) components = g_strsplit (relative, "/", -1);
+
+    for (guint i = 0; components[i] != NULL; i++)
+    {
+        if (name_is_hidden (components[i]))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Must be called with the lock held. */
+static gboolean
+overlay_is_removed (NautilusNameIndex *self,
+                    const char        *path)
+{
+    g_autofree char *prefix = NULL;
+    char *slash;
+
+    if (g_hash_table_size (self->removed) == 0)
+    {
+        return FALSE;
+    }
+
+    prefix = g_strdup (path);
+    while (TRUE)
+    {
+        if (g_hash_table_contains (self->removed, prefix))
+        {
+            return TRUE;
+        }
+
+        slash = strrchr (prefix, '/');
+        if (slash == NULL || slash == prefix)
+        {
+            return FALSE;
+        }
+        *slash = '\0';
+    }
+}
+
+/* Must be called with the lock held for writing. */
+static void
+overlay_add (NautilusNameIndex *self,
+             const char        *path,
+             guint8             flags)
+{
+    OverlayEntry *entry = g_new0 (OverlayEntry, 1);
+
+    entry->flags = flags;
+    entry->serial = ++self->serial;
+    g_hash_table_replace (self->added, g_strdup (path), entry);
+}
+
+static gboolean
+overlay_entry_is_inside (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+    return path_get_relative (key, user_data) != NULL;
+}
+
+/* Must be called with the lock held for writing. */
+static void
+overlay_remove (NautilusNameIndex *self,
+                const char        *path)
+{
+    OverlayEntry *entry = g_new0 (OverlayEntry, 1);
+
+    entry->serial = ++self->serial;
+    g_hash_table_replace (self->removed, g_strdup (path), entry);
+
+    g_hash_table_foreach_remove (self->added, overlay_entry_is_inside, (gpointer) path);
+}
+
+static gboolean
+overlay_entry_is_before (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+    OverlayEntry *entry = value;
+    guint64 *serial = user_data;
+
+    return entry->serial <= *serial;
+}
+
+static void
+builder_entry_clear (BuilderEntry *entry)
+{
+    g_free (entry->name);
+}
+
+static GArray *
+builder_new (void)
+{
+    GArray *entries = g_array_new (FALSE, FALSE, sizeof (BuilderEntry));
+
+    g_array_set_clear_func (entries, (GDestroyNotify) builder_entry_clear);
+
+    return entries;
+}
+
+static guint32
+builder_add (GArray  *entries,
+             char    *name,
+             guint32  parent,
+             guint8   flags)
+{
+    BuilderEntry entry = { name, parent, flags };
+
+    g_array_append_val (entries, entry);
+
+    return entries->len - 1;
+}
+
+static gint
+compare_builder_entries (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
+{
+    GArray *entries = user_data;
+
+    return strcmp (g_array_index (entries, BuilderEntry, *(const guint32 *) a).name,
+                   g_array_index (entries, BuilderEntry, *(const guint32 *) b).name);
+}
+
+static GByteArray *
+builder_encode (GArray *entries,
+                gint64  build_time)
+{
+    guint32 n_entries = entries->len;
+    guint32 n_restarts = (n_entries + RESTART_INTERVAL - 1) / RESTART_INTERVAL;
+    g_autoptr (GArray) order = g_array_sized_new (FALSE, FALSE, sizeof (guint32), n_entries);
+    g_autofree guint32 *new_ids = g_new (guint32, MAX (n_entries, 1));
+    GByteArray *array;
+    const char *previous = "";
+    gsize entries_start;
+
+    for (guint32 i = 0; i < n_entries; i++)
+    {
+        g_array_append_val (order, i);
+    }
+    g_array_sort_with_data (order, compare_builder_entries, entries);
+    for (guint32 i = 0; i < n_entries; i++)
+    {
+        new_ids[g_array_index (order, guint32, i)] = i;
+    }
+
+    array = g_byte_array_new ();
+    g_byte_array_append (array, (const guint8 *) INDEX_MAGIC, strlen (INDEX_MAGIC));
+    write_uint32 (array, INDEX_VERSION);
+    write_uint32 (array, n_entries);
+    write_uint32 (array, n_restarts);
+    write_uint64 (array, build_time);
+    g_byte_array_set_size (array, HEADER_SIZE + n_restarts * sizeof (guint32));
+    entries_start = array->len;
+
+    for (guint32 i = 0; i < n_entries; i++)
+    {
+        const BuilderEntry *entry = &g_array_index (entries, BuilderEntry,
+                                                    g_array_index (order, guint32, i));
+        gsize length = strlen (entry->name);
+        gsize shared = 0;
+
+        if (i % RESTART_INTERVAL == 0)
+        {
+            guint32 offset = array->len - entries_start;
+
+            memcpy (array->data + HEADER_SIZE + (i / RESTART_INTERVAL) * sizeof (guint32),
+                    &offset, sizeof (offset));
+        }
+        else
+        {
+            while (previous[shared] != '\0' && previous[shared] == entry->name[shared])
+            {
+                shared++;
+            }
+        }
+
+        write_uint16 (array, shared);
+        write_uint16 (array, length - shared);
+        g_byte_array_append (array, (const guint8 *) entry->name + shared, length - shared);
+        write_uint32 (array, (entry->parent == NO_ENTRY) ? NO_ENTRY : new_ids[entry->parent]);
+        g_byte_array_append (array, &entry->flags, 1);
+
+        previous = entry->name;
+    }
+
+    return array;
+}
+
+static guint8
+flags_from_info (GFileInfo *info)
+{
+    guint8 flags = 0;
+
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+    {
+        flags |= FLAG_DIRECTORY;
+    }
+
+    if (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN) ||
+        g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP))
+    {
+        flags |= FLAG_HIDDEN;
+    }
+
+    return flags;
+}
+
+typedef struct
+{
+    GFile *directory;
+    guint32 entry;
+} CrawlItem;
+
+static void
+crawl_item_free (CrawlItem *item)
+{
+    g_object_unref (item->directory);
+    g_free (item);
+}
+
+/* Adds everything inside @root to @entries, as children of @root_entry.
+ * Symbolic links aren't followed, and other file systems mounted inside
+ * @root are left out, so that remote ones aren't crawled.
+ */
+static void
+crawl (GFile        *root,
+       guint32       root_entry,
+       GArray       *entries,
+       GCancellable *cancellable)
+{
+    g_autoptr (GFileInfo) root_info = NULL;
+    const char *filesystem_id = NULL;
+    GQueue directories = G_QUEUE_INIT;
+    CrawlItem *item;
+
+    root_info = g_file_query_info (root, G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                   cancellable, NULL);
+    if (root_info != NULL)
+    {
+        filesystem_id = g_file_info_get_attribute_string (root_info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    }
+
+    item = g_new0 (CrawlItem, 1);
+    item->directory = g_object_ref (root);
+    item->entry = root_entry;
+    g_queue_push_tail (&directories, item);
+
+    while ((item = g_queue_pop_head (&directories)) != NULL)
+    {
+        g_autoptr (GFileEnumerator) enumerator = NULL;
+        GFileInfo *info;
+
+        if (g_cancellable_is_cancelled (cancellable))
+        {
+            crawl_item_free (item);
+            break;
+        }
+
+        enumerator = g_file_enumerate_children (item->directory, CRAWL_ATTRIBUTES,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                cancellable, NULL);
+        while (enumerator != NULL &&
+               (info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL)
+        {
+            const char *name = g_file_info_get_name (info);
+            guint8 flags = flags_from_info (info);
+            guint32 entry;
+
+            if (strlen (name) > MAX_NAME_LENGTH)
+            {
+                g_object_unref (info);
+                continue;
+            }
+
+            if ((flags & FLAG_DIRECTORY) &&
+                g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM),
+                           filesystem_id) != 0)
+            {
+                flags |= FLAG_MOUNT_POINT;
+            }
+
+            entry = builder_add (entries, g_strdup (name), item->entry, flags);
+
+            if ((flags & FLAG_DIRECTORY) && !(flags & FLAG_MOUNT_POINT))
+            {
+                CrawlItem *child = g_new0 (CrawlItem, 1);
+
+                child->directory = g_file_get_child (item->directory, name);
+                child->entry = entry;
+                g_queue_push_tail (&directories, child);
+            }
+
+            g_object_unref (info);
+        }
+
+        crawl_item_free (item);
+    }
+
+    g_queue_clear_full (&directories, (GDestroyNotify) crawl_item_free);
+}
+
+/* Writes @entries as the new index and starts using it. Changes up to
+ * @serial are part of @entries, so they are dropped from the overlay.
+ */
+static gboolean
+write_and_load (NautilusNameIndex  *self,
+                GArray             *entries,
+                guint64             serial,
+                gint64              build_time,
+                GError            **error)
+{
+    g_autoptr (GByteArray) array = NULL;
+    g_autofree char *dirname = NULL;
+    IndexData *index_data;
+
+    array = builder_encode (entries, build_time);
+
+    dirname = g_path_get_dirname (self->filename);
+    g_mkdir_with_parents (dirname, 0700);
+
+    /* The file is replaced rather than rewritten, so the current mapping
+     * stays valid until it is swapped below.
+     */
+    if (!g_file_set_contents (self->filename, (const char *) array->data, array->len, error))
+    {
+        return FALSE;
+    }
+
+    index_data = index_data_load (self->filename, error);
+    if (index_data == NULL)
+    {
+        return FALSE;
+    }
+
+    g_rw_lock_writer_lock (&self->lock);
+    g_clear_pointer (&self->index_data, index_data_unref);
+    self->index_data = index_data;
+    g_hash_table_foreach_remove (self->added, overlay_entry_is_before, &serial);
+    g_hash_table_foreach_remove (self->removed, overlay_entry_is_before, &serial);
+    g_rw_lock_writer_unlock (&self->lock);
+
+    g_debug ("Wrote name index with %u entries", index_data->n_entries);
+
+    return TRUE;
+}
+
+static void
+rebuild_thread (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+    NautilusNameIndex *self = source_object;
+    g_autoptr (GArray) entries = builder_new ();
+    GError *error = NULL;
+    gint64 build_time;
+    guint64 serial;
+
+    /* Changes from now on may or may not be seen by the crawl, so they stay
+     * in the overlay.
+     */
+    build_time = g_get_real_time ();
+    g_rw_lock_reader_lock (&self->lock);
+    serial = self->serial;
+    g_rw_lock_reader_unlock (&self->lock);
+
+    for (guint i = 0; self->roots[i] != NULL; i++)
+    {
+        g_autoptr (GFile) root = g_file_new_for_path (self->roots[i]);
+        guint32 entry;
+
+        entry = builder_add (entries, g_strdup (self->roots[i]), NO_ENTRY, FLAG_DIRECTORY);
+        crawl (root, entry, entries, cancellable);
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        return;
+    }
+
+    if (!write_and_load (self, entries, serial, build_time, &error))
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+write_task_done (NautilusNameIndex *self)
+{
+    self->writing = FALSE;
+
+    if (g_hash_table_size (self->added) > 0 || g_hash_table_size (self->removed) > 0)
+    {
+        schedule_save (self);
+    }
+}
+
+static void
+rebuild_done (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+    NautilusNameIndex *self = NAUTILUS_NAME_INDEX (source_object);
+    g_autoptr (GTask) task = user_data;
+    g_autoptr (GError) error = NULL;
+
+    write_task_done (self);
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+        g_task_return_error (task, g_steal_pointer (&error));
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * nautilus_name_index_rebuild_async:
+ *
+ * Crawls the roots of @self and replaces the index with what was found.
+ */
+void
+nautilus_name_index_rebuild_async (NautilusNameIndex   *self,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    g_autoptr (GTask) thread_task = NULL;
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, nautilus_name_index_rebuild_async);
+
+    self->writing = TRUE;
+    g_clear_handle_id (&self->save_timeout_id, g_source_remove);
+
+    thread_task = g_task_new (self, cancellable, rebuild_done, g_steal_pointer (&task));
+    g_task_run_in_thread (thread_task, rebuild_thread);
+}
+
+gboolean
+nautilus_name_index_rebuild_finish (NautilusNameIndex  *self,
+                                    GAsyncResult       *result,
+                                    GError            **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Returns whether each entry is still there, that is neither it nor any of
+ * its directories was removed. Parents are looked at once, whatever the
+ * number of their children.
+ */
+static guint8 *
+resolve_alive (GArray       *entries,
+               const guint8 *removed)
+{
+    enum
+    {
+        UNKNOWN = 0,
+        ALIVE,
+        DEAD,
+    };
+    g_autoptr (GArray) chain = g_array_new (FALSE, FALSE, sizeof (guint32));
+    guint8 *alive = g_new0 (guint8, MAX (entries->len, 1));
+
+    for (guint32 i = 0; i < entries->len; i++)
+    {
+        guint32 id = i;
+        guint8 state = ALIVE;
+
+        g_array_set_size (chain, 0);
+        while (id != NO_ENTRY)
+        {
+            /* A longer chain than there are entries means a cycle. */
+            if (id >= entries->len || removed[id] || chain->len > entries->len)
+            {
+                state = DEAD;
+                break;
+            }
+
+            if (alive[id] != UNKNOWN)
+            {
+                state = alive[id];
+                break;
+            }
+
+            g_array_append_val (chain, id);
+            id = g_array_index (entries, BuilderEntry, id).parent;
+        }
+
+        for (guint j = 0; j < chain->len; j++)
+        {
+            alive[g_array_index (chain, guint32, j)] = state;
+        }
+    }
+
+    for (guint32 i = 0; i < entries->len; i++)
+    {
+        alive[i] = (alive[i] == ALIVE);
+    }
+
+    return alive;
+}
+
+static gint
+compare_path_length (gconstpointer a,
+                     gconstpointer b)
+{
+    gsize length_a = strlen (*(char * const *) a);
+    gsize length_b = strlen (*(char * const *) b);
+
+    return (length_a > length_b) - (length_a < length_b);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    NautilusNameIndex *self = source_object;
+    const IndexData *index_data;
+    g_autoptr (GArray) entries = builder_new ();
+    g_autoptr (GArray) merged = builder_new ();
+    g_autoptr (GPtrArray) added_paths = g_ptr_array_new_with_free_func (g_free);
+    g_autoptr (GArray) added_flags = g_array_new (FALSE, FALSE, sizeof (guint8));
+    g_autoptr (GPtrArray) removed_paths = g_ptr_array_new_with_free_func (g_free);
+    g_autoptr (GHashTable) added_ids = g_hash_table_new (g_str_hash, g_str_equal);
+    g_autofree guint8 *removed = NULL;
+    g_autofree guint8 *alive = NULL;
+    g_autofree guint32 *new_ids = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+    IndexCursor cursor;
+    GError *error = NULL;
+    guint64 serial;
+
+    /* Only writing tasks replace the index data, and only one runs at a
+     * time, so it can be read without the lock here. The overlay can't.
+     */
+    g_rw_lock_reader_lock (&self->lock);
+    index_data = self->index_data;
+    serial = self->serial;
+    g_hash_table_iter_init (&iter, self->added);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        g_ptr_array_add (added_paths, g_strdup (key));
+    }
+    g_ptr_array_sort (added_paths, compare_path_length);
+    for (guint i = 0; i < added_paths->len; i++)
+    {
+        OverlayEntry *entry = g_hash_table_lookup (self->added, added_paths->pdata[i]);
+
+        g_array_append_val (added_flags, entry->flags);
+    }
+    g_hash_table_iter_init (&iter, self->removed);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        g_ptr_array_add (removed_paths, g_strdup (key));
+    }
+    g_rw_lock_reader_unlock (&self->lock);
+
+    if (index_data == NULL)
+    {
+        /* Nothing to merge into; a rebuild will pick everything up. */
+        g_task_return_boolean (task, TRUE);
+        return;
+    }
+
+    cursor_seek (&cursor, index_data, 0);
+    while (cursor_next (&cursor))
+    {
+        builder_add (entries, g_strdup (cursor.name), cursor.parent, cursor.flags);
+    }
+    if (entries->len != index_data->n_entries)
+    {
+        g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                 "Name index %s is corrupt", self->filename);
+        return;
+    }
+
+    removed = g_new0 (guint8, MAX (entries->len, 1));
+    for (guint i = 0; i < removed_paths->len; i++)
+    {
+        guint32 id = index_data_locate (index_data, (const char * const *) self->roots,
+                                        removed_paths->pdata[i]);
+
+        if (id != NO_ENTRY)
+        {
+            removed[id] = TRUE;
+        }
+    }
+
+    alive = resolve_alive (entries, removed);
+    alive = g_realloc (alive, MAX (entries->len + added_paths->len, 1));
+
+    /* Added files that are already indexed only need new flags. The others
+     * are added after their directories, which have shorter paths.
+     */
+    for (guint i = 0; i < added_paths->len; i++)
+    {
+        const char *path = added_paths->pdata[i];
+        guint8 flags = g_array_index (added_flags, guint8, i);
+        guint32 id = index_data_locate (index_data, (const char * const *) self->roots, path);
+        g_autofree char *parent_path = NULL;
+        guint32 parent;
+
+        if (id != NO_ENTRY && alive[id])
+        {
+            g_array_index (entries, BuilderEntry, id).flags = flags;
+            continue;
+        }
+
+        parent_path = g_path_get_dirname (path);
+        if (g_hash_table_contains (added_ids, parent_path))
+        {
+            parent = GPOINTER_TO_UINT (g_hash_table_lookup (added_ids, parent_path));
+        }
+        else
+        {
+            parent = index_data_locate (index_data, (const char * const *) self->roots, parent_path);
+        }
+
+        if (parent == NO_ENTRY || !alive[parent])
+        {
+            continue;
+        }
+
+        id = builder_add (entries, g_path_get_basename (path), parent, flags);
+        alive[id] = TRUE;
+        g_hash_table_insert (added_ids, (gpointer) path, GUINT_TO_POINTER (id));
+    }
+
+    new_ids = g_new (guint32, MAX (entries->len, 1));
+    for (guint32 i = 0; i < entries->len; i++)
+    {
+        BuilderEntry *entry = &g_array_index (entries, BuilderEntry, i);
+
+        if (!alive[i])
+        {
+            new_ids[i] = NO_ENTRY;
+            continue;
+        }
+
+        new_ids[i] = builder_add (merged, g_steal_pointer (&entry->name), entry->parent, entry->flags);
+    }
+    for (guint32 i = 0; i < merged->len; i++)
+    {
+        BuilderEntry *entry = &g_array_index (merged, BuilderEntry, i);
+
+        if (entry->parent != NO_ENTRY)
+        {
+            entry->parent = new_ids[entry->parent];
+        }
+    }
+
+    if (!write_and_load (self, merged, serial, index_data->build_time, &error))
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+save_done (GObject      *source_object,
+           GAsyncResult *result,
+           gpointer      user_data)
+{
+    NautilusNameIndex *self = NAUTILUS_NAME_INDEX (source_object);
+    g_autoptr (GTask) task = user_data;
+    g_autoptr (GError) error = NULL;
+
+    write_task_done (self);
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+        g_task_return_error (task, g_steal_pointer (&error));
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * nautilus_name_index_save_async:
+ *
+ * Merges the changes noticed since the index was last written into a new
+ * index file. This happens on its own shortly after changes are noticed.
+ */
+void
+nautilus_name_index_save_async (NautilusNameIndex   *self,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    g_autoptr (GTask) thread_task = NULL;
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, nautilus_name_index_save_async);
+
+    self->writing = TRUE;
+    g_clear_handle_id (&self->save_timeout_id, g_source_remove);
+
+    thread_task = g_task_new (self, cancellable, save_done, g_steal_pointer (&task));
+    g_task_run_in_thread (thread_task, save_thread);
+}
+
+gboolean
+nautilus_name_index_save_finish (NautilusNameIndex  *self,
+                                 GAsyncResult       *result,
+                                 GError            **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+on_written (GObject      *source_object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (!g_task_propagate_boolean (G_TASK (result), &error) &&
+        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+        g_warning ("Couldn't write the name index: %s", error->message);
+    }
+}
+
+static void
+save_timeout_cb (gpointer user_data)
+{
+    NautilusNameIndex *self = user_data;
+
+    self->save_timeout_id = 0;
+
+    if (self->writing)
+    {
+        /* Rescheduled once the current write is done. */
+        return;
+    }
+
+    nautilus_name_index_save_async (self, NULL, on_written, NULL);
+}
+
+static void
+schedule_save (NautilusNameIndex *self)
+{
+    if (self->save_timeout_id != 0 || self->writing)
+    {
+        return;
+    }
+
+    self->save_timeout_id = g_timeout_add_seconds_once (SAVE_TIMEOUT_SECONDS, save_timeout_cb, self);
+}
+
+static void
+refresh_thread (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+    NautilusNameIndex *self = source_object;
+    GPtrArray *paths = task_data;
+
+    for (guint i = 0; i < paths->len; i++)
+    {
+        const char *path = paths->pdata[i];
+        g_autoptr (GFile) file = g_file_new_for_path (path);
+        g_autoptr (GFileInfo) info = NULL;
+        g_autoptr (GArray) entries = builder_new ();
+        g_autoptr (GPtrArray) entry_paths = g_ptr_array_new_with_free_func (g_free);
+
+        info = g_file_query_info (file, CRAWL_ATTRIBUTES,
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  cancellable, NULL);
+        if (info == NULL)
+        {
+            /* Already gone again. */
+            continue;
+        }
+
+        builder_add (entries, g_strdup (path), NO_ENTRY, flags_from_info (info));
+        if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        {
+            /* It may have been moved here with everything inside. */
+            crawl (file, 0, entries, cancellable);
+        }
+
+        /* Parents are always crawled before their children. */
+        for (guint32 j = 0; j < entries->len; j++)
+        {
+            BuilderEntry *entry = &g_array_index (entries, BuilderEntry, j);
+
+            g_ptr_array_add (entry_paths,
+                             (entry->parent == NO_ENTRY) ?
+                             g_strdup (entry->name) :
+                             g_build_filename (entry_paths->pdata[entry->parent], entry->name, NULL));
+        }
+
+        g_rw_lock_writer_lock (&self->lock);
+        for (guint32 j = 0; j < entries->len; j++)
+        {
+            overlay_add (self, entry_paths->pdata[j],
+                         g_array_index (entries, BuilderEntry, j).flags);
+        }
+        g_rw_lock_writer_unlock (&self->lock);
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void start_refresh (NautilusNameIndex *self);
+
+static void
+refresh_done (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+    NautilusNameIndex *self = NAUTILUS_NAME_INDEX (source_object);
+
+    self->refreshing = FALSE;
+    schedule_save (self);
+    start_refresh (self);
+}
+
+static void
+start_refresh (NautilusNameIndex *self)
+{
+    g_autoptr (GTask) task = NULL;
+
+    if (self->refreshing || self->pending_refresh->len == 0)
+    {
+        return;
+    }
+
+    self->refreshing = TRUE;
+
+    task = g_task_new (self, NULL, refresh_done, NULL);
+    g_task_set_task_data (task, g_steal_pointer (&self->pending_refresh),
+                          (GDestroyNotify) g_ptr_array_unref);
+    self->pending_refresh = g_ptr_array_new_with_free_func (g_free);
+    g_task_run_in_thread (task, refresh_thread);
+}
+
+/**
+ * nautilus_name_index_file_added:
+ * @location: a file that appeared, possibly with other files inside
+ *
+ * Looks at @location, and what is inside if it's a directory, in a thread
+ * and adds it to the index.
+ */
+void
+nautilus_name_index_file_added (NautilusNameIndex *self,
+                                GFile             *location)
+{
+    g_autofree char *path = g_file_get_path (location);
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    if (path == NULL || !is_inside_roots (self, path))
+    {
+        return;
+    }
+
+    g_ptr_array_add (self->pending_refresh, g_steal_pointer (&path));
+    start_refresh (self);
+}
+
+void
+nautilus_name_index_file_removed (NautilusNameIndex *self,
+                                  GFile             *location)
+{
+    g_autofree char *path = g_file_get_path (location);
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    if (path == NULL || !is_inside_roots (self, path))
+    {
+        return;
+    }
+
+    g_rw_lock_writer_lock (&self->lock);
+    overlay_remove (self, path);
+    g_rw_lock_writer_unlock (&self->lock);
+
+    schedule_save (self);
+}
+
+void
+nautilus_name_index_file_moved (NautilusNameIndex *self,
+                                GFile             *from,
+                                GFile             *to)
+{
+    nautilus_name_index_file_removed (self, from);
+    nautilus_name_index_file_added (self, to);
+}
+
+/**
+ * nautilus_name_index_covers:
+ *
+ * An index older than a day isn't used, as it may miss too much; it's
+ * only rebuilt while Tracker can't be searched.
+ *
+ * Returns: whether nautilus_name_index_search() can find everything inside
+ *     @location.
+ */
+gboolean
+nautilus_name_index_covers (NautilusNameIndex *self,
+                            GFile             *location)
+{
+    g_autofree char *path = NULL;
+    IndexCursor cursor;
+    gboolean covers = FALSE;
+
+    g_return_val_if_fail (NAUTILUS_IS_NAME_INDEX (self), FALSE);
+
+    if (!g_file_is_native (location) || (path = g_file_get_path (location)) == NULL)
+    {
+        return FALSE;
+    }
+
+    g_rw_lock_reader_lock (&self->lock);
+    if (self->index_data != NULL &&
+        g_get_real_time () - self->index_data->build_time <= MAX_AGE_SECONDS * G_USEC_PER_SEC &&
+        !overlay_is_removed (self, path))
+    {
+        guint32 id = index_data_locate (self->index_data, (const char * const *) self->roots, path);
+
+        covers = id != NO_ENTRY &&
+                 cursor_seek_to_id (&cursor, self->index_data, id) &&
+                 (cursor.flags & FLAG_DIRECTORY) &&
+                 !(cursor.flags & FLAG_MOUNT_POINT);
+    }
+    g_rw_lock_reader_unlock (&self->lock);
+
+    return covers;
+}
+
+typedef struct
+{
+    const IndexData *index_data;
+    const char *location_path;
+    guint32 location_id;
+    gboolean show_hidden;
+} SearchContext;
+
+/* Returns the path of the entry if it's inside the location searched and
+ * not hidden below it, or %NULL.
+ */
+static char *
+resolve_hit (SearchContext *context,
+             const char    *name,
+             guint32        parent,
+             guint8         flags)
+{
+    g_autoptr (GPtrArray) components = g_ptr_array_new_with_free_func (g_free);
+    IndexCursor cursor;
+    GString *path;
+
+    if (!context->show_hidden && (flags & FLAG_HIDDEN))
+    {
+        return NULL;
+    }
+
+    g_ptr_array_add (components, g_strdup (name));
+    while (parent != context->location_id)
+    {
+        if (parent == NO_ENTRY ||
+            components->len > context->index_data->n_entries ||
+            !cursor_seek_to_id (&cursor, context->index_data, parent))
+        {
+            return NULL;
+        }
+
+        if (!context->show_hidden && (cursor.flags & FLAG_HIDDEN))
+        {
+            return NULL;
+        }
+
+        g_ptr_array_add (components, g_strdup (cursor.name));
+        parent = cursor.parent;
+    }
+
+    path = g_string_new (context->location_path);
+    for (guint i = components->len; i > 0; i--)
+    {
+        if (path->len == 0 || path->str[path->len - 1] != '/')
+        {
+            g_string_append_c (path, '/');
+        }
+        g_string_append (path, components->pdata[i - 1]);
+    }
+
+    return g_string_free (path, FALSE);
+}
+
+/* Returns a reference on the index data, if any, which can be read without
+ * the lock even while a writing task replaces it.
+ */
+static IndexData *
+get_index_data (NautilusNameIndex *self)
+{
+    IndexData *index_data = NULL;
+
+    g_rw_lock_reader_lock (&self->lock);
+    if (self->index_data != NULL)
+    {
+        index_data = index_data_ref (self->index_data);
+    }
+    g_rw_lock_reader_unlock (&self->lock);
+
+    return index_data;
+}
+
+/**
+ * nautilus_name_index_search:
+ * @location: where to search, which must be covered by @self
+ * @recursive: whether to search inside subdirectories of @location
+ * @show_hidden: whether to find hidden files, and files inside hidden
+ *     directories
+ * @func: called for each match
+ *
+ * Finds the files inside @location whose names @matcher matches. This may
+ * be called from any thread, and doesn't touch the disk beyond reading the
+ * mapped index.
+ *
+ * The lock is only taken to check each match against the changes in the
+ * overlay, and never while calling @func, so that changes reported on the
+ * main thread don't wait for the search. If a new index replaces the one
+ * being searched meanwhile, a file removed before it was written may still
+ * be found.
+ */
+void
+nautilus_name_index_search (NautilusNameIndex        *self,
+                            GFile                    *location,
+                            NautilusQueryMatcher     *matcher,
+                            gboolean                  recursive,
+                            gboolean                  show_hidden,
+                            GCancellable             *cancellable,
+                            NautilusNameIndexHitFunc  func,
+                            gpointer                  user_data)
+{
+    g_autofree char *location_path = NULL;
+    g_autoptr (IndexData) index_data = NULL;
+    g_autoptr (GPtrArray) added_paths = g_ptr_array_new_with_free_func (g_free);
+    g_autoptr (GArray) added_ranks = g_array_new (FALSE, FALSE, sizeof (gdouble));
+    SearchContext context = { 0 };
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    location_path = g_file_get_path (location);
+    if (location_path == NULL)
+    {
+        return;
+    }
+
+    index_data = get_index_data (self);
+
+    context.index_data = index_data;
+    context.location_path = location_path;
+    context.location_id = NO_ENTRY;
+    context.show_hidden = show_hidden;
+    if (index_data != NULL)
+    {
+        context.location_id = index_data_locate (index_data,
+                                                 (const char * const *) self->roots,
+                                                 location_path);
+    }
+
+    if (context.location_id != NO_ENTRY)
+    {
+        IndexCursor cursor;
+
+        cursor_seek (&cursor, index_data, 0);
+        while (cursor_next (&cursor))
+        {
+            g_autofree char *path = NULL;
+            gboolean changed;
+            gdouble rank;
+
+            if (cursor.id % CANCEL_CHECK_INTERVAL == 0 &&
+                g_cancellable_is_cancelled (cancellable))
+            {
+                break;
+            }
+
+            if (cursor.parent == NO_ENTRY ||
+                (!recursive && cursor.parent != context.location_id))
+            {
+                continue;
+            }
+
+            rank = nautilus_query_matcher_match (matcher, cursor.name);
+            if (rank < 0)
+            {
+                continue;
+            }
+
+            path = resolve_hit (&context, cursor.name, cursor.parent, cursor.flags);
+            if (path == NULL)
+            {
+                continue;
+            }
+
+            g_rw_lock_reader_lock (&self->lock);
+            changed = g_hash_table_contains (self->added, path) || overlay_is_removed (self, path);
+            g_rw_lock_reader_unlock (&self->lock);
+            if (changed)
+            {
+                continue;
+            }
+
+            func (path, rank, user_data);
+        }
+    }
+
+    g_rw_lock_reader_lock (&self->lock);
+    g_hash_table_iter_init (&iter, self->added);
+    while (g_hash_table_iter_next (&iter, &key, &value) &&
+           !g_cancellable_is_cancelled (cancellable))
+    {
+        const char *path = key;
+        OverlayEntry *entry = value;
+        const char *relative = path_get_relative (path, location_path);
+        g_autofree char *basename = NULL;
+        gdouble rank;
+
+        if (relative == NULL || relative[0] == '\0' ||
+            (!recursive && strchr (relative, '/') != NULL))
+        {
+            continue;
+        }
+
+        if (!show_hidden &&
+            ((entry->flags & FLAG_HIDDEN) || relative_path_is_hidden (relative)))
+        {
+            continue;
+        }
+
+        basename = g_path_get_basename (path);
+        rank = nautilus_query_matcher_match (matcher, basename);
+        if (rank >= 0)
+        {
+            g_ptr_array_add (added_paths, g_strdup (path));
+            g_array_append_val (added_ranks, rank);
+        }
+    }
+    g_rw_lock_reader_unlock (&self->lock);
+
+    for (guint i = 0; i < added_paths->len; i++)
+    {
+        func (added_paths->pdata[i], g_array_index (added_ranks, gdouble, i), user_data);
+    }
+}
+
+static void
+collect_directories (NautilusNameIndex *self,
+                     const IndexData   *index_data,
+                     const char        *location_path,
+                     gboolean           recursive,
+                     gboolean           show_hidden,
+                     GCancellable      *cancellable,
+                     GPtrArray         *directories)
+{
+    SearchContext context = { 0 };
+    IndexCursor cursor;
+
+    context.index_data = index_data;
+    context.location_path = location_path;
+    context.location_id = index_data_locate (index_data,
+                                             (const char * const *) self->roots,
+                                             location_path);
+    context.show_hidden = show_hidden;
+    if (context.location_id == NO_ENTRY)
+    {
+        return;
+    }
+
+    g_ptr_array_add (directories, g_strdup (location_path));
+    if (!recursive)
+    {
+        return;
+    }
+
+    cursor_seek (&cursor, index_data, 0);
+    while (cursor_next (&cursor))
+    {
+        char *path;
+        gboolean removed;
+
+        if (cursor.id % CANCEL_CHECK_INTERVAL == 0 &&
+            g_cancellable_is_cancelled (cancellable))
+        {
+            break;
+        }
+
+        if (cursor.parent == NO_ENTRY ||
+            !(cursor.flags & FLAG_DIRECTORY) ||
+            (cursor.flags & FLAG_MOUNT_POINT))
+        {
+            continue;
+        }
+
+        path = resolve_hit (&context, cursor.name, cursor.parent, cursor.flags);
+        if (path == NULL)
+        {
+            continue;
+        }
+
+        g_rw_lock_reader_lock (&self->lock);
+        removed = overlay_is_removed (self, path);
+        g_rw_lock_reader_unlock (&self->lock);
+        if (removed)
+        {
+            g_free (path);
+            continue;
+        }
+
+        g_ptr_array_add (directories, path);
+    }
+}
+
+/* Crawls a directory the index doesn't know about, which was already
+ * matched itself.
+ */
+static void
+search_new_directory (GFile                    *directory,
+                      NautilusQueryMatcher     *matcher,
+                      gboolean                  show_hidden,
+                      GCancellable             *cancellable,
+                      NautilusNameIndexHitFunc  func,
+                      gpointer                  user_data)
+{
+    g_autoptr (GArray) entries = builder_new ();
+    g_autoptr (GPtrArray) entry_paths = g_ptr_array_new_with_free_func (g_free);
+    g_autofree guint8 *hidden = NULL;
+
+    builder_add (entries, g_file_get_path (directory), NO_ENTRY, FLAG_DIRECTORY);
+    crawl (directory, 0, entries, cancellable);
+
+    /* Parents are always crawled before their children. */
+    hidden = g_new0 (guint8, entries->len);
+    g_ptr_array_add (entry_paths, g_strdup (g_array_index (entries, BuilderEntry, 0).name));
+    for (guint32 i = 1; i < entries->len; i++)
+    {
+        BuilderEntry *entry = &g_array_index (entries, BuilderEntry, i);
+        gdouble rank;
+
+        g_ptr_array_add (entry_paths,
+                         g_build_filename (entry_paths->pdata[entry->parent], entry->name, NULL));
+        hidden[i] = hidden[entry->parent] || (entry->flags & FLAG_HIDDEN);
+        if (!show_hidden && hidden[i])
+        {
+            continue;
+        }
+
+        rank = nautilus_query_matcher_match (matcher, entry->name);
+        if (rank >= 0)
+        {
+            func (entry_paths->pdata[i], rank, user_data);
+        }
+    }
+}
+
+static void
+search_changed_directory (const char               *path,
+                          GHashTable               *indexed,
+                          NautilusQueryMatcher     *matcher,
+                          gboolean                  recursive,
+                          gboolean                  show_hidden,
+                          GCancellable             *cancellable,
+                          NautilusNameIndexHitFunc  func,
+                          gpointer                  user_data)
+{
+    g_autoptr (GFile) directory = g_file_new_for_path (path);
+    g_autoptr (GFileInfo) directory_info = NULL;
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    const char *filesystem_id = NULL;
+    GFileInfo *info;
+
+    directory_info = g_file_query_info (directory, G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                                        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                        cancellable, NULL);
+    if (directory_info != NULL)
+    {
+        filesystem_id = g_file_info_get_attribute_string (directory_info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    }
+
+    enumerator = g_file_enumerate_children (directory, CRAWL_ATTRIBUTES,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            cancellable, NULL);
+    while (enumerator != NULL &&
+           (info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL)
+    {
+        const char *name = g_file_info_get_name (info);
+        guint8 flags = flags_from_info (info);
+        g_autofree char *child_path = NULL;
+        gdouble rank;
+
+        if (!show_hidden && (flags & FLAG_HIDDEN))
+        {
+            g_object_unref (info);
+            continue;
+        }
+
+        child_path = g_build_filename (path, name, NULL);
+        rank = nautilus_query_matcher_match (matcher, name);
+        if (rank >= 0)
+        {
+            func (child_path, rank, user_data);
+        }
+
+        if (recursive &&
+            (flags & FLAG_DIRECTORY) &&
+            !g_hash_table_contains (indexed, child_path) &&
+            g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM),
+                       filesystem_id) == 0)
+        {
+            g_autoptr (GFile) child = g_file_get_child (directory, name);
+
+            search_new_directory (child, matcher, show_hidden, cancellable, func, user_data);
+        }
+
+        g_object_unref (info);
+    }
+}
+
+/**
+ * nautilus_name_index_search_changed:
+ *
+ * Finds the files that nautilus_name_index_search() misses because they
+ * appeared where Nautilus wasn't watching. The directories inside
+ * @location that changed since the index was built are enumerated, and
+ * new directories found there are crawled. Files may be found by both
+ * searches.
+ *
+ * This may be called from any thread. Unlike nautilus_name_index_search(),
+ * it touches the disk, but only enumerates the directories that changed.
+ */
+void
+nautilus_name_index_search_changed (NautilusNameIndex        *self,
+                                    GFile                    *location,
+                                    NautilusQueryMatcher     *matcher,
+                                    gboolean                  recursive,
+                                    gboolean                  show_hidden,
+                                    GCancellable             *cancellable,
+                                    NautilusNameIndexHitFunc  func,
+                                    gpointer                  user_data)
+{
+    g_autofree char *location_path = NULL;
+    g_autoptr (IndexData) index_data = NULL;
+    g_autoptr (GPtrArray) directories = g_ptr_array_new_with_free_func (g_free);
+    g_autoptr (GHashTable) indexed = g_hash_table_new (g_str_hash, g_str_equal);
+    gint64 build_time = 0;
+
+    g_return_if_fail (NAUTILUS_IS_NAME_INDEX (self));
+
+    location_path = g_file_get_path (location);
+    if (location_path == NULL)
+    {
+        return;
+    }
+
+    index_data = get_index_data (self);
+    if (index_data != NULL)
+    {
+        build_time = index_data->build_time;
+        collect_directories (self, index_data, location_path, recursive, show_hidden,
+                             cancellable, directories);
+    }
+
+    for (guint i = 0; i < directories->len; i++)
+    {
+        g_hash_table_add (indexed, directories->pdata[i]);
+    }
+
+    for (guint i = 0; i < directories->len && !g_cancellable_is_cancelled (cancellable); i++)
+    {
+        const char *path = directories->pdata[i];
+        GStatBuf stat_buf;
+
+        /* Modification times may be only as precise as seconds. */
+        if (g_lstat (path, &stat_buf) != 0 ||
+            stat_buf.st_mtime < build_time / G_USEC_PER_SEC)
+        {
+            continue;
+        }
+
+        search_changed_directory (path, indexed, matcher, recursive, show_hidden,
+                                  cancellable, func, user_data);
+    }
+}
+
+static gboolean
+is_persistent (void)
+{
+    /* Tests must neither pick up nor leave behind state in the user's cache. */
+    return g_strcmp0 (g_getenv ("RUNNING_TESTS"), "TRUE") != 0;
+}
+
+/* Only writing tasks replace the index data, so this must not be called
+ * while one runs.
+ */
+static gboolean
+index_is_stale (NautilusNameIndex *self)
+{
+    if (self->index_data == NULL)
+    {
+        return TRUE;
+    }
+
+    if (g_get_real_time () - self->index_data->build_time > MAX_AGE_SECONDS * G_USEC_PER_SEC)
+    {
+        return TRUE;
+    }
+
+    for (guint i = 0; self->roots[i] != NULL; i++)
+    {
+        if (index_data_lookup (self->index_data, NO_ENTRY, self->roots[i]) == NO_ENTRY)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Crawling the home directory is what Tracker's miner does already, so
+ * the index is only rebuilt when Tracker can't be searched.
+ */
+static gboolean
+tracker_is_unavailable (void)
+{
+    g_autoptr (GError) error = NULL;
+
+    return nautilus_tracker_get_miner_fs_connection (&error) == NULL && error != NULL;
+}
+
+static void
+rebuild_if_stale (NautilusNameIndex *self)
+{
+    if (self->writing || !tracker_is_unavailable () || !index_is_stale (self))
+    {
+        return;
+    }
+
+    g_debug ("Rebuilding the name index");
+    nautilus_name_index_rebuild_async (self, NULL, on_written, NULL);
+}
+
+static gboolean
+stale_check_cb (gpointer user_data)
+{
+    rebuild_if_stale (user_data);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+first_stale_check_cb (gpointer user_data)
+{
+    NautilusNameIndex *self = user_data;
+
+    rebuild_if_stale (self);
+    self->stale_check_id = g_timeout_add_seconds (STALE_CHECK_INTERVAL_SECONDS,
+                                                  stale_check_cb, self);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+nautilus_name_index_finalize (GObject *object)
+{
+    NautilusNameIndex *self = NAUTILUS_NAME_INDEX (object);
+
+    g_clear_handle_id (&self->save_timeout_id, g_source_remove);
+    g_clear_handle_id (&self->stale_check_id, g_source_remove);
+    g_clear_pointer (&self->index_data, index_data_unref);
+    g_clear_pointer (&self->added, g_hash_table_destroy);
+    g_clear_pointer (&self->removed, g_hash_table_destroy);
+    g_clear_pointer (&self->pending_refresh, g_ptr_array_unref);
+    g_rw_lock_clear (&self->lock);
+    g_free (self->filename);
+    g_strfreev (self->roots);
+
+    G_OBJECT_CLASS (nautilus_name_index_parent_class)->finalize (object);
+}
+
+static void
+nautilus_name_index_class_init (NautilusNameIndexClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = nautilus_name_index_finalize;
+}
+
+static void
+nautilus_name_index_init (NautilusNameIndex *self)
+{
+    g_rw_lock_init (&self->lock);
+    self->added = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    self->removed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    self->pending_refresh = g_ptr_array_new_with_free_func (g_free);
+}
+
+/**
+ * nautilus_name_index_new_for_roots:
+ * @filename: where the index is kept
+ * @roots: (array zero-terminated=1): absolute paths of the directories to
+ *     index
+ *
+ * Loads the index kept at @filename, if any. Nothing is searched until an
+ * index was loaded or built with nautilus_name_index_rebuild_async().
+ *
+ * Returns: (transfer full): a new #NautilusNameIndex
+ */
+NautilusNameIndex *
+nautilus_name_index_new_for_roots (const char         *filename,
+                                   const char * const *roots)
+{
+    NautilusNameIndex *self;
+    g_autoptr (GError) error = NULL;
+
+    self = g_object_new (NAUTILUS_TYPE_NAME_INDEX, NULL);
+    self->filename = g_strdup (filename);
+    self->roots = g_strdupv ((GStrv) roots);
+
+    self->index_data = index_data_load (filename, &error);
+    if (self->index_data == NULL &&
+        !g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+        g_debug ("Couldn't load the name index: %s", error->message);
+    }
+
+    return self;
+}
+
+/**
+ * nautilus_name_index_new:
+ *
+ * Creates the index of the home directory, if it doesn't exist yet. While
+ * Tracker can't be searched, it is rebuilt in the background whenever it's
+ * missing or out of date, which is checked shortly after starting up and
+ * then every hour for as long as it lives. When running tests, the index is
+ * empty and covers nothing.
+ *
+ * Returns: (transfer full): the #NautilusNameIndex singleton object.
+ */
+NautilusNameIndex *
+nautilus_name_index_new (void)
+{
+    const char *roots[] = { g_get_home_dir (), NULL };
+    g_autofree char *filename = NULL;
+
+    if (default_index != NULL)
+    {
+        return g_object_ref (default_index);
+    }
+
+    filename = g_build_filename (g_get_user_cache_dir (), "nautilus", "name-index", NULL);
+    if (is_persistent ())
+    {
+        default_index = nautilus_name_index_new_for_roots (filename, roots);
+    }
+    else
+    {
+        default_index = g_object_new (NAUTILUS_TYPE_NAME_INDEX, NULL);
+        default_index->filename = g_steal_pointer (&filename);
+        default_index->roots = g_new0 (char *, 1);
+    }
+    g_object_add_weak_pointer (G_OBJECT (default_index), (gpointer) & default_index);
+
+    if (is_persistent ())
+    {
+        default_index->stale_check_id = g_timeout_add_seconds (FIRST_STALE_CHECK_SECONDS,
+                                                               first_stale_check_cb,
+                                                               default_index);
+    }
+
+    return default_index;
+}
+
+/**
+ * nautilus_name_index_get:
+ *
+ * Returns: (transfer none) (nullable): the #NautilusNameIndex singleton
+ *     object, if it was created.
+ */
+NautilusNameIndex *
+nautilus_name_index_get (void)
+{
+    return default_index;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "nautilus-query-matcher.h"
+
+/* An index of the names of all files below a few root directories, so that
+ * they can be searched without crawling the disk.
+ *
+ * The index is kept on disk as a list of names sorted and prefix-compressed,
+ * each with the id of its parent directory, and is memory-mapped. Changes
+ * that Nautilus notices are kept in memory on top of it and merged into a
+ * new file from time to time. Changes made where Nautilus wasn't watching
+ * are missed, so the whole index is rebuilt when it gets old, and searches
+ * can look at the directories that changed since it was built. Since this
+ * crawls like Tracker's miner does, the index of the home directory is only
+ * rebuilt while Tracker can't be searched.
+ */
+
+#define NAUTILUS_TYPE_NAME_INDEX (nautilus_name_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (NautilusNameIndex, nautilus_name_index, NAUTILUS, NAME_INDEX, GObject)
+
+/* Called with the path of each match, which may be from any thread. */
+typedef void (* NautilusNameIndexHitFunc) (const char *path,
+                                           gdouble     rank,
+                                           gpointer    user_data);
+
+NautilusNameIndex *nautilus_name_index_new           (void);
+NautilusNameIndex *nautilus_name_index_get           (void);
+NautilusNameIndex *nautilus_name_index_new_for_roots (const char         *filename,
+                                                      const char * const *roots);
+
+void               nautilus_name_index_rebuild_async  (NautilusNameIndex   *self,
+                                                       GCancellable        *cancellable,
+                                                       GAsyncReadyCallback  callback,
+                                                       gpointer             user_data);
+gboolean           nautilus_name_index_rebuild_finish (NautilusNameIndex   *self,
+                                                       GAsyncResult        *result,
+                                                       GError             **error);
+void               nautilus_name_index_save_async     (NautilusNameIndex   *self,
+                                                       GCancellable        *cancellable,
+                                                       GAsyncReadyCallback  callback,
+                                                       gpointer             user_data);
+gboolean           nautilus_name_index_save_finish    (NautilusNameIndex   *self,
+                                                       GAsyncResult        *result,
+                                                       GError             **error);
+
+gboolean           nautilus_name_index_covers         (NautilusNameIndex   *self,
+                                                       GFile               *location);
+void               nautilus_name_index_search         (NautilusNameIndex        *self,
+                                                       GFile                    *location,
+                                                       NautilusQueryMatcher     *matcher,
+                                                       gboolean                  recursive,
+                                                       gboolean                  show_hidden,
+                                                       GCancellable             *cancellable,
+                                                       NautilusNameIndexHitFunc  func,
+                                                       gpointer                  user_data);
+void               nautilus_name_index_search_changed (NautilusNameIndex        *self,
+                                                       GFile                    *location,
+                                                       NautilusQueryMatcher     *matcher,
+                                                       gboolean                  recursive,
+                                                       gboolean                  show_hidden,
+                                                       GCancellable             *cancellable,
+                                                       NautilusNameIndexHitFunc  func,
+                                                       gpointer                  user_data);
+
+void               nautilus_name_index_file_added     (NautilusNameIndex   *self,
+                                                       GFile               *location);
+void               nautilus_name_index_file_removed   (NautilusNameIndex   *self,
+                                                       GFile               *location);
+void               nautilus_name_index_file_moved     (NautilusNameIndex   *self,
+                                                       GFile               *from,
+                                                       GFile               *to);
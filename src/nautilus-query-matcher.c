@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <config.h>
+#include "nautilus-query-matcher.h"
+
+#include <string.h>
+
+#define RANK_SCALE_FACTOR 100
+#define MIN_RANK 10.0
+#define MAX_RANK 50.0
+
+/* Most names fit, so folding them doesn't need an allocation. */
+#define FOLD_BUFFER_SIZE 256
+
+typedef struct
+{
+    char *text;
+    gsize length;
+} MatcherWord;
+
+struct _NautilusQueryMatcher
+{
+    MatcherWord *words;
+    guint n_words;
+    /* Whether all words are plain ASCII, as only then they can be found in
+     * an ASCII name.
+     */
+    gboolean is_ascii;
+    /* Whether the locale lower-cases ASCII like g_ascii_tolower() does. */
+    gboolean fold_ascii;
+};
+
+static gchar *
+prepare_string_for_compare (const gchar *string)
+{
+    g_autofree gchar *normalized = NULL;
+
+    normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
+    if (normalized == NULL)
+    {
+        return NULL;
+    }
+
+    return g_utf8_strdown (normalized, -1);
+}
+
+/* Both loops below are free of branches that depend on the data, so the
+ * compiler can vectorize them.
+ */
+static gboolean
+is_ascii (const char *string,
+          gsize       length)
+{
+    guchar bits = 0;
+
+    for (gsize i = 0; i < length; i++)
+    {
+        bits |= (guchar) string[i];
+    }
+
+    return (bits & 0x80) == 0;
+}
+
+static void
+ascii_fold (char       *folded,
+            const char *string,
+            gsize       length)
+{
+    for (gsize i = 0; i < length; i++)
+    {
+        guchar c = string[i];
+
+        folded[i] = c + (((guchar) (c - 'A') < 26) << 5);
+    }
+    folded[length] = '\0';
+}
+
+/**
+ * nautilus_query_matcher_new:
+ * @text: the search text, with words separated by spaces
+ *
+ * Returns: (transfer full): a matcher for names containing every word of
+ *     @text, ignoring case and accents.
+ */
+NautilusQueryMatcher *
+nautilus_query_matcher_new (const char *text)
+{
+    NautilusQueryMatcher *matcher;
+    g_autofree gchar *prepared = NULL;
+    g_autofree gchar *lowered_i = NULL;
+    g_auto (GStrv) words = NULL;
+
+    g_return_val_if_fail (text != NULL, NULL);
+
+    matcher = g_atomic_rc_box_new0 (NautilusQueryMatcher);
+    matcher->is_ascii = TRUE;
+
+    /* Turkic locales lower-case "I" to a dotless "ı", so there ASCII names
+     * have to be lower-cased like any other.
+     */
+    lowered_i = g_utf8_strdown ("I", -1);
+    matcher->fold_ascii = g_strcmp0 (lowered_i, "i") == 0;
+
+    prepared = prepare_string_for_compare (text);
+    if (prepared == NULL)
+    {
+        return matcher;
+    }
+
+    words = g_strsplit (prepared, " ", -1);
+    matcher->n_words = g_strv_length (words);
+    matcher->words = g_new0 (MatcherWord, matcher->n_words);
+    for (guint i = 0; i < matcher->n_words; i++)
+    {
+        matcher->words[i].text = g_steal_pointer (&words[i]);
+        matcher->words[i].length = strlen (matcher->words[i].text);
+        matcher->is_ascii &= is_ascii (matcher->words[i].text, matcher->words[i].length);
+    }
+
+    return matcher;
+}
+
+NautilusQueryMatcher *
+nautilus_query_matcher_ref (NautilusQueryMatcher *matcher)
+{
+    return g_atomic_rc_box_acquire (matcher);
+}
+
+static void
+nautilus_query_matcher_clear (NautilusQueryMatcher *matcher)
+{
+    for (guint i = 0; i < matcher->n_words; i++)
+    {
+        g_free (matcher->words[i].text);
+    }
+    g_free (matcher->words);
+}
+
+void
+nautilus_query_matcher_unref (NautilusQueryMatcher *matcher)
+{
+    g_atomic_rc_box_release_full (matcher, (GDestroyNotify) nautilus_query_matcher_clear);
+}
+
+static gdouble
+match_prepared (NautilusQueryMatcher *matcher,
+                const char           *prepared,
+                gsize                 length)
+{
+    const char *ptr = prepared;
+    gsize nonexact_malus = 0;
+
+    for (guint i = 0; i < matcher->n_words; i++)
+    {
+        ptr = strstr (prepared, matcher->words[i].text);
+        if (ptr == NULL)
+        {
+            return -1;
+        }
+
+        nonexact_malus += length - (ptr - prepared) - matcher->words[i].length;
+    }
+
+    /* The rank value depends on the numbers of letters before and after the match.
+     * To make the prefix matches prefered over sufix ones, the number of letters
+     * after the match is divided by a factor, so that it decreases the rank by a
+     * smaller amount.
+     */
+    return MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - prepared) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
+}
+
+/**
+ * nautilus_query_matcher_is_narrowing:
+ * @matcher: a #NautilusQueryMatcher
+ * @previous: another #NautilusQueryMatcher
+ *
+ * Names contain every word of @matcher when they match it, so if each word
+ * of @previous is part of a word of @matcher, they match @previous too.
+ *
+ * Returns: whether every name that @matcher matches is also matched by
+ *     @previous.
+ */
+gboolean
+nautilus_query_matcher_is_narrowing (NautilusQueryMatcher *matcher,
+                                     NautilusQueryMatcher *previous)
+{
+    for (guint i = 0; i < previous->n_words; i++)
+    {
+        gboolean found = FALSE;
+
+        for (guint j = 0; j < matcher->n_words && !found; j++)
+        {
+            found = strstr (matcher->words[j].text, previous->words[i].text) != NULL;
+        }
+
+        if (!found)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * nautilus_query_matcher_match:
+ * @matcher: a #NautilusQueryMatcher
+ * @string: a name to match
+ *
+ * Can be called from any thread.
+ *
+ * Returns: the rank of @string, or -1 if it doesn't contain all the words.
+ */
+gdouble
+nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                              const char           *string)
+{
+    char buffer[FOLD_BUFFER_SIZE];
+    g_autofree char *heap_buffer = NULL;
+    g_autofree gchar *prepared = NULL;
+    gsize length;
+
+    length = strlen (string);
+
+    /* Normalizing and lower-casing ASCII is the same as folding its case,
+     * which needs neither Unicode tables nor an allocation.
+     */
+    if (matcher->fold_ascii && is_ascii (string, length))
+    {
+        char *folded;
+
+        if (!matcher->is_ascii)
+        {
+            return -1;
+        }
+
+        if (length < sizeof (buffer))
+        {
+            folded = buffer;
+        }
+        else
+        {
+            heap_buffer = g_malloc (length + 1);
+            folded = heap_buffer;
+        }
+        ascii_fold (folded, string, length);
+
+        return match_prepared (matcher, folded, length);
+    }
+
+    prepared = prepare_string_for_compare (string);
+    if (prepared == NULL)
+    {
+        return -1;
+    }
+
+    return match_prepared (matcher, prepared, strlen (prepared));
+}
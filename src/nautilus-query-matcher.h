@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* The words of a search text, prepared once so that any number of names can
+ * be matched against them. A matcher never changes after it is created, so
+ * threads can share it without locking.
+ */
+typedef struct _NautilusQueryMatcher NautilusQueryMatcher;
+
+NautilusQueryMatcher *nautilus_query_matcher_new   (const char           *text);
+NautilusQueryMatcher *nautilus_query_matcher_ref   (NautilusQueryMatcher *matcher);
+void                  nautilus_query_matcher_unref (NautilusQueryMatcher *matcher);
+
+gdouble               nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                                                    const char           *string);
+gboolean              nautilus_query_matcher_is_narrowing (NautilusQueryMatcher *matcher,
+                                                           NautilusQueryMatcher *previous);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusQueryMatcher, nautilus_query_matcher_unref)
@@ -27,10 +27,6 @@
 #include "nautilus-file-utilities.h"
 #include "nautilus-global-preferences.h"
 
-#define RANK_SCALE_FACTOR 100
-#define MIN_RANK 10.0
-#define MAX_RANK 50.0
-
 struct _NautilusQuery
 {
     GObject parent;
@@ -45,8 +41,7 @@ struct _NautilusQuery
     NautilusQuerySearchContent search_content;
 
     gboolean searching;
-    char **prepared_words;
-    GMutex prepared_words_mutex;
+    NautilusQueryMatcher *matcher;
 };
 
 static void  nautilus_query_class_init (NautilusQueryClass *class);
@@ -76,11 +71,10 @@ finalize (GObject *object)
     query = NAUTILUS_QUERY (object);
 
     g_free (query->text);
-    g_strfreev (query->prepared_words);
+    g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
     g_clear_object (&query->location);
     g_clear_pointer (&query->mime_types, g_ptr_array_unref);
     g_clear_pointer (&query->date_range, g_ptr_array_unref);
-    g_mutex_clear (&query->prepared_words_mutex);
 
     G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
 }
@@ -343,75 +337,49 @@ nautilus_query_init (NautilusQuery *query)
     query->show_hidden = TRUE;
     query->search_type = g_settings_get_enum (nautilus_preferences, "search-filter-time-type");
     query->search_content = NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE;
-    g_mutex_init (&query->prepared_words_mutex);
-}
-
-static gchar *
-prepare_string_for_compare (const gchar *string)
-{
-    gchar *normalized, *res;
-
-    normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
-    res = g_utf8_strdown (normalized, -1);
-    g_free (normalized);
-
-    return res;
 }
 
+/**
+ * nautilus_query_matches_string:
+ * @query: a #NautilusQuery
+ * @string: a name to match against the text of @query
+ *
+ * Must be called from the thread that sets the text of @query. Other
+ * threads should match with a matcher from nautilus_query_get_matcher().
+ *
+ * Returns: the rank of @string, or -1 if it doesn't match.
+ */
 gdouble
 nautilus_query_matches_string (NautilusQuery *query,
                                const gchar   *string)
 {
-    gchar *prepared_string, *ptr;
-    gboolean found;
-    gdouble retval;
-    gint idx, nonexact_malus;
-
-    if (!query->text)
+    if (query->matcher == NULL)
     {
         return -1;
     }
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    if (!query->prepared_words)
-    {
-        prepared_string = prepare_string_for_compare (query->text);
-        query->prepared_words = g_strsplit (prepared_string, " ", -1);
-        g_free (prepared_string);
-    }
-
-    prepared_string = prepare_string_for_compare (string);
-    found = TRUE;
-    ptr = NULL;
-    nonexact_malus = 0;
-
-    for (idx = 0; query->prepared_words[idx] != NULL; idx++)
-    {
-        if ((ptr = strstr (prepared_string, query->prepared_words[idx])) == NULL)
-        {
-            found = FALSE;
-            break;
-        }
+    return nautilus_query_matcher_match (query->matcher, string);
+}
 
-        nonexact_malus += strlen (ptr) - strlen (query->prepared_words[idx]);
-    }
-    g_mutex_unlock (&query->prepared_words_mutex);
+/**
+ * nautilus_query_get_matcher:
+ * @query: a #NautilusQuery
+ *
+ * Returns: (transfer full) (nullable): a matcher for the current text of
+ *     @query, which can be used from any thread and is unaffected by later
+ *     changes to the text, or %NULL if there is no text.
+ */
+NautilusQueryMatcher *
+nautilus_query_get_matcher (NautilusQuery *query)
+{
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
 
-    if (!found)
+    if (query->matcher == NULL)
     {
-        g_free (prepared_string);
-        return -1;
+        return NULL;
     }
 
-    /* The rank value depends on the numbers of letters before and after the match.
-     * To make the prefix matches prefered over sufix ones, the number of letters
-     * after the match is divided by a factor, so that it decreases the rank by a
-     * smaller amount.
-     */
-    retval = MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - prepared_string) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
-    g_free (prepared_string);
-
-    return retval;
+    return nautilus_query_matcher_ref (query->matcher);
 }
 
 NautilusQuery *
@@ -438,10 +406,11 @@ nautilus_query_set_text (NautilusQuery *query,
     g_free (query->text);
     query->text = g_strstrip (g_strdup (text));
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    g_strfreev (query->prepared_words);
-    query->prepared_words = NULL;
-    g_mutex_unlock (&query->prepared_words_mutex);
+    g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
+    if (query->text != NULL)
+    {
+        query->matcher = nautilus_query_matcher_new (query->text);
+    }
 
     g_object_notify (G_OBJECT (query), "text");
 }
@@ -693,6 +662,128 @@ nautilus_query_is_empty (NautilusQuery *query)
     return FALSE;
 }
 
+/**
+ * nautilus_query_copy:
+ * @query: a #NautilusQuery
+ *
+ * Returns: (transfer full): a new #NautilusQuery with the same parameters as
+ *     @query, which doesn't change along with @query.
+ */
+NautilusQuery *
+nautilus_query_copy (NautilusQuery *query)
+{
+    NautilusQuery *copy;
+
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
+
+    copy = nautilus_query_new ();
+    copy->text = g_strdup (query->text);
+    copy->matcher = (query->matcher != NULL) ? nautilus_query_matcher_ref (query->matcher) : NULL;
+    copy->location = (query->location != NULL) ? g_object_ref (query->location) : NULL;
+    g_ptr_array_unref (copy->mime_types);
+    copy->mime_types = g_ptr_array_ref (query->mime_types);
+    copy->show_hidden = query->show_hidden;
+    copy->date_range = (query->date_range != NULL) ? g_ptr_array_ref (query->date_range) : NULL;
+    copy->recursive = query->recursive;
+    copy->search_type = query->search_type;
+    copy->search_content = query->search_content;
+
+    return copy;
+}
+
+static gboolean
+mime_types_equal (GPtrArray *a,
+                  GPtrArray *b)
+{
+    if (a->len != b->len)
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; i < a->len; i++)
+    {
+        if (g_strcmp0 (g_ptr_array_index (a, i), g_ptr_array_index (b, i)) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean
+date_ranges_equal (GPtrArray *a,
+                   GPtrArray *b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+
+    if (a->len != b->len)
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; i < a->len; i++)
+    {
+        if (!g_date_time_equal (g_ptr_array_index (a, i), g_ptr_array_index (b, i)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * nautilus_query_is_narrowing:
+ * @query: a #NautilusQuery
+ * @previous: a #NautilusQuery searched before
+ *
+ * Only file names are looked at again, so queries that search file contents
+ * are never narrowing.
+ *
+ * Returns: whether every file that @query finds was also found by @previous,
+ *     so that the results of @previous can be filtered instead of searching
+ *     again.
+ */
+gboolean
+nautilus_query_is_narrowing (NautilusQuery *query,
+                             NautilusQuery *previous)
+{
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), FALSE);
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (previous), FALSE);
+
+    if (query->matcher == NULL || previous->matcher == NULL)
+    {
+        return FALSE;
+    }
+
+    if (query->search_content != NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE ||
+        previous->search_content != NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE)
+    {
+        return FALSE;
+    }
+
+    if ((query->location == NULL) != (previous->location == NULL) ||
+        (query->location != NULL && !g_file_equal (query->location, previous->location)))
+    {
+        return FALSE;
+    }
+
+    if (query->recursive != previous->recursive ||
+        query->show_hidden != previous->show_hidden ||
+        query->search_type != previous->search_type ||
+        !mime_types_equal (query->mime_types, previous->mime_types) ||
+        !date_ranges_equal (query->date_range, previous->date_range))
+    {
+        return FALSE;
+    }
+
+    return nautilus_query_matcher_is_narrowing (query->matcher, previous->matcher);
+}
+
 gboolean
 nautilus_query_is_global (NautilusQuery *self)
 {
@@ -24,6 +24,8 @@
 #include <glib-object.h>
 #include <gio/gio.h>
 
+#include "nautilus-query-matcher.h"
+
 typedef enum {
         NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS,
         NAUTILUS_QUERY_SEARCH_TYPE_LAST_MODIFIED,
@@ -83,8 +85,13 @@ void           nautilus_query_set_searching      (NautilusQuery *query,
                                                   gboolean       searching);
 
 gdouble        nautilus_query_matches_string     (NautilusQuery *query, const gchar *string);
+NautilusQueryMatcher *nautilus_query_get_matcher (NautilusQuery *query);
 
 char *         nautilus_query_to_readable_string (NautilusQuery *query);
 
 gboolean       nautilus_query_is_empty           (NautilusQuery *query);
 gboolean       nautilus_query_is_global          (NautilusQuery *query);
+
+NautilusQuery *nautilus_query_copy               (NautilusQuery *query);
+gboolean       nautilus_query_is_narrowing       (NautilusQuery *query,
+                                                  NautilusQuery *previous);
@@ -34,6 +34,17 @@
 #include "nautilus-search-engine-model.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-provider.h"
+#include "nautilus-search-top-hits.h"
+
+/* Number of files shown at first, and added each time the view asks for
+ * more.
+ */
+#define PAGE_SIZE 1000
+
+/* Files may have changed since a search looked at the disk, so its hits
+ * are only filtered for narrower queries typed shortly after.
+ */
+#define REFINE_MAX_AGE_USEC (10 * G_USEC_PER_SEC)
 
 struct _NautilusSearchDirectory
 {
@@ -61,8 +72,35 @@ struct _NautilusSearchDirectory
     gboolean search_ready_and_valid;
 
     GList *files;
+    /* Maps each file to its link in files. */
     GHashTable *files_hash;
 
+    /* Only the most relevant hits are shown as files, so that searches that
+     * find a lot don't create a file for each hit. The others are kept as
+     * hits until the view asks for more.
+     */
+    NautilusSearchTopHits *shown_hits;
+    GPtrArray *unshown_hits;
+    gboolean unshown_hits_sorted;
+    /* Set when the view isn't sorted by relevance, so that the files shown
+     * first wouldn't be the most relevant anyway.
+     */
+    gboolean show_all_files;
+    /* Whether the search left out files because it found too many. */
+    gboolean truncated;
+
+    /* Hits of the search running, and the hits and query of the last search
+     * that completed. When the query is narrowed, say by typing one more
+     * letter, the files it finds are among those, so they are filtered
+     * instead of searching again. The time is when the search engine last
+     * looked at the disk, which filtering doesn't change.
+     */
+    GPtrArray *hits;
+    NautilusQuery *previous_query;
+    GPtrArray *previous_hits;
+    gint64 previous_search_time;
+    guint refine_idle_id;
+
     GList *monitor_list;
     GList *callback_list;
     GList *pending_callback_list;
@@ -125,6 +163,7 @@ static void search_callback_file_ready_callback (NautilusFile *file,
                                                  gpointer      data);
 static void file_changed (NautilusFile            *file,
                           NautilusSearchDirectory *self);
+static void refine_search_idle (gpointer user_data);
 
 static void
 reset_file_list (NautilusSearchDirectory *self)
@@ -154,6 +193,12 @@ reset_file_list (NautilusSearchDirectory *self)
     self->files = NULL;
 
     g_hash_table_remove_all (self->files_hash);
+
+    nautilus_search_top_hits_clear (self->shown_hits);
+    nautilus_search_top_hits_set_max_hits (self->shown_hits,
+                                           self->show_all_files ? G_MAXUINT : PAGE_SIZE,
+                                           NULL);
+    g_ptr_array_set_size (self->unshown_hits, 0);
 }
 
 static void
@@ -200,8 +245,20 @@ start_search (NautilusSearchDirectory *self)
     /* We need to start the search engine */
     self->search_running = TRUE;
     self->search_ready_and_valid = FALSE;
+    self->truncated = FALSE;
 
     set_hidden_files (self);
+
+    if (self->previous_query != NULL &&
+        g_get_monotonic_time () - self->previous_search_time < REFINE_MAX_AGE_USEC &&
+        nautilus_query_is_narrowing (self->query, self->previous_query))
+    {
+        reset_file_list (self);
+        self->refine_idle_id = g_idle_add_once (refine_search_idle, self);
+        return;
+    }
+
+    g_ptr_array_set_size (self->hits, 0);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (self->engine),
                                         self->query);
 
@@ -222,11 +279,32 @@ stop_search (NautilusSearchDirectory *self)
     }
 
     self->search_running = FALSE;
+    g_clear_handle_id (&self->refine_idle_id, g_source_remove);
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (self->engine));
 
+    g_ptr_array_set_size (self->hits, 0);
     reset_file_list (self);
 }
 
+static void
+clear_previous_search (NautilusSearchDirectory *self)
+{
+    g_clear_object (&self->previous_query);
+    g_clear_pointer (&self->previous_hits, g_ptr_array_unref);
+}
+
+static void
+save_completed_search (NautilusSearchDirectory *self,
+                       gint64                   search_time)
+{
+    clear_previous_search (self);
+
+    self->previous_search_time = search_time;
+    self->previous_query = nautilus_query_copy (self->query);
+    self->previous_hits = g_steal_pointer (&self->hits);
+    self->hits = g_ptr_array_new_with_free_func (g_object_unref);
+}
+
 static void
 file_changed (NautilusFile            *file,
               NautilusSearchDirectory *self)
@@ -600,49 +678,138 @@ on_search_directory_search_ready_and_valid (NautilusSearchDirectory *self)
     self->search_ready_and_valid = TRUE;
 }
 
-static void
-search_engine_hits_added (NautilusSearchEngine    *engine,
-                          GList                   *hits,
-                          NautilusSearchDirectory *self)
+static NautilusFile *
+show_hit (NautilusSearchDirectory *self,
+          NautilusSearchHit       *hit)
 {
-    GList *hit_list;
-    GList *file_list;
     NautilusFile *file;
-    SearchMonitor *monitor;
-    GList *monitor_list;
 
-    file_list = NULL;
+    file = nautilus_file_get_by_uri (nautilus_search_hit_get_uri (hit));
+    nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
+    nautilus_file_set_search_fts_snippet (file, nautilus_search_hit_get_fts_snippet (hit));
 
-    for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
+    for (GList *l = self->monitor_list; l != NULL; l = l->next)
     {
-        NautilusSearchHit *hit = hit_list->data;
-        const char *uri;
+        SearchMonitor *monitor = l->data;
 
-        uri = nautilus_search_hit_get_uri (hit);
+        /* Add monitors */
+        nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+    }
 
-        nautilus_search_hit_compute_scores (hit, self->query);
+    g_signal_connect (file, "changed", G_CALLBACK (file_changed), self);
 
-        file = nautilus_file_get_by_uri (uri);
-        nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
-        nautilus_file_set_search_fts_snippet (file, nautilus_search_hit_get_fts_snippet (hit));
+    /* The view sorts them, so prepend rather than walk the list. */
+    self->files = g_list_prepend (self->files, file);
+    g_hash_table_insert (self->files_hash, file, self->files);
+
+    return file;
+}
+
+/* Returns a reference to the file of @hit, if it was shown. */
+static NautilusFile *
+hide_hit (NautilusSearchDirectory *self,
+          NautilusSearchHit       *hit)
+{
+    NautilusFile *file;
+    GList *link;
 
-        for (monitor_list = self->monitor_list; monitor_list; monitor_list = monitor_list->next)
+    file = nautilus_file_get_existing_by_uri (nautilus_search_hit_get_uri (hit));
+    link = file != NULL ? g_hash_table_lookup (self->files_hash, file) : NULL;
+    if (link == NULL)
+    {
+        nautilus_file_unref (file);
+        return NULL;
+    }
+
+    g_hash_table_remove (self->files_hash, file);
+
+    g_signal_handlers_disconnect_by_func (file, file_changed, self);
+    for (GList *l = self->monitor_list; l != NULL; l = l->next)
+    {
+        nautilus_file_monitor_remove (file, l->data);
+    }
+
+    self->files = g_list_delete_link (self->files, link);
+    nautilus_file_unref (file);
+
+    return file;
+}
+
+static gint
+compare_hits_ascending (gconstpointer a,
+                        gconstpointer b)
+{
+    gdouble relevance_a = nautilus_search_hit_get_relevance (*(NautilusSearchHit **) a);
+    gdouble relevance_b = nautilus_search_hit_get_relevance (*(NautilusSearchHit **) b);
+
+    return (relevance_a > relevance_b) - (relevance_a < relevance_b);
+}
+
+static void
+add_unshown_hit (NautilusSearchDirectory *self,
+                 NautilusSearchHit       *hit)
+{
+    g_ptr_array_add (self->unshown_hits, g_object_ref (hit));
+    self->unshown_hits_sorted = FALSE;
+}
+
+/* Shows those of @hits that are among the most relevant, replacing less
+ * relevant ones if there's no room for them, and keeps the rest for later.
+ */
+static void
+show_hits (NautilusSearchDirectory *self,
+           GList                   *hits)
+{
+    g_autoptr (GPtrArray) evicted = g_ptr_array_new_with_free_func (g_object_unref);
+    GList *added = NULL;
+    GList *removed = NULL;
+    NautilusFile *file;
+
+    for (GList *l = hits; l != NULL; l = l->next)
+    {
+        if (!nautilus_search_top_hits_add (self->shown_hits, l->data, evicted))
         {
-            monitor = monitor_list->data;
+            add_unshown_hit (self, l->data);
+        }
+    }
 
-            /* Add monitors */
-            nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+    for (guint i = 0; i < evicted->len; i++)
+    {
+        NautilusSearchHit *hit = g_ptr_array_index (evicted, i);
+
+        file = hide_hit (self, hit);
+        if (file != NULL)
+        {
+            removed = g_list_prepend (removed, file);
         }
+        add_unshown_hit (self, hit);
+    }
 
-        g_signal_connect (file, "changed", G_CALLBACK (file_changed), self),
+    for (GList *l = hits; l != NULL; l = l->next)
+    {
+        NautilusSearchHit *hit = l->data;
 
-        file_list = g_list_prepend (file_list, file);
-        g_hash_table_add (self->files_hash, file);
+        /* Hits earlier in the list may have been replaced by later ones. */
+        if (nautilus_search_top_hits_lookup (self->shown_hits,
+                                             nautilus_search_hit_get_uri (hit)) == hit)
+        {
+            added = g_list_prepend (added, show_hit (self, hit));
+        }
     }
 
-    self->files = g_list_concat (self->files, file_list);
+    if (removed != NULL)
+    {
+        /* They are no longer in this directory, so the view drops them. */
+        nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (self), removed);
+        nautilus_file_list_free (removed);
+    }
 
-    nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), file_list);
+    if (added != NULL)
+    {
+        added = g_list_reverse (added);
+        nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), added);
+        g_list_free (added);
+    }
 
     file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (self));
     nautilus_file_emit_changed (file);
@@ -651,6 +818,71 @@ search_engine_hits_added (NautilusSearchEngine    *engine,
     search_directory_add_pending_files_callbacks (self);
 }
 
+static void
+search_engine_hits_added (NautilusSearchEngine    *engine,
+                          GList                   *hits,
+                          NautilusSearchDirectory *self)
+{
+    nautilus_search_hit_compute_scores_list (hits, self->query);
+
+    for (GList *l = hits; l != NULL; l = l->next)
+    {
+        g_ptr_array_add (self->hits, g_object_ref (l->data));
+    }
+
+    show_hits (self, hits);
+}
+
+static void
+search_engine_hits_changed (NautilusSearchEngine    *engine,
+                            GList                   *hits,
+                            NautilusSearchDirectory *self)
+{
+    g_autolist (NautilusFile) file_list = NULL;
+    GList *unshown = NULL;
+
+    nautilus_search_hit_compute_scores_list (hits, self->query);
+    nautilus_search_top_hits_reorder (self->shown_hits);
+    self->unshown_hits_sorted = FALSE;
+
+    for (GList *l = hits; l != NULL; l = l->next)
+    {
+        NautilusSearchHit *hit = l->data;
+        NautilusFile *file;
+
+        file = nautilus_file_get_existing_by_uri (nautilus_search_hit_get_uri (hit));
+        if (file == NULL || !g_hash_table_contains (self->files_hash, file))
+        {
+            guint index;
+
+            nautilus_file_unref (file);
+
+            /* It may now be among the most relevant. */
+            if (g_ptr_array_find (self->unshown_hits, hit, &index))
+            {
+                unshown = g_list_prepend (unshown,
+                                          g_ptr_array_steal_index_fast (self->unshown_hits, index));
+            }
+            continue;
+        }
+
+        nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
+        nautilus_file_set_search_fts_snippet (file, nautilus_search_hit_get_fts_snippet (hit));
+        file_list = g_list_prepend (file_list, file);
+    }
+
+    if (file_list != NULL)
+    {
+        nautilus_directory_emit_files_changed (NAUTILUS_DIRECTORY (self), file_list);
+    }
+
+    if (unshown != NULL)
+    {
+        show_hits (self, unshown);
+        g_list_free_full (unshown, g_object_unref);
+    }
+}
+
 static void
 search_engine_error (NautilusSearchEngine    *engine,
                      const char              *error_message,
@@ -680,6 +912,18 @@ search_engine_finished (NautilusSearchEngine         *engine,
      * happening. */
     if (status == NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL)
     {
+        self->truncated = nautilus_search_engine_get_truncated (engine);
+
+        /* Stopped or truncated searches may have missed files. */
+        if (self->truncated)
+        {
+            clear_previous_search (self);
+        }
+        else if (self->search_running)
+        {
+            save_completed_search (self, g_get_monotonic_time ());
+        }
+
         on_search_directory_search_ready_and_valid (self);
         nautilus_directory_emit_done_loading (NAUTILUS_DIRECTORY (self));
     }
@@ -691,6 +935,181 @@ search_engine_finished (NautilusSearchEngine         *engine,
     }
 }
 
+/* Most hits of a search are never shown, so avoid creating a file just to
+ * get their name.
+ */
+static char *
+get_hit_name (NautilusSearchHit *hit)
+{
+    const char *uri = nautilus_search_hit_get_uri (hit);
+    g_autoptr (NautilusFile) file = nautilus_file_get_existing_by_uri (uri);
+    g_autofree char *basename = NULL;
+    g_autofree char *unescaped = NULL;
+
+    if (file != NULL)
+    {
+        return g_strdup (nautilus_file_get_display_name (file));
+    }
+
+    basename = g_path_get_basename (uri);
+    unescaped = g_uri_unescape_string (basename, NULL);
+
+    return g_filename_display_name (unescaped != NULL ? unescaped : basename);
+}
+
+/* Filters the hits of the last search with the current query, which is
+ * narrower, and reports them as if the search engine found them.
+ */
+static void
+refine_search_idle (gpointer user_data)
+{
+    NautilusSearchDirectory *self = user_data;
+    GList *hits = NULL;
+
+    self->refine_idle_id = 0;
+
+    for (guint i = 0; i < self->previous_hits->len; i++)
+    {
+        NautilusSearchHit *hit = g_ptr_array_index (self->previous_hits, i);
+        g_autofree char *name = get_hit_name (hit);
+        gdouble match;
+
+        match = nautilus_query_matches_string (self->query, name);
+        if (match > -1)
+        {
+            nautilus_search_hit_set_fts_rank (hit, match);
+            hits = g_list_prepend (hits, hit);
+        }
+    }
+
+    if (hits != NULL)
+    {
+        search_engine_hits_added (self->engine, g_list_reverse (hits), self);
+        g_list_free (hits);
+    }
+
+    save_completed_search (self, self->previous_search_time);
+
+    on_search_directory_search_ready_and_valid (self);
+    nautilus_directory_emit_done_loading (NAUTILUS_DIRECTORY (self));
+}
+
+/**
+ * nautilus_search_directory_has_more_files:
+ * @self: a #NautilusSearchDirectory
+ *
+ * Returns: whether some of the files found are not listed yet
+ */
+gboolean
+nautilus_search_directory_has_more_files (NautilusSearchDirectory *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_SEARCH_DIRECTORY (self), FALSE);
+
+    return self->unshown_hits->len > 0;
+}
+
+/* Shows up to @n_hits more of the unshown hits, the most relevant first. */
+static void
+show_more_hits (NautilusSearchDirectory *self,
+                guint                    n_hits)
+{
+    g_autolist (NautilusSearchHit) hits = NULL;
+    guint max_hits;
+
+    if (self->unshown_hits->len == 0)
+    {
+        return;
+    }
+
+    max_hits = nautilus_search_top_hits_get_max_hits (self->shown_hits);
+    nautilus_search_top_hits_set_max_hits (self->shown_hits,
+                                           max_hits > G_MAXUINT - n_hits ? G_MAXUINT : max_hits + n_hits,
+                                           NULL);
+
+    if (!self->unshown_hits_sorted)
+    {
+        /* The most relevant last, so that taking them is cheap. */
+        g_ptr_array_sort (self->unshown_hits, compare_hits_ascending);
+        self->unshown_hits_sorted = TRUE;
+    }
+
+    for (guint i = 0; i < n_hits && self->unshown_hits->len > 0; i++)
+    {
+        hits = g_list_prepend (hits,
+                               g_ptr_array_steal_index (self->unshown_hits,
+                                                        self->unshown_hits->len - 1));
+    }
+
+    show_hits (self, hits);
+}
+
+/**
+ * nautilus_search_directory_is_truncated:
+ * @self: a #NautilusSearchDirectory
+ *
+ * Returns: whether the search found more files than the results limit, and
+ *     left the others out
+ */
+gboolean
+nautilus_search_directory_is_truncated (NautilusSearchDirectory *self)
+{
+    g_return_val_if_fail (NAUTILUS_IS_SEARCH_DIRECTORY (self), FALSE);
+
+    return self->truncated;
+}
+
+/**
+ * nautilus_search_directory_load_more_files:
+ * @self: a #NautilusSearchDirectory
+ *
+ * Lists the next most relevant files found, if there are any left.
+ */
+void
+nautilus_search_directory_load_more_files (NautilusSearchDirectory *self)
+{
+    g_return_if_fail (NAUTILUS_IS_SEARCH_DIRECTORY (self));
+
+    show_more_hits (self, PAGE_SIZE);
+}
+
+/**
+ * nautilus_search_directory_set_show_all_files:
+ * @self: a #NautilusSearchDirectory
+ * @show_all_files: whether to list every file found
+ *
+ * Files are listed a page at a time, the most relevant first, which only
+ * makes sense when the view is sorted by relevance. Otherwise the view
+ * should ask for every file found, so that it doesn't sort a partial list.
+ */
+void
+nautilus_search_directory_set_show_all_files (NautilusSearchDirectory *self,
+                                              gboolean                 show_all_files)
+{
+    g_return_if_fail (NAUTILUS_IS_SEARCH_DIRECTORY (self));
+
+    show_all_files = !!show_all_files;
+    if (self->show_all_files == show_all_files)
+    {
+        return;
+    }
+
+    self->show_all_files = show_all_files;
+
+    if (show_all_files)
+    {
+        nautilus_search_top_hits_set_max_hits (self->shown_hits, G_MAXUINT, NULL);
+        show_more_hits (self, G_MAXUINT);
+    }
+    else
+    {
+        /* Keep the files already listed, and page from there. */
+        nautilus_search_top_hits_set_max_hits (self->shown_hits,
+                                               MAX (PAGE_SIZE,
+                                                    nautilus_search_top_hits_get_length (self->shown_hits)),
+                                               NULL);
+    }
+}
+
 static NautilusFile *
 search_new_file_from_filename (NautilusDirectory *directory,
                                const char        *filename,
@@ -724,6 +1143,9 @@ search_force_reload (NautilusDirectory *directory)
 
     self->search_ready_and_valid = FALSE;
 
+    /* Reloading must look at the disk again. */
+    clear_previous_search (self);
+
     /* Remove file monitors */
     reset_file_list (self);
     stop_search (self);
@@ -842,6 +1264,9 @@ search_connect_engine (NautilusSearchDirectory *self)
     g_signal_connect (self->engine, "hits-added",
                       G_CALLBACK (search_engine_hits_added),
                       self);
+    g_signal_connect (self->engine, "hits-changed",
+                      G_CALLBACK (search_engine_hits_changed),
+                      self);
     g_signal_connect (self->engine, "error",
                       G_CALLBACK (search_engine_error),
                       self);
@@ -856,6 +1281,9 @@ search_disconnect_engine (NautilusSearchDirectory *self)
     g_signal_handlers_disconnect_by_func (self->engine,
                                           search_engine_hits_added,
                                           self);
+    g_signal_handlers_disconnect_by_func (self->engine,
+                                          search_engine_hits_changed,
+                                          self);
     g_signal_handlers_disconnect_by_func (self->engine,
                                           search_engine_error,
                                           self);
@@ -907,6 +1335,7 @@ search_dispose (GObject *object)
 
     g_clear_object (&self->query);
     stop_search (self);
+    clear_previous_search (self);
     search_disconnect_engine (self);
 
     g_clear_object (&self->engine);
@@ -922,6 +1351,9 @@ search_finalize (GObject *object)
     self = NAUTILUS_SEARCH_DIRECTORY (object);
 
     g_hash_table_destroy (self->files_hash);
+    g_ptr_array_unref (self->hits);
+    nautilus_search_top_hits_free (self->shown_hits);
+    g_ptr_array_unref (self->unshown_hits);
 
     G_OBJECT_CLASS (nautilus_search_directory_parent_class)->finalize (object);
 }
@@ -931,6 +1363,9 @@ nautilus_search_directory_init (NautilusSearchDirectory *self)
 {
     self->query = NULL;
     self->files_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
+    self->hits = g_ptr_array_new_with_free_func (g_object_unref);
+    self->shown_hits = nautilus_search_top_hits_new (PAGE_SIZE);
+    self->unshown_hits = g_ptr_array_new_with_free_func (g_object_unref);
 
     self->engine = nautilus_search_engine_new ();
     search_connect_engine (self);
@@ -984,6 +1419,13 @@ update_base_model (NautilusSearchDirectory *self)
         return;
     }
 
+    /* Hits of another directory can't be narrowed down to this one's. A
+     * pending refine still uses them, and is stopped along with the search.
+     */
+    if (self->refine_idle_id == 0)
+    {
+        clear_previous_search (self);
+    }
     clear_base_model (self);
     self->base_model = nautilus_directory_ref (base_model);
 
@@ -36,3 +36,9 @@ char   *nautilus_search_directory_generate_new_uri     (void);
 NautilusQuery *nautilus_search_directory_get_query       (NautilusSearchDirectory *self);
 void           nautilus_search_directory_set_query       (NautilusSearchDirectory *self,
 							  NautilusQuery           *query);
+
+gboolean       nautilus_search_directory_has_more_files  (NautilusSearchDirectory *self);
+gboolean       nautilus_search_directory_is_truncated    (NautilusSearchDirectory *self);
+void           nautilus_search_directory_load_more_files (NautilusSearchDirectory *self);
+void           nautilus_search_directory_set_show_all_files (NautilusSearchDirectory *self,
+                                                             gboolean                 show_all_files);
@@ -0,0 +1,543 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#define G_LOG_DOMAIN "nautilus-search"
+
+#include <config.h>
+#include "nautilus-search-engine-index.h"
+
+#include "nautilus-name-index.h"
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#include "nautilus-ui-utilities.h"
+
+#include <gio/gio.h>
+
+/* Searches the name index instead of the disk, which answers recursive
+ * searches of large trees without enumerating every directory. Only the
+ * matches are looked at on disk, to get the details of the hits and to
+ * leave out files that went away without the index noticing, and the
+ * directories that changed since the index was built are enumerated for
+ * files it didn't notice.
+ */
+
+#define BATCH_SIZE 100
+
+#define STD_ATTRIBUTES \
+        G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+        G_FILE_ATTRIBUTE_TIME_ACCESS "," \
+        G_FILE_ATTRIBUTE_TIME_CREATED
+
+enum
+{
+    PROP_0,
+    PROP_RUNNING,
+    NUM_PROPERTIES
+};
+
+typedef struct
+{
+    char *path;
+    gdouble rank;
+} IndexMatch;
+
+/* Hits verified in the search thread, on their way to the main loop. */
+typedef struct
+{
+    NautilusSearchEngineIndex *engine;
+    GCancellable *cancellable;
+    GList *hits;
+} HitsBatch;
+
+typedef struct
+{
+    NautilusNameIndex *index;
+    NautilusQuery *query;
+    GFile *location;
+    NautilusQueryMatcher *matcher;
+    GPtrArray *mime_types;
+    GArray *matches;    /* IndexMatch */
+    GHashTable *match_paths;
+} SearchData;
+
+struct _NautilusSearchEngineIndex
+{
+    GObject parent_instance;
+    NautilusQuery *query;
+
+    GCancellable *cancellable;
+    gboolean running;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineIndex,
+                         nautilus_search_engine_index,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+                                                nautilus_search_provider_init))
+
+static void
+index_match_clear (IndexMatch *match)
+{
+    g_free (match->path);
+}
+
+static void
+search_data_free (SearchData *data)
+{
+    g_object_unref (data->index);
+    g_object_unref (data->query);
+    g_object_unref (data->location);
+    g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
+    g_ptr_array_unref (data->mime_types);
+    g_array_unref (data->matches);
+    g_hash_table_destroy (data->match_paths);
+
+    g_free (data);
+}
+
+static void
+add_match (const char *path,
+           gdouble     rank,
+           gpointer    user_data)
+{
+    SearchData *data = user_data;
+    IndexMatch match;
+
+    /* The same file may be found in the index and on disk. */
+    if (!g_hash_table_add (data->match_paths, g_strdup (path)))
+    {
+        return;
+    }
+
+    match.path = g_strdup (path);
+    match.rank = rank;
+    g_array_append_val (data->matches, match);
+}
+
+static gboolean
+matches_mime_types (SearchData *data,
+                    GFileInfo  *info)
+{
+    const char *mime_type;
+
+    if (data->mime_types->len == 0)
+    {
+        return TRUE;
+    }
+
+    mime_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+    if (mime_type == NULL)
+    {
+        mime_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
+
+    for (guint i = 0; mime_type != NULL && i < data->mime_types->len; i++)
+    {
+        if (g_content_type_is_a (mime_type, g_ptr_array_index (data->mime_types, i)))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Returns a hit for @match if it's still there and passes the filters
+ * that need the disk.
+ */
+static NautilusSearchHit *
+verify_match (SearchData   *data,
+              IndexMatch   *match,
+              GPtrArray    *date_range,
+              GCancellable *cancellable)
+{
+    g_autoptr (GFile) file = g_file_new_for_path (match->path);
+    g_autoptr (GFileInfo) info = NULL;
+    g_autoptr (GDateTime) mtime = NULL;
+    g_autoptr (GDateTime) atime = NULL;
+    g_autoptr (GDateTime) ctime = NULL;
+    g_autofree char *uri = NULL;
+    NautilusSearchHit *hit;
+
+    info = g_file_query_info (file,
+                              data->mime_types->len > 0 ?
+                              STD_ATTRIBUTES ","
+                              G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+                              G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE
+                              :
+                              STD_ATTRIBUTES,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              cancellable, NULL);
+    if (info == NULL || !matches_mime_types (data, info))
+    {
+        return NULL;
+    }
+
+    mtime = g_file_info_get_modification_date_time (info);
+    atime = g_file_info_get_access_date_time (info);
+    ctime = g_file_info_get_creation_date_time (info);
+
+    if (date_range != NULL)
+    {
+        GDateTime *target_date;
+
+        switch (nautilus_query_get_search_type (data->query))
+        {
+            case NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS:
+            {
+                target_date = atime;
+            }
+            break;
+
+            case NAUTILUS_QUERY_SEARCH_TYPE_LAST_MODIFIED:
+            {
+                target_date = mtime;
+            }
+            break;
+
+            case NAUTILUS_QUERY_SEARCH_TYPE_CREATED:
+            {
+                target_date = ctime;
+            }
+            break;
+
+            default:
+            {
+                target_date = NULL;
+            }
+        }
+
+        if (!nautilus_date_time_is_between_dates (target_date,
+                                                  g_ptr_array_index (date_range, 0),
+                                                  g_ptr_array_index (date_range, 1)))
+        {
+            return NULL;
+        }
+    }
+
+    uri = g_file_get_uri (file);
+    hit = nautilus_search_hit_new (uri);
+    nautilus_search_hit_set_fts_rank (hit, match->rank);
+    nautilus_search_hit_set_modification_time (hit, mtime);
+    nautilus_search_hit_set_access_time (hit, atime);
+    nautilus_search_hit_set_creation_time (hit, ctime);
+
+    return hit;
+}
+
+static void
+hits_batch_free (HitsBatch *batch)
+{
+    g_object_unref (batch->engine);
+    g_object_unref (batch->cancellable);
+    g_list_free_full (batch->hits, g_object_unref);
+    g_free (batch);
+}
+
+static gboolean
+send_hits_batch (gpointer user_data)
+{
+    HitsBatch *batch = user_data;
+
+    if (!g_cancellable_is_cancelled (batch->cancellable))
+    {
+        g_debug ("Index engine add hits");
+        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (batch->engine),
+                                             batch->hits);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Batches are sent at the priority the task returns at, so they all reach
+ * the main loop before the search finishes.
+ */
+static void
+send_hits_batch_in_idle (GTask *task,
+                         GList *hits)
+{
+    HitsBatch *batch;
+
+    if (hits == NULL)
+    {
+        return;
+    }
+
+    batch = g_new0 (HitsBatch, 1);
+    batch->engine = g_object_ref (g_task_get_source_object (task));
+    batch->cancellable = g_object_ref (g_task_get_cancellable (task));
+    batch->hits = g_list_reverse (hits);
+
+    g_main_context_invoke_full (g_task_get_context (task),
+                                g_task_get_priority (task),
+                                send_hits_batch,
+                                batch,
+                                (GDestroyNotify) hits_batch_free);
+}
+
+/* Looks at the matches from @first on, sending hits as they are found. */
+static void
+verify_matches (GTask        *task,
+                SearchData   *data,
+                guint         first,
+                GPtrArray    *date_range,
+                GCancellable *cancellable)
+{
+    GList *hits = NULL;
+    guint n_hits = 0;
+
+    for (guint i = first; i < data->matches->len && !g_cancellable_is_cancelled (cancellable); i++)
+    {
+        NautilusSearchHit *hit;
+
+        hit = verify_match (data, &g_array_index (data->matches, IndexMatch, i),
+                            date_range, cancellable);
+        if (hit == NULL)
+        {
+            continue;
+        }
+
+        hits = g_list_prepend (hits, hit);
+        if (++n_hits == BATCH_SIZE)
+        {
+            send_hits_batch_in_idle (task, g_steal_pointer (&hits));
+            n_hits = 0;
+        }
+    }
+
+    send_hits_batch_in_idle (task, g_steal_pointer (&hits));
+}
+
+static void
+search_thread (GTask        *task,
+               gpointer      source_object,
+               gpointer      task_data,
+               GCancellable *cancellable)
+{
+    SearchData *data = task_data;
+    g_autoptr (GPtrArray) date_range = NULL;
+    NautilusQueryRecursive recursive_flag;
+    gboolean recursive;
+    gboolean show_hidden;
+    guint n_indexed;
+
+    recursive_flag = nautilus_query_get_recursive (data->query);
+    recursive = recursive_flag == NAUTILUS_QUERY_RECURSIVE_ALWAYS ||
+                recursive_flag == NAUTILUS_QUERY_RECURSIVE_LOCAL_ONLY;
+    show_hidden = nautilus_query_get_show_hidden_files (data->query);
+    date_range = nautilus_query_get_date_range (data->query);
+
+    /* The index answers at once, so its hits are sent before looking at
+     * the directories that changed since it was built.
+     */
+    nautilus_name_index_search (data->index, data->location, data->matcher,
+                                recursive, show_hidden, cancellable,
+                                add_match, data);
+    n_indexed = data->matches->len;
+    verify_matches (task, data, 0, date_range, cancellable);
+
+    if (!g_cancellable_is_cancelled (cancellable))
+    {
+        nautilus_name_index_search_changed (data->index, data->location, data->matcher,
+                                            recursive, show_hidden, cancellable,
+                                            add_match, data);
+        verify_matches (task, data, n_indexed, date_range, cancellable);
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+search_finished (NautilusSearchEngineIndex *self)
+{
+    g_clear_object (&self->cancellable);
+    self->running = FALSE;
+    nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (self),
+                                       NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+
+    g_object_notify (G_OBJECT (self), "running");
+}
+
+static void
+search_done (GObject      *source_object,
+             GAsyncResult *result,
+             gpointer      user_data)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (source_object);
+
+    g_debug ("Index engine finished");
+    search_finished (self);
+}
+
+static gboolean
+search_finished_idle (gpointer user_data)
+{
+    search_finished (user_data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+    NautilusNameIndex *index = nautilus_name_index_get ();
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    g_autoptr (GTask) task = NULL;
+    SearchData *data;
+
+    if (self->running)
+    {
+        return;
+    }
+
+    g_debug ("Index engine start");
+
+    self->running = TRUE;
+    self->cancellable = g_cancellable_new ();
+    g_object_notify (G_OBJECT (provider), "running");
+
+    location = nautilus_query_get_location (self->query);
+    matcher = nautilus_query_get_matcher (self->query);
+    if (index == NULL || location == NULL || matcher == NULL)
+    {
+        /* Nothing for this engine to do. */
+        g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, search_finished_idle,
+                         g_object_ref (self), g_object_unref);
+        return;
+    }
+
+    data = g_new0 (SearchData, 1);
+    data->index = g_object_ref (index);
+    data->query = g_object_ref (self->query);
+    data->location = g_steal_pointer (&location);
+    data->matcher = g_steal_pointer (&matcher);
+    data->mime_types = nautilus_query_get_mime_types (self->query);
+    data->matches = g_array_new (FALSE, FALSE, sizeof (IndexMatch));
+    g_array_set_clear_func (data->matches, (GDestroyNotify) index_match_clear);
+    data->match_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    task = g_task_new (self, self->cancellable, search_done, NULL);
+    g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
+    g_task_run_in_thread (task, search_thread);
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    if (self->running)
+    {
+        g_debug ("Index engine stop");
+        g_cancellable_cancel (self->cancellable);
+    }
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchProvider *provider,
+                                        NautilusQuery          *query)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    g_set_object (&self->query, query);
+}
+
+static gboolean
+nautilus_search_engine_index_is_running (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    return self->running;
+}
+
+/**
+ * nautilus_search_engine_index_can_handle_query:
+ *
+ * Returns: whether the name index has all the files @query searches.
+ */
+gboolean
+nautilus_search_engine_index_can_handle_query (NautilusQuery *query)
+{
+    NautilusNameIndex *index = nautilus_name_index_get ();
+    g_autoptr (GFile) location = NULL;
+
+    if (index == NULL)
+    {
+        return FALSE;
+    }
+
+    location = nautilus_query_get_location (query);
+
+    return location != NULL && nautilus_name_index_covers (index, location);
+}
+
+static void
+nautilus_search_engine_index_get_property (GObject    *object,
+                                           guint       arg_id,
+                                           GValue     *value,
+                                           GParamSpec *pspec)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+
+    switch (arg_id)
+    {
+        case PROP_RUNNING:
+        {
+            g_value_set_boolean (value, self->running);
+        }
+        break;
+    }
+}
+
+static void
+nautilus_search_engine_index_finalize (GObject *object)
+{
+    NautilusSearchEngineIndex *self = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+
+    g_clear_object (&self->query);
+    g_clear_object (&self->cancellable);
+
+    G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderInterface *iface)
+{
+    iface->set_query = nautilus_search_engine_index_set_query;
+    iface->start = nautilus_search_engine_index_start;
+    iface->stop = nautilus_search_engine_index_stop;
+    iface->is_running = nautilus_search_engine_index_is_running;
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = nautilus_search_engine_index_finalize;
+    object_class->get_property = nautilus_search_engine_index_get_property;
+
+    g_object_class_override_property (object_class, PROP_RUNNING, "running");
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *self)
+{
+}
+
+NautilusSearchEngineIndex *
+nautilus_search_engine_index_new (void)
+{
+    return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib-object.h>
+
+#pragma once
+
+#include "nautilus-query.h"
+
+G_BEGIN_DECLS
+
+#define NAUTILUS_TYPE_SEARCH_ENGINE_INDEX (nautilus_search_engine_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (NautilusSearchEngineIndex, nautilus_search_engine_index, NAUTILUS, SEARCH_ENGINE_INDEX, GObject);
+
+NautilusSearchEngineIndex* nautilus_search_engine_index_new (void);
+
+gboolean nautilus_search_engine_index_can_handle_query (NautilusQuery *query);
+
+G_END_DECLS
@@ -20,6 +20,7 @@
 #define G_LOG_DOMAIN "nautilus-search"
 
 #include <config.h>
+#include "nautilus-mount-table.h"
 #include "nautilus-search-hit.h"
 #include "nautilus-search-provider.h"
 #include "nautilus-search-engine-recent.h"
@@ -196,6 +197,15 @@ is_file_valid_recursive (NautilusSearchEngineRecent  *self,
     return TRUE;
 }
 
+static gboolean
+is_on_remote_file_system (GFile *file)
+{
+    g_autofree char *path = g_file_get_path (file);
+
+    return (path != NULL &&
+            nautilus_mount_table_get_path_locality (path) == NAUTILUS_MOUNT_LOCALITY_REMOTE);
+}
+
 static gpointer
 recent_thread_func (gpointer user_data)
 {
@@ -203,9 +213,11 @@ recent_thread_func (gpointer user_data)
     g_autoptr (GPtrArray) date_range = NULL;
     g_autoptr (GFile) query_location = NULL;
     g_autoptr (GPtrArray) mime_types = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
     GList *recent_items;
     GList *hits;
     GList *l;
+    gboolean skip_remote = FALSE;
 
     g_return_val_if_fail (self->query, NULL);
 
@@ -214,6 +226,19 @@ recent_thread_func (gpointer user_data)
     mime_types = nautilus_query_get_mime_types (self->query);
     date_range = nautilus_query_get_date_range (self->query);
     query_location = nautilus_query_get_location (self->query);
+    matcher = nautilus_query_get_matcher (self->query);
+
+    /* Like crawling, leave out remote file systems mounted under a local
+     * location when only local folders are searched.
+     */
+    if (query_location != NULL &&
+        nautilus_query_get_recursive (self->query) == NAUTILUS_QUERY_RECURSIVE_LOCAL_ONLY)
+    {
+        g_autofree char *location_path = g_file_get_path (query_location);
+
+        skip_remote = (location_path != NULL &&
+                       nautilus_mount_table_get_path_locality (location_path) == NAUTILUS_MOUNT_LOCALITY_LOCAL);
+    }
 
     for (l = recent_items; l != NULL; l = l->next)
     {
@@ -237,12 +262,12 @@ recent_thread_func (gpointer user_data)
         }
 
         name = gtk_recent_info_get_display_name (info);
-        rank = nautilus_query_matches_string (self->query, name);
+        rank = (matcher != NULL) ? nautilus_query_matcher_match (matcher, name) : -1;
 
-        if (rank <= 0)
+        if (rank <= 0 && matcher != NULL)
         {
             g_autofree char *short_name = gtk_recent_info_get_short_name (info);
-            rank = nautilus_query_matches_string (self->query, short_name);
+            rank = nautilus_query_matcher_match (matcher, short_name);
         }
 
         if (rank > 0)
@@ -258,6 +283,11 @@ recent_thread_func (gpointer user_data)
                 continue;
             }
 
+            if (skip_remote && is_on_remote_file_system (file))
+            {
+                continue;
+            }
+
             if (!is_file_valid_recursive (self, file, &mtime, &atime, &ctime, &error))
             {
                 if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
@@ -23,8 +23,11 @@
 #include <config.h>
 #include "nautilus-search-engine-simple.h"
 
+#include "nautilus-content-search.h"
+#include "nautilus-mount-table.h"
 #include "nautilus-search-hit.h"
 #include "nautilus-search-provider.h"
+#include "nautilus-tracker-utilities.h"
 #include "nautilus-ui-utilities.h"
 
 #include <string.h>
@@ -32,8 +35,15 @@
 #include <gio/gio.h>
 
 #define BATCH_SIZE 500
+#define CONTENT_BATCH_SIZE 50
 #define CREATE_THREAD_DELAY_MS 500
 
+/* Searching is bound by the latency of enumerating each directory rather
+ * than by CPU, so use a few more workers than there are processors.
+ */
+#define MIN_WORKERS 2
+#define MAX_WORKERS 8
+
 enum
 {
     PROP_0,
@@ -41,20 +51,56 @@ enum
     NUM_PROPERTIES
 };
 
+typedef struct _SearchThreadData SearchThreadData;
+
 typedef struct
+{
+    SearchThreadData *data;
+    guint index;
+
+    /* Directories found by this worker and not visited yet. The worker
+     * takes them from the tail, so it goes depth first, while idle workers
+     * steal from the head, where the largest subtrees are. Guarded by the
+     * frontier mutex.
+     */
+    GQueue directories;     /* GFiles */
+
+    gint n_processed_files;
+    GList *hits;
+} SearchWorker;
+
+struct _SearchThreadData
 {
     NautilusSearchEngineSimple *engine;
     GCancellable *cancellable;
 
     GPtrArray *mime_types;
-    GList *found_list;
+    NautilusQueryMatcher *matcher;
 
-    GQueue *directories;     /* GFiles */
+    GFile *location;
 
+    /* Set when searching the contents of files too. Files whose names
+     * don't match are read by a pool of threads, so that the workers keep
+     * crawling meanwhile.
+     */
+    char *content_text;
+    GThreadPool *content_pool;
+    GMutex content_mutex;
+    GList *content_hits;
+    guint n_content_hits;
+
+    SearchWorker *workers;
+    guint n_workers;
+    gint n_running_workers; /* atomic */
+
+    GMutex frontier_mutex;
+    GCond frontier_cond;
+    /* The following data is shared by the workers and needs to lock the
+     * frontier mutex
+     */
     GHashTable *visited;
-
-    gint n_processed_files;
-    GList *hits;
+    guint n_busy_workers;
+    gboolean frontier_done;
 
     NautilusQuery *query;
     gint processing_id;
@@ -64,7 +110,7 @@ typedef struct
      */
     GQueue *idle_queue;
     gboolean finished;
-} SearchThreadData;
+};
 
 
 struct _NautilusSearchEngineSimple
@@ -77,6 +123,8 @@ struct _NautilusSearchEngineSimple
 };
 
 static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+static void search_file_content (gpointer job_data,
+                                 gpointer user_data);
 
 G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineSimple,
                          nautilus_search_engine_simple,
@@ -103,13 +151,41 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
     data = g_new0 (SearchThreadData, 1);
 
     data->engine = g_object_ref (engine);
-    data->directories = g_queue_new ();
     data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     data->query = g_object_ref (query);
     data->mime_types = nautilus_query_get_mime_types (query);
+    data->matcher = nautilus_query_get_matcher (query);
 
     data->cancellable = g_cancellable_new ();
 
+    if (nautilus_search_engine_simple_searches_content (query))
+    {
+        g_autofree char *text = nautilus_query_get_text (query);
+
+        data->content_text = nautilus_content_search_prepare_text (text);
+    }
+    if (data->content_text != NULL)
+    {
+        data->content_pool = g_thread_pool_new (search_file_content, data,
+                                                g_get_num_processors (), FALSE, NULL);
+    }
+    g_mutex_init (&data->content_mutex);
+
+    data->n_workers = CLAMP (g_get_num_processors () * 2, MIN_WORKERS, MAX_WORKERS);
+    data->workers = g_new0 (SearchWorker, data->n_workers);
+    for (guint i = 0; i < data->n_workers; i++)
+    {
+        data->workers[i].data = data;
+        data->workers[i].index = i;
+        g_queue_init (&data->workers[i].directories);
+    }
+    /* Workers count as busy until they first look for a directory, so that
+     * none of them gives up before the first one has queued the location.
+     */
+    data->n_busy_workers = data->n_workers;
+    g_mutex_init (&data->frontier_mutex);
+    g_cond_init (&data->frontier_cond);
+
     g_mutex_init (&data->idle_mutex);
     data->idle_queue = g_queue_new ();
 
@@ -121,14 +197,27 @@ search_thread_data_free (SearchThreadData *data)
 {
     GList *hits;
 
-    g_queue_foreach (data->directories,
-                     (GFunc) g_object_unref, NULL);
-    g_queue_free (data->directories);
+    for (guint i = 0; i < data->n_workers; i++)
+    {
+        g_queue_clear_full (&data->workers[i].directories, g_object_unref);
+        g_list_free_full (data->workers[i].hits, g_object_unref);
+    }
+    g_free (data->workers);
+    g_clear_object (&data->location);
+    if (data->content_pool != NULL)
+    {
+        g_thread_pool_free (data->content_pool, TRUE, TRUE);
+    }
+    g_free (data->content_text);
+    g_list_free_full (data->content_hits, g_object_unref);
+    g_mutex_clear (&data->content_mutex);
     g_hash_table_destroy (data->visited);
+    g_mutex_clear (&data->frontier_mutex);
+    g_cond_clear (&data->frontier_cond);
     g_object_unref (data->cancellable);
     g_object_unref (data->query);
     g_clear_pointer (&data->mime_types, g_ptr_array_unref);
-    g_list_free_full (data->hits, g_object_unref);
+    g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
     g_object_unref (data->engine);
     g_mutex_clear (&data->idle_mutex);
 
@@ -225,7 +314,6 @@ finish_search_thread (SearchThreadData *thread_data)
 {
     g_mutex_lock (&thread_data->idle_mutex);
     thread_data->finished = TRUE;
-    g_mutex_unlock (&thread_data->idle_mutex);
 
     /* If no results were processed, direclty finish the search, in the main
      * thread.
@@ -234,6 +322,7 @@ finish_search_thread (SearchThreadData *thread_data)
     {
         g_idle_add (G_SOURCE_FUNC (search_thread_done), thread_data);
     }
+    g_mutex_unlock (&thread_data->idle_mutex);
 }
 
 static void
@@ -244,24 +333,118 @@ process_batch_in_idle (SearchThreadData *thread_data,
 
     g_mutex_lock (&thread_data->idle_mutex);
     g_queue_push_tail (thread_data->idle_queue, hits);
-    g_mutex_unlock (&thread_data->idle_mutex);
 
+    /* Several workers may get here at once, so the source must only be
+     * added once.
+     */
     if (thread_data->processing_id == 0)
     {
         thread_data->processing_id = g_idle_add (search_thread_process_idle, thread_data);
     }
+    g_mutex_unlock (&thread_data->idle_mutex);
+}
+
+static void
+send_batch_in_idle (SearchWorker *worker)
+{
+    worker->n_processed_files = 0;
+
+    if (worker->hits)
+    {
+        process_batch_in_idle (worker->data, worker->hits);
+    }
+    worker->hits = NULL;
+}
+
+typedef struct
+{
+    GFile *file;
+    NautilusSearchHit *hit;
+} ContentJob;
+
+static void
+content_job_free (ContentJob *job)
+{
+    g_object_unref (job->file);
+    g_clear_object (&job->hit);
+    g_free (job);
+}
+
+/* Must be called with the content mutex held. */
+static void
+send_content_hits (SearchThreadData *data)
+{
+    if (data->content_hits != NULL)
+    {
+        process_batch_in_idle (data, data->content_hits);
+    }
+    data->content_hits = NULL;
+    data->n_content_hits = 0;
 }
 
 static void
-send_batch_in_idle (SearchThreadData *thread_data)
+search_file_content (gpointer job_data,
+                     gpointer user_data)
 {
-    thread_data->n_processed_files = 0;
+    ContentJob *job = job_data;
+    SearchThreadData *data = user_data;
+    g_autofree char *snippet = NULL;
+    guint n_matches = 0;
+
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        snippet = nautilus_content_search_file (job->file, data->content_text,
+                                                data->cancellable, &n_matches);
+    }
 
-    if (thread_data->hits)
+    if (snippet != NULL)
     {
-        process_batch_in_idle (thread_data, thread_data->hits);
+        nautilus_search_hit_set_fts_rank (job->hit, n_matches);
+        nautilus_search_hit_set_fts_snippet (job->hit, snippet);
+
+        g_mutex_lock (&data->content_mutex);
+        data->content_hits = g_list_prepend (data->content_hits, g_steal_pointer (&job->hit));
+        data->n_content_hits++;
+        if (data->n_content_hits >= CONTENT_BATCH_SIZE)
+        {
+            send_content_hits (data);
+        }
+        g_mutex_unlock (&data->content_mutex);
     }
-    thread_data->hits = NULL;
+
+    content_job_free (job);
+}
+
+/* Takes @hit, which is only reported if @file contains the text. */
+static void
+queue_content_search (SearchThreadData  *data,
+                      GFile             *file,
+                      NautilusSearchHit *hit)
+{
+    ContentJob *job = g_new (ContentJob, 1);
+
+    job->file = g_object_ref (file);
+    job->hit = hit;
+    g_thread_pool_push (data->content_pool, job, NULL);
+}
+
+/* Waits for the files queued to be read. */
+static void
+finish_content_search (SearchThreadData *data)
+{
+    if (data->content_pool == NULL)
+    {
+        return;
+    }
+
+    g_thread_pool_free (g_steal_pointer (&data->content_pool), FALSE, TRUE);
+
+    g_mutex_lock (&data->content_mutex);
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        send_content_hits (data);
+    }
+    g_mutex_unlock (&data->content_mutex);
 }
 
 #define STD_ATTRIBUTES \
@@ -275,33 +458,89 @@ send_batch_in_idle (SearchThreadData *thread_data)
         G_FILE_ATTRIBUTE_TIME_CREATED "," \
         G_FILE_ATTRIBUTE_ID_FILE
 
+/* Uses the mount table when the device is known, which saves asking the file
+ * system about each directory.
+ */
+static gboolean
+is_local_directory (GFile     *directory,
+                    GFileInfo *info)
+{
+    g_autoptr (GFileInfo) file_system_info = NULL;
+
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_DEVICE))
+    {
+        guint32 device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+
+        switch (nautilus_mount_table_get_device_locality (device))
+        {
+            case NAUTILUS_MOUNT_LOCALITY_LOCAL:
+            {
+                return TRUE;
+            }
+
+            case NAUTILUS_MOUNT_LOCALITY_REMOTE:
+            {
+                return FALSE;
+            }
+
+            case NAUTILUS_MOUNT_LOCALITY_UNKNOWN:
+            default:
+            {
+            }
+            break;
+        }
+    }
+
+    file_system_info = g_file_query_filesystem_info (directory,
+                                                     G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
+                                                     NULL, NULL);
+    if (file_system_info == NULL)
+    {
+        return FALSE;
+    }
+
+    return !g_file_info_get_attribute_boolean (file_system_info,
+                                               G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+}
+
 static void
-visit_directory (GFile            *dir,
-                 SearchThreadData *data)
+visit_directory (GFile        *dir,
+                 SearchWorker *worker)
 {
+    SearchThreadData *data = worker->data;
     g_autoptr (GPtrArray) date_range = NULL;
     NautilusQuerySearchType type;
     NautilusQueryRecursive recursive_flag;
+    g_autoptr (GString) attributes = g_string_new (STD_ATTRIBUTES);
     GFileEnumerator *enumerator;
     GFileInfo *info;
     GFile *child;
     const char *mime_type, *display_name;
     gdouble match;
-    gboolean is_hidden, found;
+    gboolean is_hidden, found, search_content;
     const char *id;
     gboolean visited;
     GDateTime *initial_date;
     GDateTime *end_date;
     gchar *uri;
 
+    if (data->mime_types->len > 0)
+    {
+        g_string_append (attributes,
+                         "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
+                         "," G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
+    if (data->content_pool != NULL)
+    {
+        g_string_append (attributes, "," NAUTILUS_CONTENT_SEARCH_ATTRIBUTES);
+    }
+    if (nautilus_query_get_recursive (data->query) == NAUTILUS_QUERY_RECURSIVE_LOCAL_ONLY)
+    {
+        g_string_append (attributes, "," G_FILE_ATTRIBUTE_UNIX_DEVICE);
+    }
+
     enumerator = g_file_enumerate_children (dir,
-                                            data->mime_types->len > 0 ?
-                                            STD_ATTRIBUTES ","
-                                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
-                                            G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE
-                                            :
-                                            STD_ATTRIBUTES
-                                            ,
+                                            attributes->str,
                                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                             data->cancellable, NULL);
 
@@ -337,9 +576,19 @@ visit_directory (GFile            *dir,
         }
 
         child = g_file_get_child (dir, g_file_info_get_name (info));
-        match = nautilus_query_matches_string (data->query, display_name);
+        match = (data->matcher != NULL) ?
+                nautilus_query_matcher_match (data->matcher, display_name) : -1;
         found = (match > -1);
 
+        /* Files whose name doesn't match may have the text inside. The
+         * filters below still apply, so that only files they let through
+         * get read.
+         */
+        search_content = (!found &&
+                          data->content_pool != NULL &&
+                          nautilus_content_search_can_search (info));
+        found = found || search_content;
+
         if (found && data->mime_types->len > 0)
         {
             mime_type = g_file_info_get_attribute_string (info,
@@ -416,13 +665,20 @@ visit_directory (GFile            *dir,
             nautilus_search_hit_set_access_time (hit, atime);
             nautilus_search_hit_set_creation_time (hit, ctime);
 
-            data->hits = g_list_prepend (data->hits, hit);
+            if (search_content)
+            {
+                queue_content_search (data, child, hit);
+            }
+            else
+            {
+                worker->hits = g_list_prepend (worker->hits, hit);
+            }
         }
 
-        data->n_processed_files++;
-        if (data->n_processed_files > BATCH_SIZE)
+        worker->n_processed_files++;
+        if (worker->n_processed_files > BATCH_SIZE)
         {
-            send_batch_in_idle (data);
+            send_batch_in_idle (worker);
         }
 
         if (recursive_flag != NAUTILUS_QUERY_RECURSIVE_NEVER &&
@@ -434,16 +690,7 @@ visit_directory (GFile            *dir,
             }
             else if (recursive_flag == NAUTILUS_QUERY_RECURSIVE_LOCAL_ONLY)
             {
-                g_autoptr (GFileInfo) file_system_info = NULL;
-
-                file_system_info = g_file_query_filesystem_info (child,
-                                                                 G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
-                                                                 NULL, NULL);
-                if (file_system_info != NULL)
-                {
-                    recursive = !g_file_info_get_attribute_boolean (file_system_info,
-                                                                    G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
-                }
+                recursive = is_local_directory (child, info);
             }
         }
 
@@ -451,6 +698,8 @@ visit_directory (GFile            *dir,
         {
             id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
             visited = FALSE;
+
+            g_mutex_lock (&data->frontier_mutex);
             if (id)
             {
                 if (g_hash_table_lookup_extended (data->visited,
@@ -466,8 +715,10 @@ visit_directory (GFile            *dir,
 
             if (!visited)
             {
-                g_queue_push_tail (data->directories, g_object_ref (child));
+                g_queue_push_tail (&worker->directories, g_object_ref (child));
+                g_cond_signal (&data->frontier_cond);
             }
+            g_mutex_unlock (&data->frontier_mutex);
         }
 
         g_object_unref (child);
@@ -479,42 +730,125 @@ next:
 }
 
 
+/* Must be called with the frontier mutex held. */
+static GFile *
+steal_directory (SearchWorker *worker)
+{
+    SearchThreadData *data = worker->data;
+
+    for (guint i = 1; i < data->n_workers; i++)
+    {
+        SearchWorker *victim = &data->workers[(worker->index + i) % data->n_workers];
+        GFile *dir = g_queue_pop_head (&victim->directories);
+
+        if (dir != NULL)
+        {
+            return dir;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns the next directory for @worker to visit, waiting for other
+ * workers to find some if needed, or %NULL once the search is over.
+ */
+static GFile *
+search_worker_next_directory (SearchWorker *worker)
+{
+    SearchThreadData *data = worker->data;
+    GFile *dir = NULL;
+
+    g_mutex_lock (&data->frontier_mutex);
+
+    data->n_busy_workers--;
+
+    while (!data->frontier_done)
+    {
+        if (g_cancellable_is_cancelled (data->cancellable))
+        {
+            data->frontier_done = TRUE;
+            g_cond_broadcast (&data->frontier_cond);
+            break;
+        }
+
+        dir = g_queue_pop_tail (&worker->directories);
+        if (dir == NULL)
+        {
+            dir = steal_directory (worker);
+        }
+        if (dir != NULL)
+        {
+            data->n_busy_workers++;
+            break;
+        }
+
+        /* Only busy workers can find more directories. Any of them notices
+         * cancellation once it's done with its directory, so waiting here
+         * never outlasts the search.
+         */
+        if (data->n_busy_workers == 0)
+        {
+            data->frontier_done = TRUE;
+            g_cond_broadcast (&data->frontier_cond);
+            break;
+        }
+
+        g_cond_wait (&data->frontier_cond, &data->frontier_mutex);
+    }
+
+    g_mutex_unlock (&data->frontier_mutex);
+
+    return dir;
+}
+
 static gpointer
 search_thread_func (gpointer user_data)
 {
-    SearchThreadData *data;
+    SearchWorker *worker = user_data;
+    SearchThreadData *data = worker->data;
     GFile *dir;
-    GFileInfo *info;
-    const char *id;
 
-    data = user_data;
-
-    /* Insert id for toplevel directory into visited */
-    dir = g_queue_peek_head (data->directories);
-    info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
-    if (info)
+    if (worker->index == 0)
     {
-        id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-        if (id)
+        g_autoptr (GFileInfo) info = NULL;
+
+        /* Insert id for toplevel directory into visited */
+        info = g_file_query_info (data->location, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+
+        g_mutex_lock (&data->frontier_mutex);
+        if (info)
         {
-            g_hash_table_insert (data->visited, g_strdup (id), NULL);
+            const char *id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+
+            if (id)
+            {
+                g_hash_table_insert (data->visited, g_strdup (id), NULL);
+            }
         }
-        g_object_unref (info);
+        g_queue_push_tail (&worker->directories, g_object_ref (data->location));
+        g_mutex_unlock (&data->frontier_mutex);
     }
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-           (dir = g_queue_pop_head (data->directories)) != NULL)
+    while ((dir = search_worker_next_directory (worker)) != NULL)
     {
-        visit_directory (dir, data);
+        visit_directory (dir, worker);
         g_object_unref (dir);
     }
 
     if (!g_cancellable_is_cancelled (data->cancellable))
     {
-        send_batch_in_idle (data);
+        send_batch_in_idle (worker);
     }
 
-    finish_search_thread (data);
+    /* The last worker to leave hands the search back to the main thread,
+     * which may free it right away.
+     */
+    if (g_atomic_int_dec_and_test (&data->n_running_workers))
+    {
+        finish_content_search (data);
+        finish_search_thread (data);
+    }
 
     return NULL;
 }
@@ -523,10 +857,19 @@ static void
 create_thread_timeout (gpointer user_data)
 {
     NautilusSearchEngineSimple *simple = user_data;
-    g_autoptr (GThread) thread = NULL;
+    SearchThreadData *data = simple->active_search;
 
     simple->create_thread_timeout_id = 0;
-    thread = g_thread_new ("nautilus-search-simple", search_thread_func, simple->active_search);
+
+    g_debug ("Simple engine searching with %u workers", data->n_workers);
+
+    g_atomic_int_set (&data->n_running_workers, data->n_workers);
+    for (guint i = 0; i < data->n_workers; i++)
+    {
+        g_autoptr (GThread) thread = NULL;
+
+        thread = g_thread_new ("nautilus-search-simple", search_thread_func, &data->workers[i]);
+    }
 }
 
 static void
@@ -558,7 +901,7 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
         return;
     }
 
-    g_queue_push_tail (data->directories, g_steal_pointer (&location));
+    data->location = g_steal_pointer (&location);
 
     simple->create_thread_timeout_id = g_timeout_add_once (CREATE_THREAD_DELAY_MS,
                                                            create_thread_timeout,
@@ -657,6 +1000,35 @@ nautilus_search_engine_simple_init (NautilusSearchEngineSimple *engine)
     engine->active_search = NULL;
 }
 
+/**
+ * nautilus_search_engine_simple_searches_content:
+ * @query: a #NautilusQuery
+ *
+ * The contents of files are only read where Tracker can't search them, and
+ * not on remote locations, where reading each file would be too slow.
+ *
+ * Returns: whether the engine searches the contents of files for @query
+ */
+gboolean
+nautilus_search_engine_simple_searches_content (NautilusQuery *query)
+{
+    g_autoptr (GFile) location = NULL;
+
+    if (nautilus_query_get_search_content (query) != NAUTILUS_QUERY_SEARCH_CONTENT_FULL_TEXT)
+    {
+        return FALSE;
+    }
+
+    location = nautilus_query_get_location (query);
+    if (location == NULL || !g_file_is_native (location))
+    {
+        return FALSE;
+    }
+
+    return (nautilus_tracker_get_miner_fs_connection (NULL) == NULL ||
+            !nautilus_tracker_directory_is_tracked (location));
+}
+
 NautilusSearchEngineSimple *
 nautilus_search_engine_simple_new (void)
 {
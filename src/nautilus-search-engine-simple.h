@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include "nautilus-query.h"
+
 G_BEGIN_DECLS
 
 #define NAUTILUS_TYPE_SEARCH_ENGINE_SIMPLE (nautilus_search_engine_simple_get_type ())
@@ -31,4 +33,6 @@ G_DECLARE_FINAL_TYPE (NautilusSearchEngineSimple, nautilus_search_engine_simple,
 
 NautilusSearchEngineSimple* nautilus_search_engine_simple_new (void);
 
+gboolean nautilus_search_engine_simple_searches_content (NautilusQuery *query);
+
 G_END_DECLS
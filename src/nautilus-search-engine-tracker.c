@@ -24,6 +24,7 @@
 #include "nautilus-search-engine-tracker.h"
 
 #include "nautilus-file.h"
+#include "nautilus-global-preferences.h"
 #include "nautilus-search-hit.h"
 #include "nautilus-search-provider.h"
 #include "nautilus-tracker-utilities.h"
@@ -52,12 +53,14 @@ struct _NautilusSearchEngineTracker
     TrackerSparqlConnection *connection;
     NautilusQuery *query;
     GHashTable *statements;
+    GMutex statements_mutex;
 
     gboolean query_pending;
-    GQueue *hits_pending;
 
     gboolean recursive;
     gboolean fts_enabled;
+    /* Whether the last search found more than the results limit. */
+    gboolean truncated;
 
     GCancellable *cancellable;
 };
@@ -91,57 +94,134 @@ finalize (GObject *object)
     }
 
     g_clear_object (&tracker->query);
-    g_queue_free_full (tracker->hits_pending, g_object_unref);
     g_clear_pointer (&tracker->statements, g_hash_table_unref);
+    g_mutex_clear (&tracker->statements_mutex);
     /* This is a singleton, no need to unref. */
     tracker->connection = NULL;
 
     G_OBJECT_CLASS (nautilus_search_engine_tracker_parent_class)->finalize (object);
 }
 
+/* Rows are read in pages, so that the first results show up quickly even
+ * when the query matches a large part of the index. The first page is about
+ * a screenful, and the following ones grow up to MAX_PAGE_SIZE.
+ */
+#define FIRST_PAGE_SIZE 100
+#define MAX_PAGE_SIZE 2000
+
+/* Number of hits sent at once to the main thread. */
 #define BATCH_SIZE 100
 
+typedef struct
+{
+    NautilusSearchEngineTracker *tracker;
+    TrackerSparqlStatement *stmt;
+    GCancellable *cancellable;
+
+    NautilusQueryMatcher *matcher;
+    gboolean fts_enabled;
+    guint max_results;
+    /* Set by the search thread when there were more results than that. */
+    gboolean truncated;
+
+    /* Values bound to the statement for each page. */
+    gchar *location_uri;
+    gchar *match;
+    gchar *mime_types;
+    gchar *start_time;
+    gchar *end_time;
+
+    GMutex hits_mutex;
+    /* The following data is shared with the search thread and needs to lock
+     * the hits mutex.
+     */
+    GQueue hits_pending;    /* GLists of NautilusSearchHits */
+    guint hits_idle_id;
+} SearchData;
+
 static void
-check_pending_hits (NautilusSearchEngineTracker *tracker,
-                    gboolean                     force_send)
+search_data_free (SearchData *data)
 {
-    GList *hits = NULL;
-    NautilusSearchHit *hit;
+    GList *hits;
+
+    while ((hits = g_queue_pop_head (&data->hits_pending)) != NULL)
+    {
+        g_list_free_full (hits, g_object_unref);
+    }
+    g_mutex_clear (&data->hits_mutex);
 
-    g_debug ("Tracker engine add hits");
+    g_free (data->location_uri);
+    g_free (data->match);
+    g_free (data->mime_types);
+    g_free (data->start_time);
+    g_free (data->end_time);
+    g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
+    g_object_unref (data->cancellable);
+    g_object_unref (data->stmt);
+    g_object_unref (data->tracker);
+    g_free (data);
+}
 
-    if (!force_send &&
-        g_queue_get_length (tracker->hits_pending) < BATCH_SIZE)
+/* Called in the main thread, with each batch in the order it was read. */
+static gboolean
+send_pending_hits_idle (gpointer user_data)
+{
+    SearchData *data = user_data;
+    GList *hits;
+
+    g_mutex_lock (&data->hits_mutex);
+    hits = g_queue_pop_head (&data->hits_pending);
+    if (hits == NULL)
     {
-        return;
+        data->hits_idle_id = 0;
     }
+    g_mutex_unlock (&data->hits_mutex);
 
-    while ((hit = g_queue_pop_head (tracker->hits_pending)))
+    if (hits == NULL)
     {
-        hits = g_list_prepend (hits, hit);
+        return G_SOURCE_REMOVE;
     }
 
-    nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (tracker), hits);
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        g_debug ("Tracker engine add hits");
+        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (data->tracker), hits);
+    }
     g_list_free_full (hits, g_object_unref);
+
+    return G_SOURCE_CONTINUE;
 }
 
+/* Called in the search thread. */
 static void
-search_finished (NautilusSearchEngineTracker *tracker,
-                 GError                      *error)
+push_hits (SearchData *data,
+           GList      *hits)
 {
-    g_debug ("Tracker engine finished");
-
-    if (error == NULL)
+    if (hits == NULL)
     {
-        check_pending_hits (tracker, TRUE);
+        return;
     }
-    else
+
+    g_mutex_lock (&data->hits_mutex);
+    g_queue_push_tail (&data->hits_pending, g_list_reverse (hits));
+    if (data->hits_idle_id == 0)
     {
-        g_queue_foreach (tracker->hits_pending, (GFunc) g_object_unref, NULL);
-        g_queue_clear (tracker->hits_pending);
+        data->hits_idle_id = g_idle_add (send_pending_hits_idle, data);
     }
+    g_mutex_unlock (&data->hits_mutex);
+}
 
-    tracker->query_pending = FALSE;
+static void
+search_finished (NautilusSearchEngineTracker *tracker,
+                 GCancellable                *cancellable,
+                 GError                      *error)
+{
+    /* A new search may have been started after this one was stopped. */
+    if (cancellable == tracker->cancellable)
+    {
+        g_clear_object (&tracker->cancellable);
+        tracker->query_pending = FALSE;
+    }
 
     g_object_notify (G_OBJECT (tracker), "running");
 
@@ -167,71 +247,57 @@ search_finished (NautilusSearchEngineTracker *tracker,
     g_object_unref (tracker);
 }
 
-static void cursor_callback (GObject      *object,
-                             GAsyncResult *result,
-                             gpointer      user_data);
-
-static void
-cursor_next (NautilusSearchEngineTracker *tracker,
-             TrackerSparqlCursor         *cursor)
+static GDateTime *
+cursor_get_date_time (TrackerSparqlCursor *cursor,
+                      gint                 column,
+                      GTimeZone           *tz)
 {
-    tracker_sparql_cursor_next_async (cursor,
-                                      tracker->cancellable,
-                                      cursor_callback,
-                                      tracker);
+    const char *str = tracker_sparql_cursor_get_string (cursor, column, NULL);
+    GDateTime *date;
+
+    if (str == NULL)
+    {
+        return NULL;
+    }
+
+    date = g_date_time_new_from_iso8601 (str, tz);
+    if (date == NULL)
+    {
+        g_warning ("unable to parse %s: %s",
+                   tracker_sparql_cursor_get_variable_name (cursor, column), str);
+    }
+
+    return date;
 }
 
-static void
-cursor_callback (GObject      *object,
-                 GAsyncResult *result,
-                 gpointer      user_data)
+static NautilusSearchHit *
+create_hit (SearchData          *data,
+            TrackerSparqlCursor *cursor,
+            GTimeZone           *tz)
 {
-    NautilusSearchEngineTracker *tracker;
-    GError *error = NULL;
-    TrackerSparqlCursor *cursor;
     NautilusSearchHit *hit;
     const char *uri;
-    const char *mtime_str;
-    const char *atime_str;
-    const char *ctime_str;
-    const gchar *snippet;
-    g_autoptr (GTimeZone) tz = g_time_zone_new_local ();
     gdouble rank, match;
-    gboolean success;
-    gchar *basename;
-
-    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (user_data);
-
-    cursor = TRACKER_SPARQL_CURSOR (object);
-    success = tracker_sparql_cursor_next_finish (cursor, result, &error);
-
-    if (!success)
-    {
-        search_finished (tracker, error);
-
-        g_clear_error (&error);
-        tracker_sparql_cursor_close (cursor);
-        g_clear_object (&cursor);
-
-        return;
-    }
+    g_autofree gchar *basename = NULL;
+    g_autoptr (GDateTime) mtime = NULL;
+    g_autoptr (GDateTime) ctime = NULL;
+    g_autoptr (GDateTime) atime = NULL;
 
-    /* We iterate result by result, not n at a time. */
     uri = tracker_sparql_cursor_get_string (cursor, 0, NULL);
     rank = tracker_sparql_cursor_get_double (cursor, 1);
-    mtime_str = tracker_sparql_cursor_get_string (cursor, 2, NULL);
-    ctime_str = tracker_sparql_cursor_get_string (cursor, 3, NULL);
-    atime_str = tracker_sparql_cursor_get_string (cursor, 4, NULL);
+    mtime = cursor_get_date_time (cursor, 2, tz);
+    ctime = cursor_get_date_time (cursor, 3, tz);
+    atime = cursor_get_date_time (cursor, 4, tz);
     basename = g_path_get_basename (uri);
 
     hit = nautilus_search_hit_new (uri);
-    match = nautilus_query_matches_string (tracker->query, basename);
+    match = data->matcher != NULL ? nautilus_query_matcher_match (data->matcher, basename) : -1;
     nautilus_search_hit_set_fts_rank (hit, rank + match);
-    g_free (basename);
 
-    if (tracker->fts_enabled)
+    if (data->fts_enabled)
     {
-        snippet = tracker_sparql_cursor_get_string (cursor, 5, NULL);
+        const gchar *snippet = tracker_sparql_cursor_get_string (cursor, 5, NULL);
+
         if (snippet != NULL)
         {
             g_autofree gchar *escaped = NULL;
@@ -246,72 +312,160 @@ cursor_callback (GObject      *object,
         }
     }
 
-    if (mtime_str != NULL)
+    nautilus_search_hit_set_modification_time (hit, mtime);
+    nautilus_search_hit_set_access_time (hit, atime);
+    nautilus_search_hit_set_creation_time (hit, ctime);
+
+    return hit;
+}
+
+static TrackerSparqlCursor *
+execute_page (SearchData  *data,
+              guint        limit,
+              guint        offset,
+              GError     **error)
+{
+    TrackerSparqlCursor *cursor;
+
+    /* Statements are shared by all the searches with the same features, and
+     * one that was stopped may still be running in another thread.
+     */
+    g_mutex_lock (&data->tracker->statements_mutex);
+
+    if (data->location_uri != NULL)
+    {
+        tracker_sparql_statement_bind_string (data->stmt, "location", data->location_uri);
+    }
+    if (data->match != NULL)
+    {
+        tracker_sparql_statement_bind_string (data->stmt, "match", data->match);
+    }
+    if (data->mime_types != NULL)
+    {
+        tracker_sparql_statement_bind_string (data->stmt, "mimeTypes", data->mime_types);
+    }
+    if (data->start_time != NULL)
+    {
+        tracker_sparql_statement_bind_string (data->stmt, "startTime", data->start_time);
+        tracker_sparql_statement_bind_string (data->stmt, "endTime", data->end_time);
+    }
+    tracker_sparql_statement_bind_int (data->stmt, "limit", limit);
+    tracker_sparql_statement_bind_int (data->stmt, "offset", offset);
+
+    cursor = tracker_sparql_statement_execute (data->stmt, data->cancellable, error);
+
+    g_mutex_unlock (&data->tracker->statements_mutex);
+
+    return cursor;
+}
+
+static void
+search_thread (GTask        *task,
+               gpointer      source_object,
+               gpointer      task_data,
+               GCancellable *cancellable)
+{
+    SearchData *data = task_data;
+    g_autoptr (GTimeZone) tz = g_time_zone_new_local ();
+    guint page_size = FIRST_PAGE_SIZE;
+    guint n_results = 0;
+    GError *error = NULL;
+
+    while (data->max_results == 0 || n_results < data->max_results)
     {
-        g_autoptr (GDateTime) date = g_date_time_new_from_iso8601 (mtime_str, tz);
+        g_autoptr (TrackerSparqlCursor) cursor = NULL;
+        GList *hits = NULL;
+        guint n_hits = 0;
+        guint n_rows = 0;
+        guint limit;
+        gboolean last_page = FALSE;
 
-        if (date == NULL)
+        limit = page_size;
+        if (data->max_results != 0 && limit >= data->max_results - n_results)
         {
-            g_warning ("unable to parse mtime: %s", mtime_str);
+            limit = data->max_results - n_results;
+            last_page = TRUE;
         }
-        nautilus_search_hit_set_modification_time (hit, date);
-    }
 
-    if (atime_str != NULL)
-    {
-        g_autoptr (GDateTime) date = g_date_time_new_from_iso8601 (atime_str, tz);
+        /* The last page asks for one more row, to tell whether the limit
+         * left results out.
+         */
+        cursor = execute_page (data, last_page ? limit + 1 : limit, n_results, &error);
+        if (cursor == NULL)
+        {
+            break;
+        }
+
+        while (tracker_sparql_cursor_next (cursor, cancellable, &error))
+        {
+            if (n_rows == limit)
+            {
+                data->truncated = TRUE;
+                break;
+            }
+
+            hits = g_list_prepend (hits, create_hit (data, cursor, tz));
+            n_rows++;
+
+            if (++n_hits == BATCH_SIZE)
+            {
+                push_hits (data, g_steal_pointer (&hits));
+                n_hits = 0;
+            }
+        }
+        push_hits (data, g_steal_pointer (&hits));
+        tracker_sparql_cursor_close (cursor);
 
-        if (date == NULL)
+        n_results += n_rows;
+        if (error != NULL || n_rows < limit)
         {
-            g_warning ("unable to parse atime: %s", atime_str);
+            /* Either failed or there are no more results. */
+            break;
         }
-        nautilus_search_hit_set_access_time (hit, date);
+
+        page_size = MIN (page_size * 4, MAX_PAGE_SIZE);
     }
 
-    if (ctime_str != NULL)
+    if (error != NULL)
     {
-        g_autoptr (GDateTime) date = g_date_time_new_from_iso8601 (ctime_str, tz);
-
-        if (date == NULL)
+        g_task_return_error (task, error);
+    }
+    else
+    {
+        if (data->truncated)
         {
-            g_warning ("unable to parse ctime: %s", ctime_str);
+            g_debug ("Tracker engine left out results past the limit of %u",
+                     data->max_results);
         }
-        nautilus_search_hit_set_creation_time (hit, date);
+        g_task_return_boolean (task, TRUE);
     }
-
-    g_queue_push_head (tracker->hits_pending, hit);
-    check_pending_hits (tracker, FALSE);
-
-    /* Get next */
-    cursor_next (tracker, cursor);
 }
 
 static void
-query_callback (GObject      *object,
-                GAsyncResult *result,
-                gpointer      user_data)
+search_done (GObject      *source_object,
+             GAsyncResult *result,
+             gpointer      user_data)
 {
-    NautilusSearchEngineTracker *tracker;
-    TrackerSparqlStatement *stmt;
-    TrackerSparqlCursor *cursor;
-    GError *error = NULL;
-
-    tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (user_data);
+    NautilusSearchEngineTracker *tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (source_object);
+    SearchData *data = g_task_get_task_data (G_TASK (result));
+    g_autoptr (GError) error = NULL;
 
-    stmt = TRACKER_SPARQL_STATEMENT (object);
-    cursor = tracker_sparql_statement_execute_finish (stmt,
-                                                      result,
-                                                      &error);
+    g_task_propagate_boolean (G_TASK (result), &error);
 
-    if (error != NULL)
+    if (data->cancellable == tracker->cancellable)
     {
-        search_finished (tracker, error);
-        g_error_free (error);
+        tracker->truncated = data->truncated;
     }
-    else
+
+    /* Send what the search thread left behind before finishing. */
+    g_mutex_lock (&data->hits_mutex);
+    g_clear_handle_id (&data->hits_idle_id, g_source_remove);
+    g_mutex_unlock (&data->hits_mutex);
+    while (send_pending_hits_idle (data) == G_SOURCE_CONTINUE)
     {
-        cursor_next (tracker, cursor);
     }
+
+    search_finished (tracker, data->cancellable, error);
 }
 
 static gboolean
@@ -321,7 +475,7 @@ search_finished_idle (gpointer user_data)
 
     g_debug ("Tracker engine finished idle");
 
-    search_finished (tracker, NULL);
+    search_finished (tracker, NULL, NULL);
 
     return FALSE;
 }
@@ -462,6 +616,10 @@ create_statement (NautilusSearchProvider *provider,
 
     g_string_append (sparql, ")}");
 
+    /* A stable order is needed to read the results in pages. */
+    g_string_append (sparql, " ORDER BY DESC (?rank) ?url"
+                     " LIMIT ~limit OFFSET ~offset");
+
     stmt = tracker_sparql_connection_query_statement (tracker->connection,
                                                       sparql->str,
                                                       NULL,
@@ -482,6 +640,8 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
     TrackerSparqlStatement *stmt;
     SearchFeatures features = 0;
     g_autoptr (GFile) location = NULL;
+    g_autoptr (GTask) task = NULL;
+    SearchData *data;
 
     tracker = NAUTILUS_SEARCH_ENGINE_TRACKER (provider);
 
@@ -493,6 +653,7 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
     g_debug ("Tracker engine start");
     g_object_ref (tracker);
     tracker->query_pending = TRUE;
+    tracker->truncated = FALSE;
 
     g_object_notify (G_OBJECT (provider), "running");
 
@@ -557,15 +718,24 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
                              GUINT_TO_POINTER (features), stmt);
     }
 
+    data = g_new0 (SearchData, 1);
+    data->tracker = g_object_ref (tracker);
+    data->stmt = g_object_ref (stmt);
+    data->matcher = nautilus_query_get_matcher (tracker->query);
+    data->fts_enabled = tracker->fts_enabled;
+    data->max_results = g_settings_get_uint (nautilus_preferences,
+                                             NAUTILUS_PREFERENCES_SEARCH_RESULTS_LIMIT);
+    g_mutex_init (&data->hits_mutex);
+    g_queue_init (&data->hits_pending);
+
     if (location != NULL)
     {
-        g_autofree gchar *location_uri = g_file_get_uri (location);
-        tracker_sparql_statement_bind_string (stmt, "location", location_uri);
+        data->location_uri = g_file_get_uri (location);
     }
 
     if (*query_text)
     {
-        tracker_sparql_statement_bind_string (stmt, "match", query_text);
+        data->match = g_steal_pointer (&query_text);
     }
 
     if (mimetypes->len > 0)
@@ -588,16 +758,14 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
             }
         }
 
-        tracker_sparql_statement_bind_string (stmt, "mimeTypes", mimetype_str->str);
+        data->mime_types = g_string_free (g_steal_pointer (&mimetype_str), FALSE);
     }
 
     if (date_range)
     {
-        g_autofree gchar *initial_date_format = NULL;
-        g_autofree gchar *end_date_format = NULL;
         GDateTime *initial_date;
         GDateTime *end_date;
-        GDateTime *shifted_end_date;
+        g_autoptr (GDateTime) shifted_end_date = NULL;
 
         initial_date = g_ptr_array_index (date_range, 0);
         end_date = g_ptr_array_index (date_range, 1);
@@ -605,20 +773,19 @@ nautilus_search_engine_tracker_start (NautilusSearchProvider *provider)
          * For that, add a day to it */
         shifted_end_date = g_date_time_add_days (end_date, 1);
 
-        initial_date_format = g_date_time_format_iso8601 (initial_date);
-        end_date_format = g_date_time_format_iso8601 (shifted_end_date);
-
-        tracker_sparql_statement_bind_string (stmt, "startTime",
-                                              initial_date_format);
-        tracker_sparql_statement_bind_string (stmt, "endTime",
-                                              end_date_format);
+        data->start_time = g_date_time_format_iso8601 (initial_date);
+        data->end_time = g_date_time_format_iso8601 (shifted_end_date);
     }
 
     tracker->cancellable = g_cancellable_new ();
-    tracker_sparql_statement_execute_async (stmt,
-                                            tracker->cancellable,
-                                            query_callback,
-                                            tracker);
+    data->cancellable = g_object_ref (tracker->cancellable);
+
+    /* Reading the cursor row by row from the main thread costs a round trip
+     * per result, so the rows are read and turned into hits in a thread.
+     */
+    task = g_task_new (tracker, tracker->cancellable, search_done, NULL);
+    g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
+    g_task_run_in_thread (task, search_thread);
 }
 
 static void
@@ -732,7 +899,7 @@ nautilus_search_engine_tracker_init (NautilusSearchEngineTracker *engine)
 {
     GError *error = NULL;
 
-    engine->hits_pending = g_queue_new ();
+    g_mutex_init (&engine->statements_mutex);
     engine->statements = g_hash_table_new_full (NULL, NULL, NULL,
                                                 g_object_unref);
 
@@ -750,3 +917,18 @@ nautilus_search_engine_tracker_new (void)
 {
     return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_TRACKER, NULL);
 }
+
+/**
+ * nautilus_search_engine_tracker_get_truncated:
+ * @tracker: a #NautilusSearchEngineTracker
+ *
+ * Returns: whether the last search found more results than the
+ *     "search-results-limit" setting allows, and left the others out
+ */
+gboolean
+nautilus_search_engine_tracker_get_truncated (NautilusSearchEngineTracker *tracker)
+{
+    g_return_val_if_fail (NAUTILUS_IS_SEARCH_ENGINE_TRACKER (tracker), FALSE);
+
+    return tracker->truncated;
+}
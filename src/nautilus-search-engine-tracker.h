@@ -27,3 +27,4 @@
 G_DECLARE_FINAL_TYPE (NautilusSearchEngineTracker, nautilus_search_engine_tracker, NAUTILUS, SEARCH_ENGINE_TRACKER, GObject)
 
 NautilusSearchEngineTracker* nautilus_search_engine_tracker_new (void);
+gboolean nautilus_search_engine_tracker_get_truncated (NautilusSearchEngineTracker *tracker);
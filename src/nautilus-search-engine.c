@@ -24,6 +24,7 @@
 #include "nautilus-search-engine.h"
 
 #include "nautilus-file-utilities.h"
+#include "nautilus-search-engine-index.h"
 #include "nautilus-search-engine-model.h"
 #include <glib/gi18n.h>
 #include "nautilus-search-engine-recent.h"
@@ -35,9 +36,12 @@ typedef struct
     NautilusSearchEngineTracker *tracker;
     NautilusSearchEngineRecent *recent;
     NautilusSearchEngineSimple *simple;
+    NautilusSearchEngineIndex *index;
     NautilusSearchEngineModel *model;
 
-    GHashTable *uris;
+    NautilusQuery *query;
+    /* Hits reported so far, by URI. The keys are the URIs of the hits. */
+    GHashTable *hits;
     guint providers_running;
     guint providers_finished;
     guint providers_error;
@@ -45,6 +49,8 @@ typedef struct
     gboolean running;
     gboolean restart;
     gboolean recent_enabled;
+    /* Whether a provider left out results past the results limit. */
+    gboolean truncated;
 } NautilusSearchEnginePrivate;
 
 enum
@@ -54,6 +60,14 @@ enum
     LAST_PROP
 };
 
+enum
+{
+    HITS_CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
 
 static gboolean nautilus_search_engine_is_running (NautilusSearchProvider *provider);
@@ -75,10 +89,12 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
     engine = NAUTILUS_SEARCH_ENGINE (provider);
     priv = nautilus_search_engine_get_instance_private (engine);
 
+    g_set_object (&priv->query, query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->tracker), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->recent), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->model), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->simple), query);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->index), query);
 }
 
 static void
@@ -93,6 +109,7 @@ search_engine_start_real_setup (NautilusSearchEngine *engine)
     priv->providers_error = 0;
 
     priv->restart = FALSE;
+    priv->truncated = FALSE;
 
     g_debug ("Search engine start real setup");
 
@@ -149,10 +166,25 @@ search_engine_start_real_simple (NautilusSearchEngine *engine)
     nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->simple));
 }
 
+static void
+search_engine_start_real_index (NautilusSearchEngine *engine)
+{
+    NautilusSearchEnginePrivate *priv;
+
+    priv = nautilus_search_engine_get_instance_private (engine);
+    priv->providers_running++;
+
+    nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->index));
+}
+
 static void
 search_engine_start_real (NautilusSearchEngine       *engine,
                           NautilusSearchEngineTarget  target_engine)
 {
+    NautilusSearchEnginePrivate *priv;
+
+    priv = nautilus_search_engine_get_instance_private (engine);
+
     search_engine_start_real_setup (engine);
 
     switch (target_engine)
@@ -181,13 +213,32 @@ search_engine_start_real (NautilusSearchEngine       *engine,
         }
         break;
 
+        case NAUTILUS_SEARCH_ENGINE_INDEX_ENGINE:
+        {
+            search_engine_start_real_index (engine);
+        }
+        break;
+
         case NAUTILUS_SEARCH_ENGINE_ALL_ENGINES:
         default:
         {
             search_engine_start_real_tracker (engine);
             search_engine_start_real_recent (engine);
             search_engine_start_real_model (engine);
-            search_engine_start_real_simple (engine);
+
+            /* Both find the same files, but the index without crawling.
+             * Only crawling reads the contents of the files though.
+             */
+            if (priv->query != NULL &&
+                nautilus_search_engine_index_can_handle_query (priv->query) &&
+                !nautilus_search_engine_simple_searches_content (priv->query))
+            {
+                search_engine_start_real_index (engine);
+            }
+            else
+            {
+                search_engine_start_real_simple (engine);
+            }
         }
     }
 }
@@ -288,6 +339,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->recent));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->model));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->simple));
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->index));
 
     priv->running = FALSE;
     priv->restart = FALSE;
@@ -302,6 +354,8 @@ search_provider_hits_added (NautilusSearchProvider *provider,
 {
     NautilusSearchEnginePrivate *priv;
     GList *added = NULL;
+    GList *changed = NULL;
+    g_autoptr (GHashTable) batch_hits = NULL;
     GList *l;
 
     priv = nautilus_search_engine_get_instance_private (engine);
@@ -313,19 +367,33 @@ search_provider_hits_added (NautilusSearchProvider *provider,
         return;
     }
 
+    /* Hits already in the signals emitted for this batch. */
+    batch_hits = g_hash_table_new (NULL, NULL);
+
     for (l = hits; l != NULL; l = l->next)
     {
         NautilusSearchHit *hit = l->data;
-        int count;
-        const char *uri;
+        NautilusSearchHit *known_hit;
 
-        uri = nautilus_search_hit_get_uri (hit);
-        count = GPOINTER_TO_INT (g_hash_table_lookup (priv->uris, uri));
-        if (count == 0)
+        known_hit = g_hash_table_lookup (priv->hits, nautilus_search_hit_get_uri (hit));
+        if (known_hit == NULL)
         {
+            /* The hit owns the key, so that URIs are not copied. */
+            g_hash_table_insert (priv->hits,
+                                 (gpointer) nautilus_search_hit_get_uri (hit),
+                                 g_object_ref (hit));
             added = g_list_prepend (added, hit);
+            g_hash_table_add (batch_hits, hit);
+        }
+        else if (known_hit != hit &&
+                 nautilus_search_hit_merge (known_hit, hit) &&
+                 g_hash_table_add (batch_hits, known_hit))
+        {
+            /* Another provider found the same file. Clients already have
+             * the hit, unless it's in this same batch.
+             */
+            changed = g_list_prepend (changed, known_hit);
         }
-        g_hash_table_replace (priv->uris, g_strdup (uri), GINT_TO_POINTER (++count));
     }
     if (added != NULL)
     {
@@ -333,6 +401,12 @@ search_provider_hits_added (NautilusSearchProvider *provider,
         nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (engine), added);
         g_list_free (added);
     }
+    if (changed != NULL)
+    {
+        changed = g_list_reverse (changed);
+        g_signal_emit (engine, signals[HITS_CHANGED], 0, changed);
+        g_list_free (changed);
+    }
 }
 
 static void
@@ -373,7 +447,7 @@ check_providers_status (NautilusSearchEngine *engine)
     priv->running = FALSE;
     g_object_notify (G_OBJECT (engine), "running");
 
-    g_hash_table_remove_all (priv->uris);
+    g_hash_table_remove_all (priv->hits);
 
     if (priv->restart)
     {
@@ -410,6 +484,12 @@ search_provider_finished (NautilusSearchProvider       *provider,
     priv = nautilus_search_engine_get_instance_private (engine);
     priv->providers_finished++;
 
+    if (provider == NAUTILUS_SEARCH_PROVIDER (priv->tracker) &&
+        nautilus_search_engine_tracker_get_truncated (priv->tracker))
+    {
+        priv->truncated = TRUE;
+    }
+
     check_providers_status (engine);
 }
 
@@ -458,12 +538,14 @@ nautilus_search_engine_finalize (GObject *object)
     engine = NAUTILUS_SEARCH_ENGINE (object);
     priv = nautilus_search_engine_get_instance_private (engine);
 
-    g_hash_table_destroy (priv->uris);
+    g_hash_table_destroy (priv->hits);
+    g_clear_object (&priv->query);
 
     g_clear_object (&priv->tracker);
     g_clear_object (&priv->recent);
     g_clear_object (&priv->model);
     g_clear_object (&priv->simple);
+    g_clear_object (&priv->index);
 
     G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
 }
@@ -507,6 +589,23 @@ nautilus_search_engine_class_init (NautilusSearchEngineClass *class)
      * Whether the search engine is running a search.
      */
     g_object_class_override_property (object_class, PROP_RUNNING, "running");
+
+    /**
+     * NautilusSearchEngine::hits-changed:
+     * @hits: (element-type NautilusSearchHit): hits already added
+     *
+     * Emitted when a provider finds a file that another provider already
+     * found, and the rank, snippet or times it brings are merged into the
+     * hit that was added first.
+     */
+    signals[HITS_CHANGED] = g_signal_new ("hits-changed",
+                                          NAUTILUS_TYPE_SEARCH_ENGINE,
+                                          G_SIGNAL_RUN_LAST,
+                                          0,
+                                          NULL, NULL,
+                                          g_cclosure_marshal_VOID__POINTER,
+                                          G_TYPE_NONE, 1,
+                                          G_TYPE_POINTER);
 }
 
 static void
@@ -515,7 +614,7 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
     NautilusSearchEnginePrivate *priv;
 
     priv = nautilus_search_engine_get_instance_private (engine);
-    priv->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->hits = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
 
     priv->tracker = nautilus_search_engine_tracker_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->tracker));
@@ -526,6 +625,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
     priv->simple = nautilus_search_engine_simple_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->simple));
 
+    priv->index = nautilus_search_engine_index_new ();
+    connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->index));
+
     priv->recent = nautilus_search_engine_recent_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->recent));
 
@@ -554,6 +656,23 @@ nautilus_search_engine_get_model_provider (NautilusSearchEngine *engine)
     return priv->model;
 }
 
+/**
+ * nautilus_search_engine_get_truncated:
+ * @engine: a #NautilusSearchEngine
+ *
+ * Returns: whether the last search left out results because there were too
+ *     many of them
+ */
+gboolean
+nautilus_search_engine_get_truncated (NautilusSearchEngine *engine)
+{
+    NautilusSearchEnginePrivate *priv;
+
+    priv = nautilus_search_engine_get_instance_private (engine);
+
+    return priv->truncated;
+}
+
 void
 nautilus_search_engine_enable_recent (NautilusSearchEngine *engine)
 {
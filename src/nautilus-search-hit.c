@@ -55,101 +55,196 @@ enum
 
 G_DEFINE_TYPE (NautilusSearchHit, nautilus_search_hit, G_TYPE_OBJECT)
 
-void
-nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
-                                    NautilusQuery     *query)
+static gdouble
+get_recent_bonus (NautilusSearchHit *hit,
+                  GDateTime         *now)
 {
-    g_autoptr (GFile) query_location = NULL;
-    GFile *hit_location;
-    guint dir_count = 0;
     GTimeSpan m_diff = G_MAXINT64;
     GTimeSpan a_diff = G_MAXINT64;
-    GTimeSpan t_diff = G_MAXINT64;
-    gdouble recent_bonus = 0.0;
-    gdouble proximity_bonus = 0.0;
-    gdouble match_bonus = 0.0;
-
-    query_location = nautilus_query_get_location (query);
-    hit_location = g_file_new_for_uri (hit->uri);
+    GTimeSpan t_diff;
 
-    if (query_location != NULL &&
-        g_file_has_prefix (hit_location, query_location))
+    if (hit->modification_time != NULL)
+    {
+        m_diff = g_date_time_difference (now, hit->modification_time);
+    }
+    if (hit->access_time != NULL)
+    {
+        a_diff = g_date_time_difference (now, hit->access_time);
+    }
+    m_diff /= G_TIME_SPAN_DAY;
+    a_diff /= G_TIME_SPAN_DAY;
+    t_diff = MIN (m_diff, a_diff);
+    if (t_diff > 90)
+    {
+        return 0.0;
+    }
+    else if (t_diff > 30)
+    {
+        return 10.0;
+    }
+    else if (t_diff > 14)
+    {
+        return 30.0;
+    }
+    else if (t_diff > 7)
     {
-        GFile *parent, *location;
+        return 50.0;
+    }
+    else if (t_diff > 1)
+    {
+        return 70.0;
+    }
+    else
+    {
+        return 100.0;
+    }
+}
 
-        parent = g_file_get_parent (hit_location);
+/* Returns the number of directories between @uri and @location_uri, or -1
+ * if @uri is not inside @location_uri. This is what walking up the parents
+ * of the file would give, without creating a GFile for each of them.
+ */
+static gint
+get_depth (const char *uri,
+           const char *location_uri,
+           gsize       location_len)
+{
+    const char *relative;
+    const char *end;
+    gint depth = 0;
 
-        while (!g_file_equal (parent, query_location))
-        {
-            dir_count++;
-            location = parent;
-            parent = g_file_get_parent (location);
-            g_object_unref (location);
-        }
-        g_object_unref (parent);
+    if (strncmp (uri, location_uri, location_len) != 0)
+    {
+        return -1;
+    }
 
-        if (dir_count < 10)
+    relative = uri + location_len;
+    if (location_len == 0 || location_uri[location_len - 1] != '/')
+    {
+        if (*relative != '/')
         {
-            proximity_bonus = 10000.0 - 1000.0 * dir_count;
+            return -1;
         }
+        relative++;
     }
-    g_object_unref (hit_location);
 
-    /* Recency bonus is useful for recursive search, but unwanted for results
-     * from the current folder, which should always sort by filename match,
-     * which makes prefix matches sort first. */
-    if (dir_count != 0)
+    end = relative + strlen (relative);
+    while (end > relative && end[-1] == '/')
     {
-        g_autoptr (GDateTime) now = g_date_time_new_now_local ();
-        if (hit->modification_time != NULL)
-        {
-            m_diff = g_date_time_difference (now, hit->modification_time);
-        }
-        if (hit->access_time != NULL)
-        {
-            a_diff = g_date_time_difference (now, hit->access_time);
-        }
-        m_diff /= G_TIME_SPAN_DAY;
-        a_diff /= G_TIME_SPAN_DAY;
-        t_diff = MIN (m_diff, a_diff);
-        if (t_diff > 90)
-        {
-            recent_bonus = 0.0;
-        }
-        else if (t_diff > 30)
+        end--;
+    }
+    if (end == relative)
+    {
+        /* The location itself. */
+        return -1;
+    }
+
+    for (const char *p = relative; p < end; p++)
+    {
+        if (*p == '/')
         {
-            recent_bonus = 10.0;
+            depth++;
         }
-        else if (t_diff > 14)
+    }
+
+    return depth;
+}
+
+/**
+ * nautilus_search_hit_compute_scores_batch:
+ * @hits: (array length=n_hits): the hits to score
+ * @n_hits: the number of hits
+ * @location: (nullable): the location of the search
+ * @now: the time to compare the hit times to
+ *
+ * Computes the relevance of each hit. This only touches the hits, so it can
+ * be called from any thread that owns them.
+ */
+void
+nautilus_search_hit_compute_scores_batch (NautilusSearchHit * const *hits,
+                                          guint                      n_hits,
+                                          GFile                     *location,
+                                          GDateTime                 *now)
+{
+    g_autofree char *location_uri = NULL;
+    gsize location_len = 0;
+
+    if (location != NULL)
+    {
+        location_uri = g_file_get_uri (location);
+        location_len = strlen (location_uri);
+    }
+
+    for (guint i = 0; i < n_hits; i++)
+    {
+        NautilusSearchHit *hit = hits[i];
+        gint dir_count = -1;
+        gdouble recent_bonus = 0.0;
+        gdouble proximity_bonus = 0.0;
+        gdouble match_bonus = 0.0;
+
+        if (location_uri != NULL)
         {
-            recent_bonus = 30.0;
+            dir_count = get_depth (hit->uri, location_uri, location_len);
         }
-        else if (t_diff > 7)
+
+        if (dir_count >= 0 && dir_count < 10)
         {
-            recent_bonus = 50.0;
+            proximity_bonus = 10000.0 - 1000.0 * dir_count;
         }
-        else if (t_diff > 1)
+
+        /* Recency bonus is useful for recursive search, but unwanted for results
+         * from the current folder, which should always sort by filename match,
+         * which makes prefix matches sort first. */
+        if (dir_count > 0)
         {
-            recent_bonus = 70.0;
+            recent_bonus = get_recent_bonus (hit, now);
         }
-        else
+
+        if (hit->fts_rank > 0)
         {
-            recent_bonus = 100.0;
+            match_bonus = MIN (500, 10.0 * hit->fts_rank);
         }
-    }
 
-    if (hit->fts_rank > 0)
-    {
-        match_bonus = MIN (500, 10.0 * hit->fts_rank);
+        hit->relevance = recent_bonus + proximity_bonus + match_bonus;
     }
-    else
+
+    g_debug ("Computed relevance of %u hits", n_hits);
+}
+
+/**
+ * nautilus_search_hit_compute_scores_list:
+ * @hits: (element-type NautilusSearchHit): the hits to score
+ * @query: the query that found them
+ *
+ * Computes the relevance of each hit against the same location and time.
+ */
+void
+nautilus_search_hit_compute_scores_list (GList         *hits,
+                                         NautilusQuery *query)
+{
+    g_autoptr (GPtrArray) array = g_ptr_array_sized_new (g_list_length (hits));
+    g_autoptr (GFile) location = nautilus_query_get_location (query);
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+
+    for (GList *l = hits; l != NULL; l = l->next)
     {
-        match_bonus = 0.0;
+        g_ptr_array_add (array, l->data);
     }
 
-    hit->relevance = recent_bonus + proximity_bonus + match_bonus;
-    g_debug ("Hit %s computed relevance %.2f (%.2f + %.2f + %.2f)", hit->uri, hit->relevance,
-             proximity_bonus, recent_bonus, match_bonus);
+    nautilus_search_hit_compute_scores_batch ((NautilusSearchHit **) array->pdata, array->len,
+                                              location, now);
+}
+
+void
+nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
+                                    NautilusQuery     *query)
+{
+    g_autoptr (GFile) query_location = nautilus_query_get_location (query);
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+
+    nautilus_search_hit_compute_scores_batch (&hit, 1, query_location, now);
+    g_debug ("Hit %s computed relevance %.2f", hit->uri, hit->relevance);
 }
 
 const char *
@@ -248,6 +343,57 @@ nautilus_search_hit_set_fts_snippet (NautilusSearchHit *hit,
     hit->fts_snippet = g_strdup (snippet);
 }
 
+/**
+ * nautilus_search_hit_merge:
+ * @hit: a #NautilusSearchHit
+ * @other: another hit for the same file, usually from another provider
+ *
+ * Adds what @other knows about the file to @hit: the best rank of the two,
+ * and the snippet and times that @hit lacks.
+ *
+ * Returns: %TRUE if @hit changed
+ */
+gboolean
+nautilus_search_hit_merge (NautilusSearchHit *hit,
+                           NautilusSearchHit *other)
+{
+    gboolean changed = FALSE;
+
+    g_return_val_if_fail (g_strcmp0 (hit->uri, other->uri) == 0, FALSE);
+
+    if (other->fts_rank > hit->fts_rank)
+    {
+        hit->fts_rank = other->fts_rank;
+        changed = TRUE;
+    }
+
+    if (hit->fts_snippet == NULL && other->fts_snippet != NULL)
+    {
+        hit->fts_snippet = g_strdup (other->fts_snippet);
+        changed = TRUE;
+    }
+
+    if (hit->modification_time == NULL && other->modification_time != NULL)
+    {
+        hit->modification_time = g_date_time_ref (other->modification_time);
+        changed = TRUE;
+    }
+
+    if (hit->access_time == NULL && other->access_time != NULL)
+    {
+        hit->access_time = g_date_time_ref (other->access_time);
+        changed = TRUE;
+    }
+
+    if (hit->creation_time == NULL && other->creation_time != NULL)
+    {
+        hit->creation_time = g_date_time_ref (other->creation_time);
+        changed = TRUE;
+    }
+
+    return changed;
+}
+
 static void
 nautilus_search_hit_set_property (GObject      *object,
                                   guint         arg_id,
@@ -40,8 +40,16 @@ void                nautilus_search_hit_set_creation_time     (NautilusSearchHit
 							       GDateTime         *date);
 void                nautilus_search_hit_set_fts_snippet       (NautilusSearchHit *hit,
                                                                const gchar       *snippet);
+gboolean            nautilus_search_hit_merge                 (NautilusSearchHit *hit,
+                                                               NautilusSearchHit *other);
 void                nautilus_search_hit_compute_scores        (NautilusSearchHit *hit,
 							       NautilusQuery     *query);
+void                nautilus_search_hit_compute_scores_batch  (NautilusSearchHit * const *hits,
+                                                               guint                      n_hits,
+                                                               GFile                     *location,
+                                                               GDateTime                 *now);
+void                nautilus_search_hit_compute_scores_list   (GList             *hits,
+                                                               NautilusQuery     *query);
 
 const char *        nautilus_search_hit_get_uri               (NautilusSearchHit *hit);
 gdouble             nautilus_search_hit_get_relevance         (NautilusSearchHit *hit);
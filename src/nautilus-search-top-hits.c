@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <config.h>
+#include "nautilus-search-top-hits.h"
+
+#include <string.h>
+
+struct _NautilusSearchTopHits
+{
+    guint max_hits;
+
+    /* A binary min-heap, with the least relevant hit at index 0. */
+    GPtrArray *heap;
+    /* The index in the heap plus one of each hit, by URI. The keys are the
+     * URIs of the hits.
+     */
+    GHashTable *positions;
+};
+
+/* Ties are broken by URI, so that the hits kept don't depend on the order
+ * in which they come.
+ */
+static gint
+compare_hits (NautilusSearchHit *a,
+              NautilusSearchHit *b)
+{
+    gdouble relevance_a = nautilus_search_hit_get_relevance (a);
+    gdouble relevance_b = nautilus_search_hit_get_relevance (b);
+
+    if (relevance_a != relevance_b)
+    {
+        return relevance_a < relevance_b ? -1 : 1;
+    }
+
+    return -strcmp (nautilus_search_hit_get_uri (a), nautilus_search_hit_get_uri (b));
+}
+
+static NautilusSearchHit *
+heap_get (NautilusSearchTopHits *self,
+          guint                  index)
+{
+    return g_ptr_array_index (self->heap, index);
+}
+
+static void
+heap_set (NautilusSearchTopHits *self,
+          guint                  index,
+          NautilusSearchHit     *hit)
+{
+    g_ptr_array_index (self->heap, index) = hit;
+    g_hash_table_insert (self->positions,
+                         (gpointer) nautilus_search_hit_get_uri (hit),
+                         GUINT_TO_POINTER (index + 1));
+}
+
+static void
+sift_up (NautilusSearchTopHits *self,
+         guint                  index)
+{
+    NautilusSearchHit *hit = heap_get (self, index);
+
+    while (index > 0)
+    {
+        guint parent = (index - 1) / 2;
+
+        if (compare_hits (heap_get (self, parent), hit) <= 0)
+        {
+            break;
+        }
+
+        heap_set (self, index, heap_get (self, parent));
+        index = parent;
+    }
+
+    heap_set (self, index, hit);
+}
+
+static void
+sift_down (NautilusSearchTopHits *self,
+           guint                  index)
+{
+    NautilusSearchHit *hit = heap_get (self, index);
+    guint length = self->heap->len;
+
+    while (2 * index + 1 < length)
+    {
+        guint child = 2 * index + 1;
+
+        if (child + 1 < length &&
+            compare_hits (heap_get (self, child + 1), heap_get (self, child)) < 0)
+        {
+            child++;
+        }
+
+        if (compare_hits (hit, heap_get (self, child)) <= 0)
+        {
+            break;
+        }
+
+        heap_set (self, index, heap_get (self, child));
+        index = child;
+    }
+
+    heap_set (self, index, hit);
+}
+
+static void
+evict (NautilusSearchHit *hit,
+       GPtrArray         *evicted)
+{
+    if (evicted != NULL)
+    {
+        g_ptr_array_add (evicted, hit);
+    }
+    else
+    {
+        g_object_unref (hit);
+    }
+}
+
+/* Removes the least relevant hit. */
+static NautilusSearchHit *
+pop_worst (NautilusSearchTopHits *self)
+{
+    NautilusSearchHit *worst = heap_get (self, 0);
+    NautilusSearchHit *last;
+
+    g_hash_table_remove (self->positions, nautilus_search_hit_get_uri (worst));
+    last = g_ptr_array_steal_index_fast (self->heap, self->heap->len - 1);
+    if (self->heap->len > 0)
+    {
+        heap_set (self, 0, last);
+        sift_down (self, 0);
+    }
+
+    return worst;
+}
+
+NautilusSearchTopHits *
+nautilus_search_top_hits_new (guint max_hits)
+{
+    NautilusSearchTopHits *self = g_new0 (NautilusSearchTopHits, 1);
+
+    self->max_hits = max_hits;
+    self->heap = g_ptr_array_new_with_free_func (g_object_unref);
+    self->positions = g_hash_table_new (g_str_hash, g_str_equal);
+
+    return self;
+}
+
+void
+nautilus_search_top_hits_free (NautilusSearchTopHits *self)
+{
+    g_hash_table_destroy (self->positions);
+    g_ptr_array_unref (self->heap);
+    g_free (self);
+}
+
+void
+nautilus_search_top_hits_clear (NautilusSearchTopHits *self)
+{
+    g_hash_table_remove_all (self->positions);
+    g_ptr_array_set_size (self->heap, 0);
+}
+
+guint
+nautilus_search_top_hits_get_max_hits (NautilusSearchTopHits *self)
+{
+    return self->max_hits;
+}
+
+/**
+ * nautilus_search_top_hits_set_max_hits:
+ * @self: a #NautilusSearchTopHits
+ * @max_hits: the number of hits to keep
+ * @evicted: (element-type NautilusSearchHit) (transfer full) (nullable): where
+ *     to add the hits that no longer fit
+ */
+void
+nautilus_search_top_hits_set_max_hits (NautilusSearchTopHits *self,
+                                       guint                  max_hits,
+                                       GPtrArray             *evicted)
+{
+    self->max_hits = max_hits;
+
+    while (self->heap->len > max_hits)
+    {
+        evict (pop_worst (self), evicted);
+    }
+}
+
+guint
+nautilus_search_top_hits_get_length (NautilusSearchTopHits *self)
+{
+    return self->heap->len;
+}
+
+/**
+ * nautilus_search_top_hits_lookup:
+ * @self: a #NautilusSearchTopHits
+ * @uri: a URI
+ *
+ * Returns: (transfer none) (nullable): the hit kept for @uri
+ */
+NautilusSearchHit *
+nautilus_search_top_hits_lookup (NautilusSearchTopHits *self,
+                                 const char            *uri)
+{
+    guint position = GPOINTER_TO_UINT (g_hash_table_lookup (self->positions, uri));
+
+    return position > 0 ? heap_get (self, position - 1) : NULL;
+}
+
+/**
+ * nautilus_search_top_hits_add:
+ * @self: a #NautilusSearchTopHits
+ * @hit: a hit, with its relevance computed
+ * @evicted: (element-type NautilusSearchHit) (transfer full) (nullable): where
+ *     to add the hits that make room for @hit
+ *
+ * Keeps @hit if it's among the most relevant ones. If a hit for the same URI
+ * is kept already, only the most relevant of the two stays.
+ *
+ * Returns: whether @hit was kept
+ */
+gboolean
+nautilus_search_top_hits_add (NautilusSearchTopHits *self,
+                              NautilusSearchHit     *hit,
+                              GPtrArray             *evicted)
+{
+    guint position;
+
+    position = GPOINTER_TO_UINT (g_hash_table_lookup (self->positions,
+                                                      nautilus_search_hit_get_uri (hit)));
+    if (position > 0)
+    {
+        NautilusSearchHit *kept = heap_get (self, position - 1);
+
+        if (kept == hit)
+        {
+            return TRUE;
+        }
+        if (compare_hits (hit, kept) <= 0)
+        {
+            return FALSE;
+        }
+
+        /* The key is the URI of the kept hit, which is going away. */
+        g_hash_table_remove (self->positions, nautilus_search_hit_get_uri (kept));
+        heap_set (self, position - 1, g_object_ref (hit));
+        sift_down (self, position - 1);
+        evict (kept, evicted);
+
+        return TRUE;
+    }
+
+    if (self->heap->len < self->max_hits)
+    {
+        g_ptr_array_add (self->heap, g_object_ref (hit));
+        sift_up (self, self->heap->len - 1);
+
+        return TRUE;
+    }
+
+    if (self->max_hits == 0 || compare_hits (hit, heap_get (self, 0)) <= 0)
+    {
+        return FALSE;
+    }
+
+    evict (pop_worst (self), evicted);
+    g_ptr_array_add (self->heap, g_object_ref (hit));
+    sift_up (self, self->heap->len - 1);
+
+    return TRUE;
+}
+
+/**
+ * nautilus_search_top_hits_reorder:
+ * @self: a #NautilusSearchTopHits
+ *
+ * Restores the order of the hits after their relevance changed.
+ */
+void
+nautilus_search_top_hits_reorder (NautilusSearchTopHits *self)
+{
+    for (guint i = self->heap->len / 2; i > 0; i--)
+    {
+        sift_down (self, i - 1);
+    }
+}
+
+static gint
+compare_hits_descending (gconstpointer a,
+                         gconstpointer b)
+{
+    return compare_hits (*(NautilusSearchHit **) b, *(NautilusSearchHit **) a);
+}
+
+/**
+ * nautilus_search_top_hits_get_sorted:
+ * @self: a #NautilusSearchTopHits
+ *
+ * Returns: (transfer full) (element-type NautilusSearchHit): the hits kept,
+ *     the most relevant first
+ */
+GPtrArray *
+nautilus_search_top_hits_get_sorted (NautilusSearchTopHits *self)
+{
+    GPtrArray *sorted;
+
+    sorted = g_ptr_array_copy (self->heap, (GCopyFunc) g_object_ref, NULL);
+    g_ptr_array_set_free_func (sorted, g_object_unref);
+    g_ptr_array_sort (sorted, compare_hits_descending);
+
+    return sorted;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "nautilus-search-hit.h"
+
+/* The most relevant hits of a search, up to a maximum number, kept as they
+ * stream in. The hits are kept in a heap with the least relevant one on
+ * top, so that a new hit only has to beat that one to get in.
+ *
+ * The relevance of the hits must be computed before adding them.
+ */
+typedef struct _NautilusSearchTopHits NautilusSearchTopHits;
+
+NautilusSearchTopHits *nautilus_search_top_hits_new          (guint                  max_hits);
+void                   nautilus_search_top_hits_free         (NautilusSearchTopHits *self);
+void                   nautilus_search_top_hits_clear        (NautilusSearchTopHits *self);
+
+guint                  nautilus_search_top_hits_get_max_hits (NautilusSearchTopHits *self);
+void                   nautilus_search_top_hits_set_max_hits (NautilusSearchTopHits *self,
+                                                              guint                  max_hits,
+                                                              GPtrArray             *evicted);
+guint                  nautilus_search_top_hits_get_length   (NautilusSearchTopHits *self);
+NautilusSearchHit     *nautilus_search_top_hits_lookup       (NautilusSearchTopHits *self,
+                                                              const char            *uri);
+
+gboolean               nautilus_search_top_hits_add          (NautilusSearchTopHits *self,
+                                                              NautilusSearchHit     *hit,
+                                                              GPtrArray             *evicted);
+void                   nautilus_search_top_hits_reorder      (NautilusSearchTopHits *self);
+GPtrArray             *nautilus_search_top_hits_get_sorted   (NautilusSearchTopHits *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (NautilusSearchTopHits, nautilus_search_top_hits_free)
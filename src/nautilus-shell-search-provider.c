@@ -33,6 +33,7 @@
 #include "nautilus-scheme.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-provider.h"
+#include "nautilus-search-top-hits.h"
 #include "nautilus-ui-utilities.h"
 
 #include "nautilus-application.h"
@@ -40,6 +41,11 @@
 #include "nautilus-shell-search-provider-generated.h"
 #include "nautilus-shell-search-provider.h"
 
+/* The Shell shows only a few results, and filters those it got for narrower
+ * searches, so only the most relevant hits are kept.
+ */
+#define MAX_RESULTS 200
+
 typedef struct
 {
     NautilusShellSearchProvider *self;
@@ -47,10 +53,15 @@ typedef struct
     NautilusSearchEngine *engine;
     NautilusQuery *query;
 
-    GHashTable *hits;
+    NautilusSearchTopHits *hits;
+    /* The hits for bookmarks and volumes, which are matched by their own
+     * names rather than found by the search engine.
+     */
+    GHashTable *place_hits;
     GDBusMethodInvocation *invocation;
 
     gint64 start_time;
+    gboolean cancelled;
 } PendingSearch;
 
 struct _NautilusShellSearchProvider
@@ -61,6 +72,12 @@ struct _NautilusShellSearchProvider
 
     PendingSearch *current_search;
 
+    /* The query and engine hits of the last search that completed, which
+     * are filtered for subsearches instead of searching again.
+     */
+    NautilusQuery *previous_query;
+    GHashTable *previous_hits;
+
     GList *metas_requests;
     GHashTable *metas_cache;
 };
@@ -118,10 +135,14 @@ get_gicon (NautilusShellSearchProvider *self,
 static void
 pending_search_free (PendingSearch *search)
 {
-    g_hash_table_destroy (search->hits);
+    nautilus_search_top_hits_free (search->hits);
+    g_hash_table_destroy (search->place_hits);
     g_clear_object (&search->query);
-    g_signal_handlers_disconnect_by_data (G_OBJECT (search->engine), search);
-    g_clear_object (&search->engine);
+    if (search->engine != NULL)
+    {
+        g_signal_handlers_disconnect_by_data (G_OBJECT (search->engine), search);
+        g_clear_object (&search->engine);
+    }
     g_clear_object (&search->invocation);
 
     g_slice_free (PendingSearch, search);
@@ -154,6 +175,7 @@ cancel_current_search (NautilusShellSearchProvider *self)
 
         g_debug ("*** Cancel current search");
 
+        self->current_search->cancelled = TRUE;
         engine = NAUTILUS_SEARCH_PROVIDER (self->current_search->engine);
         /* The finish signal may be emitted during the call to nautilus_search_provider_stop
          * which causes shell_search_provider to free the engine. Increase
@@ -189,40 +211,38 @@ search_hits_added_cb (NautilusSearchEngine *engine,
 
     g_debug ("*** Search engine hits added");
 
+    nautilus_search_hit_compute_scores_list (hits, search->query);
+
     for (l = hits; l != NULL; l = l->next)
     {
         hit = l->data;
-        nautilus_search_hit_compute_scores (hit, search->query);
         hit_uri = nautilus_search_hit_get_uri (hit);
         g_debug ("    %s", hit_uri);
 
-        g_hash_table_replace (search->hits, g_strdup (hit_uri), g_object_ref (hit));
+        nautilus_search_top_hits_add (search->hits, hit, NULL);
     }
 }
 
-static gint
-search_hit_compare_relevance (gconstpointer a,
-                              gconstpointer b)
+/* The hits were merged with what another engine found, and are the ones
+ * already in the table.
+ */
+static void
+search_hits_changed_cb (NautilusSearchEngine *engine,
+                        GList                *hits,
+                        gpointer              user_data)
 {
-    NautilusSearchHit *hit_a, *hit_b;
-    gdouble relevance_a, relevance_b;
+    PendingSearch *search = user_data;
 
-    hit_a = NAUTILUS_SEARCH_HIT ((gpointer) a);
-    hit_b = NAUTILUS_SEARCH_HIT ((gpointer) b);
+    g_debug ("*** Search engine hits changed");
 
-    relevance_a = nautilus_search_hit_get_relevance (hit_a);
-    relevance_b = nautilus_search_hit_get_relevance (hit_b);
+    nautilus_search_hit_compute_scores_list (hits, search->query);
 
-    if (relevance_a > relevance_b)
+    /* Some may now make it among the top hits, or have moved in them. */
+    nautilus_search_top_hits_reorder (search->hits);
+    for (GList *l = hits; l != NULL; l = l->next)
     {
-        return -1;
+        nautilus_search_top_hits_add (search->hits, l->data, NULL);
     }
-    else if (relevance_a == relevance_b)
-    {
-        return 0;
-    }
-
-    return 1;
 }
 
 static void
@@ -231,8 +251,7 @@ search_finished_cb (NautilusSearchEngine         *engine,
                     gpointer                      user_data)
 {
     PendingSearch *search = user_data;
-    GList *hits, *l;
-    NautilusSearchHit *hit;
+    g_autoptr (GPtrArray) hits = NULL;
     GVariantBuilder builder;
     gint64 current_time;
 
@@ -240,18 +259,45 @@ search_finished_cb (NautilusSearchEngine         *engine,
     g_debug ("*** Search engine search finished - time elapsed %dms",
              (gint) ((current_time - search->start_time) / 1000));
 
-    hits = g_hash_table_get_values (search->hits);
-    hits = g_list_sort (hits, search_hit_compare_relevance);
+    hits = nautilus_search_top_hits_get_sorted (search->hits);
+
+    /* Searches that were cancelled may have missed files, and so may those
+     * that found more than the results kept.
+     */
+    if (!search->cancelled && hits->len >= MAX_RESULTS)
+    {
+        g_clear_object (&search->self->previous_query);
+        g_clear_pointer (&search->self->previous_hits, g_hash_table_unref);
+    }
+    else if (!search->cancelled)
+    {
+        NautilusShellSearchProvider *self = search->self;
+
+        g_set_object (&self->previous_query, search->query);
+        g_clear_pointer (&self->previous_hits, g_hash_table_unref);
+        self->previous_hits = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     NULL, g_object_unref);
+        for (guint i = 0; i < hits->len; i++)
+        {
+            NautilusSearchHit *hit = g_ptr_array_index (hits, i);
+
+            if (!g_hash_table_contains (search->place_hits, hit))
+            {
+                g_hash_table_insert (self->previous_hits,
+                                     (gpointer) nautilus_search_hit_get_uri (hit),
+                                     g_object_ref (hit));
+            }
+        }
+    }
 
     g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
 
-    for (l = hits; l != NULL; l = l->next)
+    for (guint i = 0; i < hits->len; i++)
     {
-        hit = l->data;
-        g_variant_builder_add (&builder, "s", nautilus_search_hit_get_uri (hit));
+        g_variant_builder_add (&builder, "s",
+                               nautilus_search_hit_get_uri (g_ptr_array_index (hits, i)));
     }
 
-    g_list_free (hits);
     pending_search_finish (search, search->invocation,
                            g_variant_new ("(as)", &builder));
 }
@@ -445,7 +491,8 @@ search_add_volumes_and_bookmarks (PendingSearch *search)
             hit = nautilus_search_hit_new (candidate->uri);
             nautilus_search_hit_set_fts_rank (hit, match);
             nautilus_search_hit_compute_scores (hit, search->query);
-            g_hash_table_replace (search->hits, g_strdup (candidate->uri), hit);
+            nautilus_search_top_hits_add (search->hits, hit, NULL);
+            g_hash_table_add (search->place_hits, hit);
         }
     }
     g_list_free_full (candidates, (GDestroyNotify) search_hit_candidate_free);
@@ -465,56 +512,74 @@ shell_query_new (gchar **terms)
     /* Global search is not limited by location. */
     nautilus_query_set_location (query, NULL);
     nautilus_query_set_recursive (query, NAUTILUS_QUERY_RECURSIVE_INDEXED_ONLY);
+    nautilus_query_set_show_hidden_files (query, FALSE);
 
     return query;
 }
 
+static gboolean
+terms_are_too_short (gchar **terms)
+{
+    /* don't attempt searches for a single character */
+    return g_strv_length (terms) == 1 &&
+           g_utf8_strlen (terms[0], -1) == 1;
+}
+
+static PendingSearch *
+pending_search_new (NautilusShellSearchProvider *self,
+                    GDBusMethodInvocation       *invocation,
+                    NautilusQuery               *query)
+{
+    PendingSearch *pending_search;
+
+    pending_search = g_slice_new0 (PendingSearch);
+    pending_search->invocation = g_object_ref (invocation);
+    pending_search->hits = nautilus_search_top_hits_new (MAX_RESULTS);
+    pending_search->place_hits = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+    pending_search->query = query;
+    pending_search->start_time = g_get_monotonic_time ();
+    pending_search->self = self;
+
+    self->current_search = pending_search;
+    g_application_hold (g_application_get_default ());
+
+    search_add_volumes_and_bookmarks (pending_search);
+
+    return pending_search;
+}
+
 static void
 execute_search (NautilusShellSearchProvider  *self,
                 GDBusMethodInvocation        *invocation,
                 gchar                       **terms)
 {
-    NautilusQuery *query;
     PendingSearch *pending_search;
 
     cancel_current_search (self);
 
-    /* don't attempt searches for a single character */
-    if (g_strv_length (terms) == 1 &&
-        g_utf8_strlen (terms[0], -1) == 1)
+    if (terms_are_too_short (terms))
     {
         g_dbus_method_invocation_return_value (invocation, g_variant_new ("(as)", NULL));
         return;
     }
 
-    query = shell_query_new (terms);
-    nautilus_query_set_show_hidden_files (query, FALSE);
-
-    pending_search = g_slice_new0 (PendingSearch);
-    pending_search->invocation = g_object_ref (invocation);
-    pending_search->hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
-    pending_search->query = query;
+    pending_search = pending_search_new (self, invocation, shell_query_new (terms));
     pending_search->engine = nautilus_search_engine_new ();
-    pending_search->start_time = g_get_monotonic_time ();
-    pending_search->self = self;
 
     g_signal_connect (pending_search->engine, "hits-added",
                       G_CALLBACK (search_hits_added_cb), pending_search);
+    g_signal_connect (pending_search->engine, "hits-changed",
+                      G_CALLBACK (search_hits_changed_cb), pending_search);
     g_signal_connect (pending_search->engine, "finished",
                       G_CALLBACK (search_finished_cb), pending_search);
     g_signal_connect (pending_search->engine, "error",
                       G_CALLBACK (search_error_cb), pending_search);
 
-    self->current_search = pending_search;
-    g_application_hold (g_application_get_default ());
-
-    search_add_volumes_and_bookmarks (pending_search);
-
     /* start searching */
     g_debug ("*** Search engine search started");
     nautilus_search_engine_enable_recent (pending_search->engine);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (pending_search->engine),
-                                        query);
+                                        pending_search->query);
     nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (pending_search->engine));
 }
 
@@ -531,6 +596,47 @@ handle_get_initial_result_set (NautilusShellSearchProvider2  *skeleton,
     return TRUE;
 }
 
+/* Filters the previous results with @query, which is narrower than the
+ * query that found them, instead of searching again.
+ */
+static void
+refine_search (NautilusShellSearchProvider  *self,
+               GDBusMethodInvocation        *invocation,
+               NautilusQuery                *query,
+               gchar                       **previous_results)
+{
+    PendingSearch *pending_search;
+
+    cancel_current_search (self);
+
+    g_debug ("*** Refining previous search");
+    pending_search = pending_search_new (self, invocation, g_object_ref (query));
+
+    for (guint i = 0; previous_results[i] != NULL; i++)
+    {
+        const char *uri = previous_results[i];
+        NautilusSearchHit *hit = g_hash_table_lookup (self->previous_hits, uri);
+        g_autoptr (NautilusFile) file = NULL;
+        gdouble match;
+
+        if (hit == NULL || nautilus_search_top_hits_lookup (pending_search->hits, uri) != NULL)
+        {
+            continue;
+        }
+
+        file = nautilus_file_get_by_uri (uri);
+        match = nautilus_query_matches_string (query, nautilus_file_get_display_name (file));
+        if (match > -1)
+        {
+            nautilus_search_hit_set_fts_rank (hit, match);
+            nautilus_search_hit_compute_scores (hit, query);
+            nautilus_search_top_hits_add (pending_search->hits, hit, NULL);
+        }
+    }
+
+    search_finished_cb (NULL, NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL, pending_search);
+}
+
 static gboolean
 handle_get_subsearch_result_set (NautilusShellSearchProvider2  *skeleton,
                                  GDBusMethodInvocation         *invocation,
@@ -539,9 +645,21 @@ handle_get_subsearch_result_set (NautilusShellSearchProvider2  *skeleton,
                                  gpointer                       user_data)
 {
     NautilusShellSearchProvider *self = user_data;
+    g_autoptr (NautilusQuery) query = shell_query_new (terms);
 
     g_debug ("****** GetSubSearchResultSet");
-    execute_search (self, invocation, terms);
+
+    if (self->previous_query != NULL &&
+        !terms_are_too_short (terms) &&
+        nautilus_query_is_narrowing (query, self->previous_query))
+    {
+        refine_search (self, invocation, query, previous_results);
+    }
+    else
+    {
+        execute_search (self, invocation, terms);
+    }
+
     return TRUE;
 }
 
@@ -812,6 +930,8 @@ search_provider_dispose (GObject *obj)
     g_clear_object (&self->skeleton);
     g_hash_table_destroy (self->metas_cache);
     cancel_current_search_ignoring_partial_results (self);
+    g_clear_object (&self->previous_query);
+    g_clear_pointer (&self->previous_hits, g_hash_table_unref);
     cancel_result_meta_requests (self);
 
     G_OBJECT_CLASS (nautilus_shell_search_provider_parent_class)->dispose (obj);
@@ -54,6 +54,9 @@ static NautilusTagManager *tag_manager = NULL;
 /* See nautilus_tag_manager_new_dummy() documentation for details. */
 static gboolean make_dummy_instance = FALSE;
 
+/* Bumped whenever the set of starred files may have changed. */
+static guint starred_generation = 1;
+
 typedef struct
 {
     NautilusTagManager *tag_manager;
@@ -233,6 +236,7 @@ on_get_starred_files_cursor_callback (GObject      *object,
     url = tracker_sparql_cursor_get_string (cursor, 0, NULL);
 
     g_hash_table_add (self->starred_file_uris, g_strdup (url));
+    starred_generation++;
 
     file = nautilus_file_get_by_uri (url);
 
@@ -363,6 +367,19 @@ nautilus_tag_manager_file_is_starred (NautilusTagManager *self,
     return g_hash_table_contains (self->starred_file_uris, file_uri);
 }
 
+/**
+ * nautilus_tag_manager_get_starred_generation:
+ *
+ * Returns: a number that changes whenever the starred state of any file may
+ *     have changed, so that results of nautilus_tag_manager_file_is_starred()
+ *     can be kept until then. It is never 0.
+ */
+guint
+nautilus_tag_manager_get_starred_generation (void)
+{
+    return starred_generation;
+}
+
 void
 nautilus_tag_manager_star_files (NautilusTagManager  *self,
                                  GObject             *object,
@@ -482,6 +499,7 @@ on_tracker_notifier_events (TrackerNotifier *notifier,
 
             if (inserted)
             {
+                starred_generation++;
                 g_debug ("Added %s to starred files list", file_url);
                 changed_file = nautilus_file_get_by_uri (file_url);
             }
@@ -492,6 +510,7 @@ on_tracker_notifier_events (TrackerNotifier *notifier,
 
             if (removed)
             {
+                starred_generation++;
                 g_debug ("Removed %s from starred files list", file_url);
                 changed_file = nautilus_file_get_by_uri (file_url);
             }
@@ -533,6 +552,7 @@ nautilus_tag_manager_finalize (GObject *object)
     g_clear_pointer (&self->pending_changed_files, nautilus_file_list_free);
 
     g_hash_table_destroy (self->starred_file_uris);
+    starred_generation++;
     g_clear_object (&self->home);
 
     G_OBJECT_CLASS (nautilus_tag_manager_parent_class)->finalize (object);
@@ -672,6 +692,7 @@ nautilus_tag_manager_init (NautilusTagManager *self)
                                                      (GDestroyNotify) g_free,
                                                      /* values are keys */
                                                      NULL);
+    starred_generation++;
     self->home = g_file_new_for_path (g_get_home_dir ());
 
     if (make_dummy_instance)
@@ -49,6 +49,7 @@ void                nautilus_tag_manager_unstar_files       (NautilusTagManager
 
 gboolean            nautilus_tag_manager_file_is_starred   (NautilusTagManager *self,
                                                             const gchar        *file_uri);
+guint               nautilus_tag_manager_get_starred_generation (void);
 
 gboolean            nautilus_tag_manager_can_star_contents (NautilusTagManager *self,
                                                             GFile              *directory);
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "nautilus-trash-batch"
+
+#include <config.h>
+#include "nautilus-trash-batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Attempts at finding a free name in the trash. */
+#define MAX_NAME_ATTEMPTS 1000
+
+typedef struct
+{
+    char *path;
+    char *trash_name;
+    char *info_path;
+    gint64 deletion_time;
+    GError *error;
+} TrashItem;
+
+static void
+trash_item_clear (TrashItem *item)
+{
+    g_free (item->path);
+    g_free (item->trash_name);
+    g_free (item->info_path);
+    g_clear_error (&item->error);
+}
+
+static GError *
+error_from_errno (int errsv)
+{
+    return g_error_new_literal (G_IO_ERROR, g_io_error_from_errno (errsv), g_strerror (errsv));
+}
+
+static GError *
+not_supported_error (void)
+{
+    return g_error_new_literal (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                "The file can't be trashed in a batch");
+}
+
+/* The deletion date is in local time, and only changes once a second. */
+static const char *
+get_deletion_date (gint64 *last_time,
+                   char    date[32])
+{
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+    if (now != *last_time)
+    {
+        g_autoptr (GDateTime) date_time = g_date_time_new_from_unix_local (now);
+        g_autofree char *formatted = g_date_time_format (date_time, "%Y-%m-%dT%H:%M:%S");
+
+        g_strlcpy (date, formatted, 32);
+        *last_time = now;
+    }
+
+    return date;
+}
+
+/* Claims a free name in the trash by creating its info file, as the
+ * specification requires, and writes the info with a single write.
+ */
+static void
+write_trash_info (TrashItem  *item,
+                  const char *files_dir,
+                  const char *info_dir,
+                  const char *deletion_date,
+                  GString    *contents)
+{
+    g_autofree char *basename = g_path_get_basename (item->path);
+    g_autofree char *escaped_path = g_uri_escape_string (item->path, "/", FALSE);
+    g_autofd int fd = -1;
+    gssize written;
+
+    for (guint i = 1; i <= MAX_NAME_ATTEMPTS && fd < 0; i++)
+    {
+        g_autofree char *info_name = NULL;
+
+        g_free (item->trash_name);
+        item->trash_name = (i == 1) ? g_strdup (basename) : g_strdup_printf ("%s.%u", basename, i);
+        info_name = g_strconcat (item->trash_name, ".trashinfo", NULL);
+
+        g_free (item->info_path);
+        item->info_path = g_build_filename (info_dir, info_name, NULL);
+
+        fd = g_open (item->info_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EEXIST)
+        {
+            item->error = error_from_errno (errno);
+            g_clear_pointer (&item->info_path, g_free);
+            return;
+        }
+
+        /* Left over files without info would be replaced on renaming. */
+        if (fd >= 0)
+        {
+            g_autofree char *trashed_path = g_build_filename (files_dir, item->trash_name, NULL);
+            struct stat stat_buf;
+
+            if (g_lstat (trashed_path, &stat_buf) == 0)
+            {
+                g_clear_fd (&fd, NULL);
+                g_unlink (item->info_path);
+            }
+        }
+    }
+
+    if (fd < 0)
+    {
+        item->error = not_supported_error ();
+        g_clear_pointer (&item->info_path, g_free);
+        return;
+    }
+
+    g_string_printf (contents, "[Trash Info]\nPath=%s\nDeletionDate=%s\n",
+                     escaped_path, deletion_date);
+
+    do
+    {
+        written = write (fd, contents->str, contents->len);
+    }
+    while (written < 0 && errno == EINTR);
+
+    if (written == (gssize) contents->len)
+    {
+        g_close (g_steal_fd (&fd), &item->error);
+    }
+    else
+    {
+        item->error = (written < 0) ? error_from_errno (errno) : not_supported_error ();
+    }
+
+    if (item->error != NULL)
+    {
+        g_unlink (item->info_path);
+        g_clear_pointer (&item->info_path, g_free);
+    }
+}
+
+static gboolean
+is_path_within (const char *path,
+                const char *directory)
+{
+    gsize length = strlen (directory);
+
+    return (strncmp (path, directory, length) == 0 &&
+            (path[length] == '\0' || path[length] == G_DIR_SEPARATOR));
+}
+
+/* Only files that can be renamed into the trash are batched. Files on
+ * other file systems have trash directories of their own, which are left
+ * to g_file_trash().
+ */
+static gboolean
+can_trash (TrashItem  *item,
+           const char *trash_dir,
+           dev_t       trash_device)
+{
+    struct stat stat_buf;
+
+    return (item->path != NULL &&
+            g_lstat (item->path, &stat_buf) == 0 &&
+            stat_buf.st_dev == trash_device &&
+            !is_path_within (trash_dir, item->path) &&
+            !is_path_within (item->path, trash_dir));
+}
+
+/**
+ * nautilus_trash_batch_trash_files:
+ * @trash_dir: (nullable): the trash directory, or %NULL for the one in the
+ *     home directory
+ * @files: the files to move to the trash
+ * @deletion_times: (out caller-allocates) (array) (nullable): where to
+ *     store, for each file, the deletion date written to its info, in
+ *     seconds since the epoch
+ * @cancellable: (nullable): a #GCancellable
+ *
+ * Moves files to the trash together. Files that can't be trashed this way,
+ * because they aren't local or are on another file system than the trash,
+ * fail with %G_IO_ERROR_NOT_SUPPORTED and should be trashed with
+ * g_file_trash() instead.
+ *
+ * Returns: (transfer full): an array with, for each file, %NULL if it was
+ *     trashed, and otherwise the #GError it failed with
+ */
+GPtrArray *
+nautilus_trash_batch_trash_files (const char   *trash_dir,
+                                  GPtrArray    *files,
+                                  gint64       *deletion_times,
+                                  GCancellable *cancellable)
+{
+    g_autofree char *home_trash_dir = NULL;
+    g_autofree char *files_dir = NULL;
+    g_autofree char *info_dir = NULL;
+    g_autofree TrashItem *items = g_new0 (TrashItem, files->len);
+    g_autoptr (GString) contents = g_string_new (NULL);
+    GPtrArray *errors = g_ptr_array_new_full (files->len, (GDestroyNotify) g_error_free);
+    struct stat trash_stat = { 0 };
+    gboolean trash_usable;
+    gint64 last_time = 0;
+    char deletion_date[32];
+    guint n_trashed = 0;
+
+    if (trash_dir == NULL)
+    {
+        home_trash_dir = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+        trash_dir = home_trash_dir;
+    }
+
+    files_dir = g_build_filename (trash_dir, "files", NULL);
+    info_dir = g_build_filename (trash_dir, "info", NULL);
+    trash_usable = (g_mkdir_with_parents (files_dir, 0700) == 0 &&
+                    g_mkdir_with_parents (info_dir, 0700) == 0 &&
+                    g_stat (files_dir, &trash_stat) == 0);
+
+    /* The info files are written first, so that the files are never in
+     * the trash without them.
+     */
+    for (guint i = 0; i < files->len; i++)
+    {
+        TrashItem *item = &items[i];
+
+        item->path = g_file_get_path (g_ptr_array_index (files, i));
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, &item->error))
+        {
+            continue;
+        }
+
+        if (!trash_usable || !can_trash (item, trash_dir, trash_stat.st_dev))
+        {
+            item->error = not_supported_error ();
+            continue;
+        }
+
+        write_trash_info (item, files_dir, info_dir,
+                          get_deletion_date (&last_time, deletion_date), contents);
+        item->deletion_time = last_time;
+    }
+
+    for (guint i = 0; i < files->len; i++)
+    {
+        TrashItem *item = &items[i];
+
+        if (item->error == NULL)
+        {
+            g_autofree char *trashed_path = g_build_filename (files_dir, item->trash_name, NULL);
+
+            if (g_rename (item->path, trashed_path) == 0)
+            {
+                n_trashed++;
+            }
+            else
+            {
+                int errsv = errno;
+
+                item->error = (errsv == EXDEV) ? not_supported_error () : error_from_errno (errsv);
+                g_unlink (item->info_path);
+            }
+        }
+
+        if (deletion_times != NULL)
+        {
+            deletion_times[i] = item->deletion_time;
+        }
+        g_ptr_array_add (errors, g_steal_pointer (&item->error));
+        trash_item_clear (item);
+    }
+
+    g_debug ("Trashed %u of %u files in %s", n_trashed, files->len, trash_dir);
+
+    return errors;
+}
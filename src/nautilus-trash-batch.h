@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2026 The GNOME project contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+/* Moves many local files to the trash together, as g_file_trash() would
+ * one by one: the trash info files are all written first, and then the
+ * files are renamed into the trash.
+ */
+
+GPtrArray *nautilus_trash_batch_trash_files (const char   *trash_dir,
+                                             GPtrArray    *files,
+                                             gint64       *deletion_times,
+                                             GCancellable *cancellable);
@@ -941,6 +941,22 @@ nautilus_window_show_operation_notification (NautilusWindow *window,
     adw_toast_overlay_add_toast (window->toast_overlay, toast);
 }
 
+void
+nautilus_window_show_notification (NautilusWindow *window,
+                                   const char     *label)
+{
+    AdwToast *toast;
+
+    if (!gtk_window_is_active (GTK_WINDOW (window)))
+    {
+        return;
+    }
+
+    toast = adw_toast_new (label);
+    adw_toast_set_use_markup (toast, FALSE);
+    adw_toast_overlay_add_toast (window->toast_overlay, toast);
+}
+
 static gboolean
 tab_view_close_page_cb (AdwTabView     *view,
                         AdwTabPage     *page,
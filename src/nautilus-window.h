@@ -83,6 +83,9 @@ void nautilus_window_show_operation_notification (NautilusWindow *window,
                                                   GFile          *folder_to_open,
                                                   gboolean        was_quick);
 
+void nautilus_window_show_notification (NautilusWindow *window,
+                                        const char     *label);
+
 void nautilus_window_search (NautilusWindow *window,
                              NautilusQuery  *query);
 
@@ -0,0 +1,356 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <nautilus-directory.h>
+#include <nautilus-directory-private.h>
+#include <nautilus-file-utilities.h>
+
+#include "test-utilities.h"
+
+/* Measures how fast directories are loaded, and how long loading them may
+ * keep the main loop from running. The 10k entry case always runs; the
+ * larger ones only run in performance mode (-m perf), as generating them
+ * takes a while:
+ *
+ *   test-directory-load -m perf
+ */
+
+static void
+create_load_directory (const gchar *path,
+                       guint        n_files)
+{
+    g_assert_cmpint (g_mkdir_with_parents (path, 0700), ==, 0);
+
+    for (guint i = 0; i < n_files; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("file_%07u", i);
+        g_autofree gchar *file_path = g_build_filename (path, name, NULL);
+        int fd;
+
+        fd = g_open (file_path, O_CREAT | O_WRONLY, 0600);
+        g_assert_cmpint (fd, >=, 0);
+        close (fd);
+    }
+}
+
+static void
+delete_load_directory (const gchar *path)
+{
+    g_autoptr (GDir) dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    g_assert_nonnull (dir);
+    while ((name = g_dir_read_name (dir)) != NULL)
+    {
+        g_autofree gchar *file_path = g_build_filename (path, name, NULL);
+
+        g_remove (file_path);
+    }
+
+    g_rmdir (path);
+}
+
+static void
+loaded_callback (NautilusDirectory *directory,
+                 GList             *files,
+                 gpointer           callback_data)
+{
+    gboolean *loaded = callback_data;
+
+    *loaded = TRUE;
+}
+
+static void
+benchmark_directory_load (gconstpointer test_data)
+{
+    guint n_files = GPOINTER_TO_UINT (test_data);
+    g_autofree gchar *name = g_strdup_printf ("load_%u", n_files);
+    g_autofree gchar *path = g_build_filename (test_get_tmp_dir (), name, NULL);
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autolist (NautilusFile) files = NULL;
+    gboolean loaded = FALSE;
+    gint64 start;
+    gdouble seconds;
+
+    if (n_files > 10000 && !g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    create_load_directory (path, n_files);
+
+    location = g_file_new_for_path (path);
+    directory = nautilus_directory_get (location);
+
+    start = g_get_monotonic_time ();
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                        TRUE,
+                                        loaded_callback, &loaded);
+    while (!loaded)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    files = nautilus_directory_get_file_list (directory);
+    g_assert_cmpuint (g_list_length (files), ==, n_files);
+
+    g_test_maximized_result (n_files / seconds,
+                             "Loaded %u entries in %.2f s (%.0f entries/s)",
+                             n_files, seconds, n_files / seconds);
+
+    g_clear_list (&files, g_object_unref);
+    g_clear_object (&directory);
+    delete_load_directory (path);
+}
+
+#define BLOCKING_FILES 50000
+#define BLOCKING_BUDGET_USEC 4000
+#define BLOCKING_MAX_USEC (250 * 1000)
+
+typedef struct
+{
+    gint64 last_tick;
+    gint64 longest_gap;
+    guint n_done_loading;
+} BlockingData;
+
+static gboolean
+blocking_tick_callback (gpointer user_data)
+{
+    BlockingData *data = user_data;
+    gint64 now = g_get_monotonic_time ();
+
+    data->longest_gap = MAX (data->longest_gap, now - data->last_tick);
+    data->last_tick = now;
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+blocking_done_loading_callback (NautilusDirectory *directory,
+                                gpointer           user_data)
+{
+    BlockingData *data = user_data;
+
+    data->n_done_loading++;
+}
+
+/** Check that a large load keeps yielding to the main loop and notifies once */
+static void
+test_directory_load_blocking (void)
+{
+    g_autofree gchar *path = g_build_filename (test_get_tmp_dir (), "load_blocking", NULL);
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autolist (NautilusFile) files = NULL;
+    BlockingData data = { 0 };
+    guint tick_id;
+
+    create_load_directory (path, BLOCKING_FILES);
+
+    nautilus_directory_set_dequeue_budget (BLOCKING_BUDGET_USEC);
+
+    location = g_file_new_for_path (path);
+    directory = nautilus_directory_get (location);
+    g_signal_connect (directory, "done-loading",
+                      G_CALLBACK (blocking_done_loading_callback), &data);
+
+    data.last_tick = g_get_monotonic_time ();
+    tick_id = g_timeout_add_full (G_PRIORITY_HIGH, 1, blocking_tick_callback, &data, NULL);
+
+    nautilus_directory_file_monitor_add (directory, &data, TRUE,
+                                         NAUTILUS_FILE_ATTRIBUTE_INFO,
+                                         NULL, NULL);
+    while (data.n_done_loading == 0)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    /* Give a second notification the chance to show up. */
+    for (guint i = 0; i < 100; i++)
+    {
+        g_main_context_iteration (NULL, FALSE);
+    }
+    g_source_remove (tick_id);
+
+    g_assert_cmpuint (data.n_done_loading, ==, 1);
+
+    files = nautilus_directory_get_file_list (directory);
+    g_assert_cmpuint (g_list_length (files), ==, BLOCKING_FILES);
+
+    g_test_minimized_result ((gdouble) data.longest_gap / 1000,
+                             "Longest main loop block while loading %u entries: %.1f ms",
+                             BLOCKING_FILES, (gdouble) data.longest_gap / 1000);
+    g_assert_cmpint (data.longest_gap, <, BLOCKING_MAX_USEC);
+
+    g_clear_list (&files, g_object_unref);
+    nautilus_directory_file_monitor_remove (directory, &data);
+    g_signal_handlers_disconnect_by_data (directory, &data);
+    g_clear_object (&directory);
+    delete_load_directory (path);
+}
+
+/* Wraps an enumerator, taking a while for every entry it returns. */
+#define SLOW_TYPE_ENUMERATOR (slow_enumerator_get_type ())
+G_DECLARE_FINAL_TYPE (SlowEnumerator, slow_enumerator, SLOW, ENUMERATOR, GFileEnumerator)
+
+struct _SlowEnumerator
+{
+    GFileEnumerator parent_instance;
+
+    GFileEnumerator *inner;
+    gint delay_usec;
+};
+
+G_DEFINE_TYPE (SlowEnumerator, slow_enumerator, G_TYPE_FILE_ENUMERATOR)
+
+static GFileInfo *
+slow_enumerator_next_file (GFileEnumerator  *enumerator,
+                           GCancellable     *cancellable,
+                           GError          **error)
+{
+    SlowEnumerator *self = SLOW_ENUMERATOR (enumerator);
+
+    g_usleep (g_atomic_int_get (&self->delay_usec));
+
+    return g_file_enumerator_next_file (self->inner, cancellable, error);
+}
+
+static gboolean
+slow_enumerator_close (GFileEnumerator  *enumerator,
+                       GCancellable     *cancellable,
+                       GError          **error)
+{
+    return g_file_enumerator_close (SLOW_ENUMERATOR (enumerator)->inner, cancellable, error);
+}
+
+static void
+slow_enumerator_finalize (GObject *object)
+{
+    g_clear_object (&SLOW_ENUMERATOR (object)->inner);
+
+    G_OBJECT_CLASS (slow_enumerator_parent_class)->finalize (object);
+}
+
+static void
+slow_enumerator_init (SlowEnumerator *self)
+{
+}
+
+static void
+slow_enumerator_class_init (SlowEnumeratorClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GFileEnumeratorClass *enumerator_class = G_FILE_ENUMERATOR_CLASS (klass);
+
+    object_class->finalize = slow_enumerator_finalize;
+    enumerator_class->next_file = slow_enumerator_next_file;
+    enumerator_class->close_fn = slow_enumerator_close;
+}
+
+#define BATCH_FILES 3000
+#define BATCH_SLOW_DELAY_USEC 200
+
+static void
+got_batch_callback (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+    GAsyncResult **result_out = user_data;
+
+    *result_out = g_object_ref (result);
+}
+
+static guint
+fetch_batch (GFileEnumerator *enumerator,
+             guint            batch_size)
+{
+    g_autoptr (GAsyncResult) result = NULL;
+    GList *infos;
+    guint n_files;
+    gint64 start;
+
+    start = g_get_monotonic_time ();
+    g_file_enumerator_next_files_async (enumerator, batch_size, G_PRIORITY_DEFAULT, NULL,
+                                        got_batch_callback, &result);
+    while (result == NULL)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    infos = g_file_enumerator_next_files_finish (enumerator, result, NULL);
+    n_files = g_list_length (infos);
+    g_list_free_full (infos, g_object_unref);
+
+    g_assert_cmpuint (n_files, >, 0);
+
+    return nautilus_directory_next_load_batch_size (batch_size, n_files,
+                                                    g_get_monotonic_time () - start);
+}
+
+/** Check that batches grow while the enumerator is fast, and shrink once it slows down */
+static void
+test_directory_load_batch_size (void)
+{
+    g_autofree gchar *path = g_build_filename (test_get_tmp_dir (), "load_batch_size", NULL);
+    g_autoptr (GFile) location = NULL;
+    g_autoptr (SlowEnumerator) enumerator = NULL;
+    guint batch_size = 100;
+    guint fast_batch_size;
+
+    create_load_directory (path, BATCH_FILES);
+
+    location = g_file_new_for_path (path);
+    enumerator = g_object_new (SLOW_TYPE_ENUMERATOR, "container", location, NULL);
+    enumerator->inner = g_file_enumerate_children (location, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                                   G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_assert_nonnull (enumerator->inner);
+
+    /* 100, 200 and 400 entries. */
+    for (guint i = 0; i < 3; i++)
+    {
+        batch_size = fetch_batch (G_FILE_ENUMERATOR (enumerator), batch_size);
+    }
+    fast_batch_size = batch_size;
+    g_assert_cmpuint (fast_batch_size, >, 400);
+
+    /* At 200 us per entry, only 250 entries fit in a 50 ms batch. */
+    g_atomic_int_set (&enumerator->delay_usec, BATCH_SLOW_DELAY_USEC);
+    batch_size = fetch_batch (G_FILE_ENUMERATOR (enumerator), batch_size);
+    g_assert_cmpuint (batch_size, <, fast_batch_size);
+    g_assert_cmpuint (batch_size, <=, 250);
+
+    g_file_enumerator_close (G_FILE_ENUMERATOR (enumerator), NULL, NULL);
+    g_clear_object (&enumerator);
+    delete_load_directory (path);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+    nautilus_ensure_extension_points ();
+
+    g_test_add_func ("/directory-load/blocking",
+                     test_directory_load_blocking);
+    g_test_add_func ("/directory-load/batch-size",
+                     test_directory_load_batch_size);
+    g_test_add_data_func ("/directory-load/10k",
+                          GUINT_TO_POINTER (10000),
+                          benchmark_directory_load);
+    g_test_add_data_func ("/directory-load/100k",
+                          GUINT_TO_POINTER (100000),
+                          benchmark_directory_load);
+    g_test_add_data_func ("/directory-load/1M",
+                          GUINT_TO_POINTER (1000000),
+                          benchmark_directory_load);
+
+    return g_test_run ();
+}
@@ -1,9 +1,14 @@
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
 
 #include <nautilus-directory.h>
 #include <nautilus-directory-private.h>
+#include <nautilus-file-private.h>
 #include <nautilus-file-utilities.h>
 
+#include "test-utilities.h"
+
 
 static int data_dummy;
 
@@ -85,7 +90,398 @@ test_directory_call_when_ready (void)
     g_assert_true (got_files_flag);
     /* Every NautilusFile created by call_when_ready must have been
      * unref'd and destroyed after the NautilusDirectoryCallback returns */
-    g_assert_null (directory->details->file_list);
+    g_assert_cmpuint (directory->details->files->len, ==, 0);
+}
+
+#define FILE_ARRAY_FILES 10
+
+/** Check that files removed from the middle leave the others findable */
+static void
+test_directory_file_array (void)
+{
+    g_autoptr (NautilusDirectory) directory = nautilus_directory_get_by_uri ("file:///etc");
+    NautilusFile *files[FILE_ARRAY_FILES];
+    GPtrArray *array;
+
+    for (guint i = 0; i < FILE_ARRAY_FILES; i++)
+    {
+        g_autofree gchar *uri = g_strdup_printf ("file:///etc/file-array-%u", i);
+
+        files[i] = nautilus_file_get_by_uri (uri);
+    }
+
+    array = directory->details->files;
+    g_assert_cmpuint (array->len, ==, FILE_ARRAY_FILES);
+
+    /* Dropping the last reference removes the file from the directory. */
+    for (guint i = 0; i < FILE_ARRAY_FILES; i += 2)
+    {
+        g_clear_object (&files[i]);
+    }
+    g_assert_cmpuint (array->len, ==, FILE_ARRAY_FILES / 2);
+
+    for (guint i = 1; i < FILE_ARRAY_FILES; i += 2)
+    {
+        g_autofree gchar *name = g_strdup_printf ("file-array-%u", i);
+
+        g_assert_true (nautilus_directory_find_file_by_name (directory, name) == files[i]);
+        g_assert_true (g_ptr_array_index (array, files[i]->details->directory_index) == files[i]);
+    }
+
+    for (guint i = 1; i < FILE_ARRAY_FILES; i += 2)
+    {
+        g_clear_object (&files[i]);
+    }
+    g_assert_cmpuint (array->len, ==, 0);
+}
+
+/** Check that async. jobs are accounted to the directory's backend */
+static void
+test_directory_io_stats (void)
+{
+    g_autoptr (NautilusDirectory) directory = nautilus_directory_get_by_uri ("file:///etc");
+    NautilusDirectoryIOStats stats;
+
+    got_files_flag = FALSE;
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO |
+                                        NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT,
+                                        TRUE,
+                                        got_files_callback, &data_dummy);
+    for (guint i = 0; !got_files_flag && i < 100000; i++)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_true (got_files_flag);
+
+    nautilus_directory_get_io_stats (directory, &stats);
+    g_assert_cmpuint (stats.max_jobs, >, 0);
+    g_assert_cmpuint (stats.running_jobs, <=, stats.max_jobs);
+    g_assert_cmpuint (stats.queue_depth, ==, 0);
+    g_assert_cmpuint (stats.max_queue_depth, <=, 1);
+}
+
+#define DEEP_COUNT_DIRECTORIES 500
+#define DEEP_COUNT_FILES_PER_DIRECTORY 1000
+#define DEEP_COUNT_HARD_LINKS 10
+#define DEEP_COUNT_TIME_BUDGET_USEC (60 * G_USEC_PER_SEC)
+
+/* Returns the total size a deep count of the tree is expected to report. */
+static goffset
+create_deep_count_tree (const gchar *root_path)
+{
+    g_autofree gchar *linked_path = NULL;
+    goffset expected_size = 0;
+
+    g_mkdir (root_path, 0700);
+    for (guint i = 0; i < DEEP_COUNT_DIRECTORIES; i++)
+    {
+        g_autofree gchar *dir_name = g_strdup_printf ("dir_%u", i);
+        g_autofree gchar *dir_path = g_build_filename (root_path, dir_name, NULL);
+        GStatBuf dir_stat;
+
+        g_assert_cmpint (g_mkdir (dir_path, 0700), ==, 0);
+        for (guint j = 0; j < DEEP_COUNT_FILES_PER_DIRECTORY; j++)
+        {
+            g_autofree gchar *file_name = g_strdup_printf ("file_%u", j);
+            g_autofree gchar *file_path = g_build_filename (dir_path, file_name, NULL);
+            int fd;
+
+            fd = g_creat (file_path, 0600);
+            g_assert_cmpint (fd, >=, 0);
+            g_assert_true (write (fd, "x", 1) == 1);
+            g_close (fd, NULL);
+            expected_size += 1;
+        }
+
+        g_assert_cmpint (g_stat (dir_path, &dir_stat), ==, 0);
+        expected_size += dir_stat.st_size;
+    }
+
+    /* Hard links to an existing file must only contribute their size once. */
+    linked_path = g_build_filename (root_path, "dir_0", "file_0", NULL);
+    for (guint i = 0; i < DEEP_COUNT_HARD_LINKS; i++)
+    {
+        g_autofree gchar *link_name = g_strdup_printf ("link_%u", i);
+        g_autofree gchar *link_path = g_build_filename (root_path, link_name, NULL);
+
+        g_assert_cmpint (link (linked_path, link_path), ==, 0);
+    }
+
+    return expected_size;
+}
+
+static void
+delete_deep_count_tree (const gchar *root_path)
+{
+    for (guint i = 0; i < DEEP_COUNT_HARD_LINKS; i++)
+    {
+        g_autofree gchar *link_name = g_strdup_printf ("link_%u", i);
+        g_autofree gchar *link_path = g_build_filename (root_path, link_name, NULL);
+
+        g_remove (link_path);
+    }
+    for (guint i = 0; i < DEEP_COUNT_DIRECTORIES; i++)
+    {
+        g_autofree gchar *dir_name = g_strdup_printf ("dir_%u", i);
+        g_autofree gchar *dir_path = g_build_filename (root_path, dir_name, NULL);
+
+        for (guint j = 0; j < DEEP_COUNT_FILES_PER_DIRECTORY; j++)
+        {
+            g_autofree gchar *file_name = g_strdup_printf ("file_%u", j);
+            g_autofree gchar *file_path = g_build_filename (dir_path, file_name, NULL);
+
+            g_remove (file_path);
+        }
+        g_rmdir (dir_path);
+    }
+    g_rmdir (root_path);
+}
+
+static gboolean got_deep_counts_flag;
+
+static void
+got_deep_counts_callback (NautilusFile *file,
+                          gpointer      callback_data)
+{
+    got_deep_counts_flag = TRUE;
+}
+
+/* Returns the time it took, or a negative value if it didn't finish in time. */
+static gint64
+wait_for_deep_counts (NautilusFile *file)
+{
+    gint64 start_time = g_get_monotonic_time ();
+
+    nautilus_file_recompute_deep_counts (file);
+
+    got_deep_counts_flag = FALSE;
+    nautilus_file_call_when_ready (file,
+                                   NAUTILUS_FILE_ATTRIBUTE_INFO |
+                                   NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS,
+                                   got_deep_counts_callback, NULL);
+    while (!got_deep_counts_flag &&
+           g_get_monotonic_time () - start_time < DEEP_COUNT_TIME_BUDGET_USEC)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    return got_deep_counts_flag ? g_get_monotonic_time () - start_time : -1;
+}
+
+/** Check that deep counting a large tree is not quadratic and dedups hard links */
+static void
+test_directory_deep_count_large_tree (void)
+{
+    g_autofree gchar *root_path = g_build_filename (test_get_tmp_dir (), "deep_count", NULL);
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (NautilusFile) file = NULL;
+    NautilusRequestStatus status;
+    guint directory_count;
+    guint file_count;
+    guint unreadable_count;
+    goffset total_size;
+    goffset expected_size;
+    gint64 elapsed;
+
+    expected_size = create_deep_count_tree (root_path);
+
+    root = g_file_new_for_path (root_path);
+    file = nautilus_file_get (root);
+
+    elapsed = wait_for_deep_counts (file);
+    g_assert_cmpint (elapsed, >=, 0);
+    g_assert_cmpint (elapsed, <, DEEP_COUNT_TIME_BUDGET_USEC);
+
+    status = nautilus_file_get_deep_counts (file, &directory_count, &file_count,
+                                            &unreadable_count, &total_size, TRUE);
+    g_assert_cmpint (status, ==, NAUTILUS_REQUEST_DONE);
+    g_assert_cmpuint (directory_count, ==, DEEP_COUNT_DIRECTORIES);
+    g_assert_cmpuint (file_count, ==,
+                      DEEP_COUNT_DIRECTORIES * DEEP_COUNT_FILES_PER_DIRECTORY + DEEP_COUNT_HARD_LINKS);
+    g_assert_cmpuint (unreadable_count, ==, 0);
+    g_assert_cmpint (total_size, ==, expected_size);
+
+    g_clear_object (&file);
+    delete_deep_count_tree (root_path);
+}
+
+/** Check that repeated deep counts are served from the cache, and pick up
+ * changes below unchanged directories */
+static void
+test_directory_deep_count_cache (void)
+{
+    g_autofree gchar *root_path = g_build_filename (test_get_tmp_dir (), "deep_count_cache", NULL);
+    g_autofree gchar *middle_path = g_build_filename (root_path, "middle", NULL);
+    g_autofree gchar *leaf_path = g_build_filename (middle_path, "leaf", NULL);
+    g_autofree gchar *old_file_path = g_build_filename (leaf_path, "old", NULL);
+    g_autofree gchar *new_file_path = g_build_filename (leaf_path, "new", NULL);
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (NautilusFile) file = NULL;
+    guint directory_count;
+    guint file_count;
+    goffset old_size;
+    goffset size;
+    FILE *stream;
+
+    g_assert_cmpint (g_mkdir_with_parents (leaf_path, 0700), ==, 0);
+    g_assert_true (g_file_set_contents (old_file_path, "old", -1, NULL));
+
+    root = g_file_new_for_path (root_path);
+    file = nautilus_file_get (root);
+
+    g_assert_cmpint (wait_for_deep_counts (file), >=, 0);
+    nautilus_file_get_deep_counts (file, &directory_count, &file_count, NULL, &old_size, TRUE);
+    g_assert_cmpuint (directory_count, ==, 2);
+    g_assert_cmpuint (file_count, ==, 1);
+
+    /* Appending to a file leaves its directory untouched, so the cached
+     * total is served instead of the file being looked at again.
+     */
+    stream = g_fopen (old_file_path, "a");
+    g_assert_nonnull (stream);
+    g_assert_cmpint (fputs ("er", stream), >=, 0);
+    g_assert_cmpint (fclose (stream), ==, 0);
+
+    g_assert_cmpint (wait_for_deep_counts (file), >=, 0);
+    nautilus_file_get_deep_counts (file, &directory_count, &file_count, NULL, &size, TRUE);
+    g_assert_cmpuint (directory_count, ==, 2);
+    g_assert_cmpuint (file_count, ==, 1);
+    g_assert_cmpint (size, ==, old_size);
+
+    /* Only the leaf changes, its ancestors keep their modification time. */
+    g_assert_true (g_file_set_contents (new_file_path, "new", -1, NULL));
+
+    g_assert_cmpint (wait_for_deep_counts (file), >=, 0);
+    nautilus_file_get_deep_counts (file, &directory_count, &file_count, NULL, &size, TRUE);
+    g_assert_cmpuint (directory_count, ==, 2);
+    g_assert_cmpuint (file_count, ==, 2);
+    /* Both the append and the new file count now. */
+    g_assert_cmpint (size, ==, old_size + 2 + 3);
+
+    g_clear_object (&file);
+    g_remove (new_file_path);
+    g_remove (old_file_path);
+    g_rmdir (leaf_path);
+    g_rmdir (middle_path);
+    g_rmdir (root_path);
+}
+
+#define PIPELINE_DIRECTORIES 16
+
+/** Check that item counts fetched several at a time end up on the right files */
+static void
+test_directory_count_pipeline (void)
+{
+    g_autofree gchar *root_path = g_build_filename (test_get_tmp_dir (), "count_pipeline", NULL);
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (NautilusDirectory) directory = NULL;
+    g_autolist (NautilusFile) files = NULL;
+
+    for (guint i = 0; i < PIPELINE_DIRECTORIES; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("%02u", i);
+        g_autofree gchar *path = g_build_filename (root_path, name, NULL);
+
+        g_assert_cmpint (g_mkdir_with_parents (path, 0700), ==, 0);
+        for (guint j = 0; j < i; j++)
+        {
+            g_autofree gchar *file_name = g_strdup_printf ("%u", j);
+            g_autofree gchar *file_path = g_build_filename (path, file_name, NULL);
+
+            g_assert_true (g_file_set_contents (file_path, "", 0, NULL));
+        }
+    }
+
+    nautilus_directory_set_pipeline_width (REQUEST_DIRECTORY_COUNT, 3);
+
+    root = g_file_new_for_path (root_path);
+    directory = nautilus_directory_get (root);
+
+    got_files_flag = FALSE;
+    nautilus_directory_call_when_ready (directory,
+                                        NAUTILUS_FILE_ATTRIBUTE_INFO |
+                                        NAUTILUS_FILE_ATTRIBUTE_DIRECTORY_ITEM_COUNT,
+                                        TRUE,
+                                        got_files_callback, &data_dummy);
+    for (guint i = 0; !got_files_flag && i < 100000; i++)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_true (got_files_flag);
+
+    files = nautilus_directory_get_file_list (directory);
+    g_assert_cmpuint (g_list_length (files), ==, PIPELINE_DIRECTORIES);
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        NautilusFile *file = l->data;
+        g_autofree char *name = nautilus_file_get_name (file);
+        guint count;
+        gboolean unreadable;
+
+        g_assert_true (nautilus_file_get_directory_item_count (file, &count, &unreadable));
+        g_assert_false (unreadable);
+        g_assert_cmpuint (count, ==, g_ascii_strtoull (name, NULL, 10));
+    }
+
+    nautilus_directory_set_pipeline_width (REQUEST_DIRECTORY_COUNT, 4);
+    g_clear_list (&files, g_object_unref);
+    g_clear_object (&directory);
+    test_clear_tmp_dir ();
+}
+
+static void
+got_file_list_callback (GList    *file_list,
+                        gpointer  callback_data)
+{
+    gboolean *got_file_list = callback_data;
+
+    *got_file_list = TRUE;
+}
+
+/** Check that file info fetched several at a time ends up on the right files */
+static void
+test_directory_file_info_pipeline (void)
+{
+    g_autofree gchar *root_path = g_build_filename (test_get_tmp_dir (), "file_info_pipeline", NULL);
+    g_autolist (NautilusFile) files = NULL;
+    NautilusFileListHandle *handle;
+    gboolean got_file_list = FALSE;
+
+    g_assert_cmpint (g_mkdir_with_parents (root_path, 0700), ==, 0);
+    for (guint i = 0; i < PIPELINE_DIRECTORIES; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("%02u", i);
+        g_autofree gchar *path = g_build_filename (root_path, name, NULL);
+        g_autofree gchar *contents = g_strnfill (i, 'x');
+        g_autoptr (GFile) location = g_file_new_for_path (path);
+
+        g_assert_true (g_file_set_contents (path, contents, i, NULL));
+        files = g_list_prepend (files, nautilus_file_get (location));
+    }
+
+    nautilus_directory_set_pipeline_width (REQUEST_FILE_INFO, 3);
+
+    nautilus_file_list_call_when_ready (files, NAUTILUS_FILE_ATTRIBUTE_INFO, &handle,
+                                        got_file_list_callback, &got_file_list);
+    for (guint i = 0; !got_file_list && i < 100000; i++)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_true (got_file_list);
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        NautilusFile *file = l->data;
+        g_autofree char *name = nautilus_file_get_name (file);
+
+        g_assert_false (nautilus_file_is_gone (file));
+        g_assert_cmpuint (nautilus_file_get_size (file), ==, g_ascii_strtoull (name, NULL, 10));
+    }
+
+    nautilus_directory_set_pipeline_width (REQUEST_FILE_INFO, 4);
+    g_clear_list (&files, g_object_unref);
+    test_clear_tmp_dir ();
 }
 
 int
@@ -102,6 +498,18 @@ main (int   argc,
                      test_directory_hash_table_cleanup);
     g_test_add_func ("/directory-call-when-ready/1.0",
                      test_directory_call_when_ready);
+    g_test_add_func ("/directory-file-array/1.0",
+                     test_directory_file_array);
+    g_test_add_func ("/directory-io-stats/1.0",
+                     test_directory_io_stats);
+    g_test_add_func ("/directory-deep-count-large-tree/1.0",
+                     test_directory_deep_count_large_tree);
+    g_test_add_func ("/directory-deep-count-cache/1.0",
+                     test_directory_deep_count_cache);
+    g_test_add_func ("/directory-count-pipeline/1.0",
+                     test_directory_count_pipeline);
+    g_test_add_func ("/directory-file-info-pipeline/1.0",
+                     test_directory_file_info_pipeline);
 
     return g_test_run ();
 }
@@ -977,6 +977,110 @@ test_copy_fourth_hierarchy_undo (void)
     empty_directory_by_prefix (root, "copy");
 }
 
+/* Enough files to keep every copy thread busy, with some large enough to
+ * be copied on the job thread.
+ */
+static void
+test_copy_directory_many_files (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) first_dir = NULL;
+    g_autoptr (GFile) second_dir = NULL;
+    g_autoptr (GFile) result_dir = NULL;
+    g_autolist (GFile) files = NULL;
+    g_autofree gchar *large_contents = g_strnfill (2 * 1024 * 1024, 'x');
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    first_dir = g_file_get_child (root, "copy_first_dir");
+    second_dir = g_file_get_child (root, "copy_second_dir");
+    g_assert_true (g_file_make_directory (first_dir, NULL, NULL));
+    g_assert_true (g_file_make_directory (second_dir, NULL, NULL));
+
+    for (guint i = 0; i < 500; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("copy_file_%u", i);
+        g_autoptr (GFile) file = g_file_get_child (first_dir, name);
+        const gchar *contents = (i % 100 == 0) ? large_contents : name;
+
+        g_assert_true (g_file_replace_contents (file, contents, strlen (contents), NULL, FALSE,
+                                                G_FILE_CREATE_NONE, NULL, NULL, NULL));
+    }
+
+    files = g_list_prepend (files, g_object_ref (first_dir));
+    nautilus_file_operations_copy_sync (files, second_dir);
+
+    result_dir = g_file_get_child (second_dir, "copy_first_dir");
+    for (guint i = 0; i < 500; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("copy_file_%u", i);
+        g_autoptr (GFile) file = g_file_get_child (result_dir, name);
+        g_autofree gchar *contents = NULL;
+
+        g_assert_true (g_file_load_contents (file, NULL, &contents, NULL, NULL, NULL));
+        g_assert_cmpstr (contents, ==, (i % 100 == 0) ? large_contents : name);
+    }
+
+    test_operation_undo ();
+
+    g_assert_false (g_file_query_exists (result_dir, NULL));
+    g_assert_true (g_file_query_exists (first_dir, NULL));
+
+    empty_directory_by_prefix (root, "copy");
+}
+
+/* The count of the sources is held up, so that the copy has to start before
+ * it's done.
+ */
+static void
+test_copy_while_counting (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) second_dir = NULL;
+    g_autoptr (GFile) first_target = NULL;
+    g_autolist (GFile) files = NULL;
+    TestCountData data = { 0 };
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+    second_dir = g_file_get_child (root, "copy_second_dir");
+    g_assert_true (g_file_make_directory (second_dir, NULL, NULL));
+
+    for (guint i = 0; i < 2; i++)
+    {
+        g_autofree gchar *dir_name = g_strdup_printf ("copy_counted_dir_%u", i);
+        GFile *dir = g_file_get_child (root, dir_name);
+
+        g_assert_true (g_file_make_directory (dir, NULL, NULL));
+        for (guint j = 0; j < 20; j++)
+        {
+            g_autofree gchar *name = g_strdup_printf ("copy_file_%u", j);
+            g_autoptr (GFile) file = g_file_get_child (dir, name);
+
+            g_assert_true (g_file_replace_contents (file, name, strlen (name), NULL, FALSE,
+                                                    G_FILE_CREATE_NONE, NULL, NULL, NULL));
+        }
+
+        files = g_list_append (files, dir);
+    }
+
+    first_target = g_file_get_child (second_dir, "copy_counted_dir_0");
+    data.held_source = files->data;
+    data.changed_file = first_target;
+    data.changed_file_exists = TRUE;
+
+    test_follow_count (&data);
+    nautilus_file_operations_copy_sync (files, second_dir);
+    test_follow_count (NULL);
+
+    g_assert_true (data.started_while_counting);
+    g_assert_true (data.finished);
+    /* Both directories and their files. */
+    g_assert_cmpint (data.transferred_files, ==, 2 + 2 * 20);
+    g_assert_cmpint (data.total_files, ==, data.transferred_files);
+    g_assert_cmpint (data.total_bytes, ==, data.transferred_bytes);
+
+    empty_directory_by_prefix (root, "copy");
+}
+
 static void
 setup_test_suite (void)
 {
@@ -1032,6 +1136,10 @@ setup_test_suite (void)
                      test_copy_fourth_hierarchy);
     g_test_add_func ("/test-copy-hierarchy-undo/1.4",
                      test_copy_fourth_hierarchy_undo);
+    g_test_add_func ("/test-copy-hierarchy/1.5",
+                     test_copy_directory_many_files);
+    g_test_add_func ("/test-copy-while-counting/1.0",
+                     test_copy_while_counting);
 }
 
 int
@@ -437,6 +437,58 @@ test_delete_third_hierarchy (void)
     empty_directory_by_prefix (root, "trash_or_delete");
 }
 
+/* The count of the sources is held up, so that the deletion has to start
+ * before it's done, and gets to files the count hasn't seen.
+ */
+static void
+test_delete_while_counting (void)
+{
+    g_autoptr (GFile) root = NULL;
+    g_autolist (GFile) files = NULL;
+    TestCountData data = { 0 };
+
+    root = g_file_new_for_path (test_get_tmp_dir ());
+
+    for (guint i = 0; i < 2; i++)
+    {
+        g_autofree gchar *dir_name = g_strdup_printf ("delete_counted_dir_%u", i);
+        GFile *dir = g_file_get_child (root, dir_name);
+
+        g_assert_true (g_file_make_directory (dir, NULL, NULL));
+        for (guint j = 0; j < 20; j++)
+        {
+            g_autofree gchar *name = g_strdup_printf ("delete_file_%u", j);
+            g_autoptr (GFile) file = g_file_get_child (dir, name);
+
+            g_assert_true (g_file_replace_contents (file, name, strlen (name), NULL, FALSE,
+                                                    G_FILE_CREATE_NONE, NULL, NULL, NULL));
+        }
+
+        files = g_list_append (files, dir);
+    }
+
+    data.held_source = files->data;
+    data.changed_file = files->data;
+    data.changed_file_exists = FALSE;
+
+    test_follow_count (&data);
+    nautilus_file_operations_delete_sync (files);
+    test_follow_count (NULL);
+
+    g_assert_true (data.started_while_counting);
+    g_assert_true (data.finished);
+    /* Both directories and their files. */
+    g_assert_cmpint (data.transferred_files, ==, 2 + 2 * 20);
+    g_assert_cmpint (data.total_files, ==, data.transferred_files);
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        g_assert_false (g_file_query_exists (l->data, NULL));
+    }
+
+    empty_directory_by_prefix (root, "delete");
+}
+
 static void
 setup_test_suite (void)
 {
@@ -468,6 +520,8 @@ setup_test_suite (void)
                      test_delete_first_hierarchy);
     g_test_add_func ("/test-delete-more-full-directories/1.6",
                      test_delete_third_hierarchy);
+    g_test_add_func ("/test-delete-while-counting/1.0",
+                     test_delete_while_counting);
 }
 
 int
@@ -87,6 +87,56 @@ test_file_sort_with_self (void)
     g_assert_cmpint (order, ==, 0);
 }
 
+static GFileInfo *
+sort_key_info (const char *name,
+               const char *content_type,
+               guint64     mtime)
+{
+    GFileInfo *info = g_file_info_new ();
+
+    g_file_info_set_name (info, name);
+    g_file_info_set_file_type (info, G_FILE_TYPE_REGULAR);
+    g_file_info_set_content_type (info, content_type);
+    g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+
+    return info;
+}
+
+/** Check that cached sort keys follow changes to the file info */
+static void
+test_file_sort_keys_invalidation (void)
+{
+    g_autoptr (NautilusFile) file_1 = nautilus_file_get_by_uri ("file:///sort-keys-1");
+    g_autoptr (NautilusFile) file_2 = nautilus_file_get_by_uri ("file:///sort-keys-2");
+    g_autoptr (GFileInfo) info_1 = NULL;
+    g_autoptr (GFileInfo) info_2 = NULL;
+    int order;
+
+    /* Files without info have unknown times, so the path breaks the tie. */
+    order = nautilus_file_compare_for_sort (file_1, file_2, NAUTILUS_FILE_SORT_BY_MTIME, FALSE, FALSE);
+    g_assert_cmpint (order, <, 0);
+
+    info_1 = sort_key_info ("sort-keys-1", "text/plain", 2000);
+    info_2 = sort_key_info ("sort-keys-2", "image/png", 1000);
+    nautilus_file_update_info (file_1, info_1);
+    nautilus_file_update_info (file_2, info_2);
+
+    order = nautilus_file_compare_for_sort (file_1, file_2, NAUTILUS_FILE_SORT_BY_MTIME, FALSE, FALSE);
+    g_assert_cmpint (order, >, 0);
+    order = nautilus_file_compare_for_sort (file_1, file_2, NAUTILUS_FILE_SORT_BY_TYPE, FALSE, FALSE);
+    g_assert_cmpint (order, !=, 0);
+
+    /* Same type and an older time now; by type the path breaks the tie. */
+    g_clear_object (&info_1);
+    info_1 = sort_key_info ("sort-keys-1", "image/png", 500);
+    nautilus_file_update_info (file_1, info_1);
+
+    order = nautilus_file_compare_for_sort (file_1, file_2, NAUTILUS_FILE_SORT_BY_MTIME, FALSE, FALSE);
+    g_assert_cmpint (order, <, 0);
+    order = nautilus_file_compare_for_sort (file_1, file_2, NAUTILUS_FILE_SORT_BY_TYPE, FALSE, FALSE);
+    g_assert_cmpint (order, <, 0);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -107,6 +157,8 @@ main (int   argc,
                      test_file_sort_order);
     g_test_add_func ("/file-sort/with-self",
                      test_file_sort_with_self);
+    g_test_add_func ("/file-sort/keys-invalidation",
+                     test_file_sort_keys_invalidation);
 
     return g_test_run ();
 }
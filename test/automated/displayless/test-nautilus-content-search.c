@@ -0,0 +1,212 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include <nautilus-content-search.h>
+
+#include "test-utilities.h"
+
+/* Checks that text is found in files, and measures how fast files are read.
+ * The benchmark only runs in performance mode:
+ *
+ *   test-nautilus-content-search -m perf
+ */
+
+#define BENCHMARK_SIZE (256 * 1024 * 1024)
+
+static char *
+search_buffer (const char *buffer,
+               const char *query_text,
+               guint      *n_matches)
+{
+    g_autofree char *text = nautilus_content_search_prepare_text (query_text);
+
+    return nautilus_content_search_buffer (buffer, strlen (buffer), text, n_matches);
+}
+
+static void
+test_content_search_buffer (void)
+{
+    g_autofree char *snippet = NULL;
+    guint n_matches = 0;
+
+    snippet = search_buffer ("Nothing to see here", "report", &n_matches);
+    g_assert_null (snippet);
+
+    /* Case is ignored, and all the matches are counted. */
+    snippet = search_buffer ("Quarterly REPORT\nThe report is late.", "Report", &n_matches);
+    g_assert_cmpstr (snippet, ==, "Quarterly <b>REPORT</b>");
+    g_assert_cmpuint (n_matches, ==, 2);
+    g_clear_pointer (&snippet, g_free);
+
+    /* Snippets are escaped, and cut to the line of the match. */
+    snippet = search_buffer ("first line\n<a> & report\tdone\nlast line", " report ", NULL);
+    g_assert_cmpstr (snippet, ==, "&lt;a&gt; &amp; <b>report</b> done");
+    g_clear_pointer (&snippet, g_free);
+
+    snippet = search_buffer ("This line is long enough for the context to be cut on both "
+                             "sides of the word report, so that the snippet is not too "
+                             "long to show.", "report", NULL);
+    g_assert_cmpstr (snippet, ==, "…ext to be cut on both sides of the word "
+                                  "<b>report</b>, so that the snippet is not too long to…");
+    g_clear_pointer (&snippet, g_free);
+
+    /* Characters are not cut in half. */
+    snippet = search_buffer ("ééééééééééééééééééééééééé report ééééééééééééééééééééé", "report", NULL);
+    g_assert_true (g_utf8_validate (snippet, -1, NULL));
+    g_assert_nonnull (strstr (snippet, "<b>report</b>"));
+
+    g_assert_null (nautilus_content_search_prepare_text ("   "));
+}
+
+static GFile *
+create_file (const char *name,
+             const char *contents,
+             gssize      length)
+{
+    g_autofree char *path = g_build_filename (test_get_tmp_dir (), name, NULL);
+
+    g_assert_true (g_file_set_contents (path, contents, length, NULL));
+
+    return g_file_new_for_path (path);
+}
+
+static void
+test_content_search_file (void)
+{
+    g_autofree char *contents = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autofree char *snippet = NULL;
+    g_autofree char *text = nautilus_content_search_prepare_text ("needle");
+    gsize length = 1024 * 1024;
+    guint n_matches = 0;
+
+    /* A match across two reads is found. */
+    contents = g_malloc (length);
+    memset (contents, 'x', length);
+    for (gsize i = 80; i < length; i += 80)
+    {
+        contents[i] = '\n';
+    }
+    memcpy (contents + 64 * 1024 - 3, "NEEDLE", 6);
+    file = create_file ("text.txt", contents, length);
+
+    snippet = nautilus_content_search_file (file, text, NULL, &n_matches);
+    g_assert_nonnull (snippet);
+    g_assert_nonnull (strstr (snippet, "<b>NEEDLE</b>"));
+    g_assert_cmpuint (n_matches, ==, 1);
+    g_clear_pointer (&snippet, g_free);
+    g_file_delete (file, NULL, NULL);
+    g_clear_object (&file);
+
+    /* Binary files are given up on. */
+    contents[1000] = '\0';
+    file = create_file ("binary.txt", contents, length);
+    g_assert_null (nautilus_content_search_file (file, text, NULL, NULL));
+    g_file_delete (file, NULL, NULL);
+    g_clear_object (&file);
+
+    file = create_file ("empty.txt", "", 0);
+    g_assert_null (nautilus_content_search_file (file, text, NULL, NULL));
+    g_file_delete (file, NULL, NULL);
+}
+
+static void
+test_content_search_can_search (void)
+{
+    g_autoptr (GFile) text = create_file ("notes.txt", "some notes", -1);
+    g_autoptr (GFile) image = create_file ("picture.png", "not really", -1);
+    g_autoptr (GFile) empty = create_file ("empty.txt", "", 0);
+    g_autoptr (GFileInfo) info = NULL;
+
+    info = g_file_query_info (text, NAUTILUS_CONTENT_SEARCH_ATTRIBUTES, 0, NULL, NULL);
+    g_assert_true (nautilus_content_search_can_search (info));
+    g_clear_object (&info);
+
+    info = g_file_query_info (image, NAUTILUS_CONTENT_SEARCH_ATTRIBUTES, 0, NULL, NULL);
+    g_assert_false (nautilus_content_search_can_search (info));
+    g_clear_object (&info);
+
+    info = g_file_query_info (empty, NAUTILUS_CONTENT_SEARCH_ATTRIBUTES, 0, NULL, NULL);
+    g_assert_false (nautilus_content_search_can_search (info));
+
+    g_file_delete (text, NULL, NULL);
+    g_file_delete (image, NULL, NULL);
+    g_file_delete (empty, NULL, NULL);
+}
+
+static void
+benchmark_content_search (void)
+{
+    g_autofree char *contents = NULL;
+    g_autofree char *reference_contents = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autofree char *text = nautilus_content_search_prepare_text ("Needle");
+    g_autofree char *snippet = NULL;
+    gsize length;
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+    gboolean found;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    /* Prose-like text, with the match at the very end. */
+    contents = g_malloc (BENCHMARK_SIZE);
+    for (gsize i = 0; i < BENCHMARK_SIZE; i++)
+    {
+        contents[i] = (i % 64 == 63) ? '\n' : "etaoin shrdlu NEEDL "[i % 20];
+    }
+    memcpy (contents + BENCHMARK_SIZE - 7, "needle", 6);
+    file = create_file ("large.txt", contents, BENCHMARK_SIZE);
+    g_clear_pointer (&contents, g_free);
+
+    start = g_get_monotonic_time ();
+    snippet = nautilus_content_search_file (file, text, NULL, NULL);
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+    g_assert_nonnull (snippet);
+
+    /* Loading the whole file and folding its case, then searching it. */
+    start = g_get_monotonic_time ();
+    g_assert_true (g_file_load_contents (file, NULL, &contents, &length, NULL, NULL));
+    reference_contents = g_ascii_strdown (contents, length);
+    found = g_strstr_len (reference_contents, length, text) != NULL;
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+    g_assert_true (found);
+
+    g_file_delete (file, NULL, NULL);
+
+    g_test_message ("Loading and searching the whole file took %.3f s", reference_seconds);
+    g_test_maximized_result (BENCHMARK_SIZE / seconds / (1024 * 1024),
+                             "Searched %u MiB in %.3f s (%.0f MiB/s)",
+                             BENCHMARK_SIZE / (1024 * 1024), seconds,
+                             BENCHMARK_SIZE / seconds / (1024 * 1024));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int result;
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/content-search/buffer",
+                     test_content_search_buffer);
+    g_test_add_func ("/content-search/file",
+                     test_content_search_file);
+    g_test_add_func ("/content-search/can-search",
+                     test_content_search_can_search);
+    g_test_add_func ("/content-search/256M",
+                     benchmark_content_search);
+
+    result = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return result;
+}
@@ -0,0 +1,248 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <nautilus-delete-engine.h>
+
+#include "test-utilities.h"
+
+/* Checks that trees are deleted as with GIO, and measures how much faster
+ * it is. The benchmark only runs in performance mode:
+ *
+ *   test-nautilus-delete-engine -m perf
+ */
+
+#define BENCHMARK_N_DIRECTORIES 500
+#define BENCHMARK_N_FILES 100
+
+typedef struct
+{
+    GHashTable *seen;
+    guint n_deleted;
+    guint n_failed;
+} DeleteData;
+
+static char *
+get_path (const char *name)
+{
+    return g_build_filename (test_get_tmp_dir (), name, NULL);
+}
+
+static void
+create_tree (const char *path,
+             guint       depth,
+             guint       n_directories,
+             guint       n_files)
+{
+    g_assert_cmpint (g_mkdir_with_parents (path, 0755), ==, 0);
+
+    for (guint i = 0; i < n_files; i++)
+    {
+        g_autofree char *name = g_strdup_printf ("file-%u", i);
+        g_autofree char *file_path = g_build_filename (path, name, NULL);
+
+        g_assert_true (g_file_set_contents (file_path, name, -1, NULL));
+    }
+
+    for (guint i = 0; depth > 0 && i < n_directories; i++)
+    {
+        g_autofree char *name = g_strdup_printf ("directory-%u", i);
+        g_autofree char *directory_path = g_build_filename (path, name, NULL);
+
+        create_tree (directory_path, depth - 1, n_directories, n_files);
+    }
+}
+
+static void
+on_deleted (GFile    *file,
+            GError   *error,
+            gpointer  user_data)
+{
+    DeleteData *data = user_data;
+    g_autoptr (GFile) parent = g_file_get_parent (file);
+
+    /* Directories come after their contents. */
+    g_assert_false (g_hash_table_contains (data->seen, parent));
+    g_hash_table_add (data->seen, g_object_ref (file));
+
+    if (error == NULL)
+    {
+        data->n_deleted++;
+    }
+    else
+    {
+        data->n_failed++;
+    }
+}
+
+static void
+delete_data_init (DeleteData *data)
+{
+    data->seen = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                        g_object_unref, NULL);
+    data->n_deleted = 0;
+    data->n_failed = 0;
+}
+
+static void
+test_delete_engine_tree (void)
+{
+    g_autoptr (NautilusDeleteEngine) engine = nautilus_delete_engine_new ();
+    g_autofree char *root_path = get_path ("tree");
+    g_autofree char *outside_path = get_path ("outside");
+    g_autofree char *outside_file_path = get_path ("outside/file-0");
+    g_autofree char *link_path = get_path ("tree/link");
+    g_autofree char *empty_path = get_path ("tree/directory-0/empty");
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    DeleteData data;
+
+    /* 1 + 3 + 9 directories, with 10 files each. */
+    create_tree (root_path, 2, 3, 10);
+    create_tree (outside_path, 0, 0, 1);
+    g_assert_cmpint (symlink (outside_path, link_path), ==, 0);
+    g_assert_cmpint (g_mkdir (empty_path, 0755), ==, 0);
+
+    delete_data_init (&data);
+    g_assert_true (nautilus_delete_engine_delete (engine, root, NULL, on_deleted, &data));
+    g_assert_cmpuint (data.n_deleted, ==, 13 * 11 + 2);
+    g_assert_cmpuint (data.n_failed, ==, 0);
+    g_assert_false (g_file_test (root_path, G_FILE_TEST_EXISTS));
+
+    /* Links are deleted, not followed. */
+    g_assert_true (g_file_test (outside_file_path, G_FILE_TEST_EXISTS));
+    g_hash_table_unref (data.seen);
+
+    /* Files that aren't directories are deleted alone. */
+    delete_data_init (&data);
+    {
+        g_autoptr (GFile) outside_file = g_file_new_for_path (outside_file_path);
+
+        g_assert_true (nautilus_delete_engine_delete (engine, outside_file, NULL,
+                                                      on_deleted, &data));
+    }
+    g_assert_cmpuint (data.n_deleted, ==, 1);
+    g_hash_table_unref (data.seen);
+
+    g_rmdir (outside_path);
+}
+
+static void
+test_delete_engine_failure (void)
+{
+    g_autoptr (NautilusDeleteEngine) engine = nautilus_delete_engine_new ();
+    g_autofree char *root_path = get_path ("failure");
+    g_autofree char *locked_path = get_path ("failure/directory-0");
+    g_autofree char *unlocked_path = get_path ("failure/directory-1");
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    DeleteData data;
+
+    if (geteuid () == 0)
+    {
+        g_test_skip ("Permissions don't apply to root");
+        return;
+    }
+
+    create_tree (root_path, 1, 2, 2);
+    g_assert_cmpint (g_chmod (locked_path, 0555), ==, 0);
+
+    delete_data_init (&data);
+    g_assert_false (nautilus_delete_engine_delete (engine, root, NULL, on_deleted, &data));
+
+    /* The locked files, the locked directory and the root failed. */
+    g_assert_cmpuint (data.n_failed, ==, 4);
+    g_assert_cmpuint (data.n_deleted, ==, 5);
+    g_assert_false (g_file_test (unlocked_path, G_FILE_TEST_EXISTS));
+    g_assert_true (g_file_test (locked_path, G_FILE_TEST_EXISTS));
+    g_hash_table_unref (data.seen);
+
+    g_chmod (locked_path, 0755);
+    g_assert_true (nautilus_delete_engine_delete (engine, root, NULL, NULL, NULL));
+}
+
+/* What deleting used to do: try to delete each directory, and only list it
+ * when that fails because it isn't empty.
+ */
+static void
+delete_with_gio (GFile *file)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    g_autoptr (GError) error = NULL;
+    GFileInfo *info;
+
+    if (g_file_delete (file, NULL, &error))
+    {
+        return;
+    }
+
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_EMPTY);
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_assert_nonnull (enumerator);
+
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+    {
+        g_autoptr (GFile) child = g_file_enumerator_get_child (enumerator, info);
+
+        delete_with_gio (child);
+        g_object_unref (info);
+    }
+
+    g_assert_true (g_file_delete (file, NULL, NULL));
+}
+
+static void
+benchmark_delete_engine (void)
+{
+    g_autoptr (NautilusDeleteEngine) engine = nautilus_delete_engine_new ();
+    g_autofree char *root_path = get_path ("large");
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    guint n_files = BENCHMARK_N_DIRECTORIES * BENCHMARK_N_FILES;
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    create_tree (root_path, 1, BENCHMARK_N_DIRECTORIES, BENCHMARK_N_FILES);
+    start = g_get_monotonic_time ();
+    g_assert_true (nautilus_delete_engine_delete (engine, root, NULL, NULL, NULL));
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    create_tree (root_path, 1, BENCHMARK_N_DIRECTORIES, BENCHMARK_N_FILES);
+    start = g_get_monotonic_time ();
+    delete_with_gio (root);
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    g_test_message ("Deleting with GIO took %.3f s", reference_seconds);
+    g_test_maximized_result (n_files / seconds,
+                             "Deleted %u files in %.3f s (%.0f files/s)",
+                             n_files, seconds, n_files / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int result;
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/delete-engine/tree",
+                     test_delete_engine_tree);
+    g_test_add_func ("/delete-engine/failure",
+                     test_delete_engine_failure);
+    g_test_add_func ("/delete-engine/50k",
+                     benchmark_delete_engine);
+
+    result = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return result;
+}
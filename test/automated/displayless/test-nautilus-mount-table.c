@@ -0,0 +1,121 @@
+#include <gio/gio.h>
+
+#include <nautilus-mount-table.h>
+
+#include "test-utilities.h"
+
+/* Checks that the mount table agrees with the file system, and measures
+ * how much faster it answers. The benchmark only runs in performance mode:
+ *
+ *   test-nautilus-mount-table -m perf
+ */
+
+#define BENCHMARK_LOOKUPS 100000
+
+static guint32
+get_device (GFile *file)
+{
+    g_autoptr (GFileInfo) info = NULL;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_UNIX_DEVICE,
+                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_assert_nonnull (info);
+
+    return g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+}
+
+static NautilusMountLocality
+query_locality (GFile *file)
+{
+    g_autoptr (GFileInfo) info = NULL;
+
+    info = g_file_query_filesystem_info (file, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
+                                         NULL, NULL);
+    g_assert_nonnull (info);
+
+    return (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE) ?
+            NAUTILUS_MOUNT_LOCALITY_REMOTE : NAUTILUS_MOUNT_LOCALITY_LOCAL);
+}
+
+static void
+test_mount_table_locality (void)
+{
+    g_autoptr (GFile) directory = g_file_new_for_path (test_get_tmp_dir ());
+    NautilusMountLocality path_locality;
+    NautilusMountLocality device_locality;
+
+    path_locality = nautilus_mount_table_get_path_locality (test_get_tmp_dir ());
+    g_assert_cmpint (path_locality, !=, NAUTILUS_MOUNT_LOCALITY_UNKNOWN);
+    g_assert_cmpint (path_locality, ==, query_locality (directory));
+
+    /* Devices are only known from the Linux mount table, and not for
+     * nested btrfs subvolumes, which have devices of their own.
+     */
+    device_locality = nautilus_mount_table_get_device_locality (get_device (directory));
+    if (device_locality != NAUTILUS_MOUNT_LOCALITY_UNKNOWN)
+    {
+        g_assert_cmpint (device_locality, ==, path_locality);
+    }
+
+    /* Every absolute path is under the root mount. */
+    g_assert_cmpint (nautilus_mount_table_get_path_locality ("/no/such/path"), !=,
+                     NAUTILUS_MOUNT_LOCALITY_UNKNOWN);
+}
+
+static void
+benchmark_mount_table (void)
+{
+    g_autoptr (GFile) directory = g_file_new_for_path (test_get_tmp_dir ());
+    guint32 device = get_device (directory);
+    NautilusMountLocality expected = query_locality (directory);
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < BENCHMARK_LOOKUPS; i++)
+    {
+        g_assert_cmpint (nautilus_mount_table_get_device_locality (device), ==, expected);
+    }
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    /* What the search used to do for each directory. */
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < BENCHMARK_LOOKUPS; i++)
+    {
+        g_assert_cmpint (query_locality (directory), ==, expected);
+    }
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    g_test_message ("Querying the file system took %.3f s", reference_seconds);
+    g_test_maximized_result (BENCHMARK_LOOKUPS / seconds,
+                             "Looked up %u devices in %.3f s (%.0f lookups/s)",
+                             BENCHMARK_LOOKUPS, seconds, BENCHMARK_LOOKUPS / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int result;
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/mount-table/locality",
+                     test_mount_table_locality);
+    g_test_add_func ("/mount-table/100k",
+                     benchmark_mount_table);
+
+    result = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return result;
+}
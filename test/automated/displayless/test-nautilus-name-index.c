@@ -0,0 +1,502 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+
+#include <nautilus-name-index.h>
+
+#include "test-utilities.h"
+
+static const char *hierarchy[] =
+{
+    "alpha_report.txt",
+    "other.txt",
+    ".secret_report",
+    "sub/",
+    "sub/beta_report.txt",
+    "sub/deeper/",
+    "sub/deeper/gamma_REPORT.odt",
+    "sub/.hidden/",
+    "sub/.hidden/delta_report.txt",
+    NULL
+};
+
+static char *
+get_root_path (void)
+{
+    return g_build_filename (test_get_tmp_dir (), "root", NULL);
+}
+
+static char *
+get_index_filename (void)
+{
+    return g_build_filename (test_get_tmp_dir (), "name-index", NULL);
+}
+
+static void
+create_hierarchy (void)
+{
+    g_autofree char *root_path = get_root_path ();
+
+    g_mkdir_with_parents (root_path, 0700);
+    for (guint i = 0; hierarchy[i] != NULL; i++)
+    {
+        g_autofree char *path = g_build_filename (root_path, hierarchy[i], NULL);
+
+        if (g_str_has_suffix (hierarchy[i], "/"))
+        {
+            g_assert_cmpint (g_mkdir_with_parents (path, 0700), ==, 0);
+        }
+        else
+        {
+            g_assert_true (g_file_set_contents (path, "", 0, NULL));
+        }
+    }
+}
+
+static void
+delete_recursively (GFile *file)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    GFileInfo *info;
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    while (enumerator != NULL &&
+           (info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+    {
+        g_autoptr (GFile) child = g_file_get_child (file, g_file_info_get_name (info));
+
+        delete_recursively (child);
+        g_object_unref (info);
+    }
+
+    g_file_delete (file, NULL, NULL);
+}
+
+static void
+delete_hierarchy (void)
+{
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *filename = get_index_filename ();
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+
+    delete_recursively (root);
+    g_unlink (filename);
+}
+
+static NautilusNameIndex *
+create_index (void)
+{
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *filename = get_index_filename ();
+    const char *roots[] = { root_path, NULL };
+
+    return nautilus_name_index_new_for_roots (filename, roots);
+}
+
+static void
+add_hit (const char *path,
+         gdouble     rank,
+         gpointer    user_data)
+{
+    GPtrArray *paths = user_data;
+    g_autofree char *root_path = get_root_path ();
+
+    g_assert_cmpfloat (rank, >, 0);
+    g_assert_true (g_str_has_prefix (path, root_path));
+    g_ptr_array_add (paths, g_strdup (path + strlen (root_path) + 1));
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+    return g_strcmp0 (*(const char * const *) a, *(const char * const *) b);
+}
+
+/* Returns the paths found, relative to the root, sorted and separated by
+ * commas.
+ */
+static char *
+search (NautilusNameIndex *index,
+        const char        *directory,
+        const char        *text,
+        gboolean           recursive,
+        gboolean           show_hidden)
+{
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *path = g_build_filename (root_path, directory, NULL);
+    g_autoptr (GFile) location = g_file_new_for_path (path);
+    g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (text);
+    g_autoptr (GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
+
+    nautilus_name_index_search (index, location, matcher, recursive, show_hidden,
+                                NULL, add_hit, paths);
+
+    g_ptr_array_sort (paths, compare_strings);
+    g_ptr_array_add (paths, NULL);
+
+    return g_strjoinv (",", (char **) paths->pdata);
+}
+
+/* Like search(), for the files found on disk. */
+static char *
+search_changed (NautilusNameIndex *index,
+                const char        *text,
+                gboolean           show_hidden)
+{
+    g_autofree char *root_path = get_root_path ();
+    g_autoptr (GFile) location = g_file_new_for_path (root_path);
+    g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (text);
+    g_autoptr (GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
+
+    nautilus_name_index_search_changed (index, location, matcher, TRUE, show_hidden,
+                                        NULL, add_hit, paths);
+
+    g_ptr_array_sort (paths, compare_strings);
+    g_ptr_array_add (paths, NULL);
+
+    return g_strjoinv (",", (char **) paths->pdata);
+}
+
+/* Changes are picked up in a thread, so wait until they show. */
+static void
+wait_for_search (NautilusNameIndex *index,
+                 const char        *text,
+                 const char        *expected)
+{
+    gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+
+    while (g_get_monotonic_time () < deadline)
+    {
+        g_autofree char *result = search (index, "", text, TRUE, FALSE);
+
+        if (g_strcmp0 (result, expected) == 0)
+        {
+            return;
+        }
+
+        g_main_context_iteration (NULL, FALSE);
+        g_usleep (10000);
+    }
+
+    g_assert_not_reached ();
+}
+
+static void
+on_done (GObject      *source_object,
+         GAsyncResult *result,
+         gpointer      user_data)
+{
+    GAsyncResult **result_out = user_data;
+
+    *result_out = g_object_ref (result);
+}
+
+static void
+rebuild (NautilusNameIndex *index)
+{
+    g_autoptr (GAsyncResult) result = NULL;
+    g_autoptr (GError) error = NULL;
+
+    nautilus_name_index_rebuild_async (index, NULL, on_done, &result);
+    while (result == NULL)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    g_assert_true (nautilus_name_index_rebuild_finish (index, result, &error));
+    g_assert_no_error (error);
+}
+
+static void
+save (NautilusNameIndex *index)
+{
+    g_autoptr (GAsyncResult) result = NULL;
+    g_autoptr (GError) error = NULL;
+
+    nautilus_name_index_save_async (index, NULL, on_done, &result);
+    while (result == NULL)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    g_assert_true (nautilus_name_index_save_finish (index, result, &error));
+    g_assert_no_error (error);
+}
+
+static void
+test_name_index_search (void)
+{
+    g_autoptr (NautilusNameIndex) index = NULL;
+    g_autoptr (NautilusNameIndex) reloaded = NULL;
+    g_autofree char *root_path = get_root_path ();
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    g_autoptr (GFile) outside = g_file_new_for_path (test_get_tmp_dir ());
+    g_autofree char *result = NULL;
+
+    create_hierarchy ();
+
+    index = create_index ();
+    g_assert_false (nautilus_name_index_covers (index, root));
+
+    rebuild (index);
+    g_assert_true (nautilus_name_index_covers (index, root));
+    g_assert_false (nautilus_name_index_covers (index, outside));
+
+    result = search (index, "", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "alpha_report.txt,sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+    g_clear_pointer (&result, g_free);
+
+    result = search (index, "", "report", TRUE, TRUE);
+    g_assert_cmpstr (result, ==,
+                     ".secret_report,alpha_report.txt,sub/.hidden/delta_report.txt,"
+                     "sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+    g_clear_pointer (&result, g_free);
+
+    result = search (index, "", "report", FALSE, FALSE);
+    g_assert_cmpstr (result, ==, "alpha_report.txt");
+    g_clear_pointer (&result, g_free);
+
+    result = search (index, "sub", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+    g_clear_pointer (&result, g_free);
+
+    result = search (index, "", "no such name", TRUE, TRUE);
+    g_assert_cmpstr (result, ==, "");
+    g_clear_pointer (&result, g_free);
+
+    /* The index reads the same after loading it again. */
+    reloaded = create_index ();
+    result = search (reloaded, "", "report", TRUE, TRUE);
+    g_assert_cmpstr (result, ==,
+                     ".secret_report,alpha_report.txt,sub/.hidden/delta_report.txt,"
+                     "sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+
+    delete_hierarchy ();
+}
+
+static void
+test_name_index_changes (void)
+{
+    g_autoptr (NautilusNameIndex) index = NULL;
+    g_autoptr (NautilusNameIndex) reloaded = NULL;
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *new_path = g_build_filename (root_path, "new", NULL);
+    g_autofree char *new_file_path = g_build_filename (new_path, "epsilon_report.md", NULL);
+    g_autofree char *alpha_path = g_build_filename (root_path, "alpha_report.txt", NULL);
+    g_autofree char *moved_path = g_build_filename (root_path, "sub", "zeta_report.txt", NULL);
+    g_autofree char *deeper_path = g_build_filename (root_path, "sub", "deeper", NULL);
+    g_autoptr (GFile) new_directory = g_file_new_for_path (new_path);
+    g_autoptr (GFile) alpha = g_file_new_for_path (alpha_path);
+    g_autoptr (GFile) moved = g_file_new_for_path (moved_path);
+    g_autoptr (GFile) deeper = g_file_new_for_path (deeper_path);
+    g_autofree char *result = NULL;
+
+    create_hierarchy ();
+
+    index = create_index ();
+    rebuild (index);
+
+    /* A directory that appears with files inside is looked at as a whole. */
+    g_assert_cmpint (g_mkdir (new_path, 0700), ==, 0);
+    g_assert_true (g_file_set_contents (new_file_path, "", 0, NULL));
+    nautilus_name_index_file_added (index, new_directory);
+    wait_for_search (index, "report",
+                     "alpha_report.txt,new/epsilon_report.md,"
+                     "sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+
+    /* Removing a directory removes everything inside. */
+    delete_recursively (deeper);
+    nautilus_name_index_file_removed (index, deeper);
+    result = search (index, "", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "alpha_report.txt,new/epsilon_report.md,sub/beta_report.txt");
+    g_clear_pointer (&result, g_free);
+
+    g_assert_true (g_file_move (alpha, moved, G_FILE_COPY_NONE, NULL, NULL, NULL, NULL));
+    nautilus_name_index_file_moved (index, alpha, moved);
+    wait_for_search (index, "report",
+                     "new/epsilon_report.md,sub/beta_report.txt,sub/zeta_report.txt");
+
+    /* Merging the changes into the file gives the same results. */
+    save (index);
+    result = search (index, "", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "new/epsilon_report.md,sub/beta_report.txt,sub/zeta_report.txt");
+    g_clear_pointer (&result, g_free);
+
+    reloaded = create_index ();
+    result = search (reloaded, "", "report", TRUE, TRUE);
+    g_assert_cmpstr (result, ==,
+                     ".secret_report,new/epsilon_report.md,sub/.hidden/delta_report.txt,"
+                     "sub/beta_report.txt,sub/zeta_report.txt");
+
+    delete_hierarchy ();
+}
+
+typedef struct
+{
+    NautilusNameIndex *index;
+    guint n_hits;
+} RemoveData;
+
+static void
+remove_hit (const char *path,
+            gdouble     rank,
+            gpointer    user_data)
+{
+    RemoveData *data = user_data;
+    g_autoptr (GFile) file = g_file_new_for_path (path);
+
+    /* This takes the lock for writing, like changes on the main thread. */
+    nautilus_name_index_file_removed (data->index, file);
+    data->n_hits++;
+}
+
+/** Check that changes can be made while a search reports its hits */
+static void
+test_name_index_change_while_searching (void)
+{
+    g_autoptr (NautilusNameIndex) index = NULL;
+    g_autofree char *root_path = get_root_path ();
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new ("report");
+    g_autofree char *result = NULL;
+    RemoveData data = { 0 };
+
+    create_hierarchy ();
+
+    index = create_index ();
+    rebuild (index);
+
+    data.index = index;
+    nautilus_name_index_search (index, root, matcher, TRUE, FALSE, NULL, remove_hit, &data);
+    g_assert_cmpuint (data.n_hits, ==, 3);
+
+    result = search (index, "", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "");
+
+    delete_hierarchy ();
+}
+
+/* Makes the directories look older than an index built from now on. */
+static void
+backdate_directories (void)
+{
+    g_autofree char *root_path = get_root_path ();
+    struct utimbuf times;
+
+    times.actime = times.modtime = g_get_real_time () / G_USEC_PER_SEC - 60 * 60;
+    g_assert_cmpint (g_utime (root_path, &times), ==, 0);
+    for (guint i = 0; hierarchy[i] != NULL; i++)
+    {
+        g_autofree char *path = g_build_filename (root_path, hierarchy[i], NULL);
+
+        if (g_str_has_suffix (hierarchy[i], "/"))
+        {
+            g_assert_cmpint (g_utime (path, &times), ==, 0);
+        }
+    }
+}
+
+static void
+test_name_index_unnoticed (void)
+{
+    g_autoptr (NautilusNameIndex) index = NULL;
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *file_path = g_build_filename (root_path, "sub", "unnoticed_report.txt", NULL);
+    g_autofree char *new_path = g_build_filename (root_path, "sub", "new", NULL);
+    g_autofree char *new_file_path = g_build_filename (new_path, "eta_report.txt", NULL);
+    g_autofree char *new_hidden_path = g_build_filename (new_path, ".theta_report", NULL);
+    g_autofree char *result = NULL;
+
+    create_hierarchy ();
+    backdate_directories ();
+
+    index = create_index ();
+    rebuild (index);
+
+    /* Nothing tells the index about these. */
+    g_assert_true (g_file_set_contents (file_path, "", 0, NULL));
+    g_assert_cmpint (g_mkdir (new_path, 0700), ==, 0);
+    g_assert_true (g_file_set_contents (new_file_path, "", 0, NULL));
+    g_assert_true (g_file_set_contents (new_hidden_path, "", 0, NULL));
+
+    result = search (index, "", "report", TRUE, FALSE);
+    g_assert_cmpstr (result, ==, "alpha_report.txt,sub/beta_report.txt,sub/deeper/gamma_REPORT.odt");
+    g_clear_pointer (&result, g_free);
+
+    /* Only the directory that changed is looked at again. */
+    result = search_changed (index, "report", FALSE);
+    g_assert_cmpstr (result, ==, "sub/beta_report.txt,sub/new/eta_report.txt,sub/unnoticed_report.txt");
+    g_clear_pointer (&result, g_free);
+
+    result = search_changed (index, "report", TRUE);
+    g_assert_cmpstr (result, ==,
+                     "sub/beta_report.txt,sub/new/.theta_report,"
+                     "sub/new/eta_report.txt,sub/unnoticed_report.txt");
+
+    delete_hierarchy ();
+}
+
+static void
+test_name_index_corrupt (void)
+{
+    g_autoptr (NautilusNameIndex) index = NULL;
+    g_autofree char *root_path = get_root_path ();
+    g_autofree char *filename = get_index_filename ();
+    g_autoptr (GFile) root = g_file_new_for_path (root_path);
+    g_autofree char *contents = NULL;
+    gsize length;
+    g_autofree char *result = NULL;
+
+    create_hierarchy ();
+
+    index = create_index ();
+    rebuild (index);
+    g_clear_object (&index);
+
+    /* A truncated index must not be read past its end. */
+    g_assert_true (g_file_get_contents (filename, &contents, &length, NULL));
+    g_assert_true (g_file_set_contents (filename, contents, length / 2, NULL));
+    index = create_index ();
+    result = search (index, "", "report", TRUE, TRUE);
+    g_clear_pointer (&result, g_free);
+    g_clear_object (&index);
+
+    g_assert_true (g_file_set_contents (filename, "garbage", -1, NULL));
+    index = create_index ();
+    g_assert_false (nautilus_name_index_covers (index, root));
+    result = search (index, "", "report", TRUE, TRUE);
+    g_assert_cmpstr (result, ==, "");
+
+    delete_hierarchy ();
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    int result;
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/name-index/search",
+                     test_name_index_search);
+    g_test_add_func ("/name-index/changes",
+                     test_name_index_changes);
+    g_test_add_func ("/name-index/change-while-searching",
+                     test_name_index_change_while_searching);
+    g_test_add_func ("/name-index/unnoticed",
+                     test_name_index_unnoticed);
+    g_test_add_func ("/name-index/corrupt",
+                     test_name_index_corrupt);
+
+    result = g_test_run ();
+
+    test_clear_tmp_dir ();
+
+    return result;
+}
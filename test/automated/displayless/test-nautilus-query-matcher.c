@@ -0,0 +1,311 @@
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include <nautilus-query-matcher.h>
+
+/* Checks that matchers rank names like the original implementation did,
+ * and measures how fast they are. The benchmark only runs in performance
+ * mode:
+ *
+ *   test-nautilus-query-matcher -m perf
+ */
+
+#define BENCHMARK_NAMES 1000000
+#define N_THREADS 4
+
+/* How names used to be matched: normalizing and lower-casing both sides
+ * on every call.
+ */
+static gchar *
+reference_prepare (const gchar *string)
+{
+    g_autofree gchar *normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
+
+    return g_utf8_strdown (normalized, -1);
+}
+
+static gdouble
+reference_match (const char *text,
+                 const char *string)
+{
+    g_autofree gchar *prepared_text = reference_prepare (text);
+    g_autofree gchar *prepared_string = reference_prepare (string);
+    g_auto (GStrv) words = g_strsplit (prepared_text, " ", -1);
+    const char *ptr = NULL;
+    gint nonexact_malus = 0;
+
+    for (guint i = 0; words[i] != NULL; i++)
+    {
+        ptr = strstr (prepared_string, words[i]);
+        if (ptr == NULL)
+        {
+            return -1;
+        }
+
+        nonexact_malus += strlen (ptr) - strlen (words[i]);
+    }
+
+    return MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - (gdouble) nonexact_malus / 100);
+}
+
+static const char *texts[] =
+{
+    "report",
+    "REPORT",
+    "rep 2024",
+    "café",
+    "cafe",
+    "école",
+    "K",  /* Kelvin sign, lower-cases to an ASCII k */
+    "ß",
+    "a  b",
+    NULL
+};
+
+static const char *names[] =
+{
+    "report.txt",
+    "Annual Report 2024.pdf",
+    "2024-report-final.odt",
+    "Café menu.png",
+    "café menu.png",
+    "CAFE.JPG",
+    "École primaire",
+    "ecole",
+    "kelvin.dat",
+    "Straße.txt",
+    "a b",
+    "ab",
+    "",
+    NULL
+};
+
+static void
+test_query_matcher_equivalence (void)
+{
+    g_autofree gchar *long_name = NULL;
+
+    for (guint i = 0; texts[i] != NULL; i++)
+    {
+        g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (texts[i]);
+
+        for (guint j = 0; names[j] != NULL; j++)
+        {
+            g_assert_cmpfloat (nautilus_query_matcher_match (matcher, names[j]),
+                               ==,
+                               reference_match (texts[i], names[j]));
+        }
+    }
+
+    /* Names too long for the folding buffer on the stack. */
+    long_name = g_strnfill (1000, 'X');
+    long_name[500] = 'R';
+    for (guint i = 0; texts[i] != NULL; i++)
+    {
+        g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (texts[i]);
+
+        g_assert_cmpfloat (nautilus_query_matcher_match (matcher, long_name),
+                           ==,
+                           reference_match (texts[i], long_name));
+    }
+}
+
+/** Check that ASCII names are lower-cased like the locale does, in a Turkish locale */
+static void
+test_query_matcher_turkish (void)
+{
+    const char *turkish_texts[] = { "I", "ı", "i", "FILE", "fıle", NULL };
+    const char *turkish_names[] = { "FILE.txt", "file.txt", "fıle.txt", "İstanbul", NULL };
+    g_autofree gchar *previous_locale = g_strdup (setlocale (LC_CTYPE, NULL));
+
+    if (setlocale (LC_CTYPE, "tr_TR.UTF-8") == NULL)
+    {
+        g_test_skip ("The tr_TR.UTF-8 locale is not available");
+        return;
+    }
+
+    for (guint i = 0; turkish_texts[i] != NULL; i++)
+    {
+        g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (turkish_texts[i]);
+
+        for (guint j = 0; turkish_names[j] != NULL; j++)
+        {
+            g_assert_cmpfloat (nautilus_query_matcher_match (matcher, turkish_names[j]),
+                               ==,
+                               reference_match (turkish_texts[i], turkish_names[j]));
+        }
+    }
+
+    setlocale (LC_CTYPE, previous_locale);
+}
+
+/** Check that narrowing matchers only match names the previous one did */
+static void
+test_query_matcher_narrowing (void)
+{
+    const struct
+    {
+        const char *text;
+        const char *previous;
+        gboolean is_narrowing;
+    } cases[] =
+    {
+        { "rep", "re", TRUE },
+        { "report", "rep", TRUE },
+        { "Report", "rep", TRUE },
+        { "rep 2024", "rep", TRUE },
+        { "2024 rep", "rep", TRUE },
+        { "ab", "a b", TRUE },
+        { "café", "caf", TRUE },
+        { "rep", "rep", TRUE },
+        { "re", "rep", FALSE },
+        { "rep", "rep 2024", FALSE },
+        { "cafe", "café", FALSE },
+        { "pre", "rep", FALSE },
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+        g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new (cases[i].text);
+        g_autoptr (NautilusQueryMatcher) previous = nautilus_query_matcher_new (cases[i].previous);
+
+        g_assert_cmpint (nautilus_query_matcher_is_narrowing (matcher, previous),
+                         ==,
+                         cases[i].is_narrowing);
+
+        if (!cases[i].is_narrowing)
+        {
+            continue;
+        }
+
+        for (guint j = 0; names[j] != NULL; j++)
+        {
+            if (nautilus_query_matcher_match (matcher, names[j]) > -1)
+            {
+                g_assert_cmpfloat (nautilus_query_matcher_match (previous, names[j]), >, -1);
+            }
+        }
+    }
+}
+
+static gpointer
+match_thread_func (gpointer user_data)
+{
+    NautilusQueryMatcher *matcher = user_data;
+    guint n_matches = 0;
+
+    for (guint i = 0; i < 10000; i++)
+    {
+        for (guint j = 0; names[j] != NULL; j++)
+        {
+            if (nautilus_query_matcher_match (matcher, names[j]) > 0)
+            {
+                n_matches++;
+            }
+        }
+    }
+
+    return GUINT_TO_POINTER (n_matches);
+}
+
+/** Check that a matcher can be shared by threads */
+static void
+test_query_matcher_threads (void)
+{
+    g_autoptr (NautilusQueryMatcher) matcher = nautilus_query_matcher_new ("cafe");
+    GThread *threads[N_THREADS];
+
+    for (guint i = 0; i < N_THREADS; i++)
+    {
+        threads[i] = g_thread_new ("test-matcher",
+                                   match_thread_func,
+                                   nautilus_query_matcher_ref (matcher));
+    }
+
+    for (guint i = 0; i < N_THREADS; i++)
+    {
+        g_assert_cmpuint (GPOINTER_TO_UINT (g_thread_join (threads[i])), ==, 3 * 10000);
+        nautilus_query_matcher_unref (matcher);
+    }
+}
+
+static void
+benchmark_query_matcher (void)
+{
+    g_autoptr (GPtrArray) benchmark_names = NULL;
+    g_autoptr (NautilusQueryMatcher) matcher = NULL;
+    guint n_matches = 0;
+    guint n_reference_matches = 0;
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    /* Mostly ASCII names, like in most home directories, with some
+     * accented ones in between.
+     */
+    benchmark_names = g_ptr_array_new_full (BENCHMARK_NAMES, g_free);
+    for (guint i = 0; i < BENCHMARK_NAMES; i++)
+    {
+        g_ptr_array_add (benchmark_names,
+                         (i % 10 == 0) ?
+                         g_strdup_printf ("Résumé %07u.odt", i) :
+                         g_strdup_printf ("IMG_%07u_Holiday-Report.jpg", i));
+    }
+
+    matcher = nautilus_query_matcher_new ("report 12");
+
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < benchmark_names->len; i++)
+    {
+        if (nautilus_query_matcher_match (matcher, benchmark_names->pdata[i]) > 0)
+        {
+            n_matches++;
+        }
+    }
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < benchmark_names->len; i++)
+    {
+        if (reference_match ("report 12", benchmark_names->pdata[i]) > 0)
+        {
+            n_reference_matches++;
+        }
+    }
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    g_assert_cmpuint (n_matches, ==, n_reference_matches);
+
+    g_test_message ("Matching without a compiled matcher took %.3f s", reference_seconds);
+    g_test_maximized_result (BENCHMARK_NAMES / seconds,
+                             "Matched %u names in %.3f s (%.0f names/s)",
+                             BENCHMARK_NAMES, seconds, BENCHMARK_NAMES / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/query-matcher/equivalence",
+                     test_query_matcher_equivalence);
+    g_test_add_func ("/query-matcher/turkish",
+                     test_query_matcher_turkish);
+    g_test_add_func ("/query-matcher/narrowing",
+                     test_query_matcher_narrowing);
+    g_test_add_func ("/query-matcher/threads",
+                     test_query_matcher_threads);
+    g_test_add_func ("/query-matcher/1M",
+                     benchmark_query_matcher);
+
+    return g_test_run ();
+}
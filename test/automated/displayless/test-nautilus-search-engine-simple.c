@@ -1,6 +1,7 @@
 #include "test-utilities.h"
 
 static guint total_hits = 0;
+static GHashTable *seen_uris = NULL;
 
 static void
 hits_added_cb (NautilusSearchEngine *engine,
@@ -9,8 +10,13 @@ hits_added_cb (NautilusSearchEngine *engine,
     g_print ("Hits added for search engine simple!\n");
     for (gint hit_number = 0; hits != NULL; hits = hits->next, hit_number++)
     {
-        g_print ("Hit %i: %s\n", hit_number, nautilus_search_hit_get_uri (hits->data));
+        const char *uri = nautilus_search_hit_get_uri (hits->data);
+
+        g_print ("Hit %i: %s\n", hit_number, uri);
         total_hits += 1;
+
+        /* Workers share the directories to visit; none may be visited twice. */
+        g_assert_true (g_hash_table_add (seen_uris, g_strdup (uri)));
     }
 }
 
@@ -39,6 +45,7 @@ main (int   argc,
     g_autoptr (GFile) location = NULL;
 
     loop = g_main_loop_new (NULL, FALSE);
+    seen_uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
     nautilus_ensure_extension_points ();
     /* Needed for nautilus-query.c.
@@ -69,6 +76,7 @@ main (int   argc,
     g_main_loop_run (loop);
 
     g_assert_cmpint (total_hits, ==, 3);
+    g_clear_pointer (&seen_uris, g_hash_table_destroy);
 
     test_clear_tmp_dir ();
 
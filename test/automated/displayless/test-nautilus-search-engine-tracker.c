@@ -1,26 +1,28 @@
 #include "nautilus-tracker-utilities.h"
 #include "test-utilities.h"
 
-/* Time in seconds we allow for Tracker Miners to index the file */
+/* Time in seconds we allow for Tracker Miners to index the files */
 #define TRACKER_MINERS_AWAIT_TIMEOUT 1000
 
+/* More than the first page the Tracker engine reads. */
+#define N_PAGED_FILES 250
+
 static guint total_hits = 0;
 
 typedef struct
 {
     GMainLoop *main_loop;
-    gchar *uri;
-    gboolean created;
+    /* URIs of the files not indexed yet. */
+    GHashTable *uris;
 } TrackerAwaitFileData;
 
 static TrackerAwaitFileData *
-tracker_await_file_data_new (const char *uri,
-                             GMainLoop  *main_loop)
+tracker_await_file_data_new (GMainLoop *main_loop)
 {
     TrackerAwaitFileData *data;
 
     data = g_slice_new0 (TrackerAwaitFileData);
-    data->uri = g_strdup (uri);
+    data->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     data->main_loop = g_main_loop_ref (main_loop);
 
     return data;
@@ -29,7 +31,7 @@ tracker_await_file_data_new (const char *uri,
 static void
 tracker_await_file_data_free (TrackerAwaitFileData *data)
 {
-    g_free (data->uri);
+    g_hash_table_unref (data->uris);
     g_main_loop_unref (data->main_loop);
     g_slice_free (TrackerAwaitFileData, data);
 }
@@ -37,7 +39,8 @@ tracker_await_file_data_free (TrackerAwaitFileData *data)
 static gboolean timeout_cb (gpointer user_data)
 {
     TrackerAwaitFileData *data = user_data;
-    g_error ("Timeout waiting for %s to be indexed by Tracker.", data->uri);
+    g_error ("Timeout waiting for %u files to be indexed by Tracker.",
+             g_hash_table_size (data->uris));
     return G_SOURCE_REMOVE;
 }
 
@@ -58,9 +61,9 @@ tracker_events_cb (TrackerNotifier *self,
         {
             const gchar *urn = tracker_notifier_event_get_urn (event);
             g_debug ("Got CREATED event for %s", urn);
-            if (strcmp (urn, data->uri) == 0)
+            if (g_hash_table_remove (data->uris, urn) &&
+                g_hash_table_size (data->uris) == 0)
             {
-                data->created = TRUE;
                 g_main_loop_quit (data->main_loop);
             }
         }
@@ -72,29 +75,49 @@ static void
 create_test_data (TrackerSparqlConnection *connection,
                   const gchar             *indexed_tmpdir)
 {
-    g_autoptr (GFile) test_file = NULL;
+    g_autoptr (GFile) paged_dir = NULL;
+    g_autoptr (GPtrArray) test_files = g_ptr_array_new_with_free_func (g_object_unref);
     g_autoptr (GMainLoop) main_loop = NULL;
     g_autoptr (GError) error = NULL;
     g_autoptr (TrackerNotifier) notifier = NULL;
     TrackerAwaitFileData *await_data;
     gulong signal_id, timeout_id;
 
-    test_file = g_file_new_build_filename (indexed_tmpdir, "target_file.txt", NULL);
+    g_ptr_array_add (test_files, g_file_new_build_filename (indexed_tmpdir, "target_file.txt", NULL));
+
+    /* Enough matches for the results to be read in more than one page. */
+    paged_dir = g_file_new_build_filename (indexed_tmpdir, "paged", NULL);
+    g_file_make_directory (paged_dir, NULL, &error);
+    g_assert_no_error (error);
+    for (guint i = 0; i < N_PAGED_FILES; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf ("paged_file_%03u.txt", i);
+
+        g_ptr_array_add (test_files, g_file_get_child (paged_dir, name));
+    }
 
     main_loop = g_main_loop_new (NULL, 0);
-    await_data = tracker_await_file_data_new (g_file_get_uri (test_file), main_loop);
+    await_data = tracker_await_file_data_new (main_loop);
+    for (guint i = 0; i < test_files->len; i++)
+    {
+        g_hash_table_add (await_data->uris, g_file_get_uri (test_files->pdata[i]));
+    }
 
     notifier = tracker_sparql_connection_create_notifier (connection);
 
     signal_id = g_signal_connect (notifier, "events", G_CALLBACK (tracker_events_cb), await_data);
     timeout_id = g_timeout_add_seconds (TRACKER_MINERS_AWAIT_TIMEOUT, timeout_cb, await_data);
 
-    g_file_set_contents (g_file_peek_path (test_file), "Please show me in the search results", -1, &error);
-    g_assert_no_error (error);
+    for (guint i = 0; i < test_files->len; i++)
+    {
+        g_file_set_contents (g_file_peek_path (test_files->pdata[i]),
+                             "Please show me in the search results", -1, &error);
+        g_assert_no_error (error);
+    }
 
     g_main_loop_run (main_loop);
 
-    g_assert_true (await_data->created);
+    g_assert_cmpuint (g_hash_table_size (await_data->uris), ==, 0);
     g_source_remove (timeout_id);
     g_clear_signal_handler (&signal_id, notifier);
 
@@ -125,19 +148,49 @@ finished_cb (NautilusSearchEngine         *engine,
     g_main_loop_quit (user_data);
 }
 
+/* Returns the number of hits found by the Tracker engine for @text in @location. */
+static guint
+run_search (NautilusSearchEngine *engine,
+            const gchar          *text,
+            GFile                *location)
+{
+    g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+    g_autoptr (NautilusQuery) query = nautilus_query_new ();
+    gulong finished_id;
+
+    total_hits = 0;
+    finished_id = g_signal_connect (engine, "finished",
+                                    G_CALLBACK (finished_cb), loop);
+
+    nautilus_query_set_text (query, text);
+    nautilus_query_set_location (query, location);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine), query);
+
+    nautilus_search_engine_start_by_target (NAUTILUS_SEARCH_PROVIDER (engine),
+                                            NAUTILUS_SEARCH_ENGINE_TRACKER_ENGINE);
+
+    g_main_loop_run (loop);
+
+    g_clear_signal_handler (&finished_id, engine);
+
+    return total_hits;
+}
+
 int
 main (int   argc,
       char *argv[])
 {
-    g_autoptr (GMainLoop) loop = NULL;
     g_autoptr (TrackerSparqlConnection) connection = NULL;
     NautilusSearchEngine *engine;
     g_autoptr (NautilusDirectory) directory = NULL;
-    g_autoptr (NautilusQuery) query = NULL;
     g_autoptr (GFile) location = NULL;
+    g_autoptr (GFile) paged_location = NULL;
     g_autoptr (GError) error = NULL;
     const gchar *indexed_tmpdir;
 
+    /* The results limit is changed below. */
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
     nautilus_tracker_setup_host_miner_fs_connection_sync ();
 
     indexed_tmpdir = g_getenv ("TRACKER_INDEXED_TMPDIR");
@@ -151,8 +204,6 @@ main (int   argc,
 
     g_assert_no_error (error);
 
-    loop = g_main_loop_new (NULL, FALSE);
-
     nautilus_ensure_extension_points ();
     /* Needed for nautilus-query.c.
      * FIXME: tests are not installed, so the system does not
@@ -165,23 +216,24 @@ main (int   argc,
     engine = nautilus_search_engine_new ();
     g_signal_connect (engine, "hits-added",
                       G_CALLBACK (hits_added_cb), NULL);
-    g_signal_connect (engine, "finished",
-                      G_CALLBACK (finished_cb), loop);
-
-    query = nautilus_query_new ();
-    nautilus_query_set_text (query, "target");
-    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine), query);
 
     location = g_file_new_for_path (indexed_tmpdir);
     directory = nautilus_directory_get (location);
-    nautilus_query_set_location (query, location);
 
-    nautilus_search_engine_start_by_target (NAUTILUS_SEARCH_PROVIDER (engine),
-                                            NAUTILUS_SEARCH_ENGINE_TRACKER_ENGINE);
+    g_assert_cmpuint (run_search (engine, "target", location), ==, 1);
+    g_assert_false (nautilus_search_engine_get_truncated (engine));
 
-    g_main_loop_run (loop);
+    /* Results are read in pages until the limit, and the ones past it are
+     * left out. */
+    paged_location = g_file_get_child (location, "paged");
+    g_settings_set_uint (nautilus_preferences, NAUTILUS_PREFERENCES_SEARCH_RESULTS_LIMIT, 150);
+    g_assert_cmpuint (run_search (engine, "paged", paged_location), ==, 150);
+    g_assert_true (nautilus_search_engine_get_truncated (engine));
 
-    g_assert_cmpint (total_hits, ==, 1);
+    /* Finding exactly as many as the limit leaves nothing out. */
+    g_settings_set_uint (nautilus_preferences, NAUTILUS_PREFERENCES_SEARCH_RESULTS_LIMIT, N_PAGED_FILES);
+    g_assert_cmpuint (run_search (engine, "paged", paged_location), ==, N_PAGED_FILES);
+    g_assert_false (nautilus_search_engine_get_truncated (engine));
 
     return 0;
 }
@@ -0,0 +1,242 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include <nautilus-search-hit.h>
+
+/* Checks that hits are scored like the original implementation did, and
+ * measures how fast scoring is. The benchmark only runs in performance
+ * mode:
+ *
+ *   test-nautilus-search-hit -m perf
+ */
+
+#define BENCHMARK_HITS 1000000
+
+/* How hits used to be scored: walking up the parents of each hit until
+ * reaching the location, and getting the current time for each hit.
+ */
+static gdouble
+reference_relevance (const char *uri,
+                     GFile      *query_location,
+                     GDateTime  *mtime,
+                     gdouble     fts_rank)
+{
+    g_autoptr (GFile) hit_location = g_file_new_for_uri (uri);
+    guint dir_count = 0;
+    gdouble recent_bonus = 0.0;
+    gdouble proximity_bonus = 0.0;
+    gdouble match_bonus = 0.0;
+
+    if (query_location != NULL &&
+        g_file_has_prefix (hit_location, query_location))
+    {
+        GFile *parent, *location;
+
+        parent = g_file_get_parent (hit_location);
+
+        while (!g_file_equal (parent, query_location))
+        {
+            dir_count++;
+            location = parent;
+            parent = g_file_get_parent (location);
+            g_object_unref (location);
+        }
+        g_object_unref (parent);
+
+        if (dir_count < 10)
+        {
+            proximity_bonus = 10000.0 - 1000.0 * dir_count;
+        }
+    }
+
+    if (dir_count != 0)
+    {
+        g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+        GTimeSpan t_diff = G_MAXINT64;
+
+        if (mtime != NULL)
+        {
+            t_diff = g_date_time_difference (now, mtime);
+        }
+        t_diff /= G_TIME_SPAN_DAY;
+        recent_bonus = (t_diff > 90 ? 0.0 :
+                        t_diff > 30 ? 10.0 :
+                        t_diff > 14 ? 30.0 :
+                        t_diff > 7 ? 50.0 :
+                        t_diff > 1 ? 70.0 :
+                        100.0);
+    }
+
+    if (fts_rank > 0)
+    {
+        match_bonus = MIN (500, 10.0 * fts_rank);
+    }
+
+    return recent_bonus + proximity_bonus + match_bonus;
+}
+
+static NautilusSearchHit *
+create_hit (const char *uri,
+            GDateTime  *mtime,
+            gdouble     fts_rank)
+{
+    NautilusSearchHit *hit = nautilus_search_hit_new (uri);
+
+    nautilus_search_hit_set_modification_time (hit, mtime);
+    nautilus_search_hit_set_fts_rank (hit, fts_rank);
+
+    return hit;
+}
+
+static void
+test_search_hit_scores (void)
+{
+    const char *uris[] =
+    {
+        "file:///home/user/dir/a.txt",
+        "file:///home/user/dir/sub/b.txt",
+        "file:///home/user/dir/sub/",
+        "file:///home/user/dir/1/2/3/4/5/6/7/8/9/10/c.txt",
+        "file:///home/user/dirx/d.txt",
+        "file:///home/user/dir",
+        "file:///home/user/e.txt",
+        "file:///f.txt",
+        "trash:///g.txt",
+    };
+    const char *locations[] =
+    {
+        "file:///home/user/dir",
+        "file:///",
+        NULL,
+    };
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+    g_autoptr (GDateTime) last_month = g_date_time_add_days (now, -20);
+
+    for (guint i = 0; i < G_N_ELEMENTS (locations); i++)
+    {
+        g_autoptr (GFile) location = NULL;
+        g_autoptr (GPtrArray) hits = g_ptr_array_new_with_free_func (g_object_unref);
+
+        if (locations[i] != NULL)
+        {
+            location = g_file_new_for_uri (locations[i]);
+        }
+
+        for (guint j = 0; j < G_N_ELEMENTS (uris); j++)
+        {
+            g_ptr_array_add (hits, create_hit (uris[j], j % 2 ? now : last_month, j));
+        }
+
+        nautilus_search_hit_compute_scores_batch ((NautilusSearchHit **) hits->pdata,
+                                                  hits->len, location, now);
+
+        for (guint j = 0; j < G_N_ELEMENTS (uris); j++)
+        {
+            gdouble expected = reference_relevance (uris[j], location,
+                                                    j % 2 ? now : last_month, j);
+
+            g_test_message ("%s in %s", uris[j],
+                            locations[i] != NULL ? locations[i] : "no location");
+            g_assert_cmpfloat (nautilus_search_hit_get_relevance (hits->pdata[j]), ==, expected);
+        }
+    }
+}
+
+static void
+test_search_hit_merge (void)
+{
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+    g_autoptr (NautilusSearchHit) hit = create_hit ("file:///a.txt", NULL, 2);
+    g_autoptr (NautilusSearchHit) content_hit = create_hit ("file:///a.txt", now, 5);
+    g_autoptr (NautilusSearchHit) name_hit = create_hit ("file:///a.txt", NULL, 1);
+
+    nautilus_search_hit_set_fts_snippet (content_hit, "some <b>text</b>");
+
+    g_assert_true (nautilus_search_hit_merge (hit, content_hit));
+    g_assert_cmpstr (nautilus_search_hit_get_fts_snippet (hit), ==, "some <b>text</b>");
+
+    /* Nothing new to learn. */
+    g_assert_false (nautilus_search_hit_merge (hit, name_hit));
+    g_assert_false (nautilus_search_hit_merge (hit, content_hit));
+
+    /* The best rank is kept. */
+    nautilus_search_hit_compute_scores_batch (&hit, 1, NULL, now);
+    nautilus_search_hit_compute_scores_batch (&content_hit, 1, NULL, now);
+    g_assert_cmpfloat (nautilus_search_hit_get_relevance (hit), ==,
+                       nautilus_search_hit_get_relevance (content_hit));
+}
+
+static void
+benchmark_search_hit_scores (void)
+{
+    g_autoptr (GPtrArray) hits = NULL;
+    g_autoptr (GFile) location = g_file_new_for_uri ("file:///home/user/Documents");
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+    guint n_reference = BENCHMARK_HITS / 10;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    /* Hits spread over a few levels of directories, with various ages. */
+    hits = g_ptr_array_new_full (BENCHMARK_HITS, g_object_unref);
+    for (guint i = 0; i < BENCHMARK_HITS; i++)
+    {
+        g_autofree char *uri = NULL;
+        g_autoptr (GDateTime) mtime = g_date_time_add_days (now, -(gint) (i % 120));
+
+        uri = g_strdup_printf ("file:///home/user/Documents/%s%s%s/report-%07u.odt",
+                               (i % 3 == 0) ? "Projects/" : "",
+                               (i % 5 == 0) ? "2024/" : "",
+                               (i % 7 == 0) ? "Archive" : "Current",
+                               i);
+        g_ptr_array_add (hits, create_hit (uri, mtime, i % 50));
+    }
+
+    start = g_get_monotonic_time ();
+    nautilus_search_hit_compute_scores_batch ((NautilusSearchHit **) hits->pdata,
+                                              hits->len, location, now);
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    /* The old way is much slower, so only time a part of the hits. */
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < n_reference; i++)
+    {
+        NautilusSearchHit *hit = hits->pdata[i];
+        g_autoptr (GDateTime) mtime = g_date_time_add_days (now, -(gint) (i % 120));
+        gdouble expected;
+
+        expected = reference_relevance (nautilus_search_hit_get_uri (hit), location,
+                                        mtime, i % 50);
+        g_assert_cmpfloat (nautilus_search_hit_get_relevance (hit), ==, expected);
+    }
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    g_test_message ("Scoring hits one at a time took %.3f s for %u hits",
+                    reference_seconds, n_reference);
+    g_test_maximized_result (BENCHMARK_HITS / seconds,
+                             "Scored %u hits in %.3f s (%.0f hits/s)",
+                             BENCHMARK_HITS, seconds, BENCHMARK_HITS / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/search-hit/scores",
+                     test_search_hit_scores);
+    g_test_add_func ("/search-hit/merge",
+                     test_search_hit_merge);
+    g_test_add_func ("/search-hit/1M",
+                     benchmark_search_hit_scores);
+
+    return g_test_run ();
+}
@@ -0,0 +1,235 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include <nautilus-search-top-hits.h>
+
+/* Checks that only the most relevant hits are kept, and measures how fast
+ * hits go through. The benchmark only runs in performance mode:
+ *
+ *   test-nautilus-search-top-hits -m perf
+ */
+
+#define BENCHMARK_HITS 1000000
+#define BENCHMARK_MAX_HITS 200
+
+/* Without a location, the relevance only depends on the rank. */
+static void
+set_rank (NautilusSearchHit *hit,
+          gdouble            fts_rank)
+{
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+
+    nautilus_search_hit_set_fts_rank (hit, fts_rank);
+    nautilus_search_hit_compute_scores_batch (&hit, 1, NULL, now);
+}
+
+static NautilusSearchHit *
+create_hit (guint   number,
+            gdouble fts_rank)
+{
+    g_autofree char *uri = g_strdup_printf ("file:///%04u.txt", number);
+    NautilusSearchHit *hit = nautilus_search_hit_new (uri);
+
+    set_rank (hit, fts_rank);
+
+    return hit;
+}
+
+/* Returns the URIs of @hits, separated by commas. */
+static char *
+join_uris (GPtrArray *hits)
+{
+    g_autoptr (GString) uris = g_string_new (NULL);
+
+    for (guint i = 0; i < hits->len; i++)
+    {
+        const char *uri = nautilus_search_hit_get_uri (g_ptr_array_index (hits, i));
+
+        g_string_append_printf (uris, "%s%s", i > 0 ? "," : "", uri + strlen ("file:///"));
+    }
+
+    return g_string_free (g_steal_pointer (&uris), FALSE);
+}
+
+static char *
+get_sorted_uris (NautilusSearchTopHits *top_hits)
+{
+    g_autoptr (GPtrArray) sorted = nautilus_search_top_hits_get_sorted (top_hits);
+
+    return join_uris (sorted);
+}
+
+static void
+test_search_top_hits_keep_best (void)
+{
+    g_autoptr (NautilusSearchTopHits) top_hits = nautilus_search_top_hits_new (3);
+    g_autoptr (GPtrArray) evicted = g_ptr_array_new_with_free_func (g_object_unref);
+    g_autofree char *uris = NULL;
+    const gdouble ranks[] = { 2, 7, 1, 5, 9, 3, 5 };
+
+    for (guint i = 0; i < G_N_ELEMENTS (ranks); i++)
+    {
+        g_autoptr (NautilusSearchHit) hit = create_hit (i, ranks[i]);
+
+        nautilus_search_top_hits_add (top_hits, hit, evicted);
+        g_assert_cmpuint (nautilus_search_top_hits_get_length (top_hits), <=, 3);
+    }
+
+    /* Equal hits are kept by URI order, whatever order they come in. */
+    uris = get_sorted_uris (top_hits);
+    g_assert_cmpstr (uris, ==, "0004.txt,0001.txt,0003.txt");
+    g_clear_pointer (&uris, g_free);
+
+    /* Only hits that were kept at some point are evicted. */
+    uris = join_uris (evicted);
+    g_assert_cmpstr (uris, ==, "0002.txt,0000.txt");
+    g_clear_pointer (&uris, g_free);
+
+    g_assert_nonnull (nautilus_search_top_hits_lookup (top_hits, "file:///0001.txt"));
+    g_assert_null (nautilus_search_top_hits_lookup (top_hits, "file:///0000.txt"));
+}
+
+static void
+test_search_top_hits_same_uri (void)
+{
+    g_autoptr (NautilusSearchTopHits) top_hits = nautilus_search_top_hits_new (2);
+    g_autoptr (NautilusSearchHit) hit = create_hit (1, 2);
+    g_autoptr (NautilusSearchHit) better_hit = create_hit (1, 6);
+    g_autoptr (NautilusSearchHit) other_hit = create_hit (2, 4);
+    g_autoptr (GPtrArray) evicted = g_ptr_array_new_with_free_func (g_object_unref);
+
+    g_assert_true (nautilus_search_top_hits_add (top_hits, hit, evicted));
+    g_assert_true (nautilus_search_top_hits_add (top_hits, other_hit, evicted));
+
+    /* The same hit again is not kept twice. */
+    g_assert_true (nautilus_search_top_hits_add (top_hits, hit, evicted));
+    g_assert_cmpuint (nautilus_search_top_hits_get_length (top_hits), ==, 2);
+
+    g_assert_true (nautilus_search_top_hits_add (top_hits, better_hit, evicted));
+    g_assert_cmpuint (nautilus_search_top_hits_get_length (top_hits), ==, 2);
+    g_assert_true (nautilus_search_top_hits_lookup (top_hits, "file:///0001.txt") == better_hit);
+    g_assert_cmpuint (evicted->len, ==, 1);
+    g_assert_true (g_ptr_array_index (evicted, 0) == hit);
+
+    g_assert_false (nautilus_search_top_hits_add (top_hits, hit, NULL));
+    g_assert_true (nautilus_search_top_hits_lookup (top_hits, "file:///0001.txt") == better_hit);
+}
+
+static void
+test_search_top_hits_resize (void)
+{
+    g_autoptr (NautilusSearchTopHits) top_hits = nautilus_search_top_hits_new (4);
+    g_autoptr (GPtrArray) evicted = g_ptr_array_new_with_free_func (g_object_unref);
+    g_autofree char *uris = NULL;
+
+    for (guint i = 0; i < 4; i++)
+    {
+        g_autoptr (NautilusSearchHit) hit = create_hit (i, i);
+
+        nautilus_search_top_hits_add (top_hits, hit, NULL);
+    }
+
+    nautilus_search_top_hits_set_max_hits (top_hits, 2, evicted);
+    uris = get_sorted_uris (top_hits);
+    g_assert_cmpstr (uris, ==, "0003.txt,0002.txt");
+    g_clear_pointer (&uris, g_free);
+    uris = join_uris (evicted);
+    g_assert_cmpstr (uris, ==, "0000.txt,0001.txt");
+    g_clear_pointer (&uris, g_free);
+
+    /* The order is kept after the relevance of a hit changes. */
+    set_rank (nautilus_search_top_hits_lookup (top_hits, "file:///0002.txt"), 10);
+    nautilus_search_top_hits_reorder (top_hits);
+    uris = get_sorted_uris (top_hits);
+    g_assert_cmpstr (uris, ==, "0002.txt,0003.txt");
+    g_clear_pointer (&uris, g_free);
+
+    nautilus_search_top_hits_clear (top_hits);
+    g_assert_cmpuint (nautilus_search_top_hits_get_length (top_hits), ==, 0);
+    g_assert_null (nautilus_search_top_hits_lookup (top_hits, "file:///0002.txt"));
+}
+
+static gint
+compare_hits_descending (gconstpointer a,
+                         gconstpointer b)
+{
+    gdouble relevance_a = nautilus_search_hit_get_relevance (*(NautilusSearchHit **) a);
+    gdouble relevance_b = nautilus_search_hit_get_relevance (*(NautilusSearchHit **) b);
+
+    return (relevance_a < relevance_b) - (relevance_a > relevance_b);
+}
+
+static void
+benchmark_search_top_hits (void)
+{
+    g_autoptr (GPtrArray) hits = NULL;
+    g_autoptr (GPtrArray) all_hits = NULL;
+    g_autoptr (NautilusSearchTopHits) top_hits = NULL;
+    g_autoptr (GPtrArray) sorted = NULL;
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    hits = g_ptr_array_new_full (BENCHMARK_HITS, g_object_unref);
+    for (guint i = 0; i < BENCHMARK_HITS; i++)
+    {
+        g_ptr_array_add (hits, create_hit (i, g_test_rand_int_range (0, 50)));
+    }
+
+    start = g_get_monotonic_time ();
+    top_hits = nautilus_search_top_hits_new (BENCHMARK_MAX_HITS);
+    for (guint i = 0; i < hits->len; i++)
+    {
+        nautilus_search_top_hits_add (top_hits, g_ptr_array_index (hits, i), NULL);
+    }
+    sorted = nautilus_search_top_hits_get_sorted (top_hits);
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    /* What consumers used to do: keep all the hits and sort them. */
+    start = g_get_monotonic_time ();
+    all_hits = g_ptr_array_new_full (BENCHMARK_HITS, g_object_unref);
+    for (guint i = 0; i < hits->len; i++)
+    {
+        g_ptr_array_add (all_hits, g_object_ref (g_ptr_array_index (hits, i)));
+    }
+    g_ptr_array_sort (all_hits, compare_hits_descending);
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+    g_assert_cmpuint (sorted->len, ==, BENCHMARK_MAX_HITS);
+    for (guint i = 0; i < sorted->len; i++)
+    {
+        g_assert_cmpfloat (nautilus_search_hit_get_relevance (g_ptr_array_index (sorted, i)), ==,
+                           nautilus_search_hit_get_relevance (g_ptr_array_index (all_hits, i)));
+    }
+
+    g_test_message ("Sorting all the hits took %.3f s", reference_seconds);
+    g_test_maximized_result (BENCHMARK_HITS / seconds,
+                             "Kept the best %u of %u hits in %.3f s (%.0f hits/s)",
+                             BENCHMARK_MAX_HITS, BENCHMARK_HITS, seconds,
+                             BENCHMARK_HITS / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/search-top-hits/keep-best",
+                     test_search_top_hits_keep_best);
+    g_test_add_func ("/search-top-hits/same-uri",
+                     test_search_top_hits_same_uri);
+    g_test_add_func ("/search-top-hits/resize",
+                     test_search_top_hits_resize);
+    g_test_add_func ("/search-top-hits/1M",
+                     benchmark_search_top_hits);
+
+    return g_test_run ();
+}
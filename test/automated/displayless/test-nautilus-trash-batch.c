@@ -0,0 +1,241 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <nautilus-trash-batch.h>
+
+#include "test-utilities.h"
+
+/* Checks that files are trashed as g_file_trash() would, and measures how
+ * much faster it is. The benchmark only runs in performance mode:
+ *
+ *   test-nautilus-trash-batch -m perf
+ *
+ * The home directory is moved to a temporary one, so that the trash is too.
+ */
+
+#define BENCHMARK_N_FILES 5000
+
+static char *
+get_path (const char *name)
+{
+    return g_build_filename (test_get_tmp_dir (), name, NULL);
+}
+
+static GFile *
+create_file (const char *name)
+{
+    g_autofree char *path = get_path (name);
+    g_autofree char *parent_path = g_path_get_dirname (path);
+
+    g_assert_cmpint (g_mkdir_with_parents (parent_path, 0755), ==, 0);
+    g_assert_true (g_file_set_contents (path, name, -1, NULL));
+
+    return g_file_new_for_path (path);
+}
+
+static void
+remove_tree (GFile *file)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    GFileInfo *info;
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+    while (enumerator != NULL &&
+           (info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+    {
+        g_autoptr (GFile) child = g_file_enumerator_get_child (enumerator, info);
+
+        remove_tree (child);
+        g_object_unref (info);
+    }
+
+    g_file_delete (file, NULL, NULL);
+}
+
+static void
+empty_trash (void)
+{
+    g_autofree char *trash_path = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+    g_autoptr (GFile) trash = g_file_new_for_path (trash_path);
+
+    remove_tree (trash);
+}
+
+static void
+assert_trashed (GFile      *file,
+                const char *trash_name)
+{
+    g_autofree char *path = g_file_get_path (file);
+    g_autofree char *trashed_path = NULL;
+    g_autofree char *info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+    g_autofree char *info_path = NULL;
+    g_autofree char *escaped_path = NULL;
+    g_autofree char *original_path = NULL;
+    g_autofree char *deletion_date = NULL;
+    g_autoptr (GKeyFile) info = g_key_file_new ();
+    g_autoptr (GDateTime) date_time = NULL;
+    g_autoptr (GTimeZone) time_zone = g_time_zone_new_local ();
+
+    trashed_path = g_build_filename (g_get_user_data_dir (), "Trash", "files", trash_name, NULL);
+    info_path = g_build_filename (g_get_user_data_dir (), "Trash", "info", info_name, NULL);
+
+    g_assert_false (g_file_query_exists (file, NULL));
+    g_assert_true (g_file_test (trashed_path, G_FILE_TEST_EXISTS));
+
+    g_assert_true (g_key_file_load_from_file (info, info_path, G_KEY_FILE_NONE, NULL));
+    escaped_path = g_key_file_get_string (info, "Trash Info", "Path", NULL);
+    g_assert_nonnull (escaped_path);
+    original_path = g_uri_unescape_string (escaped_path, NULL);
+    g_assert_cmpstr (original_path, ==, path);
+
+    deletion_date = g_key_file_get_string (info, "Trash Info", "DeletionDate", NULL);
+    g_assert_nonnull (deletion_date);
+    date_time = g_date_time_new_from_iso8601 (deletion_date, time_zone);
+    g_assert_nonnull (date_time);
+    g_assert_cmpint (ABS (g_date_time_to_unix (date_time) - g_get_real_time () / G_USEC_PER_SEC),
+                     <=, 2);
+}
+
+static void
+test_trash_batch_files (void)
+{
+    g_autoptr (GPtrArray) files = g_ptr_array_new_with_free_func (g_object_unref);
+    g_autoptr (GPtrArray) errors = NULL;
+    g_autofree char *folder_path = get_path ("folder");
+    g_autofree char *other_path = get_path ("other");
+    gint64 deletion_times[4];
+
+    g_ptr_array_add (files, create_file ("same name"));
+    g_ptr_array_add (files, create_file ("other/same name"));
+    g_ptr_array_add (files, create_file ("folder/file"));
+    g_ptr_array_add (files, g_file_new_for_path (folder_path));
+
+    errors = nautilus_trash_batch_trash_files (NULL, files, deletion_times, NULL);
+    g_assert_cmpuint (errors->len, ==, files->len);
+    for (guint i = 0; i < errors->len; i++)
+    {
+        g_assert_null (g_ptr_array_index (errors, i));
+        g_assert_cmpint (ABS (deletion_times[i] - g_get_real_time () / G_USEC_PER_SEC), <=, 2);
+    }
+
+    /* Names already in the trash are made unique. */
+    assert_trashed (g_ptr_array_index (files, 0), "same name");
+    assert_trashed (g_ptr_array_index (files, 1), "same name.2");
+    assert_trashed (g_ptr_array_index (files, 2), "file");
+    assert_trashed (g_ptr_array_index (files, 3), "folder");
+
+    empty_trash ();
+    g_rmdir (other_path);
+}
+
+static void
+test_trash_batch_unsupported (void)
+{
+    g_autoptr (GPtrArray) files = g_ptr_array_new_with_free_func (g_object_unref);
+    g_autoptr (GPtrArray) errors = NULL;
+    g_autofree char *missing_path = get_path ("missing");
+    g_autofree char *trash_path = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+
+    g_ptr_array_add (files, g_file_new_for_path (missing_path));
+    g_ptr_array_add (files, g_file_new_for_path (trash_path));
+    g_ptr_array_add (files, g_file_new_for_uri ("resource:///org/gnome/nautilus"));
+
+    /* These are left for g_file_trash() to report. */
+    errors = nautilus_trash_batch_trash_files (NULL, files, NULL, NULL);
+    for (guint i = 0; i < errors->len; i++)
+    {
+        GError *error = g_ptr_array_index (errors, i);
+
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    }
+    g_assert_true (g_file_test (trash_path, G_FILE_TEST_IS_DIR));
+
+    empty_trash ();
+}
+
+static void
+benchmark_trash_batch (void)
+{
+    g_autoptr (GPtrArray) files = g_ptr_array_new_with_free_func (g_object_unref);
+    g_autoptr (GPtrArray) errors = NULL;
+    g_autofree char *large_path = get_path ("large");
+    gint64 start;
+    gdouble seconds;
+    gdouble reference_seconds;
+
+    if (!g_test_perf ())
+    {
+        g_test_skip ("Only run in performance mode");
+        return;
+    }
+
+    for (guint i = 0; i < BENCHMARK_N_FILES; i++)
+    {
+        g_autofree char *name = g_strdup_printf ("large/file-%u", i);
+
+        g_ptr_array_add (files, create_file (name));
+    }
+
+    start = g_get_monotonic_time ();
+    errors = nautilus_trash_batch_trash_files (NULL, files, NULL, NULL);
+    seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+    g_assert_null (g_ptr_array_index (errors, 0));
+    empty_trash ();
+
+    for (guint i = 0; i < BENCHMARK_N_FILES; i++)
+    {
+        g_autofree char *name = g_strdup_printf ("large/file-%u", i);
+
+        g_object_unref (create_file (name));
+    }
+
+    start = g_get_monotonic_time ();
+    for (guint i = 0; i < files->len; i++)
+    {
+        g_assert_true (g_file_trash (g_ptr_array_index (files, i), NULL, NULL));
+    }
+    reference_seconds = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+    empty_trash ();
+    g_rmdir (large_path);
+
+    g_test_message ("Trashing with GIO took %.3f s", reference_seconds);
+    g_test_maximized_result (BENCHMARK_N_FILES / seconds,
+                             "Trashed %u files in %.3f s (%.0f files/s)",
+                             BENCHMARK_N_FILES, seconds, BENCHMARK_N_FILES / seconds);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_autofree char *home_path = NULL;
+    g_autofree char *data_path = NULL;
+    g_autoptr (GFile) home = NULL;
+    int result;
+
+    /* Before GLib reads them. */
+    home_path = get_path ("home");
+    data_path = g_build_filename (home_path, ".local", "share", NULL);
+    g_assert_cmpint (g_mkdir_with_parents (data_path, 0755), ==, 0);
+    g_setenv ("HOME", home_path, TRUE);
+    g_setenv ("XDG_DATA_HOME", data_path, TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+    g_test_set_nonfatal_assertions ();
+
+    g_test_add_func ("/trash-batch/files",
+                     test_trash_batch_files);
+    g_test_add_func ("/trash-batch/unsupported",
+                     test_trash_batch_unsupported);
+    g_test_add_func ("/trash-batch/5k",
+                     benchmark_trash_batch);
+
+    result = g_test_run ();
+
+    home = g_file_new_for_path (home_path);
+    remove_tree (home);
+    test_clear_tmp_dir ();
+
+    return result;
+}
@@ -417,3 +417,57 @@ create_multiple_full_directories (gchar *prefix,
         g_file_make_directory (file, NULL, NULL);
     }
 }
+
+/* Time a held count waits for the job to start. */
+#define TEST_COUNT_HOLD_TIMEOUT (10 * G_USEC_PER_SEC)
+
+static void
+test_count_source (GFile    *source,
+                   gpointer  user_data)
+{
+    TestCountData *data = user_data;
+    gint64 end_time = g_get_monotonic_time () + TEST_COUNT_HOLD_TIMEOUT;
+
+    if (!g_file_equal (source, data->held_source))
+    {
+        return;
+    }
+
+    /* The job only waits a while for the count before starting anyway. */
+    while (g_file_query_exists (data->changed_file, NULL) != data->changed_file_exists &&
+           g_get_monotonic_time () < end_time)
+    {
+        g_usleep (10 * 1000);
+    }
+
+    data->started_while_counting = g_file_query_exists (data->changed_file, NULL) == data->changed_file_exists;
+}
+
+static void
+test_count_finished (int       total_files,
+                     goffset   total_bytes,
+                     int       transferred_files,
+                     goffset   transferred_bytes,
+                     gpointer  user_data)
+{
+    TestCountData *data = user_data;
+
+    data->finished = TRUE;
+    data->total_files = total_files;
+    data->total_bytes = total_bytes;
+    data->transferred_files = transferred_files;
+    data->transferred_bytes = transferred_bytes;
+}
+
+/* Pass NULL to stop following counts. */
+void
+test_follow_count (TestCountData *data)
+{
+    if (data == NULL)
+    {
+        nautilus_file_operations_set_count_hooks (NULL, NULL, NULL);
+        return;
+    }
+
+    nautilus_file_operations_set_count_hooks (test_count_source, test_count_finished, data);
+}
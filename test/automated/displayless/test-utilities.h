@@ -35,3 +35,24 @@ void create_first_hierarchy (gchar *prefix);
 void create_second_hierarchy (gchar *prefix);
 void create_third_hierarchy (gchar *prefix);
 void create_fourth_hierarchy (gchar *prefix);
+
+/* Follows the count of the sources of a file operation. The count is held
+ * before @held_source until @changed_file exists or is gone, as set by
+ * @changed_file_exists, so that the job has to start before its sources are
+ * counted.
+ */
+typedef struct
+{
+    GFile *held_source;
+    GFile *changed_file;
+    gboolean changed_file_exists;
+
+    gboolean started_while_counting;
+    gboolean finished;
+    int total_files;
+    goffset total_bytes;
+    int transferred_files;
+    goffset transferred_bytes;
+} TestCountData;
+
+void test_follow_count (TestCountData *data);